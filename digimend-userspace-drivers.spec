@@ -34,12 +34,17 @@ making various graphics tablets work on Linux.
 
 %install
 %make_install
+rm -f %{buildroot}%{_libdir}/*.la
 
 %files
 %{!?_licensedir:%global license %doc}
 %license COPYING
 %doc %{_defaultdocdir}/%{name}
 %{_bindir}/dud-translate
+%{_bindir}/dud-replay
+%{_bindir}/dud-flight
+%{_libdir}/libdud.so*
+%{_includedir}/dud
 
 %post
 /sbin/ldconfig
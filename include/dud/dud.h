@@ -0,0 +1,185 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * This file is part of digimend-userspace-drivers.
+ */
+
+/*
+ * libdud - graphics tablet report translation.
+ *
+ * Probes tablet USB devices, and translates their raw interrupt reports
+ * into frames of input events, as a Wacom-like pen device and a pad
+ * device would produce, delivered to a caller-supplied sink function.
+ * Lets in-process consumers, such as X.org input drivers, receive the
+ * events directly, without a round trip through uinput devices.
+ *
+ * All translation state belongs to translator objects, and distinct
+ * translators may be used from distinct threads concurrently. A single
+ * translator must not be used concurrently. The only global state is
+ * the error logging's: messages are written to stderr, rate-limited per
+ * call site across all translators, and thread-safe.
+ *
+ * Event types and codes are the ones defined in <linux/input.h>.
+ *
+ * The dud-translate daemon doesn't use this interface, but the internal
+ * one it's built on, deliberately, for the uinput and uhid outputs, the
+ * tablet parameters read over USB, and the mapping options, none of
+ * which in-process consumers need.
+ */
+
+#ifndef _DUD_DUD_H
+#define _DUD_DUD_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** A device a tablet is presented as */
+enum dud_device {
+    /** The pen, reporting absolute position, pressure, and tilt */
+    DUD_DEVICE_PEN,
+    /** The pad (frame), reporting buttons and the touch dial */
+    DUD_DEVICE_PAD,
+};
+
+/** An input event */
+struct dud_event {
+    /** Event type, one of the EV_<TYPE> macros */
+    uint16_t type;
+    /** Event code, one of the <TYPE>_<CODE> macros */
+    uint16_t code;
+    /** Event value */
+    int32_t value;
+};
+
+/**
+ * Event sink function prototype, receiving a frame of events of a device,
+ * to be applied atomically. The terminating SYN_REPORT is not included.
+ *
+ * @param data      The opaque data supplied with the function.
+ * @param device    The device the events belong to.
+ * @param events    The events of the frame.
+ * @param num       The number of events in the frame, non-zero.
+ */
+typedef void (*dud_event_fn)(void *data, enum dud_device device,
+                             const struct dud_event *events, size_t num);
+
+/** Ranges of the axes of a tablet's devices */
+struct dud_axes {
+    /** Maximum of the pen's ABS_X axis, the minimum is zero */
+    int32_t x_max;
+    /** Maximum of the pen's ABS_Y axis, the minimum is zero */
+    int32_t y_max;
+    /** Resolution of the pen's ABS_X and ABS_Y axes, units per mm */
+    int32_t resolution;
+    /** Maximum of the pen's ABS_PRESSURE axis, the minimum is zero */
+    int32_t pressure_max;
+    /** Maximum absolute value of the pen's ABS_TILT_X/Y axes, degrees */
+    int32_t tilt_max;
+    /** Maximum of the pad's ABS_WHEEL axis, the minimum is zero */
+    int32_t wheel_max;
+};
+
+/** A report translator of a single tablet (opaque) */
+struct dud_translator;
+
+/**
+ * Check if a USB device is a supported tablet.
+ *
+ * @param vendor    The device's vendor ID.
+ * @param product   The device's product ID.
+ *
+ * @return True if the device is supported.
+ */
+extern bool dud_probe(uint16_t vendor, uint16_t product);
+
+/**
+ * Create a translator for a tablet.
+ *
+ * The tablet's reports are decoded the way its model's are, according to
+ * the report descriptor of its interface 0, if it describes them, or a
+ * built-in descriptor, otherwise.
+ *
+ * @param vendor    The tablet's USB vendor ID.
+ * @param product   The tablet's USB product ID.
+ * @param desc      The report descriptor of the tablet's interface 0, or
+ *                  NULL if unknown.
+ * @param len       The length of the report descriptor.
+ * @param fn        The function to deliver event frames to.
+ * @param data      The opaque data to pass to the function.
+ *
+ * @return The created translator, or NULL on failure, with errno set
+ *         appropriately: ENODEV if the tablet is not supported.
+ */
+extern struct dud_translator *dud_translator_new(uint16_t vendor,
+                                                 uint16_t product,
+                                                 const uint8_t *desc,
+                                                 size_t len,
+                                                 dud_event_fn fn,
+                                                 void *data);
+
+/**
+ * Get the ranges of the axes of a translator's devices, as they depend
+ * on the tablet's model.
+ *
+ * @param translator    The translator to get the axes of.
+ * @param axes          Location for the axes' ranges.
+ */
+extern void dud_translator_get_axes(const struct dud_translator *translator,
+                                    struct dud_axes *axes);
+
+/**
+ * Enable or disable pen motion prediction of a translator.
+ *
+ * @param translator    The translator to configure.
+ * @param horizon_ns    The time to extrapolate the pen motion ahead,
+ *                      nanoseconds, up to 100ms, or zero to disable.
+ * @param pressure      True if pressure should be extrapolated as well.
+ *
+ * @return True if configured, false if the horizon is out of range.
+ */
+extern bool dud_translator_predict(struct dud_translator *translator,
+                                   uint64_t horizon_ns, bool pressure);
+
+/**
+ * Translate a raw tablet report into event frames, delivered to the
+ * translator's sink function before returning. Reports which don't
+ * change the devices' state produce no frames.
+ *
+ * @param translator    The translator to use.
+ * @param ts            The report arrival time, monotonic nanoseconds.
+ * @param buf           The report buffer.
+ * @param len           The length of the report.
+ *
+ * @return True if the report was recognized, false if it was rejected as
+ *         unknown or short.
+ */
+extern bool dud_translator_process(struct dud_translator *translator,
+                                   uint64_t ts,
+                                   const uint8_t *buf, size_t len);
+
+/**
+ * Bring the translator's devices to the neutral state: lift the pen and
+ * take it out of proximity, and release all pad buttons and the dial.
+ * Use when the tablet stops reporting, e.g. when it's unplugged.
+ *
+ * @param translator    The translator to use.
+ */
+extern void dud_translator_neutral(struct dud_translator *translator);
+
+/**
+ * Free a translator.
+ *
+ * @param translator    The translator to free, or NULL.
+ */
+extern void dud_translator_free(struct dud_translator *translator);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _DUD_DUD_H */
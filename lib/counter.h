@@ -0,0 +1,64 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * This file is part of digimend-userspace-drivers.
+ */
+
+/*
+ * Statistics counters.
+ *
+ * Each counter is updated by a single thread, the one owning the object
+ * it belongs to, and can be read by any thread at any time, without
+ * locking. As there's a single writer, an update is a relaxed load and
+ * store, rather than a locked read-modify-write, costing the same as a
+ * plain increment, and a reader sees either the old or the new value,
+ * never a torn one.
+ */
+
+#ifndef _COUNTER_H
+#define _COUNTER_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+/**
+ * Add to a counter, from its single writer thread.
+ *
+ * @param counter   The counter to add to.
+ * @param value     The value to add.
+ */
+static inline void
+counter_add(_Atomic uint64_t *counter, uint64_t value)
+{
+    atomic_store_explicit(
+        counter,
+        atomic_load_explicit(counter, memory_order_relaxed) + value,
+        memory_order_relaxed);
+}
+
+/**
+ * Increment a counter, from its single writer thread.
+ *
+ * @param counter   The counter to increment.
+ */
+static inline void
+counter_inc(_Atomic uint64_t *counter)
+{
+    counter_add(counter, 1);
+}
+
+/**
+ * Read a counter, from any thread.
+ *
+ * @param counter   The counter to read.
+ *
+ * @return The counter value.
+ */
+static inline uint64_t
+counter_get(const _Atomic uint64_t *counter)
+{
+    return atomic_load_explicit((_Atomic uint64_t *)counter,
+                                memory_order_relaxed);
+}
+
+#endif /* _COUNTER_H */
@@ -0,0 +1,312 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * This file is part of digimend-userspace-drivers.
+ */
+
+#include "config.h"
+#include "decoder.h"
+#include <assert.h>
+
+/** Report ID of Huion v2 proprietary reports */
+#define HUION_V2_ID             0x08
+
+/** Virtual report ID of Huion v2 frame button reports */
+#define HUION_V2_BUTTONS_ID     0xf7
+
+/** Virtual report ID of Huion v2 touch dial reports */
+#define HUION_V2_DIAL_ID        0xf8
+
+/**
+ * Report descriptor of Huion v2 proprietary reports, which the devices
+ * don't describe themselves. Frame button and touch dial reports share
+ * the pen report ID and are assigned virtual IDs instead.
+ */
+static const uint8_t huion_v2_desc[] = {
+    0x05, 0x0D,         /* Usage Page (Digitizer),              */
+    0x09, 0x02,         /* Usage (Pen),                         */
+    0xA1, 0x01,         /* Collection (Application),            */
+    0x85, 0x08,         /*  Report ID (8),                      */
+    0x09, 0x20,         /*  Usage (Stylus),                     */
+    0xA1, 0x00,         /*  Collection (Physical),              */
+    0x09, 0x42,         /*      Usage (Tip Switch),             */
+    0x09, 0x44,         /*      Usage (Barrel Switch),          */
+    0x09, 0x5A,         /*      Usage (Secondary Barrel Switch),*/
+    0x15, 0x00,         /*      Logical Minimum (0),            */
+    0x25, 0x01,         /*      Logical Maximum (1),            */
+    0x75, 0x01,         /*      Report Size (1),                */
+    0x95, 0x03,         /*      Report Count (3),               */
+    0x81, 0x02,         /*      Input (Variable),               */
+    0x95, 0x04,         /*      Report Count (4),               */
+    0x81, 0x03,         /*      Input (Constant, Variable),     */
+    0x09, 0x32,         /*      Usage (In Range),               */
+    0x95, 0x01,         /*      Report Count (1),               */
+    0x81, 0x02,         /*      Input (Variable),               */
+    0x05, 0x01,         /*      Usage Page (Desktop),           */
+    0x09, 0x30,         /*      Usage (X),                      */
+    0x09, 0x31,         /*      Usage (Y),                      */
+    0x27, 0xFF, 0xFF,
+          0x00, 0x00,   /*      Logical Maximum (65535),        */
+    0x75, 0x10,         /*      Report Size (16),               */
+    0x95, 0x02,         /*      Report Count (2),               */
+    0x81, 0x02,         /*      Input (Variable),               */
+    0x05, 0x0D,         /*      Usage Page (Digitizer),         */
+    0x09, 0x30,         /*      Usage (Tip Pressure),           */
+    0x26, 0xFF, 0x1F,   /*      Logical Maximum (8191),         */
+    0x95, 0x01,         /*      Report Count (1),               */
+    0x81, 0x02,         /*      Input (Variable),               */
+    0x05, 0x01,         /*      Usage Page (Desktop),           */
+    0x09, 0x30,         /*      Usage (X),                      */
+    0x09, 0x31,         /*      Usage (Y),                      */
+    0x26, 0xFF, 0x00,   /*      Logical Maximum (255),          */
+    0x75, 0x08,         /*      Report Size (8),                */
+    0x95, 0x02,         /*      Report Count (2),               */
+    0x81, 0x02,         /*      Input (Variable),               */
+    0x05, 0x0D,         /*      Usage Page (Digitizer),         */
+    0x09, 0x3D,         /*      Usage (X Tilt),                 */
+    0x09, 0x3E,         /*      Usage (Y Tilt),                 */
+    0x15, 0xC4,         /*      Logical Minimum (-60),          */
+    0x25, 0x3C,         /*      Logical Maximum (60),           */
+    0x81, 0x02,         /*      Input (Variable),               */
+    0xC0,               /*  End Collection,                     */
+    0xC0,               /* End Collection,                      */
+    0x05, 0x01,         /* Usage Page (Desktop),                */
+    0x09, 0x07,         /* Usage (Keypad),                      */
+    0xA1, 0x01,         /* Collection (Application),            */
+    0x85, 0xF7,         /*  Report ID (247),                    */
+    0x15, 0x00,         /*  Logical Minimum (0),                */
+    0x25, 0x01,         /*  Logical Maximum (1),                */
+    0x75, 0x08,         /*  Report Size (8),                    */
+    0x95, 0x03,         /*  Report Count (3),                   */
+    0x81, 0x03,         /*  Input (Constant, Variable),         */
+    0x05, 0x09,         /*  Usage Page (Button),                */
+    0x19, 0x01,         /*  Usage Minimum (01h),                */
+    0x29, 0x10,         /*  Usage Maximum (10h),                */
+    0x75, 0x01,         /*  Report Size (1),                    */
+    0x95, 0x10,         /*  Report Count (16),                  */
+    0x81, 0x02,         /*  Input (Variable),                   */
+    0xC0,               /* End Collection,                      */
+    0x05, 0x01,         /* Usage Page (Desktop),                */
+    0x09, 0x0E,         /* Usage (System Multi-Axis Controller),*/
+    0xA1, 0x01,         /* Collection (Application),            */
+    0x85, 0xF8,         /*  Report ID (248),                    */
+    0x75, 0x08,         /*  Report Size (8),                    */
+    0x95, 0x04,         /*  Report Count (4),                   */
+    0x81, 0x03,         /*  Input (Constant, Variable),         */
+    0x09, 0x37,         /*  Usage (Dial),                       */
+    0x15, 0x00,         /*  Logical Minimum (0),                */
+    0x26, 0xFF, 0x00,   /*  Logical Maximum (255),              */
+    0x95, 0x01,         /*  Report Count (1),                   */
+    0x81, 0x02,         /*  Input (Variable),                   */
+    0xC0                /* End Collection                       */
+};
+
+/** Fields of Huion v2 reports to negate to match evdev orientation */
+#define HUION_V2_NEGATE (1u << REPORT_FIELD_TILT_Y)
+
+static bool
+decoder_huion_v2_fixed_decode(const struct decoder *decoder,
+                              struct report *report,
+                              const uint8_t *buf, size_t len)
+{
+    int32_t *values = report->values;
+
+    (void)decoder;
+
+    if (len < 12) {
+        return false;
+    }
+    if (buf[0] != HUION_V2_ID) {
+        return false;
+    }
+    /* If it's a pen report */
+    if ((buf[1] & 0x70) == 0) {
+        report->kind = REPORT_KIND_PEN;
+        values[REPORT_FIELD_IN_RANGE] = (buf[1] & 0x80) != 0;
+        values[REPORT_FIELD_X] = (int32_t)buf[2] |
+                                 ((int32_t)buf[3] << 8) |
+                                 ((int32_t)buf[8] << 16);
+        values[REPORT_FIELD_Y] = (int32_t)buf[4] |
+                                 ((int32_t)buf[5] << 8) |
+                                 ((int32_t)buf[9] << 16);
+        values[REPORT_FIELD_PRESSURE] = (int32_t)buf[6] |
+                                        ((int32_t)buf[7] << 8);
+        values[REPORT_FIELD_TILT_X] = (int8_t)buf[10];
+        values[REPORT_FIELD_TILT_Y] = -(int8_t)buf[11];
+        values[REPORT_FIELD_PEN_BUTTONS] = buf[1] & 7;
+    /* Else, if it's a frame button report */
+    } else if (buf[1] == 0xe0) {
+        report->kind = REPORT_KIND_PAD_BUTTONS;
+        values[REPORT_FIELD_PAD_BUTTONS] = buf[4] | (buf[5] << 8);
+    /* Else, if it's a touch dial report */
+    } else if (buf[1] == 0xf0) {
+        report->kind = REPORT_KIND_PAD_DIAL;
+        values[REPORT_FIELD_DIAL] = buf[5];
+    } else {
+        return false;
+    }
+    return true;
+}
+
+void
+decoder_init_huion_v2_fixed(struct decoder *decoder)
+{
+    assert(decoder != NULL);
+    decoder->decode = decoder_huion_v2_fixed_decode;
+    decoder->builtin = true;
+    decoder->specialized = false;
+    hid_plan_init(&decoder->plan);
+}
+
+/**
+ * Compiled plans of the reports described by the built-in descriptor,
+ * written out, so the compiler specializes decoding them into
+ * straight-line code, with constant offsets, shifts, and masks. Only used
+ * if they're identical to the plans compiled at run time.
+ */
+static const struct hid_plan_report huion_v2_plan_pen = {
+    .id = HUION_V2_ID,
+    .kind = REPORT_KIND_PEN,
+    .min_len = 12,
+    .assign = {
+        /* Byte 1, bit 7 */
+        [REPORT_FIELD_IN_RANGE] = {1, 7, REPORT_FIELD_IN_RANGE, 0x1, 0},
+        /* Bytes 2-3, and byte 8 below */
+        [REPORT_FIELD_X] = {2, 0, REPORT_FIELD_X, 0xffff, 0},
+        /* Bytes 4-5, and byte 9 below */
+        [REPORT_FIELD_Y] = {4, 0, REPORT_FIELD_Y, 0xffff, 0},
+        /* Bytes 6-7 */
+        [REPORT_FIELD_PRESSURE] = {4, 16, REPORT_FIELD_PRESSURE, 0xffff, 0},
+        /* Byte 10, signed */
+        [REPORT_FIELD_TILT_X] = {4, 48, REPORT_FIELD_TILT_X, 0xff, 0x80},
+        /* Byte 11, signed, negated */
+        [REPORT_FIELD_TILT_Y] = {4, 56, REPORT_FIELD_TILT_Y, 0xff,
+                                 ~UINT32_C(0x80)},
+        /* Byte 1, bits 0-2 */
+        [REPORT_FIELD_PEN_BUTTONS] = {1, 0, REPORT_FIELD_PEN_BUTTONS, 0x7, 0},
+    },
+    .extra = {
+        /* Byte 8, bits 16-23 of X */
+        {4, 16, REPORT_FIELD_X, 0xff0000, 0},
+        /* Byte 9, bits 16-23 of Y */
+        {4, 24, REPORT_FIELD_Y, 0xff0000, 0},
+    },
+};
+
+/** See huion_v2_plan_pen */
+static const struct hid_plan_report huion_v2_plan_buttons = {
+    .id = HUION_V2_BUTTONS_ID,
+    .kind = REPORT_KIND_PAD_BUTTONS,
+    .min_len = 6,
+    .assign = {
+        /* Bytes 4-5 */
+        [REPORT_FIELD_PAD_BUTTONS] = {0, 32, REPORT_FIELD_PAD_BUTTONS,
+                                      0xffff, 0},
+    },
+};
+
+/** See huion_v2_plan_pen */
+static const struct hid_plan_report huion_v2_plan_dial = {
+    .id = HUION_V2_DIAL_ID,
+    .kind = REPORT_KIND_PAD_DIAL,
+    .min_len = 6,
+    .assign = {
+        /* Byte 5 */
+        [REPORT_FIELD_DIAL] = {0, 40, REPORT_FIELD_DIAL, 0xff, 0},
+    },
+};
+
+static bool
+decoder_huion_v2_decode(const struct decoder *decoder,
+                        struct report *report,
+                        const uint8_t *buf, size_t len)
+{
+    uint8_t id;
+
+    if (len < 2 || buf[0] != HUION_V2_ID) {
+        return false;
+    }
+    /* Assign the report its (virtual) ID */
+    if ((buf[1] & 0x70) == 0) {
+        id = HUION_V2_ID;
+    } else if (buf[1] == 0xe0) {
+        id = HUION_V2_BUTTONS_ID;
+    } else if (buf[1] == 0xf0) {
+        id = HUION_V2_DIAL_ID;
+    } else {
+        return false;
+    }
+    return hid_plan_decode(&decoder->plan, id, report, buf, len);
+}
+
+static bool
+decoder_huion_v2_specialized_decode(const struct decoder *decoder,
+                                    struct report *report,
+                                    const uint8_t *buf, size_t len)
+{
+    (void)decoder;
+
+    if (len < 2 || buf[0] != HUION_V2_ID) {
+        return false;
+    }
+    if ((buf[1] & 0x70) == 0) {
+        return hid_plan_report_decode(&huion_v2_plan_pen,
+                                      report, buf, len);
+    } else if (buf[1] == 0xe0) {
+        return hid_plan_report_decode(&huion_v2_plan_buttons,
+                                      report, buf, len);
+    } else if (buf[1] == 0xf0) {
+        return hid_plan_report_decode(&huion_v2_plan_dial,
+                                      report, buf, len);
+    }
+    return false;
+}
+
+bool
+decoder_init_huion_v2_generic(struct decoder *decoder,
+                              const uint8_t *desc, size_t len)
+{
+    assert(decoder != NULL);
+    assert(desc != NULL || len == 0);
+
+    decoder->decode = decoder_huion_v2_decode;
+    decoder->specialized = false;
+    hid_plan_init(&decoder->plan);
+
+    /* Use the interface's descriptor, if it describes proprietary reports */
+    decoder->builtin = false;
+    if (desc != NULL &&
+        hid_plan_compile(&decoder->plan, desc, len, HUION_V2_NEGATE) &&
+        hid_plan_has(&decoder->plan, HUION_V2_ID, REPORT_KIND_PEN) &&
+        hid_plan_has(&decoder->plan, HUION_V2_BUTTONS_ID,
+                     REPORT_KIND_PAD_BUTTONS) &&
+        hid_plan_has(&decoder->plan, HUION_V2_DIAL_ID,
+                     REPORT_KIND_PAD_DIAL)) {
+        return true;
+    }
+
+    /* Fall back to the built-in descriptor */
+    decoder->builtin = true;
+    hid_plan_init(&decoder->plan);
+    return hid_plan_compile(&decoder->plan,
+                            huion_v2_desc, sizeof(huion_v2_desc),
+                            HUION_V2_NEGATE);
+}
+
+bool
+decoder_init_huion_v2(struct decoder *decoder,
+                      const uint8_t *desc, size_t len)
+{
+    if (!decoder_init_huion_v2_generic(decoder, desc, len)) {
+        return false;
+    }
+
+    /* Decode with the specialized plans, if they're the compiled ones */
+    if (hid_plan_has_report(&decoder->plan, &huion_v2_plan_pen) &&
+        hid_plan_has_report(&decoder->plan, &huion_v2_plan_buttons) &&
+        hid_plan_has_report(&decoder->plan, &huion_v2_plan_dial)) {
+        decoder->decode = decoder_huion_v2_specialized_decode;
+        decoder->specialized = true;
+    }
+    return true;
+}
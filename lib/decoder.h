@@ -0,0 +1,120 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * This file is part of digimend-userspace-drivers.
+ */
+
+/*
+ * Tablet report decoders.
+ *
+ * Reports are decoded with plans compiled from HID report descriptors,
+ * running a fixed sequence of steps, without branches depending on the
+ * layout. Plans known at build time are also written out, so decoding
+ * with them is specialized into straight-line code, and used whenever
+ * they're identical to the compiled ones. Hand-written decoders are kept
+ * only as a reference for benchmarking the plans.
+ */
+
+#ifndef _DECODER_H
+#define _DECODER_H
+
+#include "hid.h"
+#include "probe.h"
+#include "report.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct decoder;
+
+/**
+ * Decoder function prototype.
+ *
+ * @param decoder   The decoder to use.
+ * @param report    Location for the decoded report.
+ * @param buf       The report buffer.
+ * @param len       The length of the report.
+ *
+ * @return True if the report was decoded, false if it was rejected as
+ *         unknown or short.
+ */
+typedef bool (*decoder_decode_fn)(const struct decoder *decoder,
+                                  struct report *report,
+                                  const uint8_t *buf, size_t len);
+
+/** A report decoder */
+struct decoder {
+    /** The decoding function */
+    decoder_decode_fn decode;
+    /** True if the plan was compiled from a built-in descriptor */
+    bool builtin;
+    /**
+     * True if decoding with a plan specialized at build time, as it's
+     * identical to the compiled plan.
+     */
+    bool specialized;
+    /** Compiled field extraction plan, for plan-driven decoders */
+    struct hid_plan plan;
+};
+
+/**
+ * Decode a report, firing the "report" probe with the report kind, or -1
+ * if rejected, and the length.
+ *
+ * @param decoder   The decoder to use.
+ * @param report    Location for the decoded report.
+ * @param buf       The report buffer.
+ * @param len       The length of the report.
+ *
+ * @return True if the report was decoded, false if it was rejected as
+ *         unknown or short.
+ */
+static inline bool
+decoder_decode(const struct decoder *decoder, struct report *report,
+               const uint8_t *buf, size_t len)
+{
+    bool decoded = decoder->decode(decoder, report, buf, len);
+    PROBE2(report, decoded ? (int)report->kind : -1, len);
+    return decoded;
+}
+
+/**
+ * Initialize the hand-written decoder of Huion v2 proprietary reports,
+ * the reference for benchmarking the plans.
+ *
+ * @param decoder   The decoder to initialize.
+ */
+extern void decoder_init_huion_v2_fixed(struct decoder *decoder);
+
+/**
+ * Initialize a plan-driven decoder of Huion v2 proprietary reports,
+ * compiling the interface's report descriptor, if it describes the
+ * proprietary reports, or the built-in descriptor otherwise, and
+ * decoding with the compiled plan, never a specialized one.
+ *
+ * @param decoder   The decoder to initialize.
+ * @param desc      The interface's report descriptor, or NULL if unknown.
+ * @param len       The length of the interface's report descriptor.
+ *
+ * @return True if initialized successfully, false otherwise.
+ */
+extern bool decoder_init_huion_v2_generic(struct decoder *decoder,
+                                          const uint8_t *desc, size_t len);
+
+/**
+ * Initialize a plan-driven decoder of Huion v2 proprietary reports,
+ * compiling the interface's report descriptor, if it describes the
+ * proprietary reports, or the built-in descriptor otherwise. Decode with
+ * the plan of the built-in descriptor specialized at build time, if
+ * that's the compiled plan.
+ *
+ * @param decoder   The decoder to initialize.
+ * @param desc      The interface's report descriptor, or NULL if unknown.
+ * @param len       The length of the interface's report descriptor.
+ *
+ * @return True if initialized successfully, false otherwise.
+ */
+extern bool decoder_init_huion_v2(struct decoder *decoder,
+                                  const uint8_t *desc, size_t len);
+
+#endif /* _DECODER_H */
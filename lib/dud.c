@@ -0,0 +1,202 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * This file is part of digimend-userspace-drivers.
+ */
+
+#include "config.h"
+#include <dud/dud.h>
+#include "decoder.h"
+#include "model.h"
+#include "sink.h"
+#include "translate.h"
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <linux/input.h>
+
+/** A sink converting written input events for an event sink function */
+struct dud_sink {
+    /** The abstract sink */
+    struct sink sink;
+    /** The device the sink receives the events of */
+    enum dud_device device;
+    /** The translator the sink belongs to */
+    struct dud_translator *translator;
+};
+
+struct dud_translator {
+    /** The tablet's model */
+    const struct model *model;
+    /** The report decoder */
+    struct decoder decoder;
+    /** The outputs, writing to the sinks below */
+    struct outputs outputs;
+    /** The pen output's sink */
+    struct dud_sink pen_sink;
+    /** The pad output's sink */
+    struct dud_sink pad_sink;
+    /** The function to deliver event frames to */
+    dud_event_fn fn;
+    /** The opaque data to pass to the function */
+    void *data;
+};
+
+bool
+dud_probe(uint16_t vendor, uint16_t product)
+{
+    return model_find(vendor, product) != NULL;
+}
+
+/**
+ * Convert input events written to a sink, a complete frame at once, and
+ * deliver them to the translator's event sink function.
+ */
+static ssize_t
+dud_sink_write(struct sink *sink, const void *buf, size_t len)
+{
+    struct dud_sink *dud_sink = (struct dud_sink *)sink;
+    struct dud_translator *translator = dud_sink->translator;
+    const struct input_event *ev = buf;
+    size_t num = len / sizeof(*ev);
+    struct dud_event events[FRAME_MAX_EVENTS];
+    size_t i;
+
+    assert(num <= FRAME_MAX_EVENTS);
+
+    /* Convert all events, but the SYN_REPORT */
+    for (i = 0; num > 0; ev++, num--) {
+        if (ev->type == EV_SYN && ev->code == SYN_REPORT) {
+            continue;
+        }
+        events[i].type = ev->type;
+        events[i].code = ev->code;
+        events[i].value = ev->value;
+        i++;
+    }
+    if (i > 0) {
+        translator->fn(translator->data, dud_sink->device, events, i);
+    }
+    return (ssize_t)(len - len % sizeof(*ev));
+}
+
+/**
+ * Initialize a sink delivering input events to a translator's event sink
+ * function.
+ *
+ * @param dud_sink      The sink to initialize.
+ * @param translator    The translator the sink belongs to.
+ * @param device        The device the sink receives the events of.
+ *
+ * @return The abstract sink.
+ */
+static struct sink *
+dud_sink_init(struct dud_sink *dud_sink, struct dud_translator *translator,
+              enum dud_device device)
+{
+    dud_sink->sink.write = dud_sink_write;
+    dud_sink->device = device;
+    dud_sink->translator = translator;
+    return &dud_sink->sink;
+}
+
+struct dud_translator *
+dud_translator_new(uint16_t vendor, uint16_t product,
+                   const uint8_t *desc, size_t len,
+                   dud_event_fn fn, void *data)
+{
+    struct dud_translator *result = NULL;
+    struct dud_translator *translator = NULL;
+    const struct model *model;
+
+    if (fn == NULL) {
+        errno = EINVAL;
+        goto cleanup;
+    }
+    model = model_find(vendor, product);
+    if (model == NULL) {
+        errno = ENODEV;
+        goto cleanup;
+    }
+
+    translator = calloc(1, sizeof(*translator));
+    if (translator == NULL) {
+        goto cleanup;
+    }
+    if (!model->decoder_init(&translator->decoder, desc, len)) {
+        errno = EINVAL;
+        goto cleanup;
+    }
+    translator->model = model;
+    translator->fn = fn;
+    translator->data = data;
+    translator->outputs.backend = OUTPUT_BACKEND_UINPUT;
+    translator->outputs.pen.sink = dud_sink_init(&translator->pen_sink,
+                                                 translator, DUD_DEVICE_PEN);
+    translator->outputs.pad.sink = dud_sink_init(&translator->pad_sink,
+                                                 translator, DUD_DEVICE_PAD);
+
+    result = translator;
+    translator = NULL;
+cleanup:
+    free(translator);
+    return result;
+}
+
+void
+dud_translator_get_axes(const struct dud_translator *translator,
+                        struct dud_axes *axes)
+{
+    assert(translator != NULL);
+    assert(axes != NULL);
+
+    axes->x_max = translator->model->axes.x_max;
+    axes->y_max = translator->model->axes.y_max;
+    axes->resolution = translator->model->axes.resolution;
+    axes->pressure_max = translator->model->axes.pressure_max;
+    axes->tilt_max = MODEL_TILT_MAX;
+    axes->wheel_max = MODEL_WHEEL_MAX;
+}
+
+bool
+dud_translator_predict(struct dud_translator *translator,
+                       uint64_t horizon_ns, bool pressure)
+{
+    assert(translator != NULL);
+
+    if (horizon_ns > PREDICT_MAX_HORIZON_NS) {
+        return false;
+    }
+    predictor_init(&translator->outputs.predictor,
+                   &translator->model->axes, horizon_ns, pressure);
+    return true;
+}
+
+bool
+dud_translator_process(struct dud_translator *translator, uint64_t ts,
+                       const uint8_t *buf, size_t len)
+{
+    struct report report;
+
+    assert(translator != NULL);
+    assert(buf != NULL || len == 0);
+
+    if (!decoder_decode(&translator->decoder, &report, buf, len)) {
+        return false;
+    }
+    translate_report(&translator->outputs, ts, &report);
+    return true;
+}
+
+void
+dud_translator_neutral(struct dud_translator *translator)
+{
+    assert(translator != NULL);
+    translate_neutral(&translator->outputs);
+}
+
+void
+dud_translator_free(struct dud_translator *translator)
+{
+    free(translator);
+}
@@ -0,0 +1,299 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * This file is part of digimend-userspace-drivers.
+ */
+
+#include "config.h"
+#include "frame.h"
+#include "misc.h"
+#include "probe.h"
+#include <stdbool.h>
+
+/**
+ * Write the rest of a frame to a sink, with as few writes as possible.
+ *
+ * @param frame The frame to write.
+ * @param poff  Location of the number of bytes of the frame already
+ *              written, updated with the progress.
+ * @param sink  The sink to write the frame to.
+ * @param stats The statistics to update.
+ *
+ * @return Zero if the frame was written completely, -1 otherwise, with
+ *         errno set appropriately. EAGAIN means the sink is congested.
+ */
+static int
+frame_write(const struct frame *frame, size_t *poff,
+            struct sink *sink, struct frame_stats *stats)
+{
+    const uint8_t *ptr;
+    size_t left;
+    ssize_t rc;
+
+    ptr = (const uint8_t *)frame->events + *poff;
+    left = frame->num * sizeof(*frame->events) - *poff;
+    while (left > 0) {
+        rc = sink_write(sink, ptr, left);
+        counter_inc(&stats->writes);
+        if (rc < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN) {
+                counter_inc(&stats->again);
+                return -1;
+            }
+            counter_inc(&stats->errors);
+            LIBC_FAILURE(errno, "write %zu events",
+                         left / sizeof(*frame->events));
+            return -1;
+        }
+        /* uinput accepts whole events only, so zero means no progress */
+        if (rc == 0) {
+            counter_inc(&stats->errors);
+            GENERIC_FAILURE("write %zu events: no progress",
+                            left / sizeof(*frame->events));
+            errno = EIO;
+            return -1;
+        }
+        if ((size_t)rc < left) {
+            counter_inc(&stats->short_writes);
+        }
+        counter_add(&stats->events, (size_t)rc / sizeof(*frame->events));
+        ptr += rc;
+        left -= (size_t)rc;
+        *poff += (size_t)rc;
+    }
+    return 0;
+}
+
+/**
+ * Check if a terminated frame only changes absolute axes which can be
+ * skipped, i.e. any but ABS_MISC, which signals pad tool presence.
+ *
+ * @param frame The frame to check.
+ *
+ * @return True if the frame only has motion, false otherwise.
+ */
+static bool
+frame_is_motion(const struct frame *frame)
+{
+    size_t i;
+
+    for (i = 0; i + 1 < frame->num; i++) {
+        if (frame->events[i].type != EV_ABS ||
+            frame->events[i].code == ABS_MISC) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Merge a terminated motion frame into another, so the latter ends up
+ * with the newest value of every axis changed by either.
+ *
+ * @param dst   The frame to merge into.
+ * @param src   The frame to merge.
+ *
+ * @return True if merged, false if the result wouldn't fit into a frame,
+ *         and nothing was changed.
+ */
+static bool
+frame_merge(struct frame *dst, const struct frame *src)
+{
+    size_t i;
+    size_t j;
+    size_t added = 0;
+
+    /* Count the axes to add */
+    for (i = 0; i + 1 < src->num; i++) {
+        for (j = 0; j + 1 < dst->num &&
+                    dst->events[j].code != src->events[i].code; j++);
+        added += j + 1 == dst->num;
+    }
+    if (dst->num + added > FRAME_MAX_EVENTS) {
+        return false;
+    }
+
+    /* Update, or insert before SYN_REPORT */
+    for (i = 0; i + 1 < src->num; i++) {
+        for (j = 0; j + 1 < dst->num &&
+                    dst->events[j].code != src->events[i].code; j++);
+        if (j + 1 == dst->num) {
+            dst->events[dst->num] = dst->events[j];
+            dst->num++;
+        }
+        dst->events[j] = src->events[i];
+    }
+    return true;
+}
+
+/**
+ * Drop all frames queued on a sink.
+ *
+ * @param queue The queue to empty.
+ * @param stats The statistics to update.
+ */
+static void
+frame_queue_drop(struct frame_queue *queue, struct frame_stats *stats)
+{
+    for (; queue->num > 0; queue->num--) {
+        counter_add(&stats->dropped,
+                    queue->frames[queue->head].num -
+                    queue->off / sizeof(struct input_event));
+        counter_inc(&stats->dropped_frames);
+        queue->head = (queue->head + 1) % FRAME_QUEUE_LEN;
+        queue->off = 0;
+        queue->dropped = true;
+    }
+}
+
+int
+frame_flush(struct frame *frame, struct frame_queue *queue,
+            struct sink *sink, struct frame_stats *stats)
+{
+    size_t off = 0;
+    struct frame *tail;
+    int result = 0;
+
+    assert(frame != NULL);
+    assert(queue != NULL);
+    assert(sink != NULL);
+    assert(stats != NULL);
+
+    /* Terminate the frame */
+    frame_add(frame, EV_SYN, SYN_REPORT, 1);
+    counter_inc(&stats->frames);
+    PROBE2(flush, frame->num, queue->num);
+
+    if (queue->num == 0) {
+        /* Write directly, and queue the remainder, if congested */
+        if (frame_write(frame, &off, sink, stats) == 0) {
+            goto cleanup;
+        }
+        if (errno != EAGAIN) {
+            counter_add(&stats->dropped,
+                        frame->num - off / sizeof(*frame->events));
+            counter_inc(&stats->dropped_frames);
+            queue->dropped = true;
+            result = -1;
+            goto cleanup;
+        }
+        queue->off = off;
+    } else {
+        /* Merge motion into the newest frame, unless it's being written */
+        tail = &queue->frames[(queue->head + queue->num - 1) %
+                              FRAME_QUEUE_LEN];
+        if ((queue->num > 1 || queue->off == 0) &&
+            frame_is_motion(tail) && frame_is_motion(frame) &&
+            frame_merge(tail, frame)) {
+            counter_inc(&stats->coalesced);
+            goto cleanup;
+        }
+        if (queue->num >= FRAME_QUEUE_LEN) {
+            counter_add(&stats->dropped, frame->num);
+            counter_inc(&stats->dropped_frames);
+            queue->dropped = true;
+            errno = ENOBUFS;
+            result = -1;
+            goto cleanup;
+        }
+    }
+
+    /* Queue the frame */
+    tail = &queue->frames[(queue->head + queue->num) % FRAME_QUEUE_LEN];
+    memcpy(tail->events, frame->events,
+           frame->num * sizeof(*frame->events));
+    tail->num = frame->num;
+    queue->num++;
+    counter_inc(&stats->queued);
+
+cleanup:
+    frame->num = 0;
+    return result;
+}
+
+int
+frame_queue_drain(struct frame_queue *queue, struct sink *sink,
+                  struct frame_stats *stats)
+{
+    int orig_errno;
+
+    assert(queue != NULL);
+    assert(sink != NULL);
+    assert(stats != NULL);
+
+    while (queue->num > 0) {
+        if (frame_write(&queue->frames[queue->head], &queue->off,
+                        sink, stats) < 0) {
+            if (errno != EAGAIN) {
+                orig_errno = errno;
+                frame_queue_drop(queue, stats);
+                errno = orig_errno;
+            }
+            return -1;
+        }
+        queue->head = (queue->head + 1) % FRAME_QUEUE_LEN;
+        queue->num--;
+        queue->off = 0;
+    }
+    return 0;
+}
+
+void
+frame_stats_print(const char *name, const struct frame_stats *stats)
+{
+    uint64_t frames, events, writes, dropped;
+
+    assert(name != NULL);
+    assert(stats != NULL);
+
+    frames = counter_get(&stats->frames);
+    events = counter_get(&stats->events);
+    writes = counter_get(&stats->writes);
+    dropped = counter_get(&stats->dropped);
+    fprintf(stderr,
+            "%s: %llu frames, %llu events, %llu writes "
+            "(%llu short, %llu EAGAIN, %llu failed), %llu events dropped, "
+            "%.2f syscalls saved per frame, %llu frames queued "
+            "(%llu coalesced, %llu dropped)\n",
+            name,
+            (unsigned long long)frames,
+            (unsigned long long)events,
+            (unsigned long long)writes,
+            (unsigned long long)counter_get(&stats->short_writes),
+            (unsigned long long)counter_get(&stats->again),
+            (unsigned long long)counter_get(&stats->errors),
+            (unsigned long long)dropped,
+            frames == 0 ? 0.0 :
+                ((double)(events + dropped) - (double)writes) /
+                (double)frames,
+            (unsigned long long)counter_get(&stats->queued),
+            (unsigned long long)counter_get(&stats->coalesced),
+            (unsigned long long)counter_get(&stats->dropped_frames));
+}
+
+void
+frame_stats_dump(FILE *stream, const char *prefix,
+                 const struct frame_stats *stats)
+{
+    assert(stream != NULL);
+    assert(prefix != NULL);
+    assert(stats != NULL);
+
+#define DUMP(_field) \
+    fprintf(stream, "%s" #_field " %llu\n", prefix, \
+            (unsigned long long)counter_get(&stats->_field))
+    DUMP(frames);
+    DUMP(events);
+    DUMP(writes);
+    DUMP(short_writes);
+    DUMP(again);
+    DUMP(errors);
+    DUMP(dropped);
+    DUMP(queued);
+    DUMP(coalesced);
+    DUMP(dropped_frames);
+#undef DUMP
+}
@@ -0,0 +1,210 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * This file is part of digimend-userspace-drivers.
+ */
+
+/* Frames of input events, written to a sink at once */
+
+#ifndef _FRAME_H
+#define _FRAME_H
+
+#include "counter.h"
+#include "sink.h"
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <linux/input.h>
+
+/** Maximum number of events in a frame, including the final SYN_REPORT */
+#define FRAME_MAX_EVENTS    32
+
+/** A frame of input events to be written with a single write */
+struct frame {
+    /** Number of events in the frame */
+    size_t num;
+    /** The events of the frame */
+    struct input_event events[FRAME_MAX_EVENTS];
+};
+
+/** Maximum number of frames pending on a congested sink */
+#define FRAME_QUEUE_LEN     16
+
+/**
+ * A queue of frames pending on a congested sink, written when it accepts
+ * data again, oldest first.
+ */
+struct frame_queue {
+    /** Index of the oldest frame */
+    size_t head;
+    /** Number of queued frames */
+    size_t num;
+    /** Number of bytes of the oldest frame already written */
+    size_t off;
+    /** The ring of queued frames, terminated with SYN_REPORT */
+    struct frame frames[FRAME_QUEUE_LEN];
+    /**
+     * True if any frame was dropped since the owner cleared the flag, so
+     * the sink may have missed values the owner considers delivered
+     */
+    bool dropped;
+};
+
+/**
+ * Statistics of frames written to a sink, counters updated by the thread
+ * writing to it
+ */
+struct frame_stats {
+    /** Number of frames flushed */
+    _Atomic uint64_t frames;
+    /** Number of events written successfully */
+    _Atomic uint64_t events;
+    /** Number of write calls made */
+    _Atomic uint64_t writes;
+    /** Number of writes which accepted only a part of the events */
+    _Atomic uint64_t short_writes;
+    /** Number of writes which failed with EAGAIN */
+    _Atomic uint64_t again;
+    /** Number of writes which failed otherwise */
+    _Atomic uint64_t errors;
+    /** Number of events dropped due to write failures */
+    _Atomic uint64_t dropped;
+    /** Number of frames queued, as the sink was congested */
+    _Atomic uint64_t queued;
+    /** Number of frames merged into a queued one */
+    _Atomic uint64_t coalesced;
+    /** Number of frames dropped, partially or completely */
+    _Atomic uint64_t dropped_frames;
+};
+
+/**
+ * Add an event to a frame.
+ *
+ * @param frame The frame to add the event to.
+ * @param type  The type of the event to add. One of EV_<TYPE> macros.
+ * @param code  The code of the event to add. One of the <TYPE>_<CODE>
+ *              macros.
+ * @param value The event value to add.
+ */
+static inline void
+frame_add(struct frame *frame, uint16_t type, uint16_t code, int32_t value)
+{
+    struct input_event *ev;
+    assert(frame != NULL);
+    assert(frame->num < FRAME_MAX_EVENTS);
+    ev = &frame->events[frame->num++];
+    ev->type = type;
+    ev->code = code;
+    ev->value = value;
+}
+
+/**
+ * Add an event to a frame, if its value differs from the cached one, and
+ * update the cache. Mirrors the kernel's dropping of unchanged ABS and
+ * KEY values, so the frame contains only the events the kernel would pass.
+ *
+ * @param frame     The frame to add the event to.
+ * @param type      The type of the event. One of EV_<TYPE> macros.
+ * @param code      The code of the event. One of the <TYPE>_<CODE> macros.
+ * @param cache     Location of the cached value to compare and update.
+ * @param value     The event value.
+ */
+static inline void
+frame_add_changed(struct frame *frame, uint16_t type, uint16_t code,
+                  int32_t *cache, int32_t value)
+{
+    assert(cache != NULL);
+    if (*cache != value) {
+        *cache = value;
+        frame_add(frame, type, code, value);
+    }
+}
+
+/**
+ * Add key events for changed bits of a button bitmap to a frame, and
+ * update the cached bitmap.
+ *
+ * @param frame     The frame to add the events to.
+ * @param codes     Key codes for each bit of the bitmap.
+ * @param cache     Location of the cached bitmap to compare and update.
+ * @param mask      The new button bitmap.
+ */
+static inline void
+frame_add_changed_buttons(struct frame *frame, const uint16_t *codes,
+                          uint32_t *cache, uint32_t mask)
+{
+    uint32_t diff;
+    unsigned int bit;
+
+    assert(codes != NULL);
+    assert(cache != NULL);
+
+    for (diff = *cache ^ mask; diff != 0; diff &= diff - 1) {
+        bit = (unsigned int)__builtin_ctz(diff);
+        frame_add(frame, EV_KEY, codes[bit], (mask >> bit) & 1);
+    }
+    *cache = mask;
+}
+
+/**
+ * Terminate a frame with SYN_REPORT and write it to a sink with as few
+ * writes as possible, normally one. Empty the frame.
+ *
+ * If the sink is congested, i.e. the write fails with EAGAIN, or earlier
+ * frames are still queued, queue the unwritten remainder of the frame to
+ * be written by frame_queue_drain(). Frames with absolute axis changes
+ * only are merged into the newest queued one like that, so congestion
+ * skips intermediate motion, but never key transitions. If the queue is
+ * full, the frame is dropped. Raise the queue's dropped flag on any drop.
+ *
+ * @param frame The frame to flush.
+ * @param queue The queue of frames pending on the sink.
+ * @param sink  The sink to write the frame to.
+ * @param stats The statistics to update.
+ *
+ * @return Zero if the frame was written or queued, -1 on failure, with
+ *         errno set appropriately. On failure the unwritten remainder of
+ *         the frame is dropped, ENOBUFS means the queue was full.
+ */
+extern int frame_flush(struct frame *frame, struct frame_queue *queue,
+                       struct sink *sink, struct frame_stats *stats);
+
+/**
+ * Write the frames queued on a congested sink, until it's congested
+ * again, or the queue is empty.
+ *
+ * @param queue The queue of frames to write.
+ * @param sink  The sink to write the frames to.
+ * @param stats The statistics to update.
+ *
+ * @return Zero if the queue was emptied, -1 otherwise, with errno set
+ *         appropriately. EAGAIN means the sink is congested again, and
+ *         the rest of the queue is kept, on other failures it's dropped,
+ *         and the queue's dropped flag is raised.
+ */
+extern int frame_queue_drain(struct frame_queue *queue, struct sink *sink,
+                             struct frame_stats *stats);
+
+/**
+ * Print frame statistics to stderr.
+ *
+ * @param name  The name of the device the statistics belong to.
+ * @param stats The statistics to print.
+ */
+extern void frame_stats_print(const char *name,
+                              const struct frame_stats *stats);
+
+/**
+ * Dump frame statistics counters to a stream, one "PREFIXCOUNTER VALUE"
+ * line each.
+ *
+ * @param stream    The stream to dump to.
+ * @param prefix    The prefix of each line.
+ * @param stats     The statistics to dump.
+ */
+extern void frame_stats_dump(FILE *stream, const char *prefix,
+                             const struct frame_stats *stats);
+
+#endif /* _FRAME_H */
@@ -0,0 +1,578 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * This file is part of digimend-userspace-drivers.
+ */
+
+#include "config.h"
+#include "hid.h"
+#include "misc.h"
+#include <assert.h>
+#include <stdlib.h>
+
+/** Maximum number of usages collected for a main item */
+#define HID_MAX_USAGES  64
+
+/** Maximum depth of the global item stack */
+#define HID_MAX_PUSH    4
+
+/** Maximum number of field pieces collected for a report */
+#define HID_MAX_PIECES  256
+
+/** Usage pages */
+#define HID_PAGE_DESKTOP    0x01
+#define HID_PAGE_BUTTON     0x09
+#define HID_PAGE_DIGITIZER  0x0d
+
+/** Global item state */
+struct hid_global {
+    uint32_t usage_page;
+    int32_t logical_min;
+    int32_t logical_max;
+    uint32_t report_size;
+    uint32_t report_count;
+    uint32_t report_id;
+};
+
+/** Local item state */
+struct hid_local {
+    /** Usages, with the usage page in the high 16 bits, if specified */
+    uint32_t usages[HID_MAX_USAGES];
+    /** Number of usages */
+    size_t num_usages;
+    /** Usage minimum, with page, if specified */
+    uint32_t usage_min;
+    /** Usage maximum, with page, if specified */
+    uint32_t usage_max;
+    /** True if usage minimum was specified */
+    bool have_usage_min;
+};
+
+/** A field extractor being built */
+struct hid_build_extractor {
+    /** Bit offset of the field in the report */
+    uint32_t bit;
+    /** Width of the field, bits */
+    uint32_t width;
+    /** Position to put the bits at in the field value */
+    uint8_t shift_out;
+    /** The field to put the bits into */
+    uint8_t field;
+};
+
+/** Per-report compilation state */
+struct hid_build {
+    /** Extractors of the report */
+    struct hid_build_extractor extractors[HID_MAX_PIECES];
+    /** Number of extractors */
+    size_t num;
+    /** Input bit offset of the next field */
+    uint32_t bit_offset;
+    /** Number of bits accumulated in each scalar field */
+    uint8_t field_bits[REPORT_FIELD_NUM];
+    /** Bitmap of fields which are signed */
+    uint32_t signed_fields;
+    /** Bitmap of fields present */
+    uint32_t fields;
+};
+
+/**
+ * Map a usage to a decoded report field.
+ *
+ * @param usage The usage with the page in the high 16 bits.
+ * @param pbit  Location for the bit number of bitmap fields,
+ *              or -1 for scalar fields.
+ *
+ * @return The field, or REPORT_FIELD_NUM if the usage is not supported.
+ */
+static enum report_field
+hid_usage_field(uint32_t usage, int *pbit)
+{
+    uint16_t page = usage >> 16;
+    uint16_t id = usage & 0xffff;
+
+    *pbit = -1;
+    switch (page) {
+    case HID_PAGE_DESKTOP:
+        switch (id) {
+        case 0x30: return REPORT_FIELD_X;
+        case 0x31: return REPORT_FIELD_Y;
+        case 0x37: return REPORT_FIELD_DIAL;
+        default: break;
+        }
+        break;
+    case HID_PAGE_DIGITIZER:
+        switch (id) {
+        case 0x30: return REPORT_FIELD_PRESSURE;
+        case 0x32: return REPORT_FIELD_IN_RANGE;
+        case 0x3d: return REPORT_FIELD_TILT_X;
+        case 0x3e: return REPORT_FIELD_TILT_Y;
+        case 0x42: *pbit = 0; return REPORT_FIELD_PEN_BUTTONS;
+        case 0x44: *pbit = 1; return REPORT_FIELD_PEN_BUTTONS;
+        case 0x5a: *pbit = 2; return REPORT_FIELD_PEN_BUTTONS;
+        default: break;
+        }
+        break;
+    case HID_PAGE_BUTTON:
+        if (id >= 1 && id <= 32) {
+            *pbit = id - 1;
+            return REPORT_FIELD_PAD_BUTTONS;
+        }
+        break;
+    default:
+        break;
+    }
+    return REPORT_FIELD_NUM;
+}
+
+/**
+ * Advance the bit offset of a report being built past an input main
+ * item, stopping at the maximum report length, so the offset can't wrap
+ * around, and the item's fields can't be iterated past it.
+ *
+ * @param build     The report build state.
+ * @param global    The global item state.
+ *
+ * @return The number of the item's fields within the maximum length.
+ */
+static uint32_t
+hid_build_advance(struct hid_build *build, const struct hid_global *global)
+{
+    /* The size and the count come from the device, don't overflow */
+    uint64_t end = build->bit_offset +
+                   (uint64_t)global->report_size * global->report_count;
+
+    if (global->report_size == 0) {
+        return 0;
+    }
+    if (end <= HID_PLAN_MAX_LEN * 8) {
+        build->bit_offset = (uint32_t)end;
+        return global->report_count;
+    }
+    end = (HID_PLAN_MAX_LEN * 8 - build->bit_offset) /
+          global->report_size;
+    build->bit_offset = HID_PLAN_MAX_LEN * 8;
+    return (uint32_t)end;
+}
+
+/**
+ * Add extractors for a variable input main item to a report being built.
+ *
+ * @param build     The report build state.
+ * @param global    The global item state.
+ * @param local     The local item state.
+ *
+ * @return True if added successfully, false if limits were exceeded.
+ */
+static bool
+hid_build_input(struct hid_build *build,
+                const struct hid_global *global,
+                const struct hid_local *local)
+{
+    uint32_t bit = build->bit_offset;
+    uint32_t num = hid_build_advance(build, global);
+    uint32_t i;
+    uint32_t usage;
+    enum report_field field;
+    int field_bit;
+    struct hid_build_extractor *e;
+
+    for (i = 0; i < num; i++, bit += global->report_size) {
+        /* Get the usage of the field */
+        if (local->num_usages > 0) {
+            usage = local->usages[i < local->num_usages
+                                    ? i : local->num_usages - 1];
+        } else if (local->have_usage_min) {
+            usage = local->usage_min + i;
+            if (usage > local->usage_max) {
+                usage = local->usage_max;
+            }
+        } else {
+            continue;
+        }
+        if ((usage >> 16) == 0) {
+            usage |= global->usage_page << 16;
+        }
+
+        field = hid_usage_field(usage, &field_bit);
+        /* Skip unsupported usages and fields wider than a value */
+        if (field == REPORT_FIELD_NUM ||
+            global->report_size == 0 || global->report_size > 32) {
+            continue;
+        }
+        if (field_bit < 0) {
+            /* Concatenate repeated scalar fields */
+            if (build->field_bits[field] + global->report_size > 32) {
+                continue;
+            }
+            field_bit = build->field_bits[field];
+            build->field_bits[field] += (uint8_t)global->report_size;
+        } else if (field_bit + global->report_size > 32) {
+            continue;
+        }
+
+        e = build->num > 0 ? &build->extractors[build->num - 1] : NULL;
+        /* Merge with the previous extractor, if contiguous */
+        if (e != NULL && e->field == field &&
+            e->bit + e->width == bit &&
+            e->shift_out + e->width == (uint32_t)field_bit &&
+            e->width + global->report_size <= 32 &&
+            e->bit % 8 + e->width + global->report_size <= 64) {
+            e->width += global->report_size;
+        } else {
+            if (build->num >= ARRAY_SIZE(build->extractors)) {
+                return false;
+            }
+            e = &build->extractors[build->num++];
+            e->bit = bit;
+            e->width = global->report_size;
+            e->shift_out = (uint8_t)field_bit;
+            e->field = (uint8_t)field;
+        }
+        build->fields |= 1u << field;
+        if (global->logical_min < 0) {
+            build->signed_fields |= 1u << field;
+        }
+    }
+    return true;
+}
+
+/**
+ * Compile a field piece of a built report into a decoding step.
+ *
+ * @param step      The step to compile into, zeroed.
+ * @param build     The report build state.
+ * @param b         The field piece to compile.
+ * @param load_max  The maximum offset of a word to load from the report.
+ * @param negate    Bitmap of fields to negate.
+ */
+static void
+hid_plan_step(struct hid_step *step, const struct hid_build *build,
+              const struct hid_build_extractor *b, size_t load_max,
+              uint32_t negate)
+{
+    uint32_t sign = 0;
+
+    /*
+     * Load each piece from the word starting at its first byte, or, if
+     * that would cross the end of the report, from the last word.
+     */
+    step->load = (uint8_t)(b->bit / 8 < load_max ? b->bit / 8 : load_max);
+    step->rotate = (uint8_t)((b->bit - step->load * 8u - b->shift_out) &
+                             63);
+    step->field = b->field;
+    step->mask = (uint32_t)((1ull << b->width) - 1) << b->shift_out;
+    /* Sign-extend the top bits of signed fields */
+    if ((build->signed_fields & (1u << b->field)) &&
+        b->shift_out + b->width == build->field_bits[b->field]) {
+        sign = 1u << (b->width - 1);
+    }
+    /* Negate each piece, as the pieces are added up */
+    if (negate & (1u << b->field)) {
+        sign = ~sign;
+    }
+    step->flip = sign << b->shift_out;
+}
+
+/**
+ * Add a built report to a plan, replacing any report with the same ID.
+ *
+ * @param plan      The plan to add the report to.
+ * @param build     The report build state.
+ * @param id        The report ID.
+ * @param negate    Bitmap of fields to negate.
+ *
+ * @return True if added or skipped, false if plan limits were exceeded.
+ */
+static bool
+hid_plan_add(struct hid_plan *plan, const struct hid_build *build,
+             uint8_t id, uint32_t negate)
+{
+    struct hid_plan_report *report;
+    const struct hid_build_extractor *b;
+    size_t i;
+    size_t end;
+    size_t min_len;
+    size_t load_max;
+    size_t extra;
+    uint32_t assigned;
+    enum report_field field;
+
+    /* Skip reports without anything we can decode */
+    if (build->fields & (1u << REPORT_FIELD_X)) {
+        field = REPORT_FIELD_X;
+    } else if (build->fields & (1u << REPORT_FIELD_PAD_BUTTONS)) {
+        field = REPORT_FIELD_PAD_BUTTONS;
+    } else if (build->fields & (1u << REPORT_FIELD_DIAL)) {
+        field = REPORT_FIELD_DIAL;
+    } else {
+        return true;
+    }
+
+    /* Check the extra pieces fit */
+    if (build->num - (size_t)__builtin_popcount(build->fields) >
+            HID_PLAN_EXTRA_STEPS) {
+        return false;
+    }
+
+    if (plan->index[id] != 0) {
+        /* Replace the existing report */
+        report = &plan->reports[plan->index[id] - 1];
+    } else {
+        if (plan->num_reports >= HID_PLAN_MAX_REPORTS) {
+            return false;
+        }
+        report = &plan->reports[plan->num_reports++];
+        plan->index[id] = (uint8_t)plan->num_reports;
+    }
+
+    memset(report, 0, sizeof(*report));
+    report->id = id;
+    report->kind = field == REPORT_FIELD_X ? REPORT_KIND_PEN :
+                   field == REPORT_FIELD_PAD_BUTTONS ?
+                        REPORT_KIND_PAD_BUTTONS :
+                        REPORT_KIND_PAD_DIAL;
+    min_len = 0;
+    for (i = 0; i < build->num; i++) {
+        b = &build->extractors[i];
+        end = (b->bit + b->width + 7) / 8;
+        if (end > min_len) {
+            min_len = end;
+        }
+    }
+    report->min_len = min_len;
+
+    /*
+     * The first piece of each field assigns it, and the rest are added
+     * to it. The pieces don't overlap, so adding them is the same as
+     * combining their bits, but negation distributes over addition.
+     */
+    load_max = min_len < sizeof(uint64_t) ? 0 : min_len - sizeof(uint64_t);
+    extra = 0;
+    assigned = 0;
+    for (i = 0; i < build->num; i++) {
+        b = &build->extractors[i];
+        if (!(assigned & (1u << b->field))) {
+            assigned |= 1u << b->field;
+            hid_plan_step(&report->assign[b->field], build, b,
+                          load_max, negate);
+        } else {
+            hid_plan_step(&report->extra[extra++], build, b,
+                          load_max, negate);
+        }
+    }
+    return true;
+}
+
+void
+hid_plan_init(struct hid_plan *plan)
+{
+    assert(plan != NULL);
+    memset(plan, 0, sizeof(*plan));
+}
+
+bool
+hid_plan_has(const struct hid_plan *plan, uint8_t id, enum report_kind kind)
+{
+    assert(plan != NULL);
+    return plan->index[id] != 0 &&
+           plan->reports[plan->index[id] - 1].kind == kind;
+}
+
+/**
+ * Check if two decoding steps are the same.
+ *
+ * @param a The first step to compare.
+ * @param b The second step to compare.
+ *
+ * @return True if the steps are the same, false otherwise.
+ */
+static bool
+hid_step_equal(const struct hid_step *a, const struct hid_step *b)
+{
+    return a->load == b->load && a->rotate == b->rotate &&
+           a->field == b->field && a->mask == b->mask &&
+           a->flip == b->flip;
+}
+
+bool
+hid_plan_has_report(const struct hid_plan *plan,
+                    const struct hid_plan_report *report)
+{
+    const struct hid_plan_report *found;
+    size_t i;
+
+    assert(plan != NULL);
+    assert(report != NULL);
+
+    if (plan->index[report->id] == 0) {
+        return false;
+    }
+    found = &plan->reports[plan->index[report->id] - 1];
+    if (found->kind != report->kind || found->min_len != report->min_len) {
+        return false;
+    }
+    for (i = 0; i < ARRAY_SIZE(found->assign); i++) {
+        if (!hid_step_equal(&found->assign[i], &report->assign[i])) {
+            return false;
+        }
+    }
+    for (i = 0; i < ARRAY_SIZE(found->extra); i++) {
+        if (!hid_step_equal(&found->extra[i], &report->extra[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool
+hid_plan_compile(struct hid_plan *plan,
+                 const uint8_t *desc, size_t len, uint32_t negate)
+{
+    struct hid_global global = {.report_count = 0};
+    struct hid_global stack[HID_MAX_PUSH];
+    size_t depth = 0;
+    struct hid_local local = {.num_usages = 0};
+    /* Build state for each report ID, allocated on first use */
+    struct hid_build *builds[256] = {NULL};
+    struct hid_build *build;
+    const uint8_t *p = desc;
+    const uint8_t *end = desc + len;
+    uint8_t prefix;
+    uint8_t size;
+    uint8_t type;
+    uint8_t tag;
+    uint32_t udata;
+    int32_t sdata;
+    bool result = false;
+    size_t i;
+
+    assert(plan != NULL);
+    assert(desc != NULL || len == 0);
+
+    while (p < end) {
+        prefix = *p++;
+        /* Skip long items */
+        if (prefix == 0xfe) {
+            if (end - p < 2 || end - p < 2 + p[0]) {
+                goto cleanup;
+            }
+            p += 2 + p[0];
+            continue;
+        }
+        size = prefix & 3;
+        if (size == 3) {
+            size = 4;
+        }
+        type = (prefix >> 2) & 3;
+        tag = prefix >> 4;
+        if (end - p < size) {
+            goto cleanup;
+        }
+        udata = 0;
+        for (i = 0; i < size; i++) {
+            udata |= (uint32_t)p[i] << (i * 8);
+        }
+        sdata = size == 1 ? (int8_t)udata :
+                size == 2 ? (int16_t)udata :
+                (int32_t)udata;
+        p += size;
+
+        switch (type) {
+        /* Main */
+        case 0:
+            /* Input */
+            if (tag == 0x8) {
+                build = builds[global.report_id];
+                if (build == NULL) {
+                    build = calloc(1, sizeof(*build));
+                    if (build == NULL) {
+                        goto cleanup;
+                    }
+                    /* Account for the report ID byte */
+                    build->bit_offset = global.report_id != 0 ? 8 : 0;
+                    builds[global.report_id] = build;
+                }
+                /* Variable, non-constant fields only */
+                if ((udata & 3) == 2) {
+                    if (!hid_build_input(build, &global, &local)) {
+                        goto cleanup;
+                    }
+                } else {
+                    hid_build_advance(build, &global);
+                }
+            }
+            memset(&local, 0, sizeof(local));
+            break;
+        /* Global */
+        case 1:
+            switch (tag) {
+            case 0x0: global.usage_page = udata; break;
+            case 0x1: global.logical_min = sdata; break;
+            case 0x2: global.logical_max = sdata; break;
+            case 0x7: global.report_size = udata; break;
+            case 0x8:
+                if (udata == 0 || udata > 0xff) {
+                    goto cleanup;
+                }
+                global.report_id = udata;
+                break;
+            case 0x9: global.report_count = udata; break;
+            case 0xa:
+                if (depth >= HID_MAX_PUSH) {
+                    goto cleanup;
+                }
+                stack[depth++] = global;
+                break;
+            case 0xb:
+                if (depth == 0) {
+                    goto cleanup;
+                }
+                global = stack[--depth];
+                break;
+            default:
+                break;
+            }
+            break;
+        /* Local */
+        case 2:
+            /* Extended usages carry the page in the high 16 bits */
+            if (size < 4) {
+                udata &= 0xffff;
+            }
+            switch (tag) {
+            case 0x0:
+                if (local.num_usages < HID_MAX_USAGES) {
+                    local.usages[local.num_usages++] = udata;
+                }
+                break;
+            case 0x1:
+                local.usage_min = udata;
+                local.have_usage_min = true;
+                break;
+            case 0x2:
+                local.usage_max = udata;
+                break;
+            default:
+                break;
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+    for (i = 0; i < ARRAY_SIZE(builds); i++) {
+        if (builds[i] != NULL &&
+            !hid_plan_add(plan, builds[i], (uint8_t)i, negate)) {
+            goto cleanup;
+        }
+    }
+
+    result = true;
+cleanup:
+    for (i = 0; i < ARRAY_SIZE(builds); i++) {
+        free(builds[i]);
+    }
+    return result;
+}
@@ -0,0 +1,254 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * This file is part of digimend-userspace-drivers.
+ */
+
+/*
+ * HID report descriptor parsing and compilation into flat field
+ * extraction plans.
+ */
+
+#ifndef _HID_H
+#define _HID_H
+
+#include "report.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <endian.h>
+
+/** Maximum number of reports in a plan */
+#define HID_PLAN_MAX_REPORTS    16
+
+/** Number of steps of a compiled report adding concatenated field bits */
+#define HID_PLAN_EXTRA_STEPS    2
+
+/** Maximum length of a report with fields in a plan */
+#define HID_PLAN_MAX_LEN        64
+
+/** Unroll the following loop completely, where the compiler supports it */
+#if defined(__clang__)
+#define HID_UNROLL _Pragma("unroll")
+#elif defined(__GNUC__) && __GNUC__ >= 8
+#define HID_UNROLL _Pragma("GCC unroll 16")
+#else
+#define HID_UNROLL
+#endif
+
+/**
+ * A step of decoding a report: takes bits out of the report, and puts
+ * them at their position in a field value, sign-extended and negated as
+ * needed, with the same few operations for any field. A step with all
+ * members zero produces zero.
+ */
+struct hid_step {
+    /** Offset of the 64-bit little-endian word to load the bits from */
+    uint8_t load;
+    /** Number of bits to rotate the word right by to position the bits */
+    uint8_t rotate;
+    /** The field to add the bits to, for the steps adding them */
+    uint8_t field;
+    /** Mask of the bits, in position */
+    uint32_t mask;
+    /**
+     * The bits to flip, and then subtract, to sign-extend the bits, if
+     * they're the top bits of a signed field, and to negate them, if the
+     * field is negated. Zero for neither.
+     */
+    uint32_t flip;
+};
+
+/**
+ * A compiled plan of a single report: a fixed sequence of steps, the
+ * same for every report, so decoding has no branches depending on the
+ * layout.
+ */
+struct hid_plan_report {
+    /** Report ID, zero if the descriptor doesn't use IDs */
+    uint8_t id;
+    /** Kind of the decoded report */
+    enum report_kind kind;
+    /**
+     * Minimum report length, bytes. Reports shorter than a 64-bit word
+     * are padded to one for decoding.
+     */
+    size_t min_len;
+    /**
+     * Steps assigning each field the bits of its first piece, indexed by
+     * the field. The steps of fields the report doesn't have are zero.
+     */
+    struct hid_step assign[REPORT_FIELD_NUM];
+    /**
+     * Steps adding the bits of concatenated fields, after the assigning
+     * steps. The unused steps are zero.
+     */
+    struct hid_step extra[HID_PLAN_EXTRA_STEPS];
+};
+
+/** A compiled plan of extracting fields from reports */
+struct hid_plan {
+    /** Number of compiled reports */
+    size_t num_reports;
+    /** Compiled reports */
+    struct hid_plan_report reports[HID_PLAN_MAX_REPORTS];
+    /** Index + 1 of the compiled report for each report ID, 0 if none */
+    uint8_t index[256];
+};
+
+/**
+ * Initialize an empty plan.
+ *
+ * @param plan  The plan to initialize.
+ */
+extern void hid_plan_init(struct hid_plan *plan);
+
+/**
+ * Parse a HID report descriptor and compile the input reports it
+ * describes into a plan, replacing any reports with the same IDs already
+ * there. Reports without pen, pad button, or dial fields are skipped.
+ *
+ * Several fields with the same usage in one report are concatenated into
+ * a single value, least-significant first, as some tablets send high
+ * bits of coordinates separately.
+ *
+ * @param plan      The plan to add the compiled reports to.
+ * @param desc      The report descriptor to parse.
+ * @param len       The length of the report descriptor.
+ * @param negate    Bitmap of fields (1 << enum report_field) to negate,
+ *                  e.g. to match evdev axis orientation.
+ *
+ * @return True if compiled successfully, false if the descriptor was
+ *         invalid or the plan limits were exceeded, e.g. a report had
+ *         more than HID_PLAN_EXTRA_STEPS concatenated pieces.
+ */
+extern bool hid_plan_compile(struct hid_plan *plan,
+                             const uint8_t *desc, size_t len,
+                             uint32_t negate);
+
+/**
+ * Check if a plan has a compiled report of specified ID and kind.
+ *
+ * @param plan  The plan to check.
+ * @param id    The report ID to look for.
+ * @param kind  The kind of the report to look for.
+ *
+ * @return True if the plan has the report, false otherwise.
+ */
+extern bool hid_plan_has(const struct hid_plan *plan,
+                         uint8_t id, enum report_kind kind);
+
+/**
+ * Check if a plan has a compiled report identical to another one, i.e.
+ * decoding it identically.
+ *
+ * @param plan      The plan to check.
+ * @param report    The compiled report to look for, by its ID.
+ *
+ * @return True if the plan has the same report, false otherwise.
+ */
+extern bool hid_plan_has_report(const struct hid_plan *plan,
+                                const struct hid_plan_report *report);
+
+/**
+ * Run a decoding step on a report.
+ *
+ * @param step  The step to run.
+ * @param buf   The report buffer, at least a 64-bit word long.
+ *
+ * @return The bits the step puts into its field.
+ */
+static inline __attribute__((always_inline)) int32_t
+hid_step_run(const struct hid_step *step, const uint8_t *buf)
+{
+    uint64_t bits;
+    uint32_t value;
+
+    memcpy(&bits, buf + step->load, sizeof(bits));
+    bits = le64toh(bits);
+    /* A rotation, as the bits could need shifting either way */
+    bits = (bits >> (step->rotate & 63)) | (bits << (-step->rotate & 63));
+    value = (uint32_t)bits & step->mask;
+    /*
+     * Sign-extend and negate with an XOR and a subtraction: for sign
+     * bit s, (v ^ s) - s sign-extends, and (v ^ ~s) - ~s = s - (v ^ s)
+     * sign-extends and negates
+     */
+    return (int32_t)((value ^ step->flip) - step->flip);
+}
+
+/**
+ * Decode a report according to its compiled plan, running the same
+ * steps for every report, without branches depending on the layout.
+ * Inlined, so the compiler specializes it into straight-line code for
+ * plans known at build time.
+ *
+ * @param plan_report   The compiled plan of the report.
+ * @param report        Location for the decoded report.
+ * @param buf           The report buffer.
+ * @param len           The length of the report.
+ *
+ * @return True if decoded, false if the report is too short.
+ */
+static inline __attribute__((always_inline)) bool
+hid_plan_report_decode(const struct hid_plan_report *plan_report,
+                       struct report *report,
+                       const uint8_t *buf, size_t len)
+{
+    /* The report, padded to a 64-bit word, if shorter */
+    uint8_t padded[sizeof(uint64_t)];
+    size_t i;
+
+    if (len < plan_report->min_len) {
+        return false;
+    }
+    if (len < sizeof(padded)) {
+        memset(padded, 0, sizeof(padded));
+        memcpy(padded, buf, len);
+        buf = padded;
+    }
+
+    /*
+     * Assign every field, zero if the report doesn't have it, and then
+     * add the bits of concatenated fields. The pieces of a field don't
+     * overlap, so adding them combines their bits, and negation
+     * distributes over the addition.
+     */
+    report->kind = plan_report->kind;
+    HID_UNROLL
+    for (i = 0; i < REPORT_FIELD_NUM; i++) {
+        report->values[i] = hid_step_run(&plan_report->assign[i], buf);
+    }
+    HID_UNROLL
+    for (i = 0; i < HID_PLAN_EXTRA_STEPS; i++) {
+        report->values[plan_report->extra[i].field] +=
+            hid_step_run(&plan_report->extra[i], buf);
+    }
+    return true;
+}
+
+/**
+ * Decode a report according to a plan.
+ *
+ * @param plan      The plan to decode according to.
+ * @param id        The ID of the compiled report to decode as.
+ * @param report    Location for the decoded report.
+ * @param buf       The report buffer.
+ * @param len       The length of the report.
+ *
+ * @return True if decoded, false if the plan has no such report, or the
+ *         report is too short.
+ */
+static inline bool
+hid_plan_decode(const struct hid_plan *plan, uint8_t id,
+                struct report *report, const uint8_t *buf, size_t len)
+{
+    if (plan->index[id] == 0) {
+        return false;
+    }
+    return hid_plan_report_decode(&plan->reports[plan->index[id] - 1],
+                                  report, buf, len);
+}
+
+#endif /* _HID_H */
@@ -0,0 +1,424 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * This file is part of digimend-userspace-drivers.
+ */
+
+#include "config.h"
+#include "log.h"
+#include "misc.h"
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+
+/** The path of the systemd journal native protocol socket */
+#define LOG_JOURNAL_PATH    "/run/systemd/journal/socket"
+
+/** Size of a cache line, to keep the ring's producer state apart */
+#define LOG_CACHE_LINE      64
+
+/** A message slot in the log ring */
+struct log_entry {
+    /**
+     * The sequence number of the slot: the ring position it's free to be
+     * filled at, or that position plus one, once filled
+     */
+    _Atomic size_t seq;
+    /** The message text, zero-terminated */
+    char text[LOG_TEXT_MAX];
+};
+
+/** The asynchronous logging state */
+static struct {
+    /** True if messages are queued into the ring, false if written */
+    _Atomic bool async;
+    /** Number of messages dropped as the ring was full */
+    _Atomic uint64_t dropped;
+    /** The position of the next slot to fill, taken by the producers */
+    _Atomic size_t tail;
+    /** Padding keeping the producers' position off the consumer's line */
+    uint8_t tail_pad[LOG_CACHE_LINE - sizeof(size_t)];
+    /** The position of the next slot to write out, the thread's only */
+    size_t head;
+    /** True if the thread announced it's going to sleep */
+    _Atomic bool waiting;
+    /** True if the thread is requested to stop */
+    _Atomic bool stop;
+    /** The eventfd waking up the thread, or -1 */
+    int wake_fd;
+    /** The systemd journal socket, or -1 to write to stderr */
+    int journal_fd;
+    /** The logging thread */
+    pthread_t thread;
+    /** The message slots */
+    struct log_entry entries[LOG_RING_LEN];
+} log_state = {.wake_fd = -1, .journal_fd = -1};
+
+/**
+ * Check if a call site may log a message, accounting it.
+ *
+ * @param site          The call site to check.
+ * @param psuppressed   Location for the number of messages suppressed at
+ *                      the site since the last one logged, if allowed.
+ *
+ * @return True if the message may be logged, false if suppressed.
+ */
+static bool
+log_site_allow(struct log_site *site, uint64_t *psuppressed)
+{
+    uint64_t now = clock_ns();
+    uint64_t start;
+
+    assert(site != NULL);
+    assert(psuppressed != NULL);
+
+    /* Start a new interval, if the current one is over, only once */
+    start = atomic_load_explicit(&site->start_ns, memory_order_relaxed);
+    if ((start == 0 || now - start >= LOG_INTERVAL_NS) &&
+        atomic_compare_exchange_strong_explicit(&site->start_ns,
+                                                &start, now,
+                                                memory_order_relaxed,
+                                                memory_order_relaxed)) {
+        atomic_store_explicit(&site->count, 0, memory_order_relaxed);
+    }
+
+    if (atomic_fetch_add_explicit(&site->count, 1,
+                                  memory_order_relaxed) >= LOG_BURST) {
+        atomic_fetch_add_explicit(&site->suppressed, 1,
+                                  memory_order_relaxed);
+        return false;
+    }
+    *psuppressed = atomic_exchange_explicit(&site->suppressed, 0,
+                                            memory_order_relaxed);
+    return true;
+}
+
+/**
+ * Format a log message, truncating it to fit.
+ *
+ * @param buf           The buffer to format into.
+ * @param size          The size of the buffer.
+ * @param suppressed    Number of messages suppressed before this one.
+ * @param fmt           The message format.
+ * @param args          The format arguments.
+ */
+static void __attribute__((format(printf, 4, 0)))
+log_format(char *buf, size_t size, uint64_t suppressed,
+           const char *fmt, va_list args)
+{
+    int len;
+
+    assert(buf != NULL);
+    assert(size > 0);
+    assert(fmt != NULL);
+
+    len = vsnprintf(buf, size, fmt, args);
+    if (len < 0) {
+        len = 0;
+        buf[0] = '\0';
+    } else if ((size_t)len >= size) {
+        len = size - 1;
+    }
+    if (suppressed != 0) {
+        snprintf(buf + len, size - len,
+                 " (%llu similar messages suppressed)",
+                 (unsigned long long)suppressed);
+    }
+}
+
+/**
+ * Write out a log message to the journal, if configured, or to stderr.
+ *
+ * @param text  The message text to write.
+ */
+static void
+log_write(const char *text)
+{
+    static const char head[] = "PRIORITY=3\nSYSLOG_IDENTIFIER=";
+    const char *ident = program_invocation_short_name;
+    uint64_t len;
+    uint8_t len_le[8];
+    size_t i;
+    struct iovec iov[6];
+
+    assert(text != NULL);
+
+    if (log_state.journal_fd >= 0) {
+        /* Send the message as a binary field, so it may have newlines */
+        len = strlen(text);
+        for (i = 0; i < sizeof(len_le); i++) {
+            len_le[i] = (uint8_t)(len >> (i * 8));
+        }
+        iov[0] = (struct iovec){(void *)head, sizeof(head) - 1};
+        iov[1] = (struct iovec){(void *)ident, strlen(ident)};
+        iov[2] = (struct iovec){(void *)"\nMESSAGE\n", 9};
+        iov[3] = (struct iovec){len_le, sizeof(len_le)};
+        iov[4] = (struct iovec){(void *)text, len};
+        iov[5] = (struct iovec){(void *)"\n", 1};
+        if (writev(log_state.journal_fd, iov, ARRAY_SIZE(iov)) >= 0) {
+            return;
+        }
+    }
+    fprintf(stderr, "%s\n", text);
+}
+
+/**
+ * Wait for a message to be queued into the empty ring, or the logging
+ * thread to be requested to stop.
+ *
+ * @param entry The entry to be filled next.
+ * @param head  The position of the entry.
+ */
+static void
+log_wait(struct log_entry *entry, size_t head)
+{
+    uint64_t value;
+
+    /*
+     * Announce sleeping, and check the ring again, so either this sees
+     * the message, or the producer sees the announcement
+     */
+    atomic_store_explicit(&log_state.waiting, true, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&entry->seq, memory_order_relaxed) !=
+            head + 1 &&
+        !atomic_load_explicit(&log_state.stop, memory_order_acquire) &&
+        read(log_state.wake_fd, &value, sizeof(value)) < 0 &&
+        errno != EINTR) {
+        fprintf(stderr, "Failed to wait for log messages: %s\n",
+                strerror(errno));
+    }
+    atomic_store_explicit(&log_state.waiting, false, memory_order_relaxed);
+}
+
+/**
+ * Run the logging thread: write out the queued messages, and the number
+ * of dropped ones, waiting for more when the ring is empty, until
+ * requested to stop.
+ *
+ * @param arg   Unused.
+ *
+ * @return NULL.
+ */
+static void *
+log_run(void *arg)
+{
+    struct log_entry *entry;
+    size_t head = log_state.head;
+    uint64_t dropped;
+    char text[LOG_TEXT_MAX];
+
+    (void)arg;
+
+    while (true) {
+        entry = &log_state.entries[head % LOG_RING_LEN];
+        if (atomic_load_explicit(&entry->seq, memory_order_acquire) ==
+                head + 1) {
+            log_write(entry->text);
+            /* Free the slot for the position a ring length ahead */
+            atomic_store_explicit(&entry->seq, head + LOG_RING_LEN,
+                                  memory_order_release);
+            head++;
+            continue;
+        }
+        dropped = atomic_exchange_explicit(&log_state.dropped, 0,
+                                           memory_order_relaxed);
+        if (dropped != 0) {
+            snprintf(text, sizeof(text),
+                     "%llu log messages dropped, the log ring was full",
+                     (unsigned long long)dropped);
+            log_write(text);
+        }
+        if (atomic_load_explicit(&log_state.stop, memory_order_acquire)) {
+            break;
+        }
+        log_wait(entry, head);
+    }
+    log_state.head = head;
+    return NULL;
+}
+
+/**
+ * Queue a formatted message into the log ring, and wake up the logging
+ * thread, if it's going to sleep.
+ *
+ * @param suppressed    Number of messages suppressed before this one.
+ * @param fmt           The message format.
+ * @param args          The format arguments.
+ *
+ * @return True if queued, false if the ring was full.
+ */
+static bool __attribute__((format(printf, 2, 0)))
+log_queue(uint64_t suppressed, const char *fmt, va_list args)
+{
+    struct log_entry *entry;
+    size_t pos;
+    size_t seq;
+    uint64_t value = 1;
+    ssize_t rc;
+
+    /* Take a free slot, if any */
+    pos = atomic_load_explicit(&log_state.tail, memory_order_relaxed);
+    while (true) {
+        entry = &log_state.entries[pos % LOG_RING_LEN];
+        seq = atomic_load_explicit(&entry->seq, memory_order_acquire);
+        if (seq == pos) {
+            if (atomic_compare_exchange_weak_explicit(
+                    &log_state.tail, &pos, pos + 1,
+                    memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if ((ptrdiff_t)(seq - pos) < 0) {
+            return false;
+        } else {
+            pos = atomic_load_explicit(&log_state.tail,
+                                       memory_order_relaxed);
+        }
+    }
+
+    /* Fill the slot, and publish it */
+    log_format(entry->text, sizeof(entry->text), suppressed, fmt, args);
+    atomic_store_explicit(&entry->seq, pos + 1, memory_order_release);
+
+    /* Wake up the thread once per sleep, taking the announcement */
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&log_state.waiting, memory_order_relaxed) &&
+        atomic_exchange_explicit(&log_state.waiting, false,
+                                 memory_order_relaxed)) {
+        /* Nowhere to report a failure, the next wakeup will find it */
+        rc = write(log_state.wake_fd, &value, sizeof(value));
+        (void)rc;
+    }
+    return true;
+}
+
+void
+log_error(struct log_site *site, const char *fmt, ...)
+{
+    int orig_errno = errno;
+    uint64_t suppressed;
+    char text[LOG_TEXT_MAX];
+    va_list args;
+
+    assert(site != NULL);
+    assert(fmt != NULL);
+
+    if (!log_site_allow(site, &suppressed)) {
+        goto cleanup;
+    }
+
+    va_start(args, fmt);
+    if (atomic_load_explicit(&log_state.async, memory_order_acquire)) {
+        if (!log_queue(suppressed, fmt, args)) {
+            atomic_fetch_add_explicit(&log_state.dropped, 1,
+                                      memory_order_relaxed);
+        }
+    } else {
+        log_format(text, sizeof(text), suppressed, fmt, args);
+        fprintf(stderr, "%s\n", text);
+    }
+    va_end(args);
+
+cleanup:
+    errno = orig_errno;
+}
+
+bool
+log_start(bool journal)
+{
+    bool result = false;
+    int orig_errno;
+    int err;
+    size_t i;
+    sigset_t signals;
+    sigset_t orig_signals;
+    struct sockaddr_un addr = {.sun_family = AF_UNIX,
+                               .sun_path = LOG_JOURNAL_PATH};
+
+    assert(!atomic_load_explicit(&log_state.async, memory_order_relaxed));
+
+    for (i = 0; i < LOG_RING_LEN; i++) {
+        atomic_init(&log_state.entries[i].seq, i);
+    }
+    atomic_init(&log_state.tail, 0);
+    atomic_init(&log_state.dropped, 0);
+    atomic_init(&log_state.waiting, false);
+    atomic_init(&log_state.stop, false);
+    log_state.head = 0;
+
+    log_state.wake_fd = eventfd(0, EFD_CLOEXEC);
+    if (log_state.wake_fd < 0) {
+        goto cleanup;
+    }
+
+    if (journal) {
+        log_state.journal_fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC,
+                                      0);
+        if (log_state.journal_fd < 0 ||
+            connect(log_state.journal_fd, (struct sockaddr *)&addr,
+                    sizeof(addr)) < 0) {
+            goto cleanup;
+        }
+    }
+
+    /* Leave the signals to the other threads, blocking them in this one */
+    sigfillset(&signals);
+    pthread_sigmask(SIG_SETMASK, &signals, &orig_signals);
+    err = pthread_create(&log_state.thread, NULL, log_run, NULL);
+    pthread_sigmask(SIG_SETMASK, &orig_signals, NULL);
+    if (err != 0) {
+        errno = err;
+        goto cleanup;
+    }
+    atomic_store_explicit(&log_state.async, true, memory_order_release);
+    result = true;
+
+cleanup:
+    if (!result) {
+        orig_errno = errno;
+        if (log_state.journal_fd >= 0) {
+            close(log_state.journal_fd);
+            log_state.journal_fd = -1;
+        }
+        if (log_state.wake_fd >= 0) {
+            close(log_state.wake_fd);
+            log_state.wake_fd = -1;
+        }
+        errno = orig_errno;
+    }
+    return result;
+}
+
+void
+log_stop(void)
+{
+    uint64_t value = 1;
+
+    if (!atomic_load_explicit(&log_state.async, memory_order_relaxed)) {
+        return;
+    }
+    atomic_store_explicit(&log_state.async, false, memory_order_relaxed);
+    atomic_store_explicit(&log_state.stop, true, memory_order_release);
+    if (write(log_state.wake_fd, &value, sizeof(value)) < 0) {
+        fprintf(stderr, "Failed to wake up the logging thread: %s\n",
+                strerror(errno));
+    }
+    pthread_join(log_state.thread, NULL);
+
+    if (log_state.journal_fd >= 0) {
+        close(log_state.journal_fd);
+        log_state.journal_fd = -1;
+    }
+    close(log_state.wake_fd);
+    log_state.wake_fd = -1;
+}
@@ -0,0 +1,81 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * This file is part of digimend-userspace-drivers.
+ */
+
+/*
+ * Error logging.
+ *
+ * Messages are rate-limited per call site: each site logs at most
+ * LOG_BURST messages per LOG_INTERVAL_NS, and counts the rest as
+ * suppressed, reporting the count with the next message it logs.
+ *
+ * By default, messages are written to stderr at once. Once log_start()
+ * is called, they're formatted into a preallocated ring instead, without
+ * blocking or locking, and written to stderr, or the systemd journal, by
+ * a logging thread, so an error storm costs the thread reporting it no
+ * more than formatting the messages. Messages not fitting into the ring
+ * are dropped and counted.
+ */
+
+#ifndef _LOG_H
+#define _LOG_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/** Maximum number of messages logged per call site in an interval */
+#define LOG_BURST           10
+
+/** Rate-limiting interval, nanoseconds */
+#define LOG_INTERVAL_NS     1000000000
+
+/** Number of messages in the log ring, a power of two */
+#define LOG_RING_LEN        256
+
+/** Maximum length of a message, including the terminating zero */
+#define LOG_TEXT_MAX        256
+
+/** Rate-limiting state of a logging call site, zero-initialized */
+struct log_site {
+    /** Start of the current interval, nanoseconds */
+    _Atomic uint64_t start_ns;
+    /** Number of messages in the current interval */
+    _Atomic uint32_t count;
+    /** Number of messages suppressed since the last one logged */
+    _Atomic uint64_t suppressed;
+};
+
+/**
+ * Log an error message from a call site, unless its rate is exceeded.
+ * Keeps errno.
+ *
+ * @param site  The call site state.
+ * @param fmt   The message format, without the trailing newline.
+ * @param ...   The format arguments.
+ */
+extern void log_error(struct log_site *site, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+
+/**
+ * Start logging asynchronously, from a thread writing out the messages,
+ * with all signals blocked. Call before switching to real-time execution,
+ * so the logging thread keeps the normal scheduling and CPU affinity.
+ *
+ * @param journal   True to write the messages to the systemd journal,
+ *                  false to write them to stderr.
+ *
+ * @return True if started, false otherwise, with errno set appropriately.
+ */
+extern bool log_start(bool journal);
+
+/**
+ * Stop the logging thread, once it writes out all the queued messages,
+ * and go back to logging synchronously. Must be called once all threads
+ * logging asynchronously are stopped. Does nothing if not started.
+ */
+extern void log_stop(void);
+
+#endif /* _LOG_H */
@@ -0,0 +1,314 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * This file is part of digimend-userspace-drivers.
+ */
+
+#include "config.h"
+#include "map.h"
+#include "misc.h"
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+/**
+ * Evaluate a coordinate of a cubic Bezier curve from 0 to 1.
+ *
+ * @param p1    The coordinate of the first control point.
+ * @param p2    The coordinate of the second control point.
+ * @param t     The curve parameter, 0-1.
+ *
+ * @return The coordinate at the parameter.
+ */
+static double
+map_bezier_coord(double p1, double p2, double t)
+{
+    double s = 1 - t;
+    return 3 * s * s * t * p1 + 3 * s * t * t * p2 + t * t * t;
+}
+
+/**
+ * Evaluate a cubic Bezier curve from (0, 0) to (1, 1) at an X.
+ *
+ * @param params    The X and Y of the first, and then the second control
+ *                  point, all 0-1, so X grows monotonically.
+ * @param x         The X to evaluate the curve at, 0-1.
+ *
+ * @return The Y of the curve at the X.
+ */
+static double
+map_bezier(const double params[4], double x)
+{
+    double lo = 0;
+    double hi = 1;
+    double t = 0.5;
+    unsigned int i;
+
+    /* Find the curve parameter for the X by bisection */
+    for (i = 0; i < 32; i++) {
+        t = (lo + hi) / 2;
+        if (map_bezier_coord(params[0], params[2], t) < x) {
+            lo = t;
+        } else {
+            hi = t;
+        }
+    }
+    return map_bezier_coord(params[1], params[3], t);
+}
+
+/**
+ * Convert the coefficients of an affine transform to fixed-point,
+ * scaling them to an output range, and rounding the result to nearest.
+ *
+ * @param coefs The coefficients of the input X, Y, and the constant,
+ *              producing the output normalized to 0-1.
+ * @param max   The maximum of the output range.
+ * @param pa    Location for the fixed-point X coefficient.
+ * @param pb    Location for the fixed-point Y coefficient.
+ * @param pc    Location for the fixed-point constant.
+ */
+static void
+map_fixed(const double coefs[3], int32_t max,
+          int64_t *pa, int64_t *pb, int64_t *pc)
+{
+    double scale = (double)max * (1 << MAP_SHIFT);
+
+    *pa = llround(coefs[0] * scale);
+    *pb = llround(coefs[1] * scale);
+    *pc = llround(coefs[2] * scale) + (1 << (MAP_SHIFT - 1));
+}
+
+bool
+map_init(struct map *map, const struct map_config *config,
+         const struct model_axes *axes)
+{
+    const double *params;
+    double left, top, right, bottom;
+    double width, height, ratio;
+    double in;
+    double out;
+    size_t i;
+    /* Normalized coordinates, and their reverses, as affine transforms */
+    double u[3], v[3], ru[3], rv[3];
+    const double *ox;
+    const double *oy;
+
+    assert(map != NULL);
+    assert(config != NULL);
+    assert(axes != NULL);
+    assert(axes->pressure_max < MAP_PRESSURE_NUM);
+
+    params = config->params;
+
+    /* Validate the curve */
+    switch (config->curve) {
+    case MAP_CURVE_LINEAR:
+        break;
+    case MAP_CURVE_GAMMA:
+        if (!(params[0] > 0) || !isfinite(params[0])) {
+            return false;
+        }
+        break;
+    case MAP_CURVE_BEZIER:
+        for (i = 0; i < 4; i++) {
+            if (!(params[i] >= 0 && params[i] <= 1)) {
+                return false;
+            }
+        }
+        break;
+    default:
+        return false;
+    }
+
+    map->x_max = axes->x_max;
+    map->y_max = axes->y_max;
+    map->pressure_max = axes->pressure_max;
+
+    /* Compute the pressure lookup table */
+    for (i = 0; i <= (size_t)axes->pressure_max; i++) {
+        in = (double)i / axes->pressure_max;
+        switch (config->curve) {
+        case MAP_CURVE_GAMMA:
+            out = pow(in, params[0]);
+            break;
+        case MAP_CURVE_BEZIER:
+            out = map_bezier(params, in);
+            break;
+        case MAP_CURVE_LINEAR:
+        default:
+            out = in;
+            break;
+        }
+        map->pressure[i] = (uint16_t)lround(out * axes->pressure_max);
+        /* Never map a press to a lift */
+        if (i > 0 && map->pressure[i] == 0) {
+            map->pressure[i] = 1;
+        }
+    }
+
+    /* Get the active area */
+    if (config->area[0] == 0 && config->area[1] == 0 &&
+        config->area[2] == 0 && config->area[3] == 0) {
+        left = 0;
+        top = 0;
+        right = axes->x_max;
+        bottom = axes->y_max;
+    } else {
+        left = config->area[0];
+        top = config->area[1];
+        right = config->area[2];
+        bottom = config->area[3];
+    }
+    if (left < 0 || top < 0 ||
+        right > axes->x_max || bottom > axes->y_max ||
+        left >= right || top >= bottom) {
+        return false;
+    }
+    width = right - left;
+    height = bottom - top;
+
+    /* Crop the area to the output aspect ratio, as rotated, centered */
+    if (config->aspect[0] != 0 && config->aspect[1] != 0) {
+        ratio = config->rotation == MAP_ROTATION_90 ||
+                config->rotation == MAP_ROTATION_270
+                    ? (double)config->aspect[1] / config->aspect[0]
+                    : (double)config->aspect[0] / config->aspect[1];
+        if (width / height > ratio) {
+            left += (width - height * ratio) / 2;
+            width = height * ratio;
+        } else {
+            top += (height - width / ratio) / 2;
+            height = width / ratio;
+        }
+    }
+
+    /* Compose the transform of input coordinates to normalized outputs */
+    u[0] = 1 / width;
+    u[1] = 0;
+    u[2] = -left / width;
+    v[0] = 0;
+    v[1] = 1 / height;
+    v[2] = -top / height;
+    for (i = 0; i < 3; i++) {
+        ru[i] = -u[i];
+        rv[i] = -v[i];
+    }
+    ru[2] += 1;
+    rv[2] += 1;
+    switch (config->rotation) {
+    case MAP_ROTATION_0:
+        ox = u;
+        oy = v;
+        break;
+    case MAP_ROTATION_90:
+        ox = rv;
+        oy = u;
+        break;
+    case MAP_ROTATION_180:
+        ox = ru;
+        oy = rv;
+        break;
+    case MAP_ROTATION_270:
+        ox = v;
+        oy = ru;
+        break;
+    default:
+        return false;
+    }
+    map_fixed(ox, axes->x_max, &map->xx, &map->xy, &map->xc);
+    map_fixed(oy, axes->y_max, &map->yx, &map->yy, &map->yc);
+
+    /* Rotate the tilt along, the signs of the coefficients are enough */
+    map->txx = (ox[0] > 0) - (ox[0] < 0);
+    map->txy = (ox[1] > 0) - (ox[1] < 0);
+    map->tyx = (oy[0] > 0) - (oy[0] < 0);
+    map->tyy = (oy[1] > 0) - (oy[1] < 0);
+
+    return true;
+}
+
+bool
+map_parse_curve(struct map_config *config, const char *str)
+{
+    double *params = config->params;
+    int len = -1;
+    size_t i;
+
+    assert(config != NULL);
+    assert(str != NULL);
+
+    if (strcmp(str, "linear") == 0) {
+        config->curve = MAP_CURVE_LINEAR;
+        return true;
+    }
+    if (sscanf(str, "gamma:%lf%n", &params[0], &len) == 1 &&
+        str[len] == '\0') {
+        config->curve = MAP_CURVE_GAMMA;
+        return params[0] > 0 && isfinite(params[0]);
+    }
+    if (sscanf(str, "bezier:%lf,%lf,%lf,%lf%n",
+               &params[0], &params[1], &params[2], &params[3],
+               &len) == 4 &&
+        str[len] == '\0') {
+        config->curve = MAP_CURVE_BEZIER;
+        for (i = 0; i < 4; i++) {
+            if (!(params[i] >= 0 && params[i] <= 1)) {
+                return false;
+            }
+        }
+        return true;
+    }
+    return false;
+}
+
+bool
+map_parse_area(struct map_config *config, const char *str)
+{
+    int32_t *area = config->area;
+    int len = -1;
+
+    assert(config != NULL);
+    assert(str != NULL);
+
+    return sscanf(str, "%d,%d,%d,%d%n",
+                  &area[0], &area[1], &area[2], &area[3], &len) == 4 &&
+           str[len] == '\0' && area[0] >= 0 && area[1] >= 0 &&
+           area[0] < area[2] && area[1] < area[3];
+}
+
+bool
+map_parse_aspect(struct map_config *config, const char *str)
+{
+    uint32_t *aspect = config->aspect;
+    int len = -1;
+
+    assert(config != NULL);
+    assert(str != NULL);
+
+    return sscanf(str, "%u:%u%n", &aspect[0], &aspect[1], &len) == 2 &&
+           str[len] == '\0' && aspect[0] != 0 && aspect[1] != 0;
+}
+
+bool
+map_parse_rotation(struct map_config *config, const char *str)
+{
+    static const char *names[] = {
+        [MAP_ROTATION_0] = "0",
+        [MAP_ROTATION_90] = "90",
+        [MAP_ROTATION_180] = "180",
+        [MAP_ROTATION_270] = "270",
+    };
+    size_t i;
+
+    assert(config != NULL);
+    assert(str != NULL);
+
+    for (i = 0; i < ARRAY_SIZE(names); i++) {
+        if (strcmp(str, names[i]) == 0) {
+            config->rotation = (enum map_rotation)i;
+            return true;
+        }
+    }
+    return false;
+}
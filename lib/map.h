@@ -0,0 +1,207 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * This file is part of digimend-userspace-drivers.
+ */
+
+/*
+ * Pen value mapping.
+ *
+ * Remaps pen pressure along a curve, and pen coordinates from an active
+ * area of the tablet to the whole output range, optionally rotated, along
+ * with the tilt. All the mapping is precomputed, into a pressure lookup
+ * table, and fixed-point coefficients of an affine coordinate transform,
+ * so applying it takes no floating point and no branches.
+ */
+
+#ifndef _MAP_H
+#define _MAP_H
+
+#include "model.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/** Number of pressure lookup table entries, covering any pressure range */
+#define MAP_PRESSURE_NUM    (MODEL_PRESSURE_MAX + 1)
+
+/** Number of fractional bits of the coordinate transform coefficients */
+#define MAP_SHIFT           16
+
+/** A pressure curve kind */
+enum map_curve {
+    /** Linear: pressure is kept as is */
+    MAP_CURVE_LINEAR,
+    /** Power: output = input ^ gamma, normalized */
+    MAP_CURVE_GAMMA,
+    /**
+     * Cubic Bezier from (0, 0) to (1, 1), with two control points,
+     * normalized
+     */
+    MAP_CURVE_BEZIER,
+};
+
+/** Clockwise rotation of the tablet, as held by the user */
+enum map_rotation {
+    MAP_ROTATION_0,
+    MAP_ROTATION_90,
+    MAP_ROTATION_180,
+    MAP_ROTATION_270,
+};
+
+/** Mapping configuration */
+struct map_config {
+    /** The pressure curve kind */
+    enum map_curve curve;
+    /**
+     * The curve parameters: the exponent for MAP_CURVE_GAMMA, the X and
+     * Y of the first, and then the second control point for
+     * MAP_CURVE_BEZIER, all 0-1
+     */
+    double params[4];
+    /**
+     * The active area, in input coordinates: left, top, right, and
+     * bottom, or all zeroes for the whole tablet
+     */
+    int32_t area[4];
+    /**
+     * The width and height ratio of the output to crop the active area
+     * to, centered, or zeroes to keep the active area as is
+     */
+    uint32_t aspect[2];
+    /** The tablet rotation */
+    enum map_rotation rotation;
+};
+
+/** A precomputed mapping */
+struct map {
+    /** Pressure lookup table, output pressure for each input one */
+    uint16_t pressure[MAP_PRESSURE_NUM];
+    /** Maximum of the X axis */
+    int32_t x_max;
+    /** Maximum of the Y axis */
+    int32_t y_max;
+    /** Maximum of the pressure axis */
+    int32_t pressure_max;
+    /**
+     * Coordinate transform coefficients, fixed-point with MAP_SHIFT
+     * fractional bits: out_x = (x * xx + y * xy + xc) >> MAP_SHIFT,
+     * out_y = (x * yx + y * yy + yc) >> MAP_SHIFT
+     */
+    int64_t xx, xy, xc;
+    int64_t yx, yy, yc;
+    /**
+     * Tilt rotation coefficients, -1, 0, or 1:
+     * out_tilt_x = tilt_x * txx + tilt_y * txy,
+     * out_tilt_y = tilt_x * tyx + tilt_y * tyy
+     */
+    int32_t txx, txy;
+    int32_t tyx, tyy;
+};
+
+/**
+ * Precompute a mapping from its configuration, for a pen's axes.
+ *
+ * @param map       The mapping to initialize.
+ * @param config    The configuration to precompute.
+ * @param axes      The pen axis capabilities, both of input and output.
+ *
+ * @return True if the mapping was initialized, false if the
+ *         configuration is invalid, or doesn't fit the axes.
+ */
+extern bool map_init(struct map *map, const struct map_config *config,
+                     const struct model_axes *axes);
+
+/**
+ * Parse a pressure curve specification into a mapping configuration:
+ * "linear", "gamma:G", or "bezier:X1,Y1,X2,Y2".
+ *
+ * @param config    The configuration to parse the curve into.
+ * @param str       The specification to parse.
+ *
+ * @return True if parsed successfully, false if the specification is
+ *         invalid.
+ */
+extern bool map_parse_curve(struct map_config *config, const char *str);
+
+/**
+ * Parse an active area specification into a mapping configuration:
+ * "LEFT,TOP,RIGHT,BOTTOM", in input coordinates. Whether the area fits
+ * the pen's axes is only checked by map_init().
+ *
+ * @param config    The configuration to parse the area into.
+ * @param str       The specification to parse.
+ *
+ * @return True if parsed successfully, false if the specification is
+ *         invalid.
+ */
+extern bool map_parse_area(struct map_config *config, const char *str);
+
+/**
+ * Parse an output aspect ratio specification into a mapping
+ * configuration: "WIDTH:HEIGHT".
+ *
+ * @param config    The configuration to parse the aspect ratio into.
+ * @param str       The specification to parse.
+ *
+ * @return True if parsed successfully, false if the specification is
+ *         invalid.
+ */
+extern bool map_parse_aspect(struct map_config *config, const char *str);
+
+/**
+ * Parse a rotation specification into a mapping configuration:
+ * "0", "90", "180", or "270" degrees clockwise.
+ *
+ * @param config    The configuration to parse the rotation into.
+ * @param str       The specification to parse.
+ *
+ * @return True if parsed successfully, false if the specification is
+ *         invalid.
+ */
+extern bool map_parse_rotation(struct map_config *config, const char *str);
+
+/**
+ * Clamp a value to a range, without branching.
+ *
+ * @param value The value to clamp.
+ * @param max   The maximum of the range, the minimum is zero.
+ *
+ * @return The clamped value.
+ */
+static inline int32_t
+map_clamp(int64_t value, int32_t max)
+{
+    value = value < 0 ? 0 : value;
+    value = value > max ? max : value;
+    return (int32_t)value;
+}
+
+/**
+ * Apply a mapping to pen values.
+ *
+ * @param map       The mapping to apply.
+ * @param x         Location of the X coordinate to map.
+ * @param y         Location of the Y coordinate to map.
+ * @param pressure  Location of the pressure to map.
+ * @param tilt_x    Location of the X tilt to map.
+ * @param tilt_y    Location of the Y tilt to map.
+ */
+static inline void
+map_apply(const struct map *map, int32_t *x, int32_t *y, int32_t *pressure,
+          int32_t *tilt_x, int32_t *tilt_y)
+{
+    int64_t in_x = *x;
+    int64_t in_y = *y;
+    int32_t in_tilt_x = *tilt_x;
+    int32_t in_tilt_y = *tilt_y;
+
+    *x = map_clamp((in_x * map->xx + in_y * map->xy + map->xc) >> MAP_SHIFT,
+                   map->x_max);
+    *y = map_clamp((in_x * map->yx + in_y * map->yy + map->yc) >> MAP_SHIFT,
+                   map->y_max);
+    *pressure = map->pressure[map_clamp(*pressure, map->pressure_max)];
+    *tilt_x = in_tilt_x * map->txx + in_tilt_y * map->txy;
+    *tilt_y = in_tilt_x * map->tyx + in_tilt_y * map->tyy;
+}
+
+#endif /* _MAP_H */
@@ -0,0 +1,91 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * This file is part of digimend-userspace-drivers.
+ */
+
+/* Miscellaneous definitions shared by the library and the programs */
+
+#ifndef _MISC_H
+#define _MISC_H
+
+#include "log.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+/** Get the number of elements in an array */
+#define ARRAY_SIZE(_array) (sizeof(_array) / sizeof((_array)[0]))
+
+/**
+ * Log an error message, rate-limited per expansion site, see log.h.
+ */
+#define GENERIC_ERROR(_fmt, _args...) \
+    do {                                        \
+        static struct log_site _log_site;       \
+        log_error(&_log_site, _fmt, ##_args);   \
+    } while (0)
+
+#define GENERIC_FAILURE(_fmt, _args...) \
+    GENERIC_ERROR("Failed to " _fmt, ##_args)
+
+#define LIBUSB_FAILURE(_err, _fmt, _args...) \
+    GENERIC_FAILURE(_fmt ": %s", ##_args, libusb_strerror(_err))
+
+#define LIBC_FAILURE(_errno, _fmt, _args...) \
+    GENERIC_FAILURE(_fmt ": %s", ##_args, strerror(_errno))
+
+#define ERROR_CLEANUP(_fmt, _args...) \
+    do {                                \
+        GENERIC_ERROR(_fmt, ##_args);   \
+        goto cleanup;                   \
+    } while (0)
+
+#define FAILURE_CLEANUP(_fmt, _args...) \
+    do {                                \
+        GENERIC_FAILURE(_fmt, ##_args); \
+        goto cleanup;                   \
+    } while (0)
+
+#define LIBUSB_FAILURE_CLEANUP(_err, _fmt, _args...) \
+    do {                                                \
+        LIBUSB_FAILURE(_err, _fmt, ##_args);            \
+        goto cleanup;                                   \
+    } while (0)
+
+#define LIBC_FAILURE_CLEANUP(_errno, _fmt, _args...) \
+    do {                                                \
+        LIBC_FAILURE(_errno, _fmt, ##_args);            \
+        goto cleanup;                                   \
+    } while (0)
+
+#define LIBUSB_GUARD(_expr, _fmt, _args...) \
+    do {                                                    \
+        enum libusb_error _err = _expr;                     \
+        if (_err != LIBUSB_SUCCESS)                         \
+            LIBUSB_FAILURE_CLEANUP(_err, _fmt, ##_args);    \
+    } while (0)
+
+#define LIBC_GUARD(_expr, _fmt, _args...) \
+    do {                                                \
+        int _rc = _expr;                                \
+        if (_rc < 0)                                    \
+            LIBC_FAILURE_CLEANUP(errno, _fmt, ##_args); \
+    } while (0)
+
+/**
+ * Get the current monotonic time.
+ *
+ * @return The monotonic time, nanoseconds.
+ */
+static inline uint64_t
+clock_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+#endif /* _MISC_H */
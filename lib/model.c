@@ -0,0 +1,183 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * This file is part of digimend-userspace-drivers.
+ */
+
+#include "config.h"
+#include "model.h"
+#include "misc.h"
+#include <assert.h>
+
+/** Default pen axes of Huion v2 tablets, as an initializer */
+#define MODEL_HUION_V2_AXES { \
+    .x_max = 50800,         \
+    .y_max = 31750,         \
+    .resolution = 200,      \
+    .pressure_max = 8191,   \
+}
+
+const struct model_axes model_huion_v2_axes = MODEL_HUION_V2_AXES;
+
+/** Length of the Huion v2 parameters string descriptor */
+#define MODEL_HUION_V2_PARAMS_LEN   18
+
+/** Index of the parameters step in model_huion_v2_init */
+#define MODEL_HUION_V2_INIT_PARAMS  0
+
+/** Index of the report descriptor step in model_huion_v2_init */
+#define MODEL_HUION_V2_INIT_RDESC   5
+
+/**
+ * Initialization control transfers of Huion v2 tablets, in the order
+ * they're queued on the default control endpoint.
+ */
+static const struct model_init_step model_huion_v2_init[] = {
+    [MODEL_HUION_V2_INIT_PARAMS] = {
+        /* Reading the string enables the proprietary mode */
+        .desc = "get configuration string descriptor",
+        /* device->host, standard, device */
+        .request_type = 0x80,
+        /* Get_Descriptor */
+        .request = 0x06,
+        /* String descriptor 0xc8 */
+        .value = (0x03 << 8) | 0xc8,
+        /* LANGID, English (United States) */
+        .index = 0x0409,
+        .length = 64,
+    },
+    {
+        .desc = "set report protocol on interface 0",
+        /* host->device, class, interface */
+        .request_type = 0x21,
+        /* Set_Protocol */
+        .request = 0x0B,
+        /* 0 - boot, 1 - report */
+        .value = 1,
+        .index = 0,
+        .stall_ok = true,
+    },
+    {
+        .desc = "set report protocol on interface 1",
+        .request_type = 0x21,
+        .request = 0x0B,
+        .value = 1,
+        .index = 1,
+        .stall_ok = true,
+    },
+    {
+        .desc = "set infinite idle on interface 0",
+        .request_type = 0x21,
+        /* Set_Idle */
+        .request = 0x0A,
+        /* duration for all report IDs */
+        .value = 0 << 8,
+        .index = 0,
+        .stall_ok = true,
+    },
+    {
+        .desc = "set infinite idle on interface 1",
+        .request_type = 0x21,
+        .request = 0x0A,
+        .value = 0 << 8,
+        .index = 1,
+        .stall_ok = true,
+    },
+    [MODEL_HUION_V2_INIT_RDESC] = {
+        /* Decoding falls back to the built-in descriptor without it */
+        .desc = "get report descriptor of interface 0",
+        /* device->host, standard, interface */
+        .request_type = 0x81,
+        /* Get_Descriptor */
+        .request = 0x06,
+        /* Report descriptor, index 0 */
+        .value = 0x22 << 8,
+        .index = 0,
+        .length = 4096,
+        .optional = true,
+    },
+};
+
+/** The supported models */
+static const struct model model_table[] = {
+    {
+        .name = "Huion Tablet",
+        .vendor = 0x256c,
+        .product = 0x006d,
+        .iface_num = 2,
+        .endpoint = 0x81,
+        .report_size = 0x40,
+        .init = model_huion_v2_init,
+        .init_num = ARRAY_SIZE(model_huion_v2_init),
+        .init_params = MODEL_HUION_V2_INIT_PARAMS,
+        .init_rdesc = MODEL_HUION_V2_INIT_RDESC,
+        .decoder_init = decoder_init_huion_v2,
+        .axes = MODEL_HUION_V2_AXES,
+        /* Pose as 056a:0314 Wacom Co., Ltd PTH-451 [Intuos pro (S)] */
+        .pose_vendor = 0x056a,
+        .pose_product = 0x0314,
+        .pose_version = 0x0110,
+        .pose_pen_name = "Wacom Intuos Pro S Pen",
+        .pose_pad_name = "Wacom Intuos Pro S Pad",
+    },
+};
+
+const struct model *
+model_find(uint16_t vendor, uint16_t product)
+{
+    size_t i;
+
+    for (i = 0; i < ARRAY_SIZE(model_table); i++) {
+        assert(model_table[i].init_num <= MODEL_INIT_MAX);
+        assert(model_table[i].init_rdesc == model_table[i].init_num - 1);
+        if (model_table[i].vendor == vendor &&
+            model_table[i].product == product) {
+            return &model_table[i];
+        }
+    }
+    return NULL;
+}
+
+bool
+model_parse_params(struct model_axes *axes, const uint8_t *buf, size_t len)
+{
+    struct model_axes parsed;
+    size_t i;
+
+    assert(axes != NULL);
+    assert(buf != NULL || len == 0);
+
+    /* Check it's a string descriptor long enough */
+    if (len < MODEL_HUION_V2_PARAMS_LEN || buf[1] != 0x03) {
+        return false;
+    }
+    /*
+     * Check it's not a UTF-16LE-encoded ASCII string, which some
+     * firmware returns for any unknown string descriptor
+     */
+    for (i = 3; i < MODEL_HUION_V2_PARAMS_LEN && buf[i] == 0; i += 2);
+    if (i >= MODEL_HUION_V2_PARAMS_LEN) {
+        return false;
+    }
+
+    /* Little-endian, 24-bit X and Y maximums, 16-bit pressure maximum */
+    parsed.x_max = buf[2] | (buf[3] << 8) | (buf[4] << 16);
+    parsed.y_max = buf[5] | (buf[6] << 8) | (buf[7] << 16);
+    parsed.pressure_max = buf[8] | (buf[9] << 8);
+    /* Resolution, units per inch, or zero if unknown */
+    parsed.resolution = buf[10] | (buf[11] << 8);
+    parsed.resolution = parsed.resolution == 0
+                            ? axes->resolution
+                            : (parsed.resolution * 10 + 127) / 254;
+
+    /* Only accept the ranges the outputs can carry */
+    if (parsed.x_max <= 0 || parsed.x_max > 0xffff ||
+        parsed.y_max <= 0 || parsed.y_max > 0xffff ||
+        parsed.pressure_max <= 0 ||
+        parsed.pressure_max > MODEL_PRESSURE_MAX ||
+        parsed.resolution <= 0) {
+        return false;
+    }
+    *axes = parsed;
+    return true;
+}
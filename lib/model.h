@@ -0,0 +1,159 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * This file is part of digimend-userspace-drivers.
+ */
+
+/*
+ * Supported tablet models.
+ *
+ * A compile-time table of the tablet models, describing everything
+ * differing between them: the USB IDs to match, the interfaces to take
+ * over and the endpoint to read, the control transfers enabling their
+ * proprietary reports, the function initializing their report decoder,
+ * and their pen axis capabilities. A tablet is matched against the table
+ * once, on arrival, so the per-report path never looks at the model.
+ */
+
+#ifndef _MODEL_H
+#define _MODEL_H
+
+#include "decoder.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/** Maximum number of initialization control transfers of a model */
+#define MODEL_INIT_MAX  8
+
+/** Maximum of the pen's pressure axis of any model */
+#define MODEL_PRESSURE_MAX  8191
+
+/** Maximum absolute value of the pen's tilt axes, degrees */
+#define MODEL_TILT_MAX      60
+
+/** Maximum of the pad's wheel axis */
+#define MODEL_WHEEL_MAX     71
+
+/** Pen axis capabilities */
+struct model_axes {
+    /** Maximum of the X axis, up to 65535, the minimum is zero */
+    int32_t x_max;
+    /** Maximum of the Y axis, up to 65535, the minimum is zero */
+    int32_t y_max;
+    /** Resolution of the X and Y axes, units per mm */
+    int32_t resolution;
+    /** Maximum of the pressure axis, up to MODEL_PRESSURE_MAX */
+    int32_t pressure_max;
+};
+
+/** Default pen axes of Huion v2 tablets, until read from parameters */
+extern const struct model_axes model_huion_v2_axes;
+
+/** An initialization control transfer of a tablet */
+struct model_init_step {
+    /** Description of the transfer, for messages */
+    const char *desc;
+    /** The bmRequestType field of the setup packet */
+    uint8_t request_type;
+    /** The bRequest field of the setup packet */
+    uint8_t request;
+    /** The wValue field of the setup packet */
+    uint16_t value;
+    /** The wIndex field of the setup packet */
+    uint16_t index;
+    /** The wLength field of the setup packet */
+    uint16_t length;
+    /** True if the request can stall, as unsupported by some devices */
+    bool stall_ok;
+    /** True if the request can fail altogether */
+    bool optional;
+};
+
+/**
+ * Decoder initialization function prototype.
+ *
+ * @param decoder   The decoder to initialize.
+ * @param desc      The report descriptor of the tablet's interface 0, or
+ *                  NULL if unknown.
+ * @param len       The length of the report descriptor.
+ *
+ * @return True if initialized successfully, false otherwise.
+ */
+typedef bool (*model_decoder_init_fn)(struct decoder *decoder,
+                                      const uint8_t *desc, size_t len);
+
+/** A tablet model */
+struct model {
+    /** Name of the model, for messages and uhid devices */
+    const char *name;
+    /** USB vendor ID */
+    uint16_t vendor;
+    /** USB product ID */
+    uint16_t product;
+    /** Number of interfaces to take over, starting with interface 0 */
+    uint8_t iface_num;
+    /** Address of the interrupt IN endpoint delivering the reports */
+    uint8_t endpoint;
+    /** Maximum size of a report on the endpoint */
+    uint16_t report_size;
+    /**
+     * Initialization control transfers, queued in this order, switching
+     * the tablet to its proprietary reports
+     */
+    const struct model_init_step *init;
+    /** Number of initialization control transfers */
+    size_t init_num;
+    /**
+     * Index of the transfer retrieving the parameters string descriptor,
+     * which could override the axis capabilities
+     */
+    size_t init_params;
+    /**
+     * Index of the transfer retrieving the report descriptor, the last
+     * one, skipped when the decoder is kept across replugs
+     */
+    size_t init_rdesc;
+    /** The decoder initialization function */
+    model_decoder_init_fn decoder_init;
+    /** Pen axis capabilities, unless overridden by the parameters */
+    struct model_axes axes;
+    /** USB vendor ID to pose as with uinput devices */
+    uint16_t pose_vendor;
+    /** USB product ID to pose as with uinput devices */
+    uint16_t pose_product;
+    /** Device version to pose as with uinput devices */
+    uint16_t pose_version;
+    /** Name of the uinput pen device */
+    const char *pose_pen_name;
+    /** Name of the uinput pad device */
+    const char *pose_pad_name;
+};
+
+/**
+ * Find the model of a USB device.
+ *
+ * @param vendor    The device's vendor ID.
+ * @param product   The device's product ID.
+ *
+ * @return The model, or NULL if the device is not supported.
+ */
+extern const struct model *model_find(uint16_t vendor, uint16_t product);
+
+/**
+ * Parse the pen axis capabilities out of a parameters string descriptor
+ * retrieved from a tablet.
+ *
+ * @param axes  The axis capabilities to override with the parsed ones,
+ *              only if they're all valid. The resolution is kept, if the
+ *              parameters don't specify it.
+ * @param buf   The string descriptor, including its header.
+ * @param len   The length of the string descriptor.
+ *
+ * @return True if the axes were parsed, false if the descriptor doesn't
+ *         contain valid parameters.
+ */
+extern bool model_parse_params(struct model_axes *axes,
+                               const uint8_t *buf, size_t len);
+
+#endif /* _MODEL_H */
@@ -0,0 +1,113 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * This file is part of digimend-userspace-drivers.
+ */
+
+#include "config.h"
+#include "predict.h"
+#include "model.h"
+#include <assert.h>
+#include <string.h>
+
+/** Weight of the latest sample's velocity in the smoothed velocity */
+#define PREDICT_ALPHA           0.5
+
+/** Maximum time between samples to estimate velocity over, nanoseconds */
+#define PREDICT_MAX_GAP_NS      50000000
+
+void
+predictor_init(struct predictor *predictor, const struct model_axes *axes,
+               uint64_t horizon_ns, bool pressure)
+{
+    assert(predictor != NULL);
+    assert(axes != NULL);
+    assert(horizon_ns <= PREDICT_MAX_HORIZON_NS);
+
+    memset(predictor, 0, sizeof(*predictor));
+    predictor->horizon_ns = horizon_ns;
+    predictor->num = pressure ? PREDICT_AXIS_NUM : PREDICT_AXIS_PRESSURE;
+    predictor->max[PREDICT_AXIS_X] = axes->x_max;
+    predictor->max[PREDICT_AXIS_Y] = axes->y_max;
+    predictor->max[PREDICT_AXIS_PRESSURE] = axes->pressure_max;
+}
+
+void
+predictor_reset(struct predictor *predictor)
+{
+    assert(predictor != NULL);
+    predictor->samples = 0;
+}
+
+void
+predictor_apply(struct predictor *predictor, uint64_t ts,
+                bool in_range, bool touching,
+                int32_t values[PREDICT_AXIS_NUM])
+{
+    unsigned int i;
+    uint64_t dt;
+    double velocity;
+    double value;
+    int32_t min;
+
+    assert(predictor != NULL);
+    assert(values != NULL);
+
+    /* Start over on proximity and touch transitions, and after gaps */
+    if (!in_range) {
+        predictor->samples = 0;
+        return;
+    }
+    dt = ts - predictor->ts;
+    if (predictor->samples > 0 &&
+        (touching != predictor->touching ||
+         ts < predictor->ts || dt > PREDICT_MAX_GAP_NS)) {
+        predictor->samples = 0;
+    }
+    predictor->touching = touching;
+
+    /* Update the velocity estimate, unless the sample is a duplicate */
+    if (predictor->samples == 0 || dt != 0) {
+        for (i = 0; i < predictor->num; i++) {
+            if (predictor->samples > 0) {
+                velocity = (double)(values[i] - predictor->last[i]) /
+                           (double)dt;
+                predictor->velocity[i] =
+                    predictor->samples == 1
+                        ? velocity
+                        : PREDICT_ALPHA * velocity +
+                          (1 - PREDICT_ALPHA) * predictor->velocity[i];
+            }
+            predictor->last[i] = values[i];
+        }
+        predictor->ts = ts;
+        if (predictor->samples < 2) {
+            predictor->samples++;
+        }
+    }
+    if (predictor->samples < 2) {
+        return;
+    }
+
+    /* Extrapolate, and clamp to the axis limits */
+    for (i = 0; i < predictor->num; i++) {
+        /* Only predict pressure in contact, and never down to a lift */
+        if (i == PREDICT_AXIS_PRESSURE) {
+            if (!touching || values[i] == 0) {
+                continue;
+            }
+            min = 1;
+        } else {
+            min = 0;
+        }
+        value = (double)values[i] +
+                predictor->velocity[i] * (double)predictor->horizon_ns;
+        if (value < min) {
+            values[i] = min;
+        } else if (value > predictor->max[i]) {
+            values[i] = predictor->max[i];
+        } else {
+            values[i] = (int32_t)(value + 0.5);
+        }
+    }
+}
@@ -0,0 +1,100 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * This file is part of digimend-userspace-drivers.
+ */
+
+/*
+ * Pen motion prediction.
+ *
+ * Extrapolates pen coordinates, and optionally pressure, a fixed time
+ * ahead, assuming constant velocity. The velocity is estimated from
+ * consecutive samples, exponentially smoothed to suppress sensor noise.
+ * The estimate is reset whenever the pen leaves proximity, or its tip
+ * touches or leaves the surface, as motion before those is no indication
+ * of motion after.
+ */
+
+#ifndef _PREDICT_H
+#define _PREDICT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct model_axes;
+
+/** A predicted axis */
+enum predict_axis {
+    /** Pen X coordinate */
+    PREDICT_AXIS_X,
+    /** Pen Y coordinate */
+    PREDICT_AXIS_Y,
+    /** Pen pressure */
+    PREDICT_AXIS_PRESSURE,
+    /** Number of axes (not a valid axis) */
+    PREDICT_AXIS_NUM
+};
+
+/** Maximum prediction horizon, nanoseconds */
+#define PREDICT_MAX_HORIZON_NS  100000000
+
+/** A pen motion predictor */
+struct predictor {
+    /** Time to predict ahead, nanoseconds, zero if disabled */
+    uint64_t horizon_ns;
+    /** Number of axes to predict, starting with PREDICT_AXIS_X */
+    unsigned int num;
+    /** Maximum value of each axis, the minimum is zero */
+    int32_t max[PREDICT_AXIS_NUM];
+    /** Number of samples since the last reset, saturated at 2 */
+    unsigned int samples;
+    /** True if the pen tip touched the surface at the last sample */
+    bool touching;
+    /** Time of the last sample, nanoseconds */
+    uint64_t ts;
+    /** Axis values of the last sample */
+    int32_t last[PREDICT_AXIS_NUM];
+    /** Smoothed axis velocities, units per nanosecond */
+    double velocity[PREDICT_AXIS_NUM];
+};
+
+/**
+ * Initialize a predictor.
+ *
+ * @param predictor     The predictor to initialize.
+ * @param axes          The pen axis capabilities, to clamp predictions to.
+ * @param horizon_ns    The time to predict ahead, nanoseconds, up to
+ *                      PREDICT_MAX_HORIZON_NS, or zero to disable
+ *                      prediction.
+ * @param pressure      True if pressure should be predicted, in addition
+ *                      to coordinates.
+ */
+extern void predictor_init(struct predictor *predictor,
+                           const struct model_axes *axes,
+                           uint64_t horizon_ns, bool pressure);
+
+/**
+ * Forget the motion seen by a predictor.
+ *
+ * @param predictor The predictor to reset.
+ */
+extern void predictor_reset(struct predictor *predictor);
+
+/**
+ * Feed a pen sample to a predictor, and replace its axis values with the
+ * ones predicted for the horizon, clamped to the axis limits. Values are
+ * left as is until the velocity is known, i.e. for the first sample
+ * after a reset.
+ *
+ * @param predictor The predictor to feed the sample to.
+ * @param ts        The sample time, nanoseconds.
+ * @param in_range  True if the pen is in proximity.
+ * @param touching  True if the pen tip touches the surface.
+ * @param values    The sample axis values to replace with the predicted
+ *                  ones, indexed by enum predict_axis.
+ */
+extern void predictor_apply(struct predictor *predictor, uint64_t ts,
+                            bool in_range, bool touching,
+                            int32_t values[PREDICT_AXIS_NUM]);
+
+#endif /* _PREDICT_H */
@@ -0,0 +1,45 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * This file is part of digimend-userspace-drivers.
+ */
+
+/*
+ * Static tracepoints.
+ *
+ * USDT probes of the "dud" provider, for perf and bpftrace to attach to
+ * without rebuilding, e.g.:
+ *
+ *      bpftrace -e 'usdt:./dud-translate:dud:report { @[arg0] = count(); }'
+ *
+ * A probe is a single nop instruction, with its arguments left where the
+ * tracer can find them, and expands to nothing, with the arguments not
+ * evaluated, unless configured with --enable-usdt.
+ */
+
+#ifndef _PROBE_H
+#define _PROBE_H
+
+#ifdef ENABLE_USDT
+
+#include <sys/sdt.h>
+
+/** Fire a probe with one argument */
+#define PROBE1(_name, _arg1) \
+    DTRACE_PROBE1(dud, _name, _arg1)
+
+/** Fire a probe with two arguments */
+#define PROBE2(_name, _arg1, _arg2) \
+    DTRACE_PROBE2(dud, _name, _arg1, _arg2)
+
+#else /* ! ENABLE_USDT */
+
+#define PROBE1(_name, _arg1) \
+    do {} while (0)
+
+#define PROBE2(_name, _arg1, _arg2) \
+    do {} while (0)
+
+#endif /* ! ENABLE_USDT */
+
+#endif /* _PROBE_H */
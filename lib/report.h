@@ -0,0 +1,81 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * This file is part of digimend-userspace-drivers.
+ */
+
+/* Decoded tablet reports */
+
+#ifndef _REPORT_H
+#define _REPORT_H
+
+#include <stdint.h>
+
+/** Kind of a decoded report */
+enum report_kind {
+    /** Pen report */
+    REPORT_KIND_PEN,
+    /** Frame (pad) button report */
+    REPORT_KIND_PAD_BUTTONS,
+    /** Touch dial report */
+    REPORT_KIND_PAD_DIAL,
+    /** Number of report kinds */
+    REPORT_KIND_NUM
+};
+
+/**
+ * Get the name of a report kind.
+ *
+ * @param kind  The report kind to get the name of.
+ *
+ * @return The report kind name.
+ */
+static inline const char *
+report_kind_name(enum report_kind kind)
+{
+    switch (kind) {
+    case REPORT_KIND_PEN:
+        return "pen";
+    case REPORT_KIND_PAD_BUTTONS:
+        return "buttons";
+    case REPORT_KIND_PAD_DIAL:
+        return "dial";
+    case REPORT_KIND_NUM:
+    default:
+        return "unknown";
+    }
+}
+
+/** A field of a decoded report */
+enum report_field {
+    /** Pen in range, 0 or 1 */
+    REPORT_FIELD_IN_RANGE,
+    /** Pen X coordinate */
+    REPORT_FIELD_X,
+    /** Pen Y coordinate */
+    REPORT_FIELD_Y,
+    /** Pen pressure */
+    REPORT_FIELD_PRESSURE,
+    /** Pen X tilt, degrees */
+    REPORT_FIELD_TILT_X,
+    /** Pen Y tilt, degrees */
+    REPORT_FIELD_TILT_Y,
+    /** Pen button bitmap: tip, barrel, and secondary barrel switches */
+    REPORT_FIELD_PEN_BUTTONS,
+    /** Pad button bitmap */
+    REPORT_FIELD_PAD_BUTTONS,
+    /** Touch dial position, 1-12, or 0 if not touched */
+    REPORT_FIELD_DIAL,
+    /** Number of fields (not a valid field) */
+    REPORT_FIELD_NUM
+};
+
+/** A decoded report */
+struct report {
+    /** Report kind */
+    enum report_kind kind;
+    /** Field values, only the ones relevant to the kind are valid */
+    int32_t values[REPORT_FIELD_NUM];
+};
+
+#endif /* _REPORT_H */
@@ -0,0 +1,94 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * This file is part of digimend-userspace-drivers.
+ */
+
+#include "config.h"
+#include "sink.h"
+#include <string.h>
+#include <unistd.h>
+#include <linux/input.h>
+
+static ssize_t
+sink_fd_write(struct sink *sink, const void *buf, size_t len)
+{
+    struct sink_fd *sink_fd = (struct sink_fd *)sink;
+    return write(sink_fd->fd, buf, len);
+}
+
+struct sink *
+sink_fd_init(struct sink_fd *sink_fd, int fd)
+{
+    assert(sink_fd != NULL);
+    assert(fd >= 0);
+    sink_fd->sink.write = sink_fd_write;
+    sink_fd->fd = fd;
+    return &sink_fd->sink;
+}
+
+static ssize_t
+sink_mem_write(struct sink *sink, const void *buf, size_t len)
+{
+    struct sink_mem *sink_mem = (struct sink_mem *)sink;
+    const uint8_t *ptr = buf;
+    size_t left = len;
+    size_t chunk;
+
+    while (left > 0) {
+        chunk = sink_mem->size - sink_mem->pos;
+        if (chunk > left) {
+            chunk = left;
+        }
+        memcpy(sink_mem->buf + sink_mem->pos, ptr, chunk);
+        sink_mem->pos = (sink_mem->pos + chunk) % sink_mem->size;
+        ptr += chunk;
+        left -= chunk;
+    }
+    sink_mem->total += len;
+    return (ssize_t)len;
+}
+
+struct sink *
+sink_mem_init(struct sink_mem *sink_mem, void *buf, size_t size)
+{
+    assert(sink_mem != NULL);
+    assert(buf != NULL);
+    assert(size > 0);
+    sink_mem->sink.write = sink_mem_write;
+    sink_mem->buf = buf;
+    sink_mem->size = size;
+    sink_mem->pos = 0;
+    sink_mem->total = 0;
+    return &sink_mem->sink;
+}
+
+static ssize_t
+sink_text_write(struct sink *sink, const void *buf, size_t len)
+{
+    struct sink_text *sink_text = (struct sink_text *)sink;
+    const struct input_event *ev = buf;
+    size_t num = len / sizeof(*ev);
+
+    for (; num > 0; ev++, num--) {
+        if (ev->type == EV_SYN && ev->code == SYN_REPORT) {
+            fprintf(sink_text->stream, "%s: ----\n", sink_text->name);
+        } else {
+            fprintf(sink_text->stream, "%s: %u %u %d\n", sink_text->name,
+                    ev->type, ev->code, ev->value);
+        }
+    }
+    return (ssize_t)(len - len % sizeof(*ev));
+}
+
+struct sink *
+sink_text_init(struct sink_text *sink_text, FILE *stream, const char *name)
+{
+    assert(sink_text != NULL);
+    assert(stream != NULL);
+    assert(name != NULL);
+    sink_text->sink.write = sink_text_write;
+    sink_text->stream = stream;
+    sink_text->name = name;
+    return &sink_text->sink;
+}
@@ -0,0 +1,125 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * This file is part of digimend-userspace-drivers.
+ */
+
+/* Output sinks, receiving data written by output devices */
+
+#ifndef _SINK_H
+#define _SINK_H
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+struct sink;
+
+/**
+ * Sink write function prototype.
+ *
+ * @param sink  The sink to write to.
+ * @param buf   The data to write.
+ * @param len   The length of the data to write.
+ *
+ * @return Number of bytes written, or -1 on failure, with errno set
+ *         appropriately, same as write(2).
+ */
+typedef ssize_t (*sink_write_fn)(struct sink *sink,
+                                 const void *buf, size_t len);
+
+/** An abstract output sink */
+struct sink {
+    /** The write function */
+    sink_write_fn write;
+};
+
+/**
+ * Write data to a sink.
+ *
+ * @param sink  The sink to write to.
+ * @param buf   The data to write.
+ * @param len   The length of the data to write.
+ *
+ * @return Number of bytes written, or -1 on failure, with errno set
+ *         appropriately, same as write(2).
+ */
+static inline ssize_t
+sink_write(struct sink *sink, const void *buf, size_t len)
+{
+    assert(sink != NULL);
+    assert(sink->write != NULL);
+    return sink->write(sink, buf, len);
+}
+
+/** A sink writing to a file descriptor, e.g. a uinput device */
+struct sink_fd {
+    /** The abstract sink */
+    struct sink sink;
+    /** The file descriptor to write to */
+    int fd;
+};
+
+/**
+ * Initialize a file descriptor sink.
+ *
+ * @param sink_fd   The sink to initialize.
+ * @param fd        The file descriptor to write to.
+ *
+ * @return The abstract sink.
+ */
+extern struct sink *sink_fd_init(struct sink_fd *sink_fd, int fd);
+
+/**
+ * A sink storing data in a memory buffer, wrapping around to the
+ * beginning when the buffer is full.
+ */
+struct sink_mem {
+    /** The abstract sink */
+    struct sink sink;
+    /** The buffer to store data in */
+    uint8_t *buf;
+    /** The size of the buffer */
+    size_t size;
+    /** The position to store the next data at */
+    size_t pos;
+    /** Total number of bytes written */
+    uint64_t total;
+};
+
+/**
+ * Initialize a memory sink.
+ *
+ * @param sink_mem  The sink to initialize.
+ * @param buf       The buffer to store data in.
+ * @param size      The size of the buffer, must be non-zero.
+ *
+ * @return The abstract sink.
+ */
+extern struct sink *sink_mem_init(struct sink_mem *sink_mem,
+                                  void *buf, size_t size);
+
+/** A sink printing written input events as text */
+struct sink_text {
+    /** The abstract sink */
+    struct sink sink;
+    /** The stream to print to */
+    FILE *stream;
+    /** The name to prefix each event with */
+    const char *name;
+};
+
+/**
+ * Initialize a text sink.
+ *
+ * @param sink_text The sink to initialize.
+ * @param stream    The stream to print the events to.
+ * @param name      The name to prefix each event with.
+ *
+ * @return The abstract sink.
+ */
+extern struct sink *sink_text_init(struct sink_text *sink_text,
+                                   FILE *stream, const char *name);
+
+#endif /* _SINK_H */
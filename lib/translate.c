@@ -0,0 +1,410 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * This file is part of digimend-userspace-drivers.
+ */
+
+#include "config.h"
+#include "translate.h"
+#include "misc.h"
+#include "uhid.h"
+#include <assert.h>
+#include <stddef.h>
+#include <string.h>
+#include <linux/uhid.h>
+
+/**
+ * Map a touch dial position to the wheel position.
+ *
+ * @param value The touch dial position, 1-12, or 0 if not touched.
+ *
+ * @return The wheel position, 0-71.
+ */
+static inline int32_t
+translate_dial(int32_t value)
+{
+    if (value != 0) {
+        value = (value > 6 ? (19 - value) : (7 - value)) * 71 / 12;
+    }
+    return value;
+}
+
+/**
+ * Flush a frame to an output, and raise the congestion flag, if the
+ * frame had to be queued.
+ *
+ * @param outputs   The outputs the output belongs to.
+ * @param output    The output to flush the frame to.
+ * @param frame     The frame to flush.
+ */
+static void
+translate_flush(struct outputs *outputs, struct output *output,
+                struct frame *frame)
+{
+    frame_flush(frame, &output->queue, output->sink, &output->stats);
+    if (output->queue.num > 0 && outputs->congested != NULL) {
+        *outputs->congested = true;
+    }
+}
+
+/**
+ * Invalidate the cached pen state, if frames were dropped on the pen
+ * output, so the next frame repeats every value, instead of leaving the
+ * device with a stale one, such as a touch never released.
+ *
+ * @param outputs   The outputs the pen output belongs to.
+ */
+static void
+translate_resync_pen(struct outputs *outputs)
+{
+    struct pen_state *state = &outputs->pen_state;
+
+    if (!outputs->pen.queue.dropped) {
+        return;
+    }
+    outputs->pen.queue.dropped = false;
+    state->in_range = -1;
+    state->x = INT32_MIN;
+    state->y = INT32_MIN;
+    state->pressure = INT32_MIN;
+    state->tilt_x = INT32_MIN;
+    state->tilt_y = INT32_MIN;
+    state->buttons ^= 7;
+}
+
+/**
+ * Invalidate the cached pad state, if frames were dropped on the pad
+ * output, so the next frame repeats every value, instead of leaving the
+ * device with a stale one, such as a button never released.
+ *
+ * @param outputs   The outputs the pad output belongs to.
+ */
+static void
+translate_resync_pad(struct outputs *outputs)
+{
+    struct pad_state *state = &outputs->pad_state;
+
+    if (!outputs->pad.queue.dropped) {
+        return;
+    }
+    outputs->pad.queue.dropped = false;
+    state->misc = INT32_MIN;
+    state->wheel = INT32_MIN;
+    state->buttons ^= 0xffff;
+}
+
+/**
+ * Write a HID input report to a uhid output, with a single write.
+ *
+ * @param output    The output to write the report to.
+ * @param data      The report data.
+ * @param size      The report size, up to UHID_PEN_REPORT_SIZE.
+ *
+ * @return True if the report was written, false if it was dropped.
+ */
+static bool
+translate_write_uhid(struct output *output, const uint8_t *data, size_t size)
+{
+    uint8_t buf[offsetof(struct uhid_event, u.input2.data) +
+                UHID_PEN_REPORT_SIZE];
+    uint32_t type = UHID_INPUT2;
+    uint16_t report_size = (uint16_t)size;
+    size_t len = offsetof(struct uhid_event, u.input2.data) + size;
+    ssize_t rc;
+
+    assert(size <= UHID_PEN_REPORT_SIZE);
+
+    /* Fill in only the used part of the event */
+    memcpy(buf + offsetof(struct uhid_event, type), &type, sizeof(type));
+    memcpy(buf + offsetof(struct uhid_event, u.input2.size),
+           &report_size, sizeof(report_size));
+    memcpy(buf + offsetof(struct uhid_event, u.input2.data), data, size);
+
+    counter_inc(&output->stats.frames);
+    do {
+        rc = sink_write(output->sink, buf, len);
+        counter_inc(&output->stats.writes);
+    } while (rc < 0 && errno == EINTR);
+    if (rc < 0) {
+        if (errno == EAGAIN) {
+            counter_inc(&output->stats.again);
+        } else {
+            counter_inc(&output->stats.errors);
+            LIBC_FAILURE(errno, "write a HID report");
+        }
+        counter_inc(&output->stats.dropped);
+        counter_inc(&output->stats.dropped_frames);
+        return false;
+    }
+    /* Count the report as a single event */
+    counter_inc(&output->stats.events);
+    return true;
+}
+
+/**
+ * Translate a decoded report into a HID input report written to the
+ * corresponding uhid output. Only send the reports changing the device
+ * state.
+ *
+ * @param outputs   The outputs to write the report to.
+ * @param ts        The report arrival time, nanoseconds.
+ * @param report    The decoded report to translate.
+ */
+static void
+translate_report_uhid(struct outputs *outputs, uint64_t ts,
+                      const struct report *report)
+{
+    const int32_t *values = report->values;
+    uint8_t buf[UHID_PEN_REPORT_SIZE];
+
+    switch (report->kind) {
+    case REPORT_KIND_PEN:
+        {
+            struct pen_state *state = &outputs->pen_state;
+            struct pen_state next = *state;
+            int32_t in_range = values[REPORT_FIELD_IN_RANGE] != 0;
+            int32_t axes[PREDICT_AXIS_NUM] = {
+                [PREDICT_AXIS_X] = values[REPORT_FIELD_X],
+                [PREDICT_AXIS_Y] = values[REPORT_FIELD_Y],
+                [PREDICT_AXIS_PRESSURE] = values[REPORT_FIELD_PRESSURE],
+            };
+            int32_t tilt_x = values[REPORT_FIELD_TILT_X];
+            int32_t tilt_y = values[REPORT_FIELD_TILT_Y];
+            /* Remap the values, if configured */
+            if (outputs->map != NULL) {
+                map_apply(outputs->map, &axes[PREDICT_AXIS_X],
+                          &axes[PREDICT_AXIS_Y],
+                          &axes[PREDICT_AXIS_PRESSURE], &tilt_x, &tilt_y);
+            }
+            /* Extrapolate the motion, if enabled */
+            if (outputs->predictor.horizon_ns != 0) {
+                predictor_apply(&outputs->predictor, ts, in_range,
+                                (values[REPORT_FIELD_PEN_BUTTONS] & 1) != 0,
+                                axes);
+            }
+            /* Keep the position out of range, lifting the pen */
+            next.in_range = in_range;
+            if (in_range) {
+                next.x = axes[PREDICT_AXIS_X];
+                next.y = axes[PREDICT_AXIS_Y];
+                next.pressure = axes[PREDICT_AXIS_PRESSURE];
+                next.tilt_x = tilt_x;
+                next.tilt_y = tilt_y;
+                next.buttons = (uint32_t)values[REPORT_FIELD_PEN_BUTTONS] & 7;
+            } else {
+                next.pressure = 0;
+                next.buttons = 0;
+            }
+            if (memcmp(&next, state, sizeof(next)) == 0) {
+                break;
+            }
+            buf[0] = (uint8_t)(next.buttons | (uint32_t)next.in_range << 3);
+            buf[1] = (uint8_t)next.x;
+            buf[2] = (uint8_t)(next.x >> 8);
+            buf[3] = (uint8_t)next.y;
+            buf[4] = (uint8_t)(next.y >> 8);
+            buf[5] = (uint8_t)next.pressure;
+            buf[6] = (uint8_t)(next.pressure >> 8);
+            buf[7] = (uint8_t)(int8_t)next.tilt_x;
+            buf[8] = (uint8_t)(int8_t)next.tilt_y;
+            /* Keep the state, so a dropped report is sent again */
+            if (translate_write_uhid(&outputs->pen, buf,
+                                     UHID_PEN_REPORT_SIZE)) {
+                *state = next;
+            }
+        }
+        break;
+    case REPORT_KIND_PAD_BUTTONS:
+    case REPORT_KIND_PAD_DIAL:
+        {
+            struct pad_state *state = &outputs->pad_state;
+            struct pad_state next = *state;
+            if (report->kind == REPORT_KIND_PAD_BUTTONS) {
+                next.buttons =
+                    (uint32_t)values[REPORT_FIELD_PAD_BUTTONS] & 0xffff;
+            } else {
+                next.wheel = translate_dial(values[REPORT_FIELD_DIAL]);
+            }
+            if (memcmp(&next, state, sizeof(next)) == 0) {
+                break;
+            }
+            buf[0] = (uint8_t)next.buttons;
+            buf[1] = (uint8_t)(next.buttons >> 8);
+            buf[2] = (uint8_t)next.wheel;
+            /* Keep the state, so a dropped report is sent again */
+            if (translate_write_uhid(&outputs->pad, buf,
+                                     UHID_PAD_REPORT_SIZE)) {
+                *state = next;
+            }
+        }
+        break;
+    case REPORT_KIND_NUM:
+    default:
+        break;
+    }
+}
+
+void
+translate_report(struct outputs *outputs, uint64_t ts,
+                 const struct report *report)
+{
+    struct frame frame = {.num = 0};
+    const int32_t *values;
+
+    assert(outputs != NULL);
+    assert(outputs->pen.sink != NULL);
+    assert(outputs->pad.sink != NULL);
+    assert(report != NULL);
+
+    if (outputs->backend == OUTPUT_BACKEND_UHID) {
+        translate_report_uhid(outputs, ts, report);
+        return;
+    }
+
+    values = report->values;
+
+    switch (report->kind) {
+    case REPORT_KIND_PEN:
+        {
+            static const uint16_t btn_codes[] = {
+                BTN_TOUCH, BTN_STYLUS, BTN_STYLUS2
+            };
+            struct pen_state *state = &outputs->pen_state;
+            int32_t in_range = values[REPORT_FIELD_IN_RANGE] != 0;
+            int32_t axes[PREDICT_AXIS_NUM] = {
+                [PREDICT_AXIS_X] = values[REPORT_FIELD_X],
+                [PREDICT_AXIS_Y] = values[REPORT_FIELD_Y],
+                [PREDICT_AXIS_PRESSURE] = values[REPORT_FIELD_PRESSURE],
+            };
+            int32_t tilt_x = values[REPORT_FIELD_TILT_X];
+            int32_t tilt_y = values[REPORT_FIELD_TILT_Y];
+            /* Remap the values, if configured */
+            if (outputs->map != NULL) {
+                map_apply(outputs->map, &axes[PREDICT_AXIS_X],
+                          &axes[PREDICT_AXIS_Y],
+                          &axes[PREDICT_AXIS_PRESSURE], &tilt_x, &tilt_y);
+            }
+            /* Extrapolate the motion, if enabled */
+            if (outputs->predictor.horizon_ns != 0) {
+                predictor_apply(&outputs->predictor, ts, in_range,
+                                (values[REPORT_FIELD_PEN_BUTTONS] & 1) != 0,
+                                axes);
+            }
+            translate_resync_pen(outputs);
+            /* If pen is in range */
+            if (in_range) {
+                frame_add_changed(&frame, EV_ABS, ABS_X, &state->x,
+                                  axes[PREDICT_AXIS_X]);
+                frame_add_changed(&frame, EV_ABS, ABS_Y, &state->y,
+                                  axes[PREDICT_AXIS_Y]);
+                frame_add_changed(&frame, EV_ABS, ABS_PRESSURE,
+                                  &state->pressure,
+                                  axes[PREDICT_AXIS_PRESSURE]);
+                frame_add_changed(&frame, EV_ABS, ABS_TILT_X,
+                                  &state->tilt_x, tilt_x);
+                frame_add_changed(&frame, EV_ABS, ABS_TILT_Y,
+                                  &state->tilt_y, tilt_y);
+                frame_add_changed_buttons(
+                    &frame, btn_codes, &state->buttons,
+                    (uint32_t)values[REPORT_FIELD_PEN_BUTTONS]);
+            } else {
+                /*
+                 * Release whatever the device may still hold, such as
+                 * a touch whose release was dropped, before leaving
+                 */
+                frame_add_changed(&frame, EV_ABS, ABS_PRESSURE,
+                                  &state->pressure, 0);
+                frame_add_changed_buttons(&frame, btn_codes,
+                                          &state->buttons, 0);
+            }
+            /* Identify the tool on proximity changes */
+            if (in_range != state->in_range) {
+                frame_add_changed(&frame, EV_KEY, BTN_TOOL_PEN,
+                                  &state->in_range, in_range);
+                frame_add(&frame, EV_MSC, MSC_SERIAL, 1098942556);
+            }
+            if (frame.num > 0) {
+                translate_flush(outputs, &outputs->pen, &frame);
+            }
+        }
+        break;
+    case REPORT_KIND_PAD_BUTTONS:
+        {
+            static const uint16_t btn_codes[] = {
+                BTN_0, BTN_1, BTN_2, BTN_3,
+                BTN_4, BTN_5, BTN_6, BTN_7,
+                BTN_8, BTN_9, BTN_A, BTN_B,
+                BTN_C, BTN_X, BTN_Y, BTN_Z,
+            };
+            struct pad_state *state = &outputs->pad_state;
+            uint32_t btn_mask =
+                (uint32_t)values[REPORT_FIELD_PAD_BUTTONS] & 0xffff;
+            translate_resync_pad(outputs);
+            frame_add_changed(&frame, EV_ABS, ABS_MISC, &state->misc,
+                              btn_mask ? 15 : 0);
+            frame_add_changed_buttons(&frame, btn_codes,
+                                      &state->buttons, btn_mask);
+            if (frame.num > 0) {
+                translate_flush(outputs, &outputs->pad, &frame);
+            }
+        }
+        break;
+    case REPORT_KIND_PAD_DIAL:
+        {
+            struct pad_state *state = &outputs->pad_state;
+            /* Map the dial position to the wheel */
+            int32_t value = translate_dial(values[REPORT_FIELD_DIAL]);
+            translate_resync_pad(outputs);
+            frame_add_changed(&frame, EV_ABS, ABS_MISC, &state->misc,
+                              value ? 15 : 0);
+            frame_add_changed(&frame, EV_ABS, ABS_WHEEL, &state->wheel,
+                              value);
+            if (frame.num > 0) {
+                translate_flush(outputs, &outputs->pad, &frame);
+            }
+        }
+        break;
+    case REPORT_KIND_NUM:
+    default:
+        break;
+    }
+}
+
+void
+translate_neutral(struct outputs *outputs)
+{
+    struct report report = {.kind = REPORT_KIND_PEN};
+    const struct pen_state *state;
+    const struct map *map;
+
+    assert(outputs != NULL);
+
+    state = &outputs->pen_state;
+    map = outputs->map;
+
+    /*
+     * Lift the pen at its position, then take it out of proximity,
+     * without remapping the already output values. Leaving proximity
+     * releases the buttons, even if the pen is out of range already.
+     */
+    predictor_reset(&outputs->predictor);
+    outputs->map = NULL;
+    if (state->in_range) {
+        report.values[REPORT_FIELD_IN_RANGE] = 1;
+        report.values[REPORT_FIELD_X] = state->x;
+        report.values[REPORT_FIELD_Y] = state->y;
+        report.values[REPORT_FIELD_TILT_X] = state->tilt_x;
+        report.values[REPORT_FIELD_TILT_Y] = state->tilt_y;
+        translate_report(outputs, 0, &report);
+    }
+    report.values[REPORT_FIELD_IN_RANGE] = 0;
+    translate_report(outputs, 0, &report);
+    outputs->map = map;
+
+    /* Release the pad */
+    memset(&report, 0, sizeof(report));
+    report.kind = REPORT_KIND_PAD_BUTTONS;
+    translate_report(outputs, 0, &report);
+    report.kind = REPORT_KIND_PAD_DIAL;
+    translate_report(outputs, 0, &report);
+}
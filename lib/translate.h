@@ -0,0 +1,138 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * This file is part of digimend-userspace-drivers.
+ */
+
+/* Tablet report translation */
+
+#ifndef _TRANSLATE_H
+#define _TRANSLATE_H
+
+#include "decoder.h"
+#include "frame.h"
+#include "map.h"
+#include "predict.h"
+#include "report.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/** The state of a pen, as last written to its output device */
+struct pen_state {
+    /** BTN_TOOL_PEN value */
+    int32_t in_range;
+    /** ABS_X value */
+    int32_t x;
+    /** ABS_Y value */
+    int32_t y;
+    /** ABS_PRESSURE value */
+    int32_t pressure;
+    /** ABS_TILT_X value */
+    int32_t tilt_x;
+    /** ABS_TILT_Y value */
+    int32_t tilt_y;
+    /** Bitmap of BTN_TOUCH, BTN_STYLUS, and BTN_STYLUS2 values */
+    uint32_t buttons;
+};
+
+/** The state of a pad, as last written to its output device */
+struct pad_state {
+    /** ABS_MISC value */
+    int32_t misc;
+    /** ABS_WHEEL value */
+    int32_t wheel;
+    /** Bitmap of BTN_0 - BTN_Z values */
+    uint32_t buttons;
+};
+
+/** The kind of output devices */
+enum output_backend {
+    /** uinput devices, receiving input events */
+    OUTPUT_BACKEND_UINPUT,
+    /** uhid devices, receiving HID input reports */
+    OUTPUT_BACKEND_UHID,
+};
+
+/** An output device */
+struct output {
+    /** The sink to write the device's events to */
+    struct sink *sink;
+    /** Frames pending on the sink, while it's congested */
+    struct frame_queue queue;
+    /** Statistics of frames written to the device */
+    struct frame_stats stats;
+};
+
+/** The collection of output devices corresponding to a tablet */
+struct outputs {
+    /** The kind of the output devices */
+    enum output_backend backend;
+    struct output pen;
+    struct output pad;
+    /** Pen state, as last written to the pen device */
+    struct pen_state pen_state;
+    /** Pad state, as last written to the pad device */
+    struct pad_state pad_state;
+    /** Pen value mapping, or NULL for none */
+    const struct map *map;
+    /** Pen motion predictor, disabled if zero-initialized */
+    struct predictor predictor;
+    /**
+     * The flag to raise when frames are queued on a congested output,
+     * to have it drained when writable, or NULL.
+     */
+    bool *congested;
+};
+
+/**
+ * Translate a decoded report into input events and write them to the
+ * corresponding output device, a single frame per report. Only send the
+ * events changing the device state. Queue the frame, if the device is
+ * congested, and raise the outputs' congestion flag. If frames were
+ * dropped on the device, repeat all of its state the next frame covers.
+ * Release the pen buttons and pressure whenever the pen is out of
+ * range, in case the device still holds them. For uhid outputs, write a
+ * single HID input report instead, if the state changed, and drop it, if
+ * the device is congested, sending it again on the next report. Pen
+ * values are remapped with the outputs' mapping, if any, and then pen
+ * coordinates and pressure are extrapolated with the outputs' predictor,
+ * if enabled.
+ *
+ * @param outputs   The outputs to write the events to.
+ * @param ts        The report arrival time, nanoseconds.
+ * @param report    The decoded report to translate.
+ */
+extern void translate_report(struct outputs *outputs, uint64_t ts,
+                             const struct report *report);
+
+/**
+ * Bring the output devices to the neutral state, as if the pen was lifted
+ * and taken out of proximity, and all buttons and the dial released.
+ * The pen buttons are released even if the pen is out of range already.
+ *
+ * @param outputs   The outputs to write the events to.
+ */
+extern void translate_neutral(struct outputs *outputs);
+
+/**
+ * Decode a tablet report and translate it into input events written to
+ * the corresponding output device.
+ *
+ * @param outputs   The outputs to write the events to.
+ * @param decoder   The decoder to decode the report with.
+ * @param ts        The report arrival time, nanoseconds.
+ * @param buf       The report buffer.
+ * @param len       The length of the report.
+ */
+static inline void
+translate(struct outputs *outputs, const struct decoder *decoder,
+          uint64_t ts, const uint8_t *buf, size_t len)
+{
+    struct report report;
+    if (decoder_decode(decoder, &report, buf, len)) {
+        translate_report(outputs, ts, &report);
+    }
+}
+
+#endif /* _TRANSLATE_H */
@@ -0,0 +1,246 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * This file is part of digimend-userspace-drivers.
+ */
+
+#include "config.h"
+#include "uhid.h"
+#include "misc.h"
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <linux/input.h>
+#include <linux/uhid.h>
+
+/** Report descriptor of the pen device */
+static const uint8_t uhid_pen_rdesc[] = {
+    0x05, 0x0D,                     /* Usage Page (Digitizer)           */
+    0x09, 0x02,                     /* Usage (Pen)                      */
+    0xA1, 0x01,                     /* Collection (Application)         */
+    0x09, 0x20,                     /*  Usage (Stylus)                  */
+    0xA0,                           /*  Collection (Physical)           */
+    0x14,                           /*      Logical Minimum (0)         */
+    0x25, 0x01,                     /*      Logical Maximum (1)         */
+    0x75, 0x01,                     /*      Report Size (1)             */
+    0x09, 0x42,                     /*      Usage (Tip Switch)          */
+    0x09, 0x44,                     /*      Usage (Barrel Switch)       */
+    0x09, 0x5A,                     /*      Usage (Secondary Barrel...  */
+    0x09, 0x32,                     /*      Usage (In Range)            */
+    0x95, 0x04,                     /*      Report Count (4)            */
+    0x81, 0x02,                     /*      Input (Variable)            */
+    0x81, 0x03,                     /*      Input (Constant, Variable)  */
+    0x05, 0x01,                     /*      Usage Page (Desktop)        */
+    0x75, 0x10,                     /*      Report Size (16)            */
+    0x95, 0x01,                     /*      Report Count (1)            */
+    0x65, 0x11,                     /*      Unit (Centimeter)           */
+    0x55, 0x0D,                     /*      Unit Exponent (-3)          */
+    0x34,                           /*      Physical Minimum (0)        */
+    0x09, 0x30,                     /*      Usage (X)                   */
+    0x27, 0x70, 0xC6, 0x00, 0x00,   /*      Logical Maximum (50800)     */
+    0x47, 0x38, 0x63, 0x00, 0x00,   /*      Physical Maximum (25400)    */
+    0x81, 0x02,                     /*      Input (Variable)            */
+    0x09, 0x31,                     /*      Usage (Y)                   */
+    0x27, 0x06, 0x7C, 0x00, 0x00,   /*      Logical Maximum (31750)     */
+    0x47, 0x03, 0x3E, 0x00, 0x00,   /*      Physical Maximum (15875)    */
+    0x81, 0x02,                     /*      Input (Variable)            */
+    0x05, 0x0D,                     /*      Usage Page (Digitizer)      */
+    0x64,                           /*      Unit (None)                 */
+    0x54,                           /*      Unit Exponent (0)           */
+    0x44,                           /*      Physical Maximum (0)        */
+    0x09, 0x30,                     /*      Usage (Tip Pressure)        */
+    0x26, 0xFF, 0x1F,               /*      Logical Maximum (8191)      */
+    0x81, 0x02,                     /*      Input (Variable)            */
+    0x75, 0x08,                     /*      Report Size (8)             */
+    0x95, 0x02,                     /*      Report Count (2)            */
+    0x65, 0x14,                     /*      Unit (Degrees)              */
+    0x15, 0xC4,                     /*      Logical Minimum (-60)       */
+    0x25, 0x3C,                     /*      Logical Maximum (60)        */
+    0x35, 0xC4,                     /*      Physical Minimum (-60)      */
+    0x45, 0x3C,                     /*      Physical Maximum (60)       */
+    0x09, 0x3D,                     /*      Usage (X Tilt)              */
+    0x09, 0x3E,                     /*      Usage (Y Tilt)              */
+    0x81, 0x02,                     /*      Input (Variable)            */
+    0xC0,                           /*  End Collection                  */
+    0xC0,                           /* End Collection                   */
+};
+
+/** Offset of the X Logical Maximum data in uhid_pen_rdesc */
+#define UHID_PEN_RDESC_X_LM         42
+/** Offset of the X Physical Maximum data in uhid_pen_rdesc */
+#define UHID_PEN_RDESC_X_PM         47
+/** Offset of the Y Logical Maximum data in uhid_pen_rdesc */
+#define UHID_PEN_RDESC_Y_LM         56
+/** Offset of the Y Physical Maximum data in uhid_pen_rdesc */
+#define UHID_PEN_RDESC_Y_PM         61
+/** Offset of the Tip Pressure Logical Maximum data in uhid_pen_rdesc */
+#define UHID_PEN_RDESC_PRESSURE_LM  75
+
+/** Report descriptor of the pad device */
+static const uint8_t uhid_pad_rdesc[] = {
+    0x05, 0x01,                     /* Usage Page (Desktop)             */
+    0x09, 0x07,                     /* Usage (Keypad)                   */
+    0xA1, 0x01,                     /* Collection (Application)         */
+    0x05, 0x09,                     /*  Usage Page (Button)             */
+    0x19, 0x01,                     /*  Usage Minimum (01h)             */
+    0x29, 0x10,                     /*  Usage Maximum (10h)             */
+    0x14,                           /*  Logical Minimum (0)             */
+    0x25, 0x01,                     /*  Logical Maximum (1)             */
+    0x75, 0x01,                     /*  Report Size (1)                 */
+    0x95, 0x10,                     /*  Report Count (16)               */
+    0x81, 0x02,                     /*  Input (Variable)                */
+    0x05, 0x01,                     /*  Usage Page (Desktop)            */
+    0x09, 0x38,                     /*  Usage (Wheel)                   */
+    0x25, 0x47,                     /*  Logical Maximum (71)            */
+    0x75, 0x08,                     /*  Report Size (8)                 */
+    0x95, 0x01,                     /*  Report Count (1)                */
+    0x81, 0x02,                     /*  Input (Variable)                */
+    0xC0,                           /* End Collection                   */
+};
+
+void
+uhid_destroy(int fd)
+{
+    struct uhid_event ev = {.type = UHID_DESTROY};
+
+    if (fd >= 0) {
+        if (write(fd, &ev, sizeof(ev)) < 0) {
+            LIBC_FAILURE(errno, "destroy uhid device");
+        }
+        close(fd);
+    }
+}
+
+/**
+ * Create a uhid device.
+ *
+ * @param model     The model of the tablet the device belongs to.
+ * @param name      The name of the device, following the model's.
+ * @param rdesc     The report descriptor of the device.
+ * @param size      The size of the report descriptor.
+ *
+ * @return The file descriptor of the created device, or -1 on failure.
+ */
+static int
+uhid_create(const struct model *model, const char *name,
+            const uint8_t *rdesc, size_t size)
+{
+    int result = -1;
+    int fd = -1;
+    struct uhid_event ev;
+
+    /* Open the file */
+    fd = open("/dev/uhid", O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) {
+        LIBC_FAILURE_CLEANUP(errno, "open /dev/uhid");
+    }
+
+    /*
+     * Create the device, on the virtual bus, so drivers for the tablet
+     * don't bind to it
+     */
+    memset(&ev, 0, sizeof(ev));
+    ev.type = UHID_CREATE2;
+    snprintf((char *)ev.u.create2.name, sizeof(ev.u.create2.name),
+             "%s %s", model->name, name);
+    ev.u.create2.rd_size = (uint16_t)size;
+    ev.u.create2.bus = BUS_VIRTUAL;
+    ev.u.create2.vendor = model->vendor;
+    ev.u.create2.product = model->product;
+    memcpy(ev.u.create2.rd_data, rdesc, size);
+    if (write(fd, &ev, sizeof(ev)) < 0) {
+        LIBC_FAILURE_CLEANUP(errno, "create uhid device");
+    }
+
+    result = fd;
+    fd = -1;
+
+cleanup:
+
+    if (fd >= 0) {
+        close(fd);
+    }
+
+    return result;
+}
+
+/**
+ * Store an item's data into a report descriptor, little-endian.
+ *
+ * @param rdesc     The report descriptor to store the data into.
+ * @param offset    The offset of the item's data.
+ * @param size      The size of the item's data, as its prefix says.
+ * @param value     The data to store.
+ */
+static void
+uhid_rdesc_put(uint8_t *rdesc, size_t offset, size_t size, uint32_t value)
+{
+    size_t i;
+
+    assert((rdesc[offset - 1] & 0x3) == (size == 4 ? 3 : size));
+    for (i = 0; i < size; i++, value >>= 8) {
+        rdesc[offset + i] = (uint8_t)value;
+    }
+}
+
+int
+uhid_create_pen(const struct model *model, const struct model_axes *axes)
+{
+    uint8_t rdesc[sizeof(uhid_pen_rdesc)];
+
+    assert(model != NULL);
+    assert(axes != NULL);
+
+    /* Fill in the axis capabilities, physical ones in 0.01mm */
+    memcpy(rdesc, uhid_pen_rdesc, sizeof(rdesc));
+    uhid_rdesc_put(rdesc, UHID_PEN_RDESC_X_LM, 4, (uint32_t)axes->x_max);
+    uhid_rdesc_put(rdesc, UHID_PEN_RDESC_X_PM, 4,
+                   (uint32_t)(axes->x_max * 100 / axes->resolution));
+    uhid_rdesc_put(rdesc, UHID_PEN_RDESC_Y_LM, 4, (uint32_t)axes->y_max);
+    uhid_rdesc_put(rdesc, UHID_PEN_RDESC_Y_PM, 4,
+                   (uint32_t)(axes->y_max * 100 / axes->resolution));
+    uhid_rdesc_put(rdesc, UHID_PEN_RDESC_PRESSURE_LM, 2,
+                   (uint32_t)axes->pressure_max);
+
+    return uhid_create(model, "Pen", rdesc, sizeof(rdesc));
+}
+
+int
+uhid_create_pad(const struct model *model)
+{
+    assert(model != NULL);
+    return uhid_create(model, "Pad", uhid_pad_rdesc, sizeof(uhid_pad_rdesc));
+}
+
+int
+uhid_handle(int fd)
+{
+    struct uhid_event ev;
+    struct uhid_event reply;
+    ssize_t rc;
+
+    rc = read(fd, &ev, sizeof(ev));
+    if (rc < 0) {
+        return errno == EAGAIN ? 0 : -1;
+    }
+
+    memset(&reply, 0, sizeof(reply));
+    switch (ev.type) {
+    case UHID_GET_REPORT:
+        reply.type = UHID_GET_REPORT_REPLY;
+        reply.u.get_report_reply.id = ev.u.get_report.id;
+        reply.u.get_report_reply.err = EIO;
+        break;
+    case UHID_SET_REPORT:
+        reply.type = UHID_SET_REPORT_REPLY;
+        reply.u.set_report_reply.id = ev.u.set_report.id;
+        reply.u.set_report_reply.err = EIO;
+        break;
+    default:
+        /* Start, stop, open, close, and output events need no reply */
+        return 0;
+    }
+    return write(fd, &reply, sizeof(reply)) < 0 ? -1 : 0;
+}
@@ -0,0 +1,80 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * This file is part of digimend-userspace-drivers.
+ */
+
+/*
+ * uhid device management.
+ *
+ * An alternative to uinput devices: HID devices created with report
+ * descriptors fixed but for the pen axis capabilities, receiving a single
+ * input report per tablet report, which the kernel's HID input layer
+ * converts to input events.
+ *
+ * Pen input report, UHID_PEN_REPORT_SIZE bytes, little-endian:
+ *      1 byte      Bit 0 - tip switch, bit 1 - barrel switch,
+ *                  bit 2 - secondary barrel switch, bit 3 - in range
+ *      2 bytes     X, 0 - the X axis maximum
+ *      2 bytes     Y, 0 - the Y axis maximum
+ *      2 bytes     Tip pressure, 0 - the pressure axis maximum
+ *      1 byte      X tilt, -60 - 60 degrees
+ *      1 byte      Y tilt, -60 - 60 degrees
+ *
+ * Pad input report, UHID_PAD_REPORT_SIZE bytes, little-endian:
+ *      2 bytes     Button bitmap, buttons 1-16
+ *      1 byte      Wheel, 0 - 71
+ */
+
+#ifndef _UHID_H
+#define _UHID_H
+
+#include "model.h"
+#include <stdint.h>
+
+/** Size of the pen device's input report */
+#define UHID_PEN_REPORT_SIZE    9
+
+/** Size of the pad device's input report */
+#define UHID_PAD_REPORT_SIZE    3
+
+/**
+ * Destroy a uhid device.
+ *
+ * @param fd    The file descriptor of the uhid device to destroy.
+ */
+extern void uhid_destroy(int fd);
+
+/**
+ * Create a uhid pen device.
+ *
+ * @param model The model of the tablet, to take the name and IDs of.
+ * @param axes  The pen axis capabilities of the tablet.
+ *
+ * @return The file descriptor of the created device, or -1 on failure.
+ */
+extern int uhid_create_pen(const struct model *model,
+                           const struct model_axes *axes);
+
+/**
+ * Create a uhid pad device.
+ *
+ * @param model The model of the tablet, to take the name and IDs of.
+ *
+ * @return The file descriptor of the created device, or -1 on failure.
+ */
+extern int uhid_create_pad(const struct model *model);
+
+/**
+ * Read an event sent by the kernel to a uhid device, and reply to it, if
+ * it's a request. The devices have no feature or output reports, so
+ * requests for them are refused.
+ *
+ * @param fd    The file descriptor of the uhid device to read from.
+ *
+ * @return Zero if an event was handled, or there was none, -1 on failure,
+ *         with errno set appropriately.
+ */
+extern int uhid_handle(int fd);
+
+#endif /* _UHID_H */
@@ -0,0 +1,317 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * This file is part of digimend-userspace-drivers.
+ */
+
+#include "config.h"
+#include "uinput.h"
+#include "misc.h"
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <linux/uinput.h>
+
+void
+uinput_destroy(int fd)
+{
+    if (fd >= 0) {
+        ioctl(fd, UI_DEV_DESTROY);
+        close(fd);
+    }
+}
+
+
+int
+uinput_create_pen(const struct model *model, const struct model_axes *axes)
+{
+    int result = -1;
+    int fd = -1;
+    struct uinput_abs_setup uinput_abs_setup;
+    struct uinput_setup uinput_setup;
+
+    /* Open the file */
+    fd = open("/dev/uinput", O_WRONLY | O_NONBLOCK);
+    if (fd < 0) {
+        LIBC_FAILURE_CLEANUP(errno, "open /dev/uinput");
+    }
+
+#define SET_EVBIT(_bit_token) \
+LIBC_GUARD(ioctl(fd, UI_SET_EVBIT, _bit_token),  \
+           "enable uinput %s", #_bit_token)
+    SET_EVBIT(EV_SYN);
+    SET_EVBIT(EV_KEY);
+    SET_EVBIT(EV_REL);
+    SET_EVBIT(EV_ABS);
+    SET_EVBIT(EV_MSC);
+#undef SET_EVBIT
+
+#define SET_KEYBIT(_bit_token) \
+LIBC_GUARD(ioctl(fd, UI_SET_KEYBIT, _bit_token),  \
+           "enable uinput %s", #_bit_token)
+    SET_KEYBIT(BTN_LEFT);
+    SET_KEYBIT(BTN_RIGHT);
+    SET_KEYBIT(BTN_MIDDLE);
+    SET_KEYBIT(BTN_SIDE);
+    SET_KEYBIT(BTN_EXTRA);
+    SET_KEYBIT(BTN_TOOL_PEN);
+    SET_KEYBIT(BTN_TOOL_RUBBER);
+    SET_KEYBIT(BTN_TOOL_BRUSH);
+    SET_KEYBIT(BTN_TOOL_PENCIL);
+    SET_KEYBIT(BTN_TOOL_AIRBRUSH);
+    SET_KEYBIT(BTN_TOOL_MOUSE);
+    SET_KEYBIT(BTN_TOOL_LENS);
+    SET_KEYBIT(BTN_TOUCH);
+    SET_KEYBIT(BTN_STYLUS);
+    SET_KEYBIT(BTN_STYLUS2);
+#undef SET_KEYBIT
+
+#define SET_ABSBIT(_bit_token) \
+LIBC_GUARD(ioctl(fd, UI_SET_ABSBIT, _bit_token),  \
+           "enable uinput %s", #_bit_token)
+    SET_ABSBIT(ABS_X);
+    SET_ABSBIT(ABS_Y);
+    SET_ABSBIT(ABS_Z);
+    SET_ABSBIT(ABS_RZ);
+    SET_ABSBIT(ABS_THROTTLE);
+    SET_ABSBIT(ABS_WHEEL);
+    SET_ABSBIT(ABS_PRESSURE);
+    SET_ABSBIT(ABS_DISTANCE);
+    SET_ABSBIT(ABS_TILT_X);
+    SET_ABSBIT(ABS_TILT_Y);
+    SET_ABSBIT(ABS_MISC);
+#undef SET_ABSBIT
+
+#define SET_RELBIT(_bit_token) \
+LIBC_GUARD(ioctl(fd, UI_SET_RELBIT, _bit_token),  \
+           "enable uinput %s", #_bit_token)
+    SET_RELBIT(REL_WHEEL);
+#undef SET_RELBIT
+
+#define SET_MSCBIT(_bit_token) \
+LIBC_GUARD(ioctl(fd, UI_SET_MSCBIT, _bit_token),  \
+           "enable uinput %s", #_bit_token)
+    SET_MSCBIT(MSC_SERIAL);
+#undef SET_MSCBIT
+
+    /* Setup X axis */
+    uinput_abs_setup = (struct uinput_abs_setup){
+        .code = ABS_X,
+        .absinfo = {
+            .value = 0,
+            .minimum = 0,
+            .maximum = axes->x_max,
+            .resolution = axes->resolution,
+        },
+    };
+    LIBC_GUARD(ioctl(fd, UI_ABS_SETUP, &uinput_abs_setup),
+               "setup X axis");
+
+    /* Setup Y axis */
+    uinput_abs_setup = (struct uinput_abs_setup){
+        .code = ABS_Y,
+        .absinfo = {
+            .value = 0,
+            .minimum = 0,
+            .maximum = axes->y_max,
+            .resolution = axes->resolution,
+        },
+    };
+    LIBC_GUARD(ioctl(fd, UI_ABS_SETUP, &uinput_abs_setup),
+               "setup Y axis");
+
+    /* Setup pressure axis */
+    uinput_abs_setup = (struct uinput_abs_setup){
+        .code = ABS_PRESSURE,
+        .absinfo = {
+            .value = 0,
+            .minimum = 0,
+            .maximum = axes->pressure_max,
+        },
+    };
+    LIBC_GUARD(ioctl(fd, UI_ABS_SETUP, &uinput_abs_setup),
+               "setup pressure axis");
+
+    /* Setup tilt X axis */
+    uinput_abs_setup = (struct uinput_abs_setup){
+        .code = ABS_TILT_X,
+        .absinfo = {
+            .value = 0,
+            .minimum = -MODEL_TILT_MAX,
+            .maximum = MODEL_TILT_MAX,
+        },
+    };
+    LIBC_GUARD(ioctl(fd, UI_ABS_SETUP, &uinput_abs_setup),
+               "setup tilt X axis");
+
+    /* Setup tilt Y axis */
+    uinput_abs_setup = (struct uinput_abs_setup){
+        .code = ABS_TILT_Y,
+        .absinfo = {
+            .value = 0,
+            .minimum = -MODEL_TILT_MAX,
+            .maximum = MODEL_TILT_MAX,
+        },
+    };
+    LIBC_GUARD(ioctl(fd, UI_ABS_SETUP, &uinput_abs_setup),
+               "setup tilt Y axis");
+
+    /* Setup device, posing as the model's counterpart */
+    uinput_setup = (struct uinput_setup){
+        .id = {
+            .bustype = BUS_USB,
+            .vendor = model->pose_vendor,
+            .product = model->pose_product,
+            .version = model->pose_version,
+        },
+    };
+    strncpy(uinput_setup.name, model->pose_pen_name,
+            sizeof(uinput_setup.name) - 1);
+    LIBC_GUARD(ioctl(fd, UI_DEV_SETUP, &uinput_setup),
+               "setup uinput device");
+
+    /* Create device */
+    LIBC_GUARD(ioctl(fd, UI_DEV_CREATE), "create uinput device");
+
+    result = fd;
+    fd = -1;
+
+cleanup:
+
+    if (fd >= 0) {
+        close(fd);
+    }
+
+    return result;
+}
+
+
+int
+uinput_create_pad(const struct model *model)
+{
+    int result = -1;
+    int fd = -1;
+    struct uinput_abs_setup uinput_abs_setup;
+    struct uinput_setup uinput_setup;
+
+    /* Open the file */
+    fd = open("/dev/uinput", O_WRONLY | O_NONBLOCK);
+    if (fd < 0) {
+        LIBC_FAILURE_CLEANUP(errno, "open /dev/uinput");
+    }
+
+#define SET_EVBIT(_bit_token) \
+LIBC_GUARD(ioctl(fd, UI_SET_EVBIT, _bit_token),  \
+           "enable uinput %s", #_bit_token)
+    SET_EVBIT(EV_SYN);
+    SET_EVBIT(EV_KEY);
+    SET_EVBIT(EV_ABS);
+#undef SET_EVBIT
+
+#define SET_KEYBIT(_bit_token) \
+LIBC_GUARD(ioctl(fd, UI_SET_KEYBIT, _bit_token),  \
+           "enable uinput %s", #_bit_token)
+    SET_KEYBIT(BTN_0);
+    SET_KEYBIT(BTN_1);
+    SET_KEYBIT(BTN_2);
+    SET_KEYBIT(BTN_3);
+    SET_KEYBIT(BTN_4);
+    SET_KEYBIT(BTN_5);
+    SET_KEYBIT(BTN_6);
+    SET_KEYBIT(BTN_7);
+    SET_KEYBIT(BTN_8);
+    SET_KEYBIT(BTN_9);
+    SET_KEYBIT(BTN_A);
+    SET_KEYBIT(BTN_B);
+    SET_KEYBIT(BTN_C);
+    SET_KEYBIT(BTN_STYLUS);
+#undef SET_KEYBIT
+
+#define SET_ABSBIT(_bit_token) \
+LIBC_GUARD(ioctl(fd, UI_SET_ABSBIT, _bit_token),  \
+           "enable uinput %s", #_bit_token)
+    SET_ABSBIT(ABS_X);
+    SET_ABSBIT(ABS_Y);
+    SET_ABSBIT(ABS_WHEEL);
+    SET_ABSBIT(ABS_MISC);
+#undef SET_ABSBIT
+
+    /* Setup X axis */
+    uinput_abs_setup = (struct uinput_abs_setup){
+        .code = ABS_X,
+        .absinfo = {
+            .value = 0,
+            .minimum = 0,
+            .maximum = 1,
+        },
+    };
+    LIBC_GUARD(ioctl(fd, UI_ABS_SETUP, &uinput_abs_setup),
+               "setup X axis");
+
+    /* Setup Y axis */
+    uinput_abs_setup = (struct uinput_abs_setup){
+        .code = ABS_Y,
+        .absinfo = {
+            .value = 0,
+            .minimum = 0,
+            .maximum = 1,
+        },
+    };
+    LIBC_GUARD(ioctl(fd, UI_ABS_SETUP, &uinput_abs_setup),
+               "setup Y axis");
+
+    /* Setup absolute wheel */
+    uinput_abs_setup = (struct uinput_abs_setup){
+        .code = ABS_WHEEL,
+        .absinfo = {
+            .value = 0,
+            .minimum = 0,
+            .maximum = MODEL_WHEEL_MAX,
+        },
+    };
+    LIBC_GUARD(ioctl(fd, UI_ABS_SETUP, &uinput_abs_setup),
+               "setup absolute wheel");
+
+    /* Setup misc axis */
+    uinput_abs_setup = (struct uinput_abs_setup){
+        .code = ABS_MISC,
+        .absinfo = {
+            .value = 0,
+            .minimum = 0,
+            .maximum = 0,
+        },
+    };
+    LIBC_GUARD(ioctl(fd, UI_ABS_SETUP, &uinput_abs_setup),
+               "setup misc axis");
+
+    /* Setup device, posing as the model's counterpart */
+    uinput_setup = (struct uinput_setup){
+        .id = {
+            .bustype = BUS_USB,
+            .vendor = model->pose_vendor,
+            .product = model->pose_product,
+            .version = model->pose_version,
+        },
+    };
+    strncpy(uinput_setup.name, model->pose_pad_name,
+            sizeof(uinput_setup.name) - 1);
+    LIBC_GUARD(ioctl(fd, UI_DEV_SETUP, &uinput_setup),
+               "setup uinput device");
+
+    /* Create device */
+    LIBC_GUARD(ioctl(fd, UI_DEV_CREATE), "create uinput device");
+
+    result = fd;
+    fd = -1;
+
+cleanup:
+
+    if (fd >= 0) {
+        close(fd);
+    }
+
+    return result;
+}
@@ -0,0 +1,41 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * This file is part of digimend-userspace-drivers.
+ */
+
+/* uinput device management */
+
+#ifndef _UINPUT_H
+#define _UINPUT_H
+
+#include "model.h"
+
+/**
+ * Destroy a uinput device.
+ *
+ * @param fd    The file descriptor of the uinput device to destroy.
+ */
+extern void uinput_destroy(int fd);
+
+/**
+ * Create a uinput pen device.
+ *
+ * @param model The model of the tablet, posing as its counterpart.
+ * @param axes  The pen axis capabilities of the tablet.
+ *
+ * @return The file descriptor of the created device, or -1 on failure.
+ */
+extern int uinput_create_pen(const struct model *model,
+                             const struct model_axes *axes);
+
+/**
+ * Create a uinput pad device.
+ *
+ * @param model The model of the tablet, posing as its counterpart.
+ *
+ * @return The file descriptor of the created device, or -1 on failure.
+ */
+extern int uinput_create_pad(const struct model *model);
+
+#endif /* _UINPUT_H */
@@ -0,0 +1,150 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * This file is part of digimend-userspace-drivers.
+ */
+
+#include "config.h"
+#include "capture.h"
+#include <assert.h>
+#include <errno.h>
+#include <string.h>
+
+/** Capture file magic */
+static const uint8_t capture_magic[6] = {'D', 'U', 'D', 'C', 'A', 'P'};
+
+/** Size of a record header */
+#define CAPTURE_RECORD_HEADER_SIZE  10
+
+/**
+ * Read exactly the specified number of bytes from a stream.
+ *
+ * @param stream    The stream to read from.
+ * @param buf       The buffer to read into.
+ * @param len       The number of bytes to read.
+ *
+ * @return 1 if read, 0 if the end of file was reached before anything was
+ *         read, -1 on failure, with errno set appropriately. EINVAL means
+ *         the end of file was reached in the middle.
+ */
+static int
+capture_read_exact(FILE *stream, uint8_t *buf, size_t len)
+{
+    size_t rc = fread(buf, 1, len, stream);
+    if (rc == len) {
+        return 1;
+    }
+    if (ferror(stream)) {
+        return -1;
+    }
+    if (rc == 0) {
+        return 0;
+    }
+    errno = EINVAL;
+    return -1;
+}
+
+bool
+capture_write_header(FILE *stream)
+{
+    uint8_t header[sizeof(capture_magic) + 2];
+
+    assert(stream != NULL);
+
+    memcpy(header, capture_magic, sizeof(capture_magic));
+    header[sizeof(capture_magic)] = CAPTURE_VERSION & 0xff;
+    header[sizeof(capture_magic) + 1] = CAPTURE_VERSION >> 8;
+    return fwrite(header, sizeof(header), 1, stream) == 1;
+}
+
+bool
+capture_write(FILE *stream, uint64_t ts, const uint8_t *buf, size_t len)
+{
+    uint8_t header[CAPTURE_RECORD_HEADER_SIZE];
+    size_t i;
+
+    assert(stream != NULL);
+    assert(buf != NULL || len == 0);
+
+    if (len > CAPTURE_MAX_LEN) {
+        errno = EINVAL;
+        return false;
+    }
+
+    for (i = 0; i < 8; i++) {
+        header[i] = (uint8_t)(ts >> (i * 8));
+    }
+    header[8] = len & 0xff;
+    header[9] = (uint8_t)(len >> 8);
+
+    return fwrite(header, sizeof(header), 1, stream) == 1 &&
+           fwrite(buf, 1, len, stream) == len;
+}
+
+bool
+capture_read_header(FILE *stream)
+{
+    uint8_t header[sizeof(capture_magic) + 2];
+    int rc;
+
+    assert(stream != NULL);
+
+    rc = capture_read_exact(stream, header, sizeof(header));
+    if (rc == 0) {
+        errno = EINVAL;
+    }
+    if (rc <= 0) {
+        return false;
+    }
+    if (memcmp(header, capture_magic, sizeof(capture_magic)) != 0 ||
+        (header[sizeof(capture_magic)] |
+         (header[sizeof(capture_magic) + 1] << 8)) != CAPTURE_VERSION) {
+        errno = EINVAL;
+        return false;
+    }
+    return true;
+}
+
+int
+capture_read(FILE *stream, uint64_t *pts,
+             uint8_t *buf, size_t size, size_t *plen)
+{
+    uint8_t header[CAPTURE_RECORD_HEADER_SIZE];
+    uint64_t ts = 0;
+    size_t len;
+    size_t i;
+    int rc;
+
+    assert(stream != NULL);
+    assert(buf != NULL || size == 0);
+
+    rc = capture_read_exact(stream, header, sizeof(header));
+    if (rc <= 0) {
+        return rc;
+    }
+    for (i = 0; i < 8; i++) {
+        ts |= (uint64_t)header[i] << (i * 8);
+    }
+    len = header[8] | ((size_t)header[9] << 8);
+    if (len > size) {
+        errno = ENOBUFS;
+        return -1;
+    }
+    if (len > 0) {
+        rc = capture_read_exact(stream, buf, len);
+        if (rc == 0) {
+            errno = EINVAL;
+        }
+        if (rc <= 0) {
+            return -1;
+        }
+    }
+
+    if (pts != NULL) {
+        *pts = ts;
+    }
+    if (plen != NULL) {
+        *plen = len;
+    }
+    return 1;
+}
@@ -0,0 +1,89 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * This file is part of digimend-userspace-drivers.
+ */
+
+/*
+ * Raw report capture files.
+ *
+ * A capture file consists of a header followed by report records, with
+ * all integers stored little-endian.
+ *
+ * Header:
+ *      6 bytes     Magic "DUDCAP"
+ *      2 bytes     Format version, CAPTURE_VERSION
+ *
+ * Record:
+ *      8 bytes     Report arrival time, monotonic clock, nanoseconds
+ *      2 bytes     Report length, up to CAPTURE_MAX_LEN
+ *      N bytes     Report data
+ */
+
+#ifndef _CAPTURE_H
+#define _CAPTURE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/** Capture format version */
+#define CAPTURE_VERSION 1
+
+/** Maximum length of a captured report */
+#define CAPTURE_MAX_LEN 0xffff
+
+/**
+ * Write a capture file header.
+ *
+ * @param stream    The stream to write the header to.
+ *
+ * @return True if written successfully, false otherwise,
+ *         with errno set appropriately.
+ */
+extern bool capture_write_header(FILE *stream);
+
+/**
+ * Write a report record to a capture file.
+ *
+ * @param stream    The stream to write the record to.
+ * @param ts        The report arrival time, nanoseconds.
+ * @param buf       The report data.
+ * @param len       The report length, up to CAPTURE_MAX_LEN.
+ *
+ * @return True if written successfully, false otherwise,
+ *         with errno set appropriately.
+ */
+extern bool capture_write(FILE *stream, uint64_t ts,
+                          const uint8_t *buf, size_t len);
+
+/**
+ * Read and verify a capture file header.
+ *
+ * @param stream    The stream to read the header from.
+ *
+ * @return True if read and verified successfully, false otherwise,
+ *         with errno set appropriately. EINVAL means the header is
+ *         invalid.
+ */
+extern bool capture_read_header(FILE *stream);
+
+/**
+ * Read a report record from a capture file.
+ *
+ * @param stream    The stream to read the record from.
+ * @param pts       Location for the report arrival time, nanoseconds.
+ * @param buf       The buffer to read the report data into.
+ * @param size      The size of the buffer.
+ * @param plen      Location for the report length.
+ *
+ * @return 1 if a record was read, 0 if the end of file was reached,
+ *         -1 on failure, with errno set appropriately. EINVAL means the
+ *         record is truncated, ENOBUFS means the report doesn't fit into
+ *         the buffer.
+ */
+extern int capture_read(FILE *stream, uint64_t *pts,
+                        uint8_t *buf, size_t size, size_t *plen);
+
+#endif /* _CAPTURE_H */
@@ -0,0 +1,222 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * This file is part of digimend-userspace-drivers.
+ */
+
+#include "config.h"
+#include "capture.h"
+#include "flight.h"
+#include "misc.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <getopt.h>
+#include <linux/input.h>
+#include <linux/uhid.h>
+
+/** Names of the devices records belong to, per enum flight_device */
+static const char *const dud_flight_devices[FLIGHT_DEVICE_NUM] = {
+    [FLIGHT_DEVICE_TABLET]  = "tablet",
+    [FLIGHT_DEVICE_PEN]     = "pen",
+    [FLIGHT_DEVICE_PAD]     = "pad",
+};
+
+/**
+ * Print bytes as hex to a stream.
+ *
+ * @param stream    The stream to print to.
+ * @param buf       The bytes to print.
+ * @param len       The number of bytes to print.
+ */
+static void
+dud_flight_print_hex(FILE *stream, const uint8_t *buf, size_t len)
+{
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        fprintf(stream, " %02x", buf[i]);
+    }
+}
+
+/**
+ * Print the time and the device of a flight record to a stream.
+ *
+ * @param stream    The stream to print to.
+ * @param header    The record header.
+ */
+static void
+dud_flight_print_prefix(FILE *stream,
+                        const struct flight_record_header *header)
+{
+    fprintf(stream, "%llu.%09llu %s: ",
+            (unsigned long long)(header->ts / 1000000000),
+            (unsigned long long)(header->ts % 1000000000),
+            dud_flight_devices[header->device]);
+}
+
+/**
+ * Print a flight record as text, one line per input event, as the replay
+ * "text" sink does, prefixed with the time.
+ *
+ * @param stream    The stream to print to.
+ * @param header    The record header.
+ * @param buf       The record data.
+ */
+static void
+dud_flight_print(FILE *stream, const struct flight_record_header *header,
+                 const uint8_t *buf)
+{
+    struct input_event ev;
+    size_t off;
+    size_t data = offsetof(struct uhid_event, u.input2.data);
+
+    switch ((enum flight_kind)header->kind) {
+    case FLIGHT_KIND_REPORT:
+        dud_flight_print_prefix(stream, header);
+        fprintf(stream, "report");
+        dud_flight_print_hex(stream, buf, header->len);
+        fputc('\n', stream);
+        break;
+    case FLIGHT_KIND_EVENTS:
+        for (off = 0; off + sizeof(ev) <= header->len; off += sizeof(ev)) {
+            memcpy(&ev, buf + off, sizeof(ev));
+            dud_flight_print_prefix(stream, header);
+            if (ev.type == EV_SYN && ev.code == SYN_REPORT) {
+                fprintf(stream, "----\n");
+            } else {
+                fprintf(stream, "%u %u %d\n", ev.type, ev.code, ev.value);
+            }
+        }
+        break;
+    case FLIGHT_KIND_UHID:
+        dud_flight_print_prefix(stream, header);
+        fprintf(stream, "uhid input");
+        if (header->len > data) {
+            dud_flight_print_hex(stream, buf + data, header->len - data);
+        }
+        fputc('\n', stream);
+        break;
+    case FLIGHT_KIND_NUM:
+    default:
+        break;
+    }
+}
+
+/**
+ * Print usage information.
+ *
+ * @param stream    The stream to print the usage information to.
+ * @param progname  The name of the program.
+ */
+static void
+usage(FILE *stream, const char *progname)
+{
+    fprintf(stream,
+            "Usage: %s [OPTION]... FLIGHT\n"
+            "Decode a snapshot of a flight recorder file, written by "
+            "dud-translate\n"
+            "--flight-dir, or dud-replay --flight, oldest records first.\n"
+            "\n"
+            "Options:\n"
+            "  -h, --help               Output this help message and exit.\n"
+            "  -c, --capture=FILE       Write the raw reports to FILE, "
+                                        "for dud-replay,\n"
+            "                           instead of printing all "
+                                        "records as text.\n"
+            "\n"
+            "Records are printed one line per report, input event, or "
+                                        "uhid input\n"
+            "report, as \"SECONDS DEVICE: DATA\", with monotonic "
+                                        "clock time.\n"
+            "\n",
+            progname);
+}
+
+int
+main(int argc, char **argv)
+{
+    int result = 1;
+    const char *capture_path = NULL;
+    FILE *capture = NULL;
+    struct flight_snapshot snapshot = {.ring = NULL};
+    struct flight_record_header header;
+    uint8_t *buf = NULL;
+    uint64_t num = 0;
+    int opt;
+    static const struct option longopts[] = {
+        {.name = "help",        .val = 'h'},
+        {.name = "capture",     .val = 'c', .has_arg = required_argument},
+        {.name = NULL}
+    };
+
+    /* Parse command-line options */
+    while ((opt = getopt_long(argc, argv, "+hc:", longopts, NULL)) >= 0) {
+        switch (opt) {
+        case 'h':
+            usage(stdout, argv[0]);
+            return 0;
+        case 'c':
+            capture_path = optarg;
+            break;
+        default:
+            usage(stderr, argv[0]);
+            return 1;
+        }
+    }
+    if (optind != argc - 1) {
+        GENERIC_ERROR("A single flight recorder file path is required");
+        usage(stderr, argv[0]);
+        return 1;
+    }
+
+    buf = malloc(FLIGHT_MAX_LEN);
+    if (buf == NULL) {
+        FAILURE_CLEANUP("allocate the record buffer");
+    }
+    if (!flight_snapshot_take(&snapshot, argv[optind])) {
+        if (errno == EINVAL) {
+            ERROR_CLEANUP("%s is not a flight recorder file", argv[optind]);
+        }
+        LIBC_FAILURE_CLEANUP(errno, "take a snapshot of %s", argv[optind]);
+    }
+
+    if (capture_path != NULL) {
+        capture = fopen(capture_path, "wb");
+        if (capture == NULL) {
+            LIBC_FAILURE_CLEANUP(errno, "open capture file %s",
+                                 capture_path);
+        }
+        if (!capture_write_header(capture)) {
+            LIBC_FAILURE_CLEANUP(errno, "write capture file header");
+        }
+    }
+
+    /* Decode the records */
+    while (flight_snapshot_next(&snapshot, &header, buf)) {
+        num++;
+        if (capture == NULL) {
+            dud_flight_print(stdout, &header, buf);
+        } else if (header.kind == FLIGHT_KIND_REPORT &&
+                   !capture_write(capture, header.ts, buf, header.len)) {
+            LIBC_FAILURE_CLEANUP(errno, "write a capture record");
+        }
+    }
+    if (capture != NULL && fflush(capture) != 0) {
+        LIBC_FAILURE_CLEANUP(errno, "write capture file");
+    }
+    fprintf(stderr, "%s: %llu records, %llu bytes of cut ones skipped\n",
+            snapshot.name, (unsigned long long)num,
+            (unsigned long long)snapshot.skipped);
+
+    result = 0;
+cleanup:
+    if (capture != NULL) {
+        fclose(capture);
+    }
+    flight_snapshot_free(&snapshot);
+    free(buf);
+    return result;
+}
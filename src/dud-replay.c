@@ -0,0 +1,756 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * This file is part of digimend-userspace-drivers.
+ */
+
+#include "config.h"
+#include "capture.h"
+#include "flight.h"
+#include "hist.h"
+#include "misc.h"
+#include "model.h"
+#include "pipeline.h"
+#include "sink.h"
+#include "translate.h"
+#include <dud/dud.h>
+#include <assert.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <math.h>
+#include <getopt.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <unistd.h>
+
+/** Size of each memory sink buffer */
+#define MEM_SINK_SIZE   (1024 * 1024)
+
+/** USB vendor ID of the tablet the captures are replayed as */
+#define REPLAY_VENDOR   0x256c
+
+/** USB product ID of the tablet the captures are replayed as */
+#define REPLAY_PRODUCT  0x006d
+
+/** A report loaded from a capture */
+struct replay_report {
+    /** Arrival time, nanoseconds */
+    uint64_t ts;
+    /** Offset of the report data in the capture data buffer */
+    size_t off;
+    /** Length of the report */
+    size_t len;
+};
+
+/** A capture loaded into memory */
+struct capture {
+    /** Loaded reports */
+    struct replay_report *reports;
+    /** Number of loaded reports */
+    size_t num;
+    /** Data of all reports, concatenated */
+    uint8_t *data;
+    /** Length of the data */
+    size_t len;
+};
+
+/**
+ * Load a capture file into memory.
+ *
+ * @param capture   The capture to load into.
+ * @param path      The path of the capture file.
+ *
+ * @return True if loaded successfully, false otherwise.
+ *         The capture must be freed with capture_free() either way.
+ */
+static bool
+capture_load(struct capture *capture, const char *path)
+{
+    bool result = false;
+    FILE *stream = NULL;
+    uint8_t buf[CAPTURE_MAX_LEN];
+    size_t reports_size = 0;
+    size_t data_size = 0;
+    struct replay_report report;
+    void *ptr;
+    int rc;
+
+    assert(capture != NULL);
+    assert(path != NULL);
+
+    memset(capture, 0, sizeof(*capture));
+
+    stream = fopen(path, "rb");
+    if (stream == NULL) {
+        LIBC_FAILURE_CLEANUP(errno, "open capture file %s", path);
+    }
+    if (!capture_read_header(stream)) {
+        LIBC_FAILURE_CLEANUP(errno, "read capture file header");
+    }
+
+    while ((rc = capture_read(stream, &report.ts,
+                              buf, sizeof(buf), &report.len)) > 0) {
+        /* Grow the arrays, if necessary */
+        if (capture->num >= reports_size) {
+            reports_size = reports_size == 0 ? 256 : reports_size * 2;
+            ptr = realloc(capture->reports,
+                          reports_size * sizeof(*capture->reports));
+            if (ptr == NULL) {
+                FAILURE_CLEANUP("allocate report array");
+            }
+            capture->reports = ptr;
+        }
+        while (capture->len + report.len > data_size) {
+            data_size = data_size == 0 ? 4096 : data_size * 2;
+            ptr = realloc(capture->data, data_size);
+            if (ptr == NULL) {
+                FAILURE_CLEANUP("allocate report data");
+            }
+            capture->data = ptr;
+        }
+        /* Store the report */
+        report.off = capture->len;
+        memcpy(capture->data + capture->len, buf, report.len);
+        capture->len += report.len;
+        capture->reports[capture->num++] = report;
+    }
+    if (rc < 0) {
+        LIBC_FAILURE_CLEANUP(errno, "read capture record #%zu",
+                             capture->num);
+    }
+
+    result = true;
+cleanup:
+    if (stream != NULL) {
+        fclose(stream);
+    }
+    return result;
+}
+
+/**
+ * Free a capture loaded into memory.
+ *
+ * @param capture   The capture to free.
+ */
+static void
+capture_free(struct capture *capture)
+{
+    assert(capture != NULL);
+    free(capture->reports);
+    free(capture->data);
+    memset(capture, 0, sizeof(*capture));
+}
+
+/** A pen sample decoded from a capture, for prediction evaluation */
+struct pen_sample {
+    /** Arrival time, nanoseconds */
+    uint64_t ts;
+    /** Index of the stroke, the predictor isn't reset within */
+    size_t stroke;
+    /** True if the pen is in proximity */
+    bool in_range;
+    /** True if the pen tip touches the surface */
+    bool touching;
+    /** Axis values, indexed by enum predict_axis */
+    int32_t values[PREDICT_AXIS_NUM];
+};
+
+/**
+ * Get the actual value of a sample axis at a particular time, linearly
+ * interpolated between the samples around it.
+ *
+ * @param samples   The samples.
+ * @param j         Index of the first sample not earlier than the time,
+ *                  must not be the first sample.
+ * @param ts        The time to get the value at, nanoseconds.
+ * @param axis      The axis to get the value of.
+ *
+ * @return The interpolated value.
+ */
+static double
+pen_sample_interpolate(const struct pen_sample *samples, size_t j,
+                       uint64_t ts, enum predict_axis axis)
+{
+    const struct pen_sample *a = &samples[j - 1];
+    const struct pen_sample *b = &samples[j];
+
+    if (b->ts == a->ts) {
+        return b->values[axis];
+    }
+    return a->values[axis] +
+           (double)(b->values[axis] - a->values[axis]) *
+           (double)(ts - a->ts) / (double)(b->ts - a->ts);
+}
+
+/**
+ * Print a one-line summary of a histogram of prediction errors.
+ *
+ * @param stream    The stream to print to.
+ * @param name      The name of the histogram.
+ * @param hist      The histogram of errors, axis units.
+ */
+static void
+predict_error_print(FILE *stream, const char *name, const struct hist *hist)
+{
+    fprintf(stream, "%s: p50 %llu, p95 %llu, p99 %llu, max %llu\n",
+            name,
+            (unsigned long long)hist_quantile(hist, 0.5),
+            (unsigned long long)hist_quantile(hist, 0.95),
+            (unsigned long long)hist_quantile(hist, 0.99),
+            (unsigned long long)hist->max);
+}
+
+/**
+ * Measure the error of pen motion prediction against the motion recorded
+ * in a capture: compare each predicted position with the position
+ * actually reported the prediction horizon later, within the same
+ * stroke, and print the error distribution, along with the one of not
+ * predicting at all.
+ *
+ * @param capture       The capture to evaluate the prediction with.
+ * @param decoder       The decoder to decode the reports with.
+ * @param horizon_ns    The prediction horizon, nanoseconds.
+ * @param pressure      True if pressure should be predicted too.
+ *
+ * @return True if evaluated successfully, false otherwise.
+ */
+static bool
+predict_evaluate(const struct capture *capture,
+                 const struct decoder *decoder,
+                 uint64_t horizon_ns, bool pressure)
+{
+    bool result = false;
+    struct pen_sample *samples = NULL;
+    struct pen_sample *sample;
+    size_t num = 0;
+    size_t i;
+    size_t j;
+    struct report report;
+    struct predictor predictor;
+    int32_t predicted[PREDICT_AXIS_NUM];
+    uint64_t target;
+    double x;
+    double y;
+    struct hist *position = NULL;
+    struct hist *position_base = NULL;
+    struct hist *pressure_error = NULL;
+    struct hist *pressure_base = NULL;
+    uint64_t predictions = 0;
+
+    samples = malloc(sizeof(*samples) * (capture->num + 1));
+    position = calloc(4, sizeof(*position));
+    if (samples == NULL || position == NULL) {
+        FAILURE_CLEANUP("allocate prediction evaluation data");
+    }
+    position_base = position + 1;
+    pressure_error = position + 2;
+    pressure_base = position + 3;
+
+    /* Decode the pen samples, and split them into strokes */
+    for (i = 0; i < capture->num; i++) {
+        if (!decoder_decode(decoder, &report,
+                            capture->data + capture->reports[i].off,
+                            capture->reports[i].len) ||
+            report.kind != REPORT_KIND_PEN) {
+            continue;
+        }
+        sample = &samples[num];
+        sample->ts = capture->reports[i].ts;
+        sample->in_range = report.values[REPORT_FIELD_IN_RANGE] != 0;
+        sample->touching = (report.values[REPORT_FIELD_PEN_BUTTONS] & 1) != 0;
+        sample->values[PREDICT_AXIS_X] = report.values[REPORT_FIELD_X];
+        sample->values[PREDICT_AXIS_Y] = report.values[REPORT_FIELD_Y];
+        sample->values[PREDICT_AXIS_PRESSURE] =
+            report.values[REPORT_FIELD_PRESSURE];
+        sample->stroke = num == 0 ? 0 : samples[num - 1].stroke;
+        if (num > 0 &&
+            (!sample->in_range || !samples[num - 1].in_range ||
+             sample->touching != samples[num - 1].touching ||
+             sample->ts < samples[num - 1].ts)) {
+            sample->stroke++;
+        }
+        num++;
+    }
+
+    /* Predict each sample, and compare with the actual motion */
+    predictor_init(&predictor, &model_huion_v2_axes, horizon_ns, pressure);
+    for (i = 0, j = 0; i < num; i++) {
+        sample = &samples[i];
+        memcpy(predicted, sample->values, sizeof(predicted));
+        predictor_apply(&predictor, sample->ts, sample->in_range,
+                        sample->touching, predicted);
+        if (predictor.samples < 2) {
+            continue;
+        }
+        /* Find the first sample at or after the horizon */
+        target = sample->ts + horizon_ns;
+        if (j <= i) {
+            j = i + 1;
+        }
+        while (j < num && samples[j].stroke == sample->stroke &&
+               samples[j].ts < target) {
+            j++;
+        }
+        if (j >= num || samples[j].stroke != sample->stroke) {
+            continue;
+        }
+        predictions++;
+        x = pen_sample_interpolate(samples, j, target, PREDICT_AXIS_X);
+        y = pen_sample_interpolate(samples, j, target, PREDICT_AXIS_Y);
+        hist_record(position,
+                    (uint64_t)(hypot(predicted[PREDICT_AXIS_X] - x,
+                                     predicted[PREDICT_AXIS_Y] - y) + 0.5));
+        hist_record(position_base,
+                    (uint64_t)(hypot(sample->values[PREDICT_AXIS_X] - x,
+                                     sample->values[PREDICT_AXIS_Y] - y) +
+                               0.5));
+        if (sample->touching) {
+            x = pen_sample_interpolate(samples, j, target,
+                                       PREDICT_AXIS_PRESSURE);
+            hist_record(pressure_error,
+                        (uint64_t)(fabs(predicted[PREDICT_AXIS_PRESSURE] -
+                                        x) + 0.5));
+            hist_record(pressure_base,
+                        (uint64_t)(fabs(sample->values[PREDICT_AXIS_PRESSURE] -
+                                        x) + 0.5));
+        }
+    }
+
+    fprintf(stderr, "%llu predictions %.1f ms ahead, out of %zu pen reports\n",
+            (unsigned long long)predictions, (double)horizon_ns / 1e6, num);
+    predict_error_print(stderr, "position error, predicted", position);
+    predict_error_print(stderr, "position error, not predicted",
+                        position_base);
+    if (pressure) {
+        predict_error_print(stderr, "pressure error, predicted",
+                            pressure_error);
+        predict_error_print(stderr, "pressure error, not predicted",
+                            pressure_base);
+    }
+
+    result = true;
+cleanup:
+    free(position);
+    free(samples);
+    return result;
+}
+
+/**
+ * Count event frames delivered through the library interface, into frame
+ * statistics of each device.
+ */
+static void
+replay_library_event(void *data, enum dud_device device,
+                     const struct dud_event *events, size_t num)
+{
+    struct frame_stats *stats = (struct frame_stats *)data;
+
+    (void)events;
+    counter_inc(&stats[device].frames);
+    counter_add(&stats[device].events, num);
+}
+
+/** The translator of replayed reports */
+struct replay_target {
+    /** The outputs to translate the reports to, unless through libdud */
+    struct outputs *outputs;
+    /** The decoder to decode the reports with, unless through libdud */
+    const struct decoder *decoder;
+    /** The library translator to process the reports with, or NULL */
+    struct dud_translator *translator;
+    /** The flight recorder to record the reports into, or NULL */
+    struct flight *flight;
+};
+
+/**
+ * Translate a replayed report, directly, or on the output thread.
+ *
+ * @param data  The replay target.
+ * @param ts    The report arrival time, nanoseconds.
+ * @param buf   The report buffer.
+ * @param len   The length of the report.
+ */
+static void
+replay_translate(void *data, uint64_t ts, const uint8_t *buf, size_t len)
+{
+    const struct replay_target *target = (const struct replay_target *)data;
+
+    if (target->flight != NULL) {
+        flight_record(target->flight, FLIGHT_KIND_REPORT,
+                      FLIGHT_DEVICE_TABLET, ts, buf, len);
+    }
+    if (target->translator != NULL) {
+        dud_translator_process(target->translator, ts, buf, len);
+    } else {
+        translate(target->outputs, target->decoder, ts, buf, len);
+    }
+}
+
+/**
+ * Print usage information.
+ *
+ * @param stream    The stream to print the usage information to.
+ * @param progname  The name of the program.
+ */
+static void
+usage(FILE *stream, const char *progname)
+{
+    fprintf(stream,
+            "Usage: %s [OPTION]... CAPTURE\n"
+            "Replay a raw report capture through the translator, "
+            "and measure throughput.\n"
+            "\n"
+            "Options:\n"
+            "  -h, --help               Output this help message and exit.\n"
+            "  -s, --sink=SINK          Write events to SINK: \"null\" - "
+                                        "/dev/null\n"
+            "                           (default), \"memory\" - a memory "
+                                        "buffer,\n"
+            "                           \"text\" - stdout, as text, or "
+                                        "\"library\" - a\n"
+            "                           function, through the libdud "
+                                        "interface.\n"
+            "  -d, --decoder=DECODER    Decode with DECODER: \"plan\" - "
+                                        "compiled from the\n"
+            "                           report descriptor, as the "
+                                        "daemon does (default),\n"
+            "                           \"generic\" - the same plan, "
+                                        "never specialized,\n"
+            "                           or \"fixed\" - hand-written, "
+                                        "for reference.\n"
+            "  -n, --repeat=NUM         Replay the capture NUM times, "
+                                        "default 1.\n"
+            "  -p, --predict=MS         Predict pen motion MS milliseconds "
+                                        "ahead, and\n"
+            "                           measure the prediction error "
+                                        "against the capture.\n"
+            "  -P, --predict-pressure   Predict pressure as well.\n"
+            "  -o, --output=OUTPUT      Translate for OUTPUT devices: "
+                                        "\"uinput\" -\n"
+            "                           input events (default), or "
+                                        "\"uhid\" - HID\n"
+            "                           input reports, not to the "
+                                        "\"text\" sink.\n"
+            "  -T, --output-thread      Translate on an output thread, "
+                                        "fed through\n"
+            "                           a pipeline, as the daemon "
+                                        "does with the\n"
+            "                           same option.\n"
+            "  -F, --flight=FILE        Record the reports and the "
+                                        "output into\n"
+            "                           flight recorder FILE, as the "
+                                        "daemon does\n"
+            "                           with --flight-dir.\n"
+            "\n",
+            progname);
+}
+
+int
+main(int argc, char **argv)
+{
+    int result = 1;
+    const char *sink_name = "null";
+    const char *output_name = "uinput";
+    unsigned long repeat = 1;
+    unsigned long i;
+    size_t j;
+    char *end;
+    int opt;
+    struct capture capture = {.num = 0};
+    int null_fd = -1;
+    struct sink_fd pen_sink_fd;
+    struct sink_fd pad_sink_fd;
+    struct sink_mem pen_sink_mem;
+    struct sink_mem pad_sink_mem;
+    struct sink_text pen_sink_text;
+    struct sink_text pad_sink_text;
+    uint8_t *pen_buf = NULL;
+    uint8_t *pad_buf = NULL;
+    struct outputs outputs = {.pen = {.sink = NULL}};
+    struct dud_translator *translator = NULL;
+    struct frame_stats library_stats[2];
+    const struct replay_report *report;
+    const char *decoder_name = "plan";
+    struct decoder decoder;
+    uint64_t start;
+    uint64_t duration;
+    uint64_t reports;
+    uint64_t events;
+    uint64_t predict_ns = 0;
+    bool predict_pressure = false;
+    double predict_ms;
+    bool output_thread = false;
+    struct replay_target target;
+    struct pipeline pipeline = {.wake_fd = -1};
+    struct pipeline_stats pipeline_stats;
+    const char *flight_path = NULL;
+    struct flight flight = {.header = NULL};
+    struct flight_sink pen_flight_sink;
+    struct flight_sink pad_flight_sink;
+    enum flight_kind flight_kind;
+    static const struct option longopts[] = {
+        {.name = "help",                .val = 'h'},
+        {.name = "sink",                .val = 's',
+                                        .has_arg = required_argument},
+        {.name = "repeat",              .val = 'n',
+                                        .has_arg = required_argument},
+        {.name = "decoder",             .val = 'd',
+                                        .has_arg = required_argument},
+        {.name = "predict",             .val = 'p',
+                                        .has_arg = required_argument},
+        {.name = "predict-pressure",    .val = 'P'},
+        {.name = "output",              .val = 'o',
+                                        .has_arg = required_argument},
+        {.name = "output-thread",       .val = 'T'},
+        {.name = "flight",              .val = 'F',
+                                        .has_arg = required_argument},
+        {.name = NULL}
+    };
+
+    /* Parse command-line options */
+    while ((opt = getopt_long(argc, argv, "+hs:n:d:p:Po:TF:",
+                              longopts, NULL)) >= 0) {
+        switch (opt) {
+        case 'h':
+            usage(stdout, argv[0]);
+            return 0;
+        case 's':
+            sink_name = optarg;
+            break;
+        case 'd':
+            decoder_name = optarg;
+            break;
+        case 'o':
+            output_name = optarg;
+            break;
+        case 'n':
+            errno = 0;
+            repeat = strtoul(optarg, &end, 0);
+            if (errno != 0 || *end != '\0' || repeat < 1) {
+                GENERIC_ERROR("Invalid repeat count: %s", optarg);
+                usage(stderr, argv[0]);
+                return 1;
+            }
+            break;
+        case 'p':
+            errno = 0;
+            predict_ms = strtod(optarg, &end);
+            if (errno != 0 || *end != '\0' || !(predict_ms > 0) ||
+                predict_ms * 1e6 > PREDICT_MAX_HORIZON_NS) {
+                GENERIC_ERROR("Invalid prediction time: %s", optarg);
+                usage(stderr, argv[0]);
+                return 1;
+            }
+            predict_ns = (uint64_t)(predict_ms * 1e6 + 0.5);
+            break;
+        case 'P':
+            predict_pressure = true;
+            break;
+        case 'T':
+            output_thread = true;
+            break;
+        case 'F':
+            flight_path = optarg;
+            break;
+        default:
+            usage(stderr, argv[0]);
+            return 1;
+        }
+    }
+    if (optind != argc - 1) {
+        GENERIC_ERROR("A single capture file path is required");
+        usage(stderr, argv[0]);
+        return 1;
+    }
+
+    /* Setup the decoder */
+    if (strcmp(decoder_name, "plan") == 0) {
+        if (!decoder_init_huion_v2(&decoder, NULL, 0)) {
+            FAILURE_CLEANUP("initialize the decoder");
+        }
+    } else if (strcmp(decoder_name, "generic") == 0) {
+        if (!decoder_init_huion_v2_generic(&decoder, NULL, 0)) {
+            FAILURE_CLEANUP("initialize the decoder");
+        }
+    } else if (strcmp(decoder_name, "fixed") == 0) {
+        decoder_init_huion_v2_fixed(&decoder);
+    } else {
+        ERROR_CLEANUP("Unknown decoder: %s", decoder_name);
+    }
+
+    /* Setup the output backend */
+    if (strcmp(output_name, "uinput") == 0) {
+        outputs.backend = OUTPUT_BACKEND_UINPUT;
+    } else if (strcmp(output_name, "uhid") == 0) {
+        if (strcmp(sink_name, "text") == 0) {
+            ERROR_CLEANUP("The text sink can't take uhid output");
+        }
+        outputs.backend = OUTPUT_BACKEND_UHID;
+    } else {
+        ERROR_CLEANUP("Unknown output: %s", output_name);
+    }
+
+    /* Setup the sinks */
+    if (strcmp(sink_name, "null") == 0) {
+        null_fd = open("/dev/null", O_WRONLY);
+        if (null_fd < 0) {
+            LIBC_FAILURE_CLEANUP(errno, "open /dev/null");
+        }
+        outputs.pen.sink = sink_fd_init(&pen_sink_fd, null_fd);
+        outputs.pad.sink = sink_fd_init(&pad_sink_fd, null_fd);
+    } else if (strcmp(sink_name, "memory") == 0) {
+        pen_buf = malloc(MEM_SINK_SIZE);
+        pad_buf = malloc(MEM_SINK_SIZE);
+        if (pen_buf == NULL || pad_buf == NULL) {
+            FAILURE_CLEANUP("allocate memory sink buffers");
+        }
+        outputs.pen.sink = sink_mem_init(&pen_sink_mem,
+                                         pen_buf, MEM_SINK_SIZE);
+        outputs.pad.sink = sink_mem_init(&pad_sink_mem,
+                                         pad_buf, MEM_SINK_SIZE);
+    } else if (strcmp(sink_name, "text") == 0) {
+        outputs.pen.sink = sink_text_init(&pen_sink_text, stdout, "pen");
+        outputs.pad.sink = sink_text_init(&pad_sink_text, stdout, "pad");
+    } else if (strcmp(sink_name, "library") == 0) {
+        if (outputs.backend != OUTPUT_BACKEND_UINPUT) {
+            ERROR_CLEANUP("The library sink takes uinput output only");
+        }
+        memset(library_stats, 0, sizeof(library_stats));
+        translator = dud_translator_new(REPLAY_VENDOR, REPLAY_PRODUCT,
+                                        NULL, 0, replay_library_event,
+                                        library_stats);
+        if (translator == NULL) {
+            LIBC_FAILURE_CLEANUP(errno, "create a library translator");
+        }
+    } else {
+        ERROR_CLEANUP("Unknown sink: %s", sink_name);
+    }
+
+    /* Record the reports, and the output, if requested */
+    if (flight_path != NULL) {
+        if (translator != NULL) {
+            ERROR_CLEANUP("The library sink can't be recorded");
+        }
+        if (!flight_open(&flight, flight_path, FLIGHT_DEF_SIZE, "replay")) {
+            LIBC_FAILURE_CLEANUP(errno, "open flight recorder file %s",
+                                 flight_path);
+        }
+        flight_kind = outputs.backend == OUTPUT_BACKEND_UHID
+            ? FLIGHT_KIND_UHID : FLIGHT_KIND_EVENTS;
+        outputs.pen.sink = flight_sink_init(&pen_flight_sink,
+                                            outputs.pen.sink, &flight,
+                                            flight_kind, FLIGHT_DEVICE_PEN);
+        outputs.pad.sink = flight_sink_init(&pad_flight_sink,
+                                            outputs.pad.sink, &flight,
+                                            flight_kind, FLIGHT_DEVICE_PAD);
+    }
+
+    /* Load the capture */
+    if (!capture_load(&capture, argv[optind])) {
+        FAILURE_CLEANUP("load capture file %s", argv[optind]);
+    }
+
+    /* Setup the predictor */
+    if (predict_ns != 0) {
+        predictor_init(&outputs.predictor, &model_huion_v2_axes,
+                       predict_ns, predict_pressure);
+        if (translator != NULL) {
+            dud_translator_predict(translator, predict_ns, predict_pressure);
+        }
+    } else if (predict_pressure) {
+        ERROR_CLEANUP("Pressure prediction requires --predict");
+    }
+
+    /* Setup the output thread */
+    target.outputs = &outputs;
+    target.decoder = &decoder;
+    target.translator = translator;
+    target.flight = flight_is_open(&flight) ? &flight : NULL;
+    if (output_thread) {
+        for (j = 0; j < capture.num; j++) {
+            if (capture.reports[j].len > PIPELINE_REPORT_MAX) {
+                ERROR_CLEANUP("Report #%zu is too long for the "
+                              "output thread", j);
+            }
+        }
+        memset(&pipeline_stats, 0, sizeof(pipeline_stats));
+        if (!pipeline_init(&pipeline, PIPELINE_DEF_SLOTS,
+                           replay_translate, &target, &pipeline_stats)) {
+            LIBC_FAILURE_CLEANUP(errno, "initialize the output pipeline");
+        }
+        if (!pipeline_start(&pipeline)) {
+            LIBC_FAILURE_CLEANUP(errno, "start the output thread");
+        }
+    }
+
+    /* Replay, waiting for the output thread, when it falls behind */
+    start = clock_ns();
+    for (i = 0; i < repeat; i++) {
+        for (j = 0; j < capture.num; j++) {
+            report = &capture.reports[j];
+            if (!output_thread) {
+                replay_translate(&target, report->ts,
+                                 capture.data + report->off, report->len);
+                continue;
+            }
+            while (!pipeline_push(&pipeline, report->ts,
+                                  capture.data + report->off,
+                                  report->len)) {
+                sched_yield();
+            }
+        }
+    }
+    pipeline_stop(&pipeline);
+    duration = clock_ns() - start;
+
+    /* Report */
+    if (translator != NULL) {
+        outputs.pen.stats = library_stats[DUD_DEVICE_PEN];
+        outputs.pad.stats = library_stats[DUD_DEVICE_PAD];
+    }
+    reports = (uint64_t)capture.num * repeat;
+    events = counter_get(&outputs.pen.stats.events) +
+             counter_get(&outputs.pad.stats.events);
+    fprintf(stderr,
+            "%llu reports, %llu events in %.3f s: "
+            "%.0f reports/s, %.0f events/s, %.1f ns/report\n",
+            (unsigned long long)reports,
+            (unsigned long long)events,
+            (double)duration / 1e9,
+            duration == 0 ? 0.0 : (double)reports * 1e9 / (double)duration,
+            duration == 0 ? 0.0 : (double)events * 1e9 / (double)duration,
+            reports == 0 ? 0.0 : (double)duration / (double)reports);
+    frame_stats_print("pen", &outputs.pen.stats);
+    frame_stats_print("pad", &outputs.pad.stats);
+    if (output_thread) {
+        fprintf(stderr,
+                "pipeline: %llu reports pushed, %llu times full, "
+                "%llu/%u slots used at most, %llu wakeups\n",
+                (unsigned long long)counter_get(&pipeline_stats.pushed),
+                (unsigned long long)counter_get(&pipeline_stats.overruns),
+                (unsigned long long)counter_get(&pipeline_stats.high_water),
+                PIPELINE_DEF_SLOTS,
+                (unsigned long long)counter_get(&pipeline_stats.wakeups));
+    }
+    if (predict_ns != 0 &&
+        !predict_evaluate(&capture, &decoder, predict_ns, predict_pressure)) {
+        FAILURE_CLEANUP("evaluate prediction");
+    }
+
+    result = 0;
+cleanup:
+    pipeline_stop(&pipeline);
+    pipeline_cleanup(&pipeline);
+    flight_close(&flight);
+    dud_translator_free(translator);
+    capture_free(&capture);
+    free(pad_buf);
+    free(pen_buf);
+    if (null_fd >= 0) {
+        close(null_fd);
+    }
+    return result;
+}
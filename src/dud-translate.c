@@ -1,800 +1,766 @@
 #include "config.h"
+#include "capture.h"
+#include "log.h"
+#include "loop.h"
+#include "map.h"
+#include "misc.h"
+#include "model.h"
+#include "query.h"
+#include "ring.h"
+#include "rt.h"
+#include "tablet.h"
+#include "usb.h"
 #include <assert.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <errno.h>
 #include <string.h>
-#include <sys/types.h>
-#include <sys/stat.h>
-#include <fcntl.h>
-#include <unistd.h>
-#include <linux/uinput.h>
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wpacked"
-#include <libusb.h>
-#pragma GCC diagnostic pop
-
-/* Define LIBUSB_CALL for libusb <= 1.0.8 */
-#ifndef LIBUSB_CALL
-#define LIBUSB_CALL
-#endif
-
-#define GENERIC_ERROR(_fmt, _args...) \
-    fprintf(stderr, _fmt "\n", ##_args)
-
-#define GENERIC_FAILURE(_fmt, _args...) \
-    GENERIC_ERROR("Failed to " _fmt, ##_args)
-
-#define LIBUSB_FAILURE(_err, _fmt, _args...) \
-    GENERIC_FAILURE(_fmt ": %s", ##_args, libusb_strerror(_err))
-
-#define LIBC_FAILURE(_errno, _fmt, _args...) \
-    GENERIC_FAILURE(_fmt ": %s", ##_args, strerror(_errno))
-
-#define ERROR_CLEANUP(_fmt, _args...) \
-    do {                                \
-        GENERIC_ERROR(_fmt, ##_args);   \
-        goto cleanup;                   \
-    } while (0)
-
-#define FAILURE_CLEANUP(_fmt, _args...) \
-    do {                                \
-        GENERIC_FAILURE(_fmt, ##_args); \
-        goto cleanup;                   \
-    } while (0)
-
-#define LIBUSB_FAILURE_CLEANUP(_err, _fmt, _args...) \
-    do {                                                \
-        LIBUSB_FAILURE(_err, _fmt, ##_args);            \
-        goto cleanup;                                   \
-    } while (0)
-
-#define LIBC_FAILURE_CLEANUP(_errno, _fmt, _args...) \
-    do {                                                \
-        LIBC_FAILURE(_errno, _fmt, ##_args);            \
-        goto cleanup;                                   \
-    } while (0)
-
-#define LIBUSB_GUARD(_expr, _fmt, _args...) \
-    do {                                                    \
-        enum libusb_error _err = _expr;                     \
-        if (_err != LIBUSB_SUCCESS)                         \
-            LIBUSB_FAILURE_CLEANUP(_err, _fmt, ##_args);    \
-    } while (0)
-
-#define LIBC_GUARD(_expr, _fmt, _args...) \
-    do {                                                \
-        int _rc = _expr;                                \
-        if (_rc < 0)                                    \
-            LIBC_FAILURE_CLEANUP(errno, _fmt, ##_args); \
-    } while (0)
+#include <getopt.h>
+#include <limits.h>
+#include <sched.h>
+#include <signal.h>
+
+
+/** The daemon state */
+struct daemon {
+    /** The libusb context */
+    libusb_context *ctx;
+    /** The event loop */
+    struct loop loop;
+    /** The watch of termination and statistics dump signals */
+    struct loop_watch signal_watch;
+    /** The path of the file to keep updating statistics in, or NULL */
+    const char *stats_path;
+    /** The timer of updating the statistics file */
+    struct loop_watch stats_watch;
+    /** The path of the statistics query socket, or NULL */
+    const char *query_path;
+    /** The statistics query socket server */
+    struct query_server query;
+    /** The options to serve tablets with */
+    struct tablet_options options;
+    /** The list of tablets */
+    struct tablet *tablets;
+    /** True if tablets arrived or left since the last update */
+    bool changed;
+};
 
 
 /**
- * Destroy a uinput device.
+ * Add a tablet for an arrived device to the daemon, or attach it to the
+ * detached tablet it was plugged in place of, to be opened on the next
+ * update.
  *
- * @param fd    The file descriptor of the uinput device to destroy.
+ * @param daemon    The daemon to add the tablet to.
+ * @param dev       The arrived device.
+ * @param model     The model of the arrived device.
  */
 static void
-uinput_destroy(int fd)
+daemon_arrive(struct daemon *daemon, libusb_device *dev,
+              const struct model *model)
 {
-    if (fd >= 0) {
-        ioctl(fd, UI_DEV_DESTROY);
-        close(fd);
+    struct tablet **ptablet;
+
+    assert(daemon != NULL);
+    assert(dev != NULL);
+
+    for (ptablet = &daemon->tablets; *ptablet != NULL;
+         ptablet = &(*ptablet)->next) {
+        if ((*ptablet)->dev == dev && !(*ptablet)->gone) {
+            return;
+        }
     }
+    for (ptablet = &daemon->tablets; *ptablet != NULL;
+         ptablet = &(*ptablet)->next) {
+        if ((*ptablet)->dev == NULL && tablet_matches(*ptablet, dev, model)) {
+            tablet_attach(*ptablet, dev);
+            daemon->changed = true;
+            fprintf(stderr, "%s: returned\n", (*ptablet)->name);
+            return;
+        }
+    }
+    *ptablet = tablet_new(dev, model);
+    if (*ptablet == NULL) {
+        GENERIC_FAILURE("allocate a tablet");
+        return;
+    }
+    daemon->changed = true;
+    fprintf(stderr, "%s: arrived\n", (*ptablet)->name);
 }
 
 
 /**
- * Create a uinput pen device.
+ * Mark a tablet of a departed device as gone, to be closed on the next
+ * update.
  *
- * @return The file descriptor of the created device, or -1 on failure.
+ * @param daemon    The daemon to look up the tablet in.
+ * @param dev       The departed device.
  */
-static int
-uinput_create_pen(void)
+static void
+daemon_leave(struct daemon *daemon, libusb_device *dev)
 {
-    int result = -1;
-    int fd = -1;
-    struct uinput_abs_setup uinput_abs_setup;
-    struct uinput_setup uinput_setup;
-
-    /* Open the file */
-    fd = open("/dev/uinput", O_WRONLY | O_NONBLOCK);
-    if (fd < 0) {
-        LIBC_FAILURE_CLEANUP(errno, "open /dev/uinput");
-    }
+    struct tablet *tablet;
 
-#define SET_EVBIT(_bit_token) \
-LIBC_GUARD(ioctl(fd, UI_SET_EVBIT, _bit_token),  \
-           "enable uinput %s", #_bit_token)
-    SET_EVBIT(EV_SYN);
-    SET_EVBIT(EV_KEY);
-    SET_EVBIT(EV_REL);
-    SET_EVBIT(EV_ABS);
-    SET_EVBIT(EV_MSC);
-#undef SET_EVBIT
-
-#define SET_KEYBIT(_bit_token) \
-LIBC_GUARD(ioctl(fd, UI_SET_KEYBIT, _bit_token),  \
-           "enable uinput %s", #_bit_token)
-    SET_KEYBIT(BTN_LEFT);
-    SET_KEYBIT(BTN_RIGHT);
-    SET_KEYBIT(BTN_MIDDLE);
-    SET_KEYBIT(BTN_SIDE);
-    SET_KEYBIT(BTN_EXTRA);
-    SET_KEYBIT(BTN_TOOL_PEN);
-    SET_KEYBIT(BTN_TOOL_RUBBER);
-    SET_KEYBIT(BTN_TOOL_BRUSH);
-    SET_KEYBIT(BTN_TOOL_PENCIL);
-    SET_KEYBIT(BTN_TOOL_AIRBRUSH);
-    SET_KEYBIT(BTN_TOOL_MOUSE);
-    SET_KEYBIT(BTN_TOOL_LENS);
-    SET_KEYBIT(BTN_TOUCH);
-    SET_KEYBIT(BTN_STYLUS);
-    SET_KEYBIT(BTN_STYLUS2);
-#undef SET_KEYBIT
-
-#define SET_ABSBIT(_bit_token) \
-LIBC_GUARD(ioctl(fd, UI_SET_ABSBIT, _bit_token),  \
-           "enable uinput %s", #_bit_token)
-    SET_ABSBIT(ABS_X);
-    SET_ABSBIT(ABS_Y);
-    SET_ABSBIT(ABS_Z);
-    SET_ABSBIT(ABS_RZ);
-    SET_ABSBIT(ABS_THROTTLE);
-    SET_ABSBIT(ABS_WHEEL);
-    SET_ABSBIT(ABS_PRESSURE);
-    SET_ABSBIT(ABS_DISTANCE);
-    SET_ABSBIT(ABS_TILT_X);
-    SET_ABSBIT(ABS_TILT_Y);
-    SET_ABSBIT(ABS_MISC);
-#undef SET_ABSBIT
-
-#define SET_RELBIT(_bit_token) \
-LIBC_GUARD(ioctl(fd, UI_SET_RELBIT, _bit_token),  \
-           "enable uinput %s", #_bit_token)
-    SET_RELBIT(REL_WHEEL);
-#undef SET_RELBIT
-
-#define SET_MSCBIT(_bit_token) \
-LIBC_GUARD(ioctl(fd, UI_SET_MSCBIT, _bit_token),  \
-           "enable uinput %s", #_bit_token)
-    SET_MSCBIT(MSC_SERIAL);
-#undef SET_MSCBIT
-
-    /* Setup X axis */
-    uinput_abs_setup = (struct uinput_abs_setup){
-        .code = ABS_X,
-        .absinfo = {
-            .value = 0,
-            .minimum = 0,
-            .maximum = 50800,
-            .resolution = 200,
-        },
-    };
-    LIBC_GUARD(ioctl(fd, UI_ABS_SETUP, &uinput_abs_setup),
-               "setup X axis");
-
-    /* Setup Y axis */
-    uinput_abs_setup = (struct uinput_abs_setup){
-        .code = ABS_Y,
-        .absinfo = {
-            .value = 0,
-            .minimum = 0,
-            .maximum = 31750,
-            .resolution = 200,
-        },
-    };
-    LIBC_GUARD(ioctl(fd, UI_ABS_SETUP, &uinput_abs_setup),
-               "setup Y axis");
-
-    /* Setup pressure axis */
-    uinput_abs_setup = (struct uinput_abs_setup){
-        .code = ABS_PRESSURE,
-        .absinfo = {
-            .value = 0,
-            .minimum = 0,
-            .maximum = 8191,
-        },
-    };
-    LIBC_GUARD(ioctl(fd, UI_ABS_SETUP, &uinput_abs_setup),
-               "setup pressure axis");
-
-    /* Setup tilt X axis */
-    uinput_abs_setup = (struct uinput_abs_setup){
-        .code = ABS_TILT_X,
-        .absinfo = {
-            .value = 0,
-            .minimum = -60,
-            .maximum = 60,
-        },
-    };
-    LIBC_GUARD(ioctl(fd, UI_ABS_SETUP, &uinput_abs_setup),
-               "setup tilt X axis");
-
-    /* Setup tilt Y axis */
-    uinput_abs_setup = (struct uinput_abs_setup){
-        .code = ABS_TILT_Y,
-        .absinfo = {
-            .value = 0,
-            .minimum = -60,
-            .maximum = 60,
-        },
-    };
-    LIBC_GUARD(ioctl(fd, UI_ABS_SETUP, &uinput_abs_setup),
-               "setup tilt Y axis");
-
-    /* Setup device */
-    /* Pose as 056a:0314 Wacom Co., Ltd PTH-451 [Intuos pro (S)] */
-    uinput_setup = (struct uinput_setup){
-        .id = {
-            .bustype = BUS_USB,
-            .vendor = 0x056a,
-            .product = 0x0314,
-            .version = 0x0110,
-        },
-        .name = "Wacom Intuos Pro S Pen",
-    };
-    LIBC_GUARD(ioctl(fd, UI_DEV_SETUP, &uinput_setup),
-               "setup uinput device");
-
-    /* Create device */
-    LIBC_GUARD(ioctl(fd, UI_DEV_CREATE), "create uinput device");
-
-    result = fd;
-    fd = -1;
-
-cleanup:
+    assert(daemon != NULL);
+    assert(dev != NULL);
 
-    if (fd >= 0) {
-        close(fd);
+    for (tablet = daemon->tablets; tablet != NULL; tablet = tablet->next) {
+        if (tablet->dev == dev && !tablet->gone) {
+            tablet->gone = true;
+            daemon->changed = true;
+            fprintf(stderr, "%s: left\n", tablet->name);
+        }
     }
-
-    return result;
 }
 
 
 /**
- * Create a uinput pad device.
+ * Open the arrived tablets, detach the departed ones, reset the ones
+ * which transfers failed, close the ones failing to open, and watch
+ * congested outputs. Done outside libusb callbacks, as opening and
+ * closing does synchronous operations.
  *
- * @return The file descriptor of the created device, or -1 on failure.
+ * Tablets which had input devices keep them while detached, for the
+ * device to be reattached to them, when plugged into the same port.
+ *
+ * @param daemon    The daemon to update the tablets of.
  */
-static int
-uinput_create_pad(void)
+static void
+daemon_update(struct daemon *daemon)
 {
-    int result = -1;
-    int fd = -1;
-    struct uinput_abs_setup uinput_abs_setup;
-    struct uinput_setup uinput_setup;
-
-    /* Open the file */
-    fd = open("/dev/uinput", O_WRONLY | O_NONBLOCK);
-    if (fd < 0) {
-        LIBC_FAILURE_CLEANUP(errno, "open /dev/uinput");
+    struct tablet **ptablet;
+    struct tablet *tablet;
+
+    assert(daemon != NULL);
+
+    daemon->changed = false;
+    ptablet = &daemon->tablets;
+    while (*ptablet != NULL) {
+        tablet = *ptablet;
+        if (tablet->gone) {
+            if (tablet->pen_fd >= 0) {
+                tablet_detach(tablet, daemon->ctx);
+                fprintf(stderr, "%s: keeping input devices "
+                        "until replugged\n", tablet->name);
+            } else {
+                tablet_close(tablet, daemon->ctx);
+                /* Re-read the link, closing could have appended tablets */
+                *ptablet = tablet->next;
+                tablet_free(tablet);
+                continue;
+            }
+        }
+        if (tablet->handle != NULL && !tablet->failed &&
+            tablet->ring.failed) {
+            GENERIC_ERROR("%s: transfers failed, resetting", tablet->name);
+            tablet_reset(tablet, daemon->ctx);
+        }
+        if (tablet->dev != NULL && tablet->handle == NULL &&
+            !tablet->failed && !tablet_open(tablet, &daemon->options)) {
+            tablet->failed = true;
+        }
+        /* Failed either opening, or initializing asynchronously */
+        if (tablet->failed && tablet->handle != NULL) {
+            GENERIC_ERROR("%s: failed to open, ignoring until replugged",
+                          tablet->name);
+            if (tablet->pen_fd >= 0) {
+                tablet_detach(tablet, daemon->ctx);
+            } else {
+                tablet_close(tablet, daemon->ctx);
+            }
+        }
+        if (tablet->handle != NULL) {
+            tablet_watch_outputs(tablet);
+        }
+        ptablet = &tablet->next;
     }
+}
 
-#define SET_EVBIT(_bit_token) \
-LIBC_GUARD(ioctl(fd, UI_SET_EVBIT, _bit_token),  \
-           "enable uinput %s", #_bit_token)
-    SET_EVBIT(EV_SYN);
-    SET_EVBIT(EV_KEY);
-    SET_EVBIT(EV_ABS);
-#undef SET_EVBIT
-
-#define SET_KEYBIT(_bit_token) \
-LIBC_GUARD(ioctl(fd, UI_SET_KEYBIT, _bit_token),  \
-           "enable uinput %s", #_bit_token)
-    SET_KEYBIT(BTN_0);
-    SET_KEYBIT(BTN_1);
-    SET_KEYBIT(BTN_2);
-    SET_KEYBIT(BTN_3);
-    SET_KEYBIT(BTN_4);
-    SET_KEYBIT(BTN_5);
-    SET_KEYBIT(BTN_6);
-    SET_KEYBIT(BTN_7);
-    SET_KEYBIT(BTN_8);
-    SET_KEYBIT(BTN_9);
-    SET_KEYBIT(BTN_A);
-    SET_KEYBIT(BTN_B);
-    SET_KEYBIT(BTN_C);
-    SET_KEYBIT(BTN_STYLUS);
-#undef SET_KEYBIT
-
-#define SET_ABSBIT(_bit_token) \
-LIBC_GUARD(ioctl(fd, UI_SET_ABSBIT, _bit_token),  \
-           "enable uinput %s", #_bit_token)
-    SET_ABSBIT(ABS_X);
-    SET_ABSBIT(ABS_Y);
-    SET_ABSBIT(ABS_WHEEL);
-    SET_ABSBIT(ABS_MISC);
-#undef SET_ABSBIT
-
-    /* Setup X axis */
-    uinput_abs_setup = (struct uinput_abs_setup){
-        .code = ABS_X,
-        .absinfo = {
-            .value = 0,
-            .minimum = 0,
-            .maximum = 1,
-        },
-    };
-    LIBC_GUARD(ioctl(fd, UI_ABS_SETUP, &uinput_abs_setup),
-               "setup X axis");
-
-    /* Setup Y axis */
-    uinput_abs_setup = (struct uinput_abs_setup){
-        .code = ABS_Y,
-        .absinfo = {
-            .value = 0,
-            .minimum = 0,
-            .maximum = 1,
-        },
-    };
-    LIBC_GUARD(ioctl(fd, UI_ABS_SETUP, &uinput_abs_setup),
-               "setup Y axis");
-
-    /* Setup absolute wheel */
-    uinput_abs_setup = (struct uinput_abs_setup){
-        .code = ABS_WHEEL,
-        .absinfo = {
-            .value = 0,
-            .minimum = 0,
-            .maximum = 71,
-        },
-    };
-    LIBC_GUARD(ioctl(fd, UI_ABS_SETUP, &uinput_abs_setup),
-               "setup absolute wheel");
-
-    /* Setup misc axis */
-    uinput_abs_setup = (struct uinput_abs_setup){
-        .code = ABS_MISC,
-        .absinfo = {
-            .value = 0,
-            .minimum = 0,
-            .maximum = 0,
-        },
-    };
-    LIBC_GUARD(ioctl(fd, UI_ABS_SETUP, &uinput_abs_setup),
-               "setup misc axis");
-
-    /* Setup device */
-    /* Pose as 056a:0314 Wacom Co., Ltd PTH-451 [Intuos pro (S)] */
-    uinput_setup = (struct uinput_setup){
-        .id = {
-            .bustype = BUS_USB,
-            .vendor = 0x056a,
-            .product = 0x0314,
-            .version = 0x0110,
-        },
-        .name = "Wacom Intuos Pro S Pad",
-    };
-    LIBC_GUARD(ioctl(fd, UI_DEV_SETUP, &uinput_setup),
-               "setup uinput device");
-
-    /* Create device */
-    LIBC_GUARD(ioctl(fd, UI_DEV_CREATE), "create uinput device");
 
-    result = fd;
-    fd = -1;
+/**
+ * Print the latency statistics of all tablets of the daemon.
+ *
+ * @param daemon    The daemon to print the statistics of.
+ * @param stream    The stream to print to.
+ */
+static void
+daemon_print_latency(const struct daemon *daemon, FILE *stream)
+{
+    const struct tablet *tablet;
 
-cleanup:
+    assert(daemon != NULL);
+    assert(stream != NULL);
 
-    if (fd >= 0) {
-        close(fd);
+    for (tablet = daemon->tablets; tablet != NULL; tablet = tablet->next) {
+        tablet_print_latency(tablet, stream);
     }
-
-    return result;
 }
 
 
 /**
- * Send an event through a uinput device.
- *
- * @param fd    The file descriptor of the device to send the event through.
- * @param type  The type of the event to send. One of EV_<TYPE> macros.
- * @param type  The code of the event to send. One of the <TYPE>_<CODE>
- *              macros.
- * @param value The event value to send.
+ * Handle the statistics file update timer: replace the statistics file
+ * with the current statistics, atomically.
  *
- * @return Zero on success, -1 on failure, with errno set appropriately.
+ * @param loop      The daemon's loop.
+ * @param watch     The timer watch.
+ * @param events    The ready epoll events.
  */
-static int
-uinput_send(int fd, uint16_t type, uint16_t code, int32_t value)
+static void
+daemon_stats_timer(struct loop *loop, struct loop_watch *watch,
+                   uint32_t events)
 {
-    struct input_event ev = {.type = type, .code = code, .value = value};
-    if (write(fd, &ev, sizeof(ev)) < 0) {
-        LIBC_FAILURE(errno, "write event");
-        return -1;
+    const struct daemon *daemon = (const struct daemon *)watch->data;
+    char tmp_path[PATH_MAX];
+    FILE *stream;
+
+    (void)loop;
+    (void)events;
+    assert(daemon != NULL);
+
+    loop_timer_read(watch);
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", daemon->stats_path);
+    stream = fopen(tmp_path, "w");
+    if (stream == NULL) {
+        LIBC_FAILURE(errno, "open statistics file %s", tmp_path);
+        return;
+    }
+    daemon_print_latency(daemon, stream);
+    if (fclose(stream) != 0) {
+        LIBC_FAILURE(errno, "write statistics file %s", tmp_path);
+        return;
+    }
+    if (rename(tmp_path, daemon->stats_path) < 0) {
+        LIBC_FAILURE(errno, "replace statistics file %s",
+                     daemon->stats_path);
     }
-    return 0;
 }
 
 
-/** The collection of uinput device fds corresponding to a tablet */
-struct fds {
-    int pen;
-    int pad;
-};
+/**
+ * Handle a statistics query: "counters" dumps the counters of all
+ * tablets, "latency" prints their latency statistics.
+ *
+ * @param data      The daemon.
+ * @param stream    The stream to write the response to.
+ * @param command   The query command.
+ *
+ * @return True if the command was handled, false if it's unknown.
+ */
+static bool
+daemon_query(void *data, FILE *stream, const char *command)
+{
+    const struct daemon *daemon = (const struct daemon *)data;
+    const struct tablet *tablet;
+
+    assert(daemon != NULL);
+
+    if (strcmp(command, "counters") == 0) {
+        for (tablet = daemon->tablets; tablet != NULL;
+             tablet = tablet->next) {
+            tablet_dump_stats(tablet, stream);
+        }
+    } else if (strcmp(command, "latency") == 0) {
+        daemon_print_latency(daemon, stream);
+    } else {
+        return false;
+    }
+    return true;
+}
 
 
+/**
+ * Handle signals: dump statistics on SIGUSR1, stop the daemon's loop
+ * on others.
+ *
+ * @param loop      The daemon's loop.
+ * @param watch     The signal watch.
+ * @param events    The ready epoll events.
+ */
 static void
-translate(const struct fds *fds, const uint8_t *buf, size_t len)
+daemon_signal(struct loop *loop, struct loop_watch *watch, uint32_t events)
 {
-    assert(fds != NULL);
-    assert(fds->pen >= 0);
-    assert(fds->pad >= 0);
+    const struct daemon *daemon = (const struct daemon *)watch->data;
+    int signo;
 
-    if (len < 12) {
-        return;
-    }
-    if (buf[0] != 8) {
-        return;
-    }
-    /* If it's a pen report */
-    if ((buf[1] & 0x70) == 0) {
-        /* If pen is in range */
-        if (buf[1] & 0x80) {
-            uinput_send(fds->pen, EV_ABS, ABS_X,
-                        (int32_t)buf[2] |
-                        ((int32_t)buf[3] << 8) |
-                        ((int32_t)buf[8] << 16));
-            uinput_send(fds->pen, EV_ABS, ABS_Y,
-                        (int32_t)buf[4] |
-                        ((int32_t)buf[5] << 8) |
-                        ((int32_t)buf[9] << 16));
-            uinput_send(fds->pen, EV_ABS, ABS_PRESSURE,
-                        (int32_t)buf[6] | ((int32_t)buf[7] << 8));
-            uinput_send(fds->pen, EV_ABS, ABS_TILT_X, (int8_t)buf[10]);
-            uinput_send(fds->pen, EV_ABS, ABS_TILT_Y, -(int8_t)buf[11]);
-            uinput_send(fds->pen, EV_KEY, BTN_TOOL_PEN, 1);
-            uinput_send(fds->pen, EV_KEY, BTN_TOUCH, (buf[1] & 1) != 0);
-            uinput_send(fds->pen, EV_KEY, BTN_STYLUS, (buf[1] & 2) != 0);
-            uinput_send(fds->pen, EV_KEY, BTN_STYLUS2, (buf[1] & 4) != 0);
-        } else {
-            uinput_send(fds->pen, EV_KEY, BTN_TOOL_PEN, 0);
-        }
-        uinput_send(fds->pen, EV_MSC, MSC_SERIAL, 1098942556);
-        uinput_send(fds->pen, EV_SYN, SYN_REPORT, 1);
-    /* Else, if it's a frame button report */
-    } else if (buf[1] == 0xe0) {
-        uint16_t btn_mask = buf[4] | (buf[5] << 8);
-        static const int32_t btn_codes[sizeof(btn_mask) * 8] = {
-            BTN_0, BTN_1, BTN_2, BTN_3,
-            BTN_4, BTN_5, BTN_6, BTN_7,
-            BTN_8, BTN_9, BTN_A, BTN_B,
-            BTN_C, BTN_X, BTN_Y, BTN_Z,
-        };
-        size_t i;
-        uinput_send(fds->pad, EV_ABS, ABS_MISC, btn_mask ? 15 : 0);
-        for (i = 0; i < (sizeof(btn_mask) * 8); btn_mask >>= 1, i++) {
-            uinput_send(fds->pad, EV_KEY, btn_codes[i], btn_mask & 1);
-        }
-        uinput_send(fds->pad, EV_SYN, SYN_REPORT, 1);
-    /* Else, if it's a touch dial report */
-    } else if (buf[1] == 0xf0) {
-        int32_t value = buf[5];
-        if (value != 0) {
-            value = (value > 6 ? (19 - value) : (7 - value)) * 71 / 12;
+    (void)events;
+    assert(daemon != NULL);
+
+    while ((signo = loop_signal_read(watch)) != 0) {
+        if (signo == SIGUSR1) {
+            daemon_print_latency(daemon, stderr);
+            continue;
         }
-        uinput_send(fds->pad, EV_ABS, ABS_MISC, value ? 15 : 0);
-        uinput_send(fds->pad, EV_ABS, ABS_WHEEL, value);
-        uinput_send(fds->pad, EV_SYN, SYN_REPORT, 1);
+        fprintf(stderr, "Received %s, exiting\n", strsignal(signo));
+        loop_stop(loop);
     }
 }
 
 
-static void LIBUSB_CALL
-interrupt_transfer_cb(struct libusb_transfer *transfer)
+#ifdef HAVE_LIBUSB_HOTPLUG_REGISTER_CALLBACK
+static int LIBUSB_CALL
+hotplug_cb(libusb_context *ctx, libusb_device *dev,
+           libusb_hotplug_event event, void *user_data)
 {
-    enum libusb_error err;
-    const struct fds *fds;
-
-    assert(transfer != NULL);
-    assert(transfer->user_data != NULL);
+    struct daemon *daemon = (struct daemon *)user_data;
+    struct libusb_device_descriptor desc;
+    const struct model *model;
 
-    fds = (const struct fds *)transfer->user_data;
+    (void)ctx;
+    assert(daemon != NULL);
 
-    switch (transfer->status)
-    {
-        case LIBUSB_TRANSFER_COMPLETED:
-#if 0
-            /* Dump the result */
-            for (int idx = 0; idx < transfer->actual_length; idx++) {
-                fprintf(stderr, "%s%02hhx", (idx == 0 ? "" : " "),
-                        transfer->buffer[idx]);
-            }
-            fprintf(stderr, "\n");
+    if (event == LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED) {
+        if (libusb_get_device_descriptor(dev, &desc) == LIBUSB_SUCCESS &&
+            (model = model_find(desc.idVendor, desc.idProduct)) != NULL) {
+            daemon_arrive(daemon, dev, model);
+        }
+    } else if (event == LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT) {
+        daemon_leave(daemon, dev);
+    }
+    /* Keep the callback registered */
+    return 0;
+}
 #endif
-            /* Translate */
-            translate(fds, transfer->buffer, transfer->actual_length);
-            /* Resubmit the transfer */
-            err = libusb_submit_transfer(transfer);
-            if (err != LIBUSB_SUCCESS) {
-                LIBUSB_FAILURE(err, "resubmit a transfer");
-            }
-            break;
-
-#define MAP(_name, _desc) \
-    case LIBUSB_TRANSFER_##_name: \
-        GENERIC_ERROR(_desc);  \
-        break
 
-        MAP(ERROR,      "Interrupt transfer failed");
-        MAP(TIMED_OUT,  "Interrupt transfer timed out");
-        MAP(STALL,      "Interrupt transfer halted (endpoint stalled)");
-        MAP(NO_DEVICE,  "Device was disconnected");
-        MAP(OVERFLOW,   "Interrupt transfer overflowed "
-                        "(device sent more data than requested)");
-#undef MAP
 
-        case LIBUSB_TRANSFER_CANCELLED:
-            break;
-        default:
-            GENERIC_ERROR("Unknown status of interrupt transfer: %d",
-                          transfer->status);
-            break;
-    }
+/**
+ * Print usage information.
+ *
+ * @param stream    The stream to print the usage information to.
+ * @param progname  The name of the program.
+ */
+static void
+usage(FILE *stream, const char *progname)
+{
+    fprintf(stream,
+            "Usage: %s [OPTION]...\n"
+            "Translate reports of graphics tablets into input events,\n"
+            "serving any number of them, as they are plugged in.\n"
+            "\n"
+            "Options:\n"
+            "  -h, --help               Output this help message and exit.\n"
+            "  -t, --transfers=NUM      Keep NUM interrupt transfers in "
+                                        "flight, 1-%u,\n"
+            "                           default %u.\n"
+            "  -c, --capture=FILE       Capture raw reports to FILE, "
+                                        "for dud-replay.\n"
+            "  -s, --stress=RATE        Verify no reports are lost when "
+                                        "the tablet\n"
+            "                           reports at RATE Hz, e.g. 1000.\n"
+            "  -S, --stats-file=FILE    Keep updating FILE with latency "
+                                        "statistics,\n"
+            "                           every second.\n"
+            "  -q, --stats-socket=PATH  Answer \"counters\" and "
+                                        "\"latency\" statistics\n"
+            "                           queries on a Unix socket at "
+                                        "PATH.\n"
+            "  -r, --rt-priority=PRIO   Run the event loop at SCHED_FIFO "
+                                        "priority PRIO,\n"
+            "                           1-99, with all memory locked.\n"
+            "  -C, --cpu=CPU            Pin the event loop to CPU.\n"
+            "  -p, --predict=MS         Extrapolate pen motion MS "
+                                        "milliseconds ahead,\n"
+            "                           up to %u, to hide latency.\n"
+            "  -P, --predict-pressure   Extrapolate pressure as well.\n"
+            "  -U, --uhid=PORTS         Serve tablets at the comma-"
+                                        "separated USB port\n"
+            "                           paths PORTS, e.g. 1-2.3, or "
+                                        "\"all\", with uhid\n"
+            "                           devices instead of uinput ones.\n"
+            "  -k, --pressure-curve=CURVE\n"
+            "                           Remap pressure along CURVE: "
+                                        "\"linear\",\n"
+            "                           \"gamma:G\", or "
+                                        "\"bezier:X1,Y1,X2,Y2\".\n"
+            "  -a, --area=L,T,R,B       Map the tablet area from "
+                                        "left L, top T, to\n"
+            "                           right R, bottom B, in tablet "
+                                        "units, to the output.\n"
+            "  -A, --aspect=W:H         Crop the area to the output "
+                                        "aspect ratio W:H.\n"
+            "  -R, --rotate=DEG         Rotate the tablet DEG degrees "
+                                        "clockwise: 0, 90,\n"
+            "                           180, or 270.\n"
+            "  -Z, --no-zero-copy       Transfer reports into heap "
+                                        "buffers, even if\n"
+            "                           mapping them from usbfs is "
+                                        "supported.\n"
+            "  -T, --output-thread      Translate reports and write "
+                                        "events on a thread\n"
+            "                           of each tablet, resubmitting "
+                                        "transfers without\n"
+            "                           waiting for them.\n"
+            "  -j, --journal            Log errors to the systemd "
+                                        "journal instead of\n"
+            "                           stderr.\n"
+            "  -F, --flight-dir=DIR     Keep recording the latest "
+                                        "reports of each\n"
+            "                           tablet and the events they "
+                                        "produce into\n"
+            "                           DIR/PORT.flight, for "
+                                        "dud-flight to decode.\n"
+            "\n"
+            "Latency statistics are printed on SIGUSR1 as well.\n"
+            "\n",
+            progname, RING_MAX_TRANSFERS, RING_DEF_TRANSFERS,
+            PREDICT_MAX_HORIZON_NS / 1000000);
 }
 
 
 int
-main(void)
+main(int argc, char **argv)
 {
     int result = 1;
-    int rc;
-    enum libusb_error err;
-    libusb_context *ctx = NULL;
+    struct daemon daemon = {
+        .ctx = NULL,
+        .options = {.transfers = RING_DEF_TRANSFERS, .zero_copy = true},
+        .tablets = NULL
+    };
+    bool loop_initialized = false;
+    bool query_initialized = false;
+    bool journal = false;
+    sigset_t signals;
+    struct tablet *tablet;
     ssize_t num;
     ssize_t idx;
     libusb_device **lusb_list = NULL;
-    libusb_device *lusb_dev;
     struct libusb_device_descriptor desc;
-    struct libusb_config_descriptor *config = NULL;
-    libusb_device_handle *handle = NULL;
-    bool iface0_detached = false;
-    bool iface1_detached = false;
-    bool iface0_claimed = false;
-    bool iface1_claimed = false;
-    struct libusb_transfer *transfer = NULL;
-    uint8_t *buf = NULL;
-    size_t len = 0;
-    struct fds fds = {.pen = -1, .pad = -1};
+    const struct model *model;
+#ifdef HAVE_LIBUSB_HOTPLUG_REGISTER_CALLBACK
+    libusb_hotplug_callback_handle hotplug_handle;
+    bool hotplug_registered = false;
+#endif
+    const char *capture_path = NULL;
+    unsigned long transfers;
+    long value;
+    double predict_ms;
+    struct map_config map_config = {.curve = MAP_CURVE_LINEAR};
+    bool map_configured = false;
+    struct rt_options rt_options = {.priority = 0, .cpu = -1};
+    char *end;
+    int opt;
+    static const struct option longopts[] = {
+        {.name = "help",        .val = 'h'},
+        {.name = "transfers",   .val = 't', .has_arg = required_argument},
+        {.name = "capture",     .val = 'c', .has_arg = required_argument},
+        {.name = "stress",      .val = 's', .has_arg = required_argument},
+        {.name = "stats-file",  .val = 'S', .has_arg = required_argument},
+        {.name = "stats-socket", .val = 'q', .has_arg = required_argument},
+        {.name = "rt-priority", .val = 'r', .has_arg = required_argument},
+        {.name = "cpu",         .val = 'C', .has_arg = required_argument},
+        {.name = "predict",     .val = 'p', .has_arg = required_argument},
+        {.name = "predict-pressure", .val = 'P'},
+        {.name = "uhid",        .val = 'U', .has_arg = required_argument},
+        {.name = "pressure-curve", .val = 'k', .has_arg = required_argument},
+        {.name = "area",        .val = 'a', .has_arg = required_argument},
+        {.name = "aspect",      .val = 'A', .has_arg = required_argument},
+        {.name = "rotate",      .val = 'R', .has_arg = required_argument},
+        {.name = "no-zero-copy", .val = 'Z'},
+        {.name = "output-thread", .val = 'T'},
+        {.name = "journal",     .val = 'j'},
+        {.name = "flight-dir",  .val = 'F', .has_arg = required_argument},
+        {.name = NULL}
+    };
+
+    daemon.options.loop = &daemon.loop;
+    daemon.options.changed = &daemon.changed;
+
+    /* Parse command-line options */
+    while ((opt = getopt_long(argc, argv, "+ht:c:s:S:q:r:C:p:PU:k:a:A:R:ZTjF:",
+                              longopts, NULL)) >= 0) {
+        switch (opt) {
+        case 'h':
+            usage(stdout, argv[0]);
+            return 0;
+        case 't':
+            errno = 0;
+            transfers = strtoul(optarg, &end, 0);
+            if (errno != 0 || *end != '\0' ||
+                transfers < 1 || transfers > RING_MAX_TRANSFERS) {
+                GENERIC_ERROR("Invalid number of transfers: %s", optarg);
+                usage(stderr, argv[0]);
+                return 1;
+            }
+            daemon.options.transfers = transfers;
+            break;
+        case 'c':
+            capture_path = optarg;
+            break;
+        case 'S':
+            daemon.stats_path = optarg;
+            break;
+        case 'q':
+            daemon.query_path = optarg;
+            break;
+        case 'r':
+            errno = 0;
+            value = strtol(optarg, &end, 0);
+            if (errno != 0 || *end != '\0' || value < 1 || value > 99) {
+                GENERIC_ERROR("Invalid real-time priority: %s", optarg);
+                usage(stderr, argv[0]);
+                return 1;
+            }
+            rt_options.priority = (int)value;
+            break;
+        case 'C':
+            errno = 0;
+            value = strtol(optarg, &end, 0);
+            if (errno != 0 || *end != '\0' ||
+                value < 0 || value >= CPU_SETSIZE) {
+                GENERIC_ERROR("Invalid CPU number: %s", optarg);
+                usage(stderr, argv[0]);
+                return 1;
+            }
+            rt_options.cpu = (int)value;
+            break;
+        case 'p':
+            errno = 0;
+            predict_ms = strtod(optarg, &end);
+            if (errno != 0 || *end != '\0' || !(predict_ms > 0) ||
+                predict_ms * 1e6 > PREDICT_MAX_HORIZON_NS) {
+                GENERIC_ERROR("Invalid prediction time: %s", optarg);
+                usage(stderr, argv[0]);
+                return 1;
+            }
+            daemon.options.predict_ns = (uint64_t)(predict_ms * 1e6 + 0.5);
+            break;
+        case 'P':
+            daemon.options.predict_pressure = true;
+            break;
+        case 'U':
+            daemon.options.uhid_ports = optarg;
+            break;
+        case 'k':
+            if (!map_parse_curve(&map_config, optarg)) {
+                GENERIC_ERROR("Invalid pressure curve: %s", optarg);
+                usage(stderr, argv[0]);
+                return 1;
+            }
+            map_configured = true;
+            break;
+        case 'a':
+            if (!map_parse_area(&map_config, optarg)) {
+                GENERIC_ERROR("Invalid area: %s", optarg);
+                usage(stderr, argv[0]);
+                return 1;
+            }
+            map_configured = true;
+            break;
+        case 'A':
+            if (!map_parse_aspect(&map_config, optarg)) {
+                GENERIC_ERROR("Invalid aspect ratio: %s", optarg);
+                usage(stderr, argv[0]);
+                return 1;
+            }
+            map_configured = true;
+            break;
+        case 'R':
+            if (!map_parse_rotation(&map_config, optarg)) {
+                GENERIC_ERROR("Invalid rotation: %s", optarg);
+                usage(stderr, argv[0]);
+                return 1;
+            }
+            map_configured = true;
+            break;
+        case 'Z':
+            daemon.options.zero_copy = false;
+            break;
+        case 'T':
+            daemon.options.output_thread = true;
+            break;
+        case 'j':
+            journal = true;
+            break;
+        case 'F':
+            daemon.options.flight_dir = optarg;
+            break;
+        case 's':
+            errno = 0;
+            daemon.options.stress_rate = strtoul(optarg, &end, 0);
+            if (errno != 0 || *end != '\0' ||
+                daemon.options.stress_rate < 1 ||
+                daemon.options.stress_rate > 1000000) {
+                GENERIC_ERROR("Invalid stress report rate: %s", optarg);
+                usage(stderr, argv[0]);
+                return 1;
+            }
+            break;
+        default:
+            usage(stderr, argv[0]);
+            return 1;
+        }
+    }
+    if (optind < argc) {
+        GENERIC_ERROR("Positional arguments are not accepted");
+        usage(stderr, argv[0]);
+        return 1;
+    }
+    if (daemon.options.predict_pressure && daemon.options.predict_ns == 0) {
+        GENERIC_ERROR("Pressure prediction requires --predict");
+        usage(stderr, argv[0]);
+        return 1;
+    }
+    if (map_configured) {
+        daemon.options.map_config = &map_config;
+    }
+
+    /*
+     * Write out error messages on a thread, off the event loop, started
+     * before switching to real-time, so it runs at normal priority
+     */
+    if (!log_start(journal)) {
+        LIBC_FAILURE_CLEANUP(errno, "start logging%s",
+                             journal ? " to the journal" : "");
+    }
+
+    /* Open the capture file, shared by all tablets */
+    if (capture_path != NULL) {
+        daemon.options.capture = fopen(capture_path, "wb");
+        if (daemon.options.capture == NULL) {
+            LIBC_FAILURE_CLEANUP(errno, "open capture file %s",
+                                 capture_path);
+        }
+        if (!capture_write_header(daemon.options.capture)) {
+            LIBC_FAILURE_CLEANUP(errno, "write capture file header");
+        }
+    }
 
     /* Create libusb context */
-    LIBUSB_GUARD(libusb_init(&ctx), "create libusb context");
+    LIBUSB_GUARD(libusb_init(&daemon.ctx), "create libusb context");
 
     /* Set libusb debug level to informational only */
 #ifdef HAVE_LIBUSB_SET_OPTION
-    libusb_set_option(ctx, LIBUSB_OPTION_LOG_LEVEL, LIBUSB_LOG_LEVEL_INFO);
+    libusb_set_option(daemon.ctx,
+                      LIBUSB_OPTION_LOG_LEVEL, LIBUSB_LOG_LEVEL_INFO);
 #else
-    libusb_set_debug(ctx, LIBUSB_LOG_LEVEL_INFO);
+    libusb_set_debug(daemon.ctx, LIBUSB_LOG_LEVEL_INFO);
 #endif
 
-    /* Retrieve libusb device list */
-    num = libusb_get_device_list(ctx, &lusb_list);
-    if (num == LIBUSB_ERROR_NO_MEM) {
-        LIBUSB_FAILURE_CLEANUP(num, "retrieve device list");
+    /* Create the event loop, watching libusb and termination signals */
+    loop_watch_init(&daemon.signal_watch, daemon_signal, &daemon);
+    loop_watch_init(&daemon.stats_watch, daemon_stats_timer, &daemon);
+    if (!loop_init(&daemon.loop, daemon.ctx)) {
+        LIBC_FAILURE_CLEANUP(errno, "create the event loop");
     }
-
-    /* Find and open the devices */
-    for (idx = 0; idx < num; idx++)
-    {
-        lusb_dev = lusb_list[idx];
-
-        LIBUSB_GUARD(libusb_get_device_descriptor(lusb_dev, &desc),
-                     "get device descriptor");
-        if (desc.idVendor == 0x256c && desc.idProduct == 0x006d) {
-            fprintf(stderr, "FOUND!\n");
-            break;
-        }
+    loop_initialized = true;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    sigaddset(&signals, SIGUSR1);
+    if (!loop_add_signals(&daemon.loop, &daemon.signal_watch, &signals)) {
+        LIBC_FAILURE_CLEANUP(errno, "watch signals");
     }
 
-    if (idx < num) {
-        unsigned char data[64];
-        /* Open the device */
-        LIBUSB_GUARD(libusb_open(lusb_dev, &handle), "open the device");
-
-        /* Detach interface 0 */
-        err = libusb_detach_kernel_driver(handle, 0);
-        if (err == LIBUSB_SUCCESS) {
-            iface0_detached = true;
-        } else if (err != LIBUSB_ERROR_NOT_FOUND) {
-            LIBUSB_FAILURE_CLEANUP(err, "detach kernel driver from interface #0");
-        }
+    /* Update the statistics file every second, if requested */
+    if (daemon.stats_path != NULL &&
+        (!loop_add_timer(&daemon.loop, &daemon.stats_watch) ||
+         !loop_timer_set(&daemon.stats_watch, 1000000000, 1000000000))) {
+        LIBC_FAILURE_CLEANUP(errno, "setup statistics file update timer");
+    }
 
-        /* Detach interface 1 */
-        err = libusb_detach_kernel_driver(handle, 1);
-        if (err == LIBUSB_SUCCESS) {
-            iface1_detached = true;
-        } else if (err != LIBUSB_ERROR_NOT_FOUND) {
-            LIBUSB_FAILURE_CLEANUP(err, "detach kernel driver from interface #1");
+    /* Answer statistics queries, if requested */
+    if (daemon.query_path != NULL) {
+        query_initialized = true;
+        if (!query_server_init(&daemon.query, &daemon.loop,
+                               daemon.query_path, daemon_query, &daemon)) {
+            LIBC_FAILURE_CLEANUP(errno, "serve statistics socket %s",
+                                 daemon.query_path);
         }
+    }
 
-        /* Claim interface 0 */
-        LIBUSB_GUARD(
-            libusb_claim_interface(handle, 0), "claim claim interface #0"
-        );
-        iface0_claimed = true;
+    /*
+     * Switch to real-time execution, if requested. Done after libusb
+     * has started its threads, so only the event loop runs real-time.
+     */
+    if (!rt_setup(&rt_options)) {
+        FAILURE_CLEANUP("setup real-time execution");
+    }
 
-        /* Claim interface 1 */
+#ifdef HAVE_LIBUSB_HOTPLUG_REGISTER_CALLBACK
+    /* Watch the tablets come and go, starting with the present ones */
+    if (libusb_has_capability(LIBUSB_CAP_HAS_HOTPLUG)) {
         LIBUSB_GUARD(
-            libusb_claim_interface(handle, 1), "claim interface #1"
-        );
-        iface1_claimed = true;
-
-        /* Get configuration string descriptor, enable proprietary mode */
-        rc = libusb_get_string_descriptor(
-            handle,
-            /* descriptor index */
-            0xc8,
-            /* LANGID, English (United States) */
-            0x0409,
-            /* data from the descriptor */
-            (unsigned char *)data,
-            sizeof(data)
-        );
-        if (rc < 0) {
-            LIBUSB_FAILURE_CLEANUP(err, "get configuration string descriptor");
-        }
-        fprintf(stderr, "Got %d configuration bytes:\n", rc);
-        for (idx = 0; idx < rc; idx++) {
-            fprintf(stderr, "%s%02hhx", (idx == 0 ? "" : " "), data[idx]);
-        }
-        fprintf(stderr, "\n");
-
-        /* Set report protocol on interface 0 */
-        rc = libusb_control_transfer(handle,
-                                     /* host->device, class, interface */
-                                     0x21,
-                                     /* Set_Protocol */
-                                     0x0B,
-                                     /* 0 - boot, 1 - report */
-                                     1,
-                                     /* interface */
-                                     0,
-                                     /* buffer */
-                                     NULL, 0,
-                                     /* timeout */
-                                     1000);
-        if (rc != LIBUSB_SUCCESS && rc != LIBUSB_ERROR_PIPE) {
-            LIBUSB_FAILURE_CLEANUP(err, "set report protocol on interface 0");
-        }
-
-        /* Set report protocol on interface 1 */
-        rc = libusb_control_transfer(handle,
-                                     /* host->device, class, interface */
-                                     0x21,
-                                     /* Set_Protocol */
-                                     0x0B,
-                                     /* 0 - boot, 1 - report */
-                                     1,
-                                     /* interface */
-                                     1,
-                                     /* buffer */
-                                     NULL, 0,
-                                     /* timeout */
-                                     1000);
-        if (rc != LIBUSB_SUCCESS && rc != LIBUSB_ERROR_PIPE) {
-            LIBUSB_FAILURE_CLEANUP(err, "set report protocol on interface 1");
-        }
-
-        /* Set infinite idle duration on interface 0 */
-        rc = libusb_control_transfer(handle,
-                                     /* host->device, class, interface */
-                                     0x21,
-                                     /* Set_Idle */
-                                     0x0A,
-                                     /* duration for all report IDs */
-                                     0 << 8,
-                                     /* interface */
-                                     0,
-                                     /* buffer */
-                                     NULL, 0,
-                                     /* timeout */
-                                     1000);
-        if (rc != LIBUSB_SUCCESS && rc != LIBUSB_ERROR_PIPE) {
-            LIBUSB_FAILURE_CLEANUP(err, "set infinite idle on interface 0");
-        }
-
-        /* Set infinite idle duration on interface 1 */
-        rc = libusb_control_transfer(handle,
-                                     /* host->device, class, interface */
-                                     0x21,
-                                     /* Set_Idle */
-                                     0x0A,
-                                     /* duration for all report IDs */
-                                     0 << 8,
-                                     /* interface */
-                                     1,
-                                     /* buffer */
-                                     NULL, 0,
-                                     /* timeout */
-                                     1000);
-        if (rc != LIBUSB_SUCCESS && rc != LIBUSB_ERROR_PIPE) {
-            LIBUSB_FAILURE_CLEANUP(err, "set infinite idle on interface 1");
+            libusb_hotplug_register_callback(
+                daemon.ctx,
+                LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED |
+                    LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT,
+                LIBUSB_HOTPLUG_ENUMERATE,
+                LIBUSB_HOTPLUG_MATCH_ANY, LIBUSB_HOTPLUG_MATCH_ANY,
+                LIBUSB_HOTPLUG_MATCH_ANY,
+                hotplug_cb, &daemon, &hotplug_handle),
+            "register hotplug callback");
+        hotplug_registered = true;
+    } else
+#endif
+    {
+        /* Serve the tablets present at startup only */
+        fprintf(stderr, "Hotplug is not supported, "
+                "serving present tablets only\n");
+        num = libusb_get_device_list(daemon.ctx, &lusb_list);
+        if (num < 0) {
+            LIBUSB_FAILURE_CLEANUP(num, "retrieve device list");
         }
-
-        /* Create uinput pen device */
-        fds.pen = uinput_create_pen();
-        if (fds.pen < 0) {
-            FAILURE_CLEANUP("create uinput pen device");
+        for (idx = 0; idx < num; idx++) {
+            LIBUSB_GUARD(libusb_get_device_descriptor(lusb_list[idx], &desc),
+                         "get device descriptor");
+            model = model_find(desc.idVendor, desc.idProduct);
+            if (model != NULL) {
+                daemon_arrive(&daemon, lusb_list[idx], model);
+            }
         }
+        libusb_free_device_list(lusb_list, true);
+        lusb_list = NULL;
+    }
 
-        /* Create uinput pad device */
-        fds.pad = uinput_create_pad();
-        if (fds.pad < 0) {
-            FAILURE_CLEANUP("create uinput pad device");
+    /* Run transfers of all tablets, until terminated */
+    while (!loop_stopped(&daemon.loop)) {
+        if (daemon.changed) {
+            daemon_update(&daemon);
         }
-
-        /* Allocate transfer buffer */
-        len = 0x40;
-        buf = malloc(len);
-        if (len > 0 && buf == NULL) {
-            FAILURE_CLEANUP("allocate interrupt transfer buffer");
-        }
-
-        /* Allocate interrupt transfer */
-        transfer = libusb_alloc_transfer(0);
-        if (transfer == NULL)
-            FAILURE_CLEANUP("allocate a transfer");
-        /* Initialize interrupt transfer */
-        libusb_fill_interrupt_transfer(transfer,
-                                       handle, 0x81,
-                                       buf, len,
-                                       interrupt_transfer_cb,
-                                       /* Callback data */
-                                       &fds,
-                                       /* Timeout */
-                                       0);
-
-        /* Submit first transfer */
-        fprintf(stderr, "Starting transfers!\n");
-        LIBUSB_GUARD(libusb_submit_transfer(transfer),
-                     "submit a transfer");
-
-        /* Run transfers */
-        while (true) {
-            err = libusb_handle_events(ctx);
-            if (err != LIBUSB_SUCCESS && err != LIBUSB_ERROR_INTERRUPTED)
-                LIBUSB_FAILURE_CLEANUP(err, "handle transfer events");
+        if (!loop_run_once(&daemon.loop)) {
+            LIBC_FAILURE_CLEANUP(errno, "run the event loop");
         }
     }
 
     result = 0;
 cleanup:
 
-    uinput_destroy(fds.pad);
-    uinput_destroy(fds.pen);
-
-    libusb_free_transfer(transfer);
-
-    free(buf);
-
-    if (iface1_claimed) {
-        libusb_release_interface(handle, 1);
+#ifdef HAVE_LIBUSB_HOTPLUG_REGISTER_CALLBACK
+    if (hotplug_registered) {
+        libusb_hotplug_deregister_callback(daemon.ctx, hotplug_handle);
     }
-    if (iface0_claimed) {
-        libusb_release_interface(handle, 0);
+#endif
+
+    while (daemon.tablets != NULL) {
+        tablet = daemon.tablets;
+        tablet_close(tablet, daemon.ctx);
+        daemon.tablets = tablet->next;
+        tablet_free(tablet);
     }
-    if (iface1_detached) {
-        libusb_attach_kernel_driver(handle, 1);
+
+    if (query_initialized) {
+        query_server_cleanup(&daemon.query);
     }
-    if (iface0_detached) {
-        libusb_attach_kernel_driver(handle, 0);
+
+    if (loop_initialized) {
+        loop_remove(&daemon.loop, &daemon.stats_watch);
+        loop_remove(&daemon.loop, &daemon.signal_watch);
+        loop_cleanup(&daemon.loop);
     }
-    /* Free the configuration descriptor */
-    libusb_free_config_descriptor(config);
 
-    /* Close the device */
-    libusb_close(handle);
+    if (daemon.options.capture != NULL) {
+        fclose(daemon.options.capture);
+    }
 
     /* Free the libusb device list along with devices */
     libusb_free_device_list(lusb_list, true);
 
     /* Destroy the libusb context */
-    if (ctx != NULL)
-        libusb_exit(ctx);
+    if (daemon.ctx != NULL)
+        libusb_exit(daemon.ctx);
+
+    /* Write out the remaining error messages */
+    log_stop();
 
     return result;
 }
@@ -0,0 +1,370 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * This file is part of digimend-userspace-drivers.
+ */
+
+#include "config.h"
+#include "flight.h"
+#include "misc.h"
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/** Flight recorder file magic */
+static const uint8_t flight_magic[6] = {'D', 'U', 'D', 'F', 'L', 'T'};
+
+/**
+ * Get the space a record takes in the ring.
+ *
+ * @param len   The length of the record data.
+ *
+ * @return The size of the record, aligned.
+ */
+static inline uint64_t
+flight_record_size(size_t len)
+{
+    return (sizeof(struct flight_record_header) + len + FLIGHT_ALIGN - 1) &
+           ~(uint64_t)(FLIGHT_ALIGN - 1);
+}
+
+/**
+ * Check if a flight recorder file header is valid.
+ *
+ * @param header    The header to check.
+ * @param size      The size of the ring following the header in the file.
+ *
+ * @return True if valid, false otherwise.
+ */
+static bool
+flight_header_valid(const struct flight_header *header, uint64_t size)
+{
+    return memcmp(header->magic, flight_magic, sizeof(flight_magic)) == 0 &&
+           header->version == FLIGHT_VERSION &&
+           header->size == size &&
+           size >= FLIGHT_MIN_SIZE && (size & (size - 1)) == 0;
+}
+
+/**
+ * Copy data into a ring at a stream position, wrapping around.
+ *
+ * @param ring  The ring to copy into.
+ * @param size  The size of the ring, a power of two.
+ * @param pos   The stream position to copy to.
+ * @param buf   The data to copy.
+ * @param len   The length of the data, up to the ring size.
+ */
+static void
+flight_ring_write(uint8_t *ring, size_t size, uint64_t pos,
+                  const void *buf, size_t len)
+{
+    size_t off = pos & (size - 1);
+    size_t first = size - off < len ? size - off : len;
+
+    memcpy(ring + off, buf, first);
+    if (len > first) {
+        memcpy(ring, (const uint8_t *)buf + first, len - first);
+    }
+}
+
+/**
+ * Copy data out of a ring at a stream position, wrapping around.
+ *
+ * @param ring  The ring to copy from.
+ * @param size  The size of the ring, a power of two.
+ * @param pos   The stream position to copy from.
+ * @param buf   The buffer to copy to.
+ * @param len   The length of the data, up to the ring size.
+ */
+static void
+flight_ring_read(const uint8_t *ring, size_t size, uint64_t pos,
+                 void *buf, size_t len)
+{
+    size_t off = pos & (size - 1);
+    size_t first = size - off < len ? size - off : len;
+
+    memcpy(buf, ring + off, first);
+    if (len > first) {
+        memcpy((uint8_t *)buf + first, ring, len - first);
+    }
+}
+
+bool
+flight_open(struct flight *flight, const char *path,
+            size_t size, const char *name)
+{
+    bool result = false;
+    int orig_errno;
+    int fd = -1;
+    struct stat st;
+    size_t map_size = FLIGHT_HEADER_SIZE + size;
+    void *map = MAP_FAILED;
+    struct flight_header *header;
+
+    assert(flight != NULL);
+    assert(path != NULL);
+    assert(size >= FLIGHT_MIN_SIZE);
+    assert((size & (size - 1)) == 0);
+    assert(name != NULL);
+
+    memset(flight, 0, sizeof(*flight));
+
+    fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        goto cleanup;
+    }
+    /* Start over, unless the ring is of the same size */
+    if ((uint64_t)st.st_size != map_size && ftruncate(fd, 0) < 0) {
+        goto cleanup;
+    }
+    /* Allocate the blocks, so stores don't fault on a full filesystem */
+    errno = posix_fallocate(fd, 0, (off_t)map_size);
+    if (errno != 0) {
+        goto cleanup;
+    }
+    map = mmap(NULL, map_size, PROT_READ | PROT_WRITE,
+               MAP_SHARED | MAP_POPULATE, fd, 0);
+    if (map == MAP_FAILED) {
+        goto cleanup;
+    }
+
+    header = (struct flight_header *)map;
+    if (!flight_header_valid(header, size)) {
+        memset(header, 0, sizeof(*header));
+        memcpy(header->magic, flight_magic, sizeof(flight_magic));
+        header->version = FLIGHT_VERSION;
+        header->size = size;
+    }
+    /* Drop the record the previous writer didn't complete, if any */
+    atomic_store_explicit(&header->reserved,
+                          atomic_load_explicit(&header->committed,
+                                               memory_order_relaxed),
+                          memory_order_relaxed);
+    snprintf(header->name, sizeof(header->name), "%s", name);
+
+    flight->header = header;
+    flight->ring = (uint8_t *)map + FLIGHT_HEADER_SIZE;
+    flight->size = size;
+    flight->pos = atomic_load_explicit(&header->committed,
+                                       memory_order_relaxed);
+    result = true;
+
+cleanup:
+    orig_errno = errno;
+    if (!result && map != MAP_FAILED) {
+        munmap(map, map_size);
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+    errno = orig_errno;
+    return result;
+}
+
+void
+flight_record(struct flight *flight, enum flight_kind kind,
+              enum flight_device device, uint64_t ts,
+              const void *buf, size_t len)
+{
+    struct flight_record_header header;
+    uint64_t end;
+
+    assert(flight_is_open(flight));
+    assert(kind < FLIGHT_KIND_NUM);
+    assert(device < FLIGHT_DEVICE_NUM);
+    assert(buf != NULL || len == 0);
+
+    if (len > FLIGHT_MAX_LEN) {
+        len = FLIGHT_MAX_LEN;
+    }
+    end = flight->pos + flight_record_size(len);
+    header.pos = (uint32_t)flight->pos;
+    header.len = (uint16_t)len;
+    header.kind = (uint8_t)kind;
+    header.device = (uint8_t)device;
+    header.ts = ts;
+
+    /*
+     * Claim the space before overwriting the oldest records in it, and
+     * publish the record once written, so snapshots taken meanwhile skip
+     * the former and don't see the latter
+     */
+    atomic_store_explicit(&flight->header->reserved, end,
+                          memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    flight_ring_write(flight->ring, flight->size, flight->pos,
+                      &header, sizeof(header));
+    if (len > 0) {
+        flight_ring_write(flight->ring, flight->size,
+                          flight->pos + sizeof(header), buf, len);
+    }
+    atomic_store_explicit(&flight->header->committed, end,
+                          memory_order_release);
+    flight->pos = end;
+}
+
+void
+flight_close(struct flight *flight)
+{
+    assert(flight != NULL);
+
+    if (!flight_is_open(flight)) {
+        return;
+    }
+    munmap(flight->header, FLIGHT_HEADER_SIZE + flight->size);
+    memset(flight, 0, sizeof(*flight));
+}
+
+static ssize_t
+flight_sink_write(struct sink *sink, const void *buf, size_t len)
+{
+    struct flight_sink *flight_sink = (struct flight_sink *)sink;
+    ssize_t rc;
+
+    rc = sink_write(flight_sink->inner, buf, len);
+    if (rc > 0) {
+        flight_record(flight_sink->flight, flight_sink->kind,
+                      flight_sink->device, clock_ns(), buf, (size_t)rc);
+    }
+    return rc;
+}
+
+struct sink *
+flight_sink_init(struct flight_sink *flight_sink, struct sink *inner,
+                 struct flight *flight, enum flight_kind kind,
+                 enum flight_device device)
+{
+    assert(flight_sink != NULL);
+    assert(inner != NULL);
+    assert(flight_is_open(flight));
+    assert(kind < FLIGHT_KIND_NUM);
+    assert(device < FLIGHT_DEVICE_NUM);
+    flight_sink->sink.write = flight_sink_write;
+    flight_sink->inner = inner;
+    flight_sink->flight = flight;
+    flight_sink->kind = kind;
+    flight_sink->device = device;
+    return &flight_sink->sink;
+}
+
+bool
+flight_snapshot_take(struct flight_snapshot *snapshot, const char *path)
+{
+    bool result = false;
+    int orig_errno;
+    int fd = -1;
+    struct stat st;
+    size_t map_size = 0;
+    void *map = MAP_FAILED;
+    struct flight_header *header;
+    uint64_t committed;
+    uint64_t reserved;
+
+    assert(snapshot != NULL);
+    assert(path != NULL);
+
+    memset(snapshot, 0, sizeof(*snapshot));
+
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        goto cleanup;
+    }
+    if (st.st_size < FLIGHT_HEADER_SIZE + FLIGHT_MIN_SIZE) {
+        errno = EINVAL;
+        goto cleanup;
+    }
+    map_size = (size_t)st.st_size;
+    map = mmap(NULL, map_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        goto cleanup;
+    }
+    header = (struct flight_header *)map;
+    if (!flight_header_valid(header, map_size - FLIGHT_HEADER_SIZE)) {
+        errno = EINVAL;
+        goto cleanup;
+    }
+
+    snapshot->size = header->size;
+    snapshot->ring = malloc(snapshot->size);
+    if (snapshot->ring == NULL) {
+        goto cleanup;
+    }
+    memcpy(snapshot->name, header->name, sizeof(snapshot->name));
+    snapshot->name[sizeof(snapshot->name) - 1] = '\0';
+
+    /*
+     * Copy the complete records, then see how far the writer got
+     * meanwhile, to skip the ones it overwrote
+     */
+    committed = atomic_load_explicit(&header->committed,
+                                     memory_order_acquire);
+    memcpy(snapshot->ring, (const uint8_t *)map + FLIGHT_HEADER_SIZE,
+           snapshot->size);
+    atomic_thread_fence(memory_order_acquire);
+    reserved = atomic_load_explicit(&header->reserved,
+                                    memory_order_relaxed);
+    if (reserved < committed) {
+        reserved = committed;
+    }
+    snapshot->end = committed;
+    snapshot->pos = reserved > snapshot->size ? reserved - snapshot->size : 0;
+    if (snapshot->pos > snapshot->end) {
+        snapshot->pos = snapshot->end;
+    }
+    result = true;
+
+cleanup:
+    orig_errno = errno;
+    if (map != MAP_FAILED) {
+        munmap(map, map_size);
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+    errno = orig_errno;
+    return result;
+}
+
+bool
+flight_snapshot_next(struct flight_snapshot *snapshot,
+                     struct flight_record_header *header, uint8_t *buf)
+{
+    uint64_t end;
+
+    assert(snapshot != NULL);
+    assert(header != NULL);
+    assert(buf != NULL);
+
+    /* Find the next record stored at its own position, skipping cut ones */
+    while (snapshot->pos + sizeof(*header) <= snapshot->end) {
+        flight_ring_read(snapshot->ring, snapshot->size, snapshot->pos,
+                         header, sizeof(*header));
+        end = snapshot->pos + flight_record_size(header->len);
+        if (header->pos == (uint32_t)snapshot->pos &&
+            header->kind < FLIGHT_KIND_NUM &&
+            header->device < FLIGHT_DEVICE_NUM &&
+            end <= snapshot->end) {
+            flight_ring_read(snapshot->ring, snapshot->size,
+                             snapshot->pos + sizeof(*header),
+                             buf, header->len);
+            snapshot->pos = end;
+            return true;
+        }
+        snapshot->pos += FLIGHT_ALIGN;
+        snapshot->skipped += FLIGHT_ALIGN;
+    }
+    return false;
+}
+
+void
+flight_snapshot_free(struct flight_snapshot *snapshot)
+{
+    assert(snapshot != NULL);
+    free(snapshot->ring);
+    snapshot->ring = NULL;
+}
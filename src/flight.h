@@ -0,0 +1,274 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * This file is part of digimend-userspace-drivers.
+ */
+
+/*
+ * Flight recorder files.
+ *
+ * A flight recorder file keeps the latest raw reports of a tablet, and the
+ * data written to its output devices in response, in a fixed-size ring,
+ * mapped into memory and written with plain stores, so recording costs no
+ * system calls, and the recorded history survives the process crashing.
+ * All integers are stored in the host byte order.
+ *
+ * Header, FLIGHT_HEADER_SIZE bytes:
+ *      6 bytes     Magic "DUDFLT"
+ *      2 bytes     Format version, FLIGHT_VERSION
+ *      8 bytes     Size of the ring, a power of two
+ *      8 bytes     Stream position up to which the ring is being written,
+ *                  including a record in progress
+ *      8 bytes     Stream position up to which records are complete
+ *      32 bytes    Tablet name, zero-terminated
+ *
+ * The ring follows, holding the stream of records, each at its stream
+ * position modulo the ring size, aligned to FLIGHT_ALIGN bytes:
+ *      4 bytes     Low 32 bits of the stream position of the record
+ *      2 bytes     Data length
+ *      1 byte      Kind, enum flight_kind
+ *      1 byte      Device, enum flight_device
+ *      8 bytes     Time, monotonic clock, nanoseconds
+ *      N bytes     Data
+ *
+ * The records within the ring size back from the position being written
+ * are intact, the oldest one possibly cut, and are found by their stream
+ * positions matching the ones they're stored at.
+ */
+
+#ifndef _FLIGHT_H
+#define _FLIGHT_H
+
+#include "sink.h"
+#include <assert.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/** Flight recorder format version */
+#define FLIGHT_VERSION      1
+
+/** Size of the file header, the ring following it page-aligned */
+#define FLIGHT_HEADER_SIZE  4096
+
+/** Alignment of records in the ring */
+#define FLIGHT_ALIGN        8
+
+/** Minimum ring size */
+#define FLIGHT_MIN_SIZE     4096
+
+/** Default ring size */
+#define FLIGHT_DEF_SIZE     (4 * 1024 * 1024)
+
+/** Maximum length of record data */
+#define FLIGHT_MAX_LEN      0xffff
+
+/** Kind of a flight record */
+enum flight_kind {
+    /** A raw report received from the tablet */
+    FLIGHT_KIND_REPORT,
+    /** Input events written to a uinput device */
+    FLIGHT_KIND_EVENTS,
+    /** An event written to a uhid device */
+    FLIGHT_KIND_UHID,
+    /** Number of kinds */
+    FLIGHT_KIND_NUM
+};
+
+/** The device a flight record belongs to */
+enum flight_device {
+    /** The tablet itself */
+    FLIGHT_DEVICE_TABLET,
+    /** The pen output device */
+    FLIGHT_DEVICE_PEN,
+    /** The pad output device */
+    FLIGHT_DEVICE_PAD,
+    /** Number of devices */
+    FLIGHT_DEVICE_NUM
+};
+
+/** The header of a flight recorder file */
+struct flight_header {
+    /** Magic "DUDFLT" */
+    uint8_t magic[6];
+    /** Format version, FLIGHT_VERSION */
+    uint16_t version;
+    /** Size of the ring */
+    uint64_t size;
+    /** Stream position up to which the ring is being written */
+    _Atomic uint64_t reserved;
+    /** Stream position up to which records are complete */
+    _Atomic uint64_t committed;
+    /** Tablet name, zero-terminated */
+    char name[32];
+};
+
+/** The header of a flight record */
+struct flight_record_header {
+    /** Low 32 bits of the stream position of the record */
+    uint32_t pos;
+    /** Data length */
+    uint16_t len;
+    /** Kind, enum flight_kind */
+    uint8_t kind;
+    /** Device, enum flight_device */
+    uint8_t device;
+    /** Time, monotonic clock, nanoseconds */
+    uint64_t ts;
+};
+
+/** A flight recorder, writing to a mapped file */
+struct flight {
+    /** The mapped file header, or NULL if not open */
+    struct flight_header *header;
+    /** The mapped ring */
+    uint8_t *ring;
+    /** The size of the ring */
+    size_t size;
+    /** The stream position of the next record, the writer's own copy */
+    uint64_t pos;
+};
+
+/**
+ * Open a flight recorder file for writing, creating it, if it doesn't
+ * exist, or overwriting it, if it isn't a valid one of the same size.
+ * Otherwise continue recording after the records it has, keeping them
+ * as long as the ring fits them. The file is mapped and pre-faulted, so
+ * recording doesn't fault or call into the kernel.
+ *
+ * @param flight    The flight recorder to open.
+ * @param path      The path of the file.
+ * @param size      The size of the ring, a power of two, at least
+ *                  FLIGHT_MIN_SIZE.
+ * @param name      The tablet name to store in the header.
+ *
+ * @return True if opened, false otherwise, with errno set appropriately.
+ */
+extern bool flight_open(struct flight *flight, const char *path,
+                        size_t size, const char *name);
+
+/**
+ * Check if a flight recorder is open.
+ *
+ * @param flight    The flight recorder to check.
+ *
+ * @return True if open, false otherwise.
+ */
+static inline bool
+flight_is_open(const struct flight *flight)
+{
+    assert(flight != NULL);
+    return flight->header != NULL;
+}
+
+/**
+ * Record data into a flight recorder, with plain memory stores only.
+ * Must be called from one thread at a time.
+ *
+ * @param flight    The open flight recorder to record into.
+ * @param kind      The kind of the data.
+ * @param device    The device the data belongs to.
+ * @param ts        The time of the data, nanoseconds.
+ * @param buf       The data.
+ * @param len       The length of the data, truncated to FLIGHT_MAX_LEN.
+ */
+extern void flight_record(struct flight *flight, enum flight_kind kind,
+                          enum flight_device device, uint64_t ts,
+                          const void *buf, size_t len);
+
+/**
+ * Close a flight recorder, unmapping its file, keeping the records.
+ * Does nothing if not open.
+ *
+ * @param flight    The flight recorder to close.
+ */
+extern void flight_close(struct flight *flight);
+
+/**
+ * A sink recording the data accepted by another sink into a flight
+ * recorder, stamped with the time of writing.
+ */
+struct flight_sink {
+    /** The abstract sink */
+    struct sink sink;
+    /** The sink to write to */
+    struct sink *inner;
+    /** The flight recorder to record into */
+    struct flight *flight;
+    /** The kind of the recorded data */
+    enum flight_kind kind;
+    /** The device the recorded data belongs to */
+    enum flight_device device;
+};
+
+/**
+ * Initialize a sink recording the data accepted by another sink.
+ *
+ * @param flight_sink   The sink to initialize.
+ * @param inner         The sink to write to.
+ * @param flight        The open flight recorder to record into.
+ * @param kind          The kind of the recorded data.
+ * @param device        The device the recorded data belongs to.
+ *
+ * @return The abstract sink.
+ */
+extern struct sink *flight_sink_init(struct flight_sink *flight_sink,
+                                     struct sink *inner,
+                                     struct flight *flight,
+                                     enum flight_kind kind,
+                                     enum flight_device device);
+
+/** A snapshot of the records of a flight recorder file */
+struct flight_snapshot {
+    /** The tablet name */
+    char name[32];
+    /** The copy of the ring, or NULL */
+    uint8_t *ring;
+    /** The size of the ring */
+    size_t size;
+    /** The stream position to look for the next record at */
+    uint64_t pos;
+    /** The stream position the records end at */
+    uint64_t end;
+    /** Number of bytes skipped looking for records */
+    uint64_t skipped;
+};
+
+/**
+ * Take a snapshot of the records of a flight recorder file, which can be
+ * being written at the same time.
+ *
+ * @param snapshot  The snapshot to take.
+ * @param path      The path of the file.
+ *
+ * @return True if taken, false otherwise, with errno set appropriately.
+ *         EINVAL means the file is not a valid flight recorder file.
+ *         The snapshot must be freed with flight_snapshot_free() either
+ *         way.
+ */
+extern bool flight_snapshot_take(struct flight_snapshot *snapshot,
+                                 const char *path);
+
+/**
+ * Retrieve the next record of a flight recorder snapshot, oldest first.
+ *
+ * @param snapshot  The snapshot to retrieve the record from.
+ * @param header    Location for the record header.
+ * @param buf       The buffer to copy the record data into, at least
+ *                  FLIGHT_MAX_LEN bytes.
+ *
+ * @return True if a record was retrieved, false if there are no more.
+ */
+extern bool flight_snapshot_next(struct flight_snapshot *snapshot,
+                                 struct flight_record_header *header,
+                                 uint8_t *buf);
+
+/**
+ * Free a flight recorder snapshot.
+ *
+ * @param snapshot  The snapshot to free.
+ */
+extern void flight_snapshot_free(struct flight_snapshot *snapshot);
+
+#endif /* _FLIGHT_H */
@@ -0,0 +1,87 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * This file is part of digimend-userspace-drivers.
+ */
+
+#include "config.h"
+#include "hist.h"
+#include <assert.h>
+
+void
+hist_record(struct hist *hist, uint64_t value)
+{
+    uint64_t *bucket = &hist->buckets[hist_bucket(value)];
+
+    /* A single writer needs no atomic read-modify-write */
+    __atomic_store_n(bucket, __atomic_load_n(bucket, __ATOMIC_RELAXED) + 1,
+                     __ATOMIC_RELAXED);
+    __atomic_store_n(&hist->count,
+                     __atomic_load_n(&hist->count, __ATOMIC_RELAXED) + 1,
+                     __ATOMIC_RELAXED);
+    if (value > __atomic_load_n(&hist->max, __ATOMIC_RELAXED)) {
+        __atomic_store_n(&hist->max, value, __ATOMIC_RELAXED);
+    }
+}
+
+uint64_t
+hist_bucket_max(unsigned int bucket)
+{
+    unsigned int shift;
+
+    assert(bucket < HIST_BUCKETS);
+
+    if (bucket < HIST_SUB_NUM) {
+        return bucket;
+    }
+    shift = bucket / HIST_SUB_NUM - 1;
+    return (((uint64_t)HIST_SUB_NUM + bucket % HIST_SUB_NUM + 1) << shift) - 1;
+}
+
+uint64_t
+hist_quantile(const struct hist *hist, double quantile)
+{
+    uint64_t count;
+    uint64_t max;
+    uint64_t rank;
+    uint64_t seen = 0;
+    unsigned int i;
+
+    assert(hist != NULL);
+    assert(quantile >= 0 && quantile <= 1);
+
+    count = __atomic_load_n(&hist->count, __ATOMIC_RELAXED);
+    max = __atomic_load_n(&hist->max, __ATOMIC_RELAXED);
+    if (count == 0) {
+        return 0;
+    }
+    rank = (uint64_t)(quantile * (double)count + 0.5);
+    if (rank < 1) {
+        rank = 1;
+    }
+    for (i = 0; i < HIST_BUCKETS; i++) {
+        seen += __atomic_load_n(&hist->buckets[i], __ATOMIC_RELAXED);
+        if (seen >= rank) {
+            return hist_bucket_max(i) < max ? hist_bucket_max(i) : max;
+        }
+    }
+    /* The counters were being updated while read */
+    return max;
+}
+
+void
+hist_print(FILE *stream, const char *name, const struct hist *hist)
+{
+    assert(stream != NULL);
+    assert(name != NULL);
+    assert(hist != NULL);
+
+    fprintf(stream, "%s: %llu samples, p50 %.1f us, p99 %.1f us, "
+            "max %.1f us\n",
+            name,
+            (unsigned long long)__atomic_load_n(&hist->count,
+                                                __ATOMIC_RELAXED),
+            (double)hist_quantile(hist, 0.5) / 1000,
+            (double)hist_quantile(hist, 0.99) / 1000,
+            (double)__atomic_load_n(&hist->max, __ATOMIC_RELAXED) / 1000);
+}
@@ -0,0 +1,111 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * This file is part of digimend-userspace-drivers.
+ */
+
+/*
+ * Log-linear histograms of durations.
+ *
+ * Each power-of-two range of values is split into HIST_SUB_NUM linear
+ * buckets, so any recorded value is known within 1/HIST_SUB_NUM of
+ * itself, with constant memory and constant recording cost.
+ *
+ * A histogram has a single writer, but can be read concurrently from any
+ * number of threads or signal handlers without locking, as counters are
+ * accessed atomically.
+ */
+
+#ifndef _HIST_H
+#define _HIST_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+/** Number of bits of linear sub-buckets of each power of two */
+#define HIST_SUB_BITS   4
+
+/** Number of linear sub-buckets of each power of two */
+#define HIST_SUB_NUM    (1u << HIST_SUB_BITS)
+
+/** Number of bits of the maximum value, larger values are clamped */
+#define HIST_MAX_BITS   40
+
+/** Number of buckets in a histogram */
+#define HIST_BUCKETS \
+    ((HIST_MAX_BITS - HIST_SUB_BITS + 1) * HIST_SUB_NUM)
+
+/** A histogram */
+struct hist {
+    /** Number of recorded values */
+    uint64_t count;
+    /** Maximum recorded value */
+    uint64_t max;
+    /** Number of recorded values in each bucket */
+    uint64_t buckets[HIST_BUCKETS];
+};
+
+/**
+ * Get the index of the bucket a value belongs to.
+ *
+ * @param value The value to get the bucket index of.
+ *
+ * @return The bucket index.
+ */
+static inline unsigned int
+hist_bucket(uint64_t value)
+{
+    unsigned int msb;
+
+    if (value < HIST_SUB_NUM) {
+        return (unsigned int)value;
+    }
+    if (value >= (UINT64_C(1) << HIST_MAX_BITS)) {
+        return HIST_BUCKETS - 1;
+    }
+    msb = 63u - (unsigned int)__builtin_clzll(value);
+    return (msb - HIST_SUB_BITS + 1) * HIST_SUB_NUM +
+           (unsigned int)((value >> (msb - HIST_SUB_BITS)) &
+                          (HIST_SUB_NUM - 1));
+}
+
+/**
+ * Record a value in a histogram. Must be called by one writer only.
+ *
+ * @param hist  The histogram to record the value in.
+ * @param value The value to record.
+ */
+extern void hist_record(struct hist *hist, uint64_t value);
+
+/**
+ * Get the highest value belonging to a histogram bucket.
+ *
+ * @param bucket    The index of the bucket.
+ *
+ * @return The highest value of the bucket.
+ */
+extern uint64_t hist_bucket_max(unsigned int bucket);
+
+/**
+ * Get a quantile of the values recorded in a histogram, rounded up to
+ * the highest value of its bucket, and limited by the maximum value.
+ *
+ * @param hist      The histogram to get the quantile of.
+ * @param quantile  The quantile to get, 0 to 1.
+ *
+ * @return The quantile value, or zero if there are no values.
+ */
+extern uint64_t hist_quantile(const struct hist *hist, double quantile);
+
+/**
+ * Print a one-line summary of a histogram of durations: the number of
+ * values, median, 99th percentile, and maximum.
+ *
+ * @param stream    The stream to print to.
+ * @param name      The name of the histogram.
+ * @param hist      The histogram of durations, nanoseconds.
+ */
+extern void hist_print(FILE *stream, const char *name,
+                       const struct hist *hist);
+
+#endif /* _HIST_H */
@@ -0,0 +1,377 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * This file is part of digimend-userspace-drivers.
+ */
+
+#include "config.h"
+#include "loop.h"
+#include "misc.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+
+/** Maximum number of events to dispatch per loop iteration */
+#define LOOP_MAX_EVENTS 32
+
+void
+loop_watch_init(struct loop_watch *watch, loop_watch_fn fn, void *data)
+{
+    assert(watch != NULL);
+    assert(fn != NULL);
+    watch->fd = -1;
+    watch->owned = false;
+    watch->fn = fn;
+    watch->data = data;
+    watch->next = NULL;
+}
+
+bool
+loop_add(struct loop *loop, struct loop_watch *watch,
+         int fd, uint32_t events)
+{
+    struct epoll_event event = {.events = events, .data.ptr = watch};
+
+    assert(loop != NULL);
+    assert(watch != NULL);
+    assert(watch->fd < 0);
+    assert(fd >= 0);
+
+    if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0) {
+        return false;
+    }
+    watch->fd = fd;
+    return true;
+}
+
+bool
+loop_modify(struct loop *loop, struct loop_watch *watch, uint32_t events)
+{
+    struct epoll_event event = {.events = events, .data.ptr = watch};
+
+    assert(loop != NULL);
+    assert(watch != NULL);
+    assert(watch->fd >= 0);
+
+    return epoll_ctl(loop->epoll_fd, EPOLL_CTL_MOD, watch->fd, &event) == 0;
+}
+
+void
+loop_remove(struct loop *loop, struct loop_watch *watch)
+{
+    assert(loop != NULL);
+    assert(watch != NULL);
+
+    if (watch->fd < 0) {
+        return;
+    }
+    epoll_ctl(loop->epoll_fd, EPOLL_CTL_DEL, watch->fd, NULL);
+    if (watch->owned) {
+        close(watch->fd);
+        watch->owned = false;
+    }
+    watch->fd = -1;
+}
+
+bool
+loop_add_timer(struct loop *loop, struct loop_watch *watch)
+{
+    int fd;
+    int orig_errno;
+
+    assert(loop != NULL);
+    assert(watch != NULL);
+
+    fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    if (!loop_add(loop, watch, fd, EPOLLIN)) {
+        orig_errno = errno;
+        close(fd);
+        errno = orig_errno;
+        return false;
+    }
+    watch->owned = true;
+    return true;
+}
+
+bool
+loop_timer_set(struct loop_watch *watch,
+               uint64_t delay_ns, uint64_t period_ns)
+{
+    struct itimerspec spec = {
+        .it_value = {
+            .tv_sec = (time_t)(delay_ns / 1000000000),
+            .tv_nsec = (long)(delay_ns % 1000000000)
+        },
+        .it_interval = {
+            .tv_sec = (time_t)(period_ns / 1000000000),
+            .tv_nsec = (long)(period_ns % 1000000000)
+        }
+    };
+
+    assert(watch != NULL);
+    assert(watch->fd >= 0);
+
+    return timerfd_settime(watch->fd, 0, &spec, NULL) == 0;
+}
+
+uint64_t
+loop_timer_read(struct loop_watch *watch)
+{
+    uint64_t expirations;
+
+    assert(watch != NULL);
+    assert(watch->fd >= 0);
+
+    if (read(watch->fd, &expirations, sizeof(expirations)) !=
+            (ssize_t)sizeof(expirations)) {
+        return 0;
+    }
+    return expirations;
+}
+
+bool
+loop_add_signals(struct loop *loop, struct loop_watch *watch,
+                 const sigset_t *signals)
+{
+    int fd;
+    int orig_errno;
+
+    assert(loop != NULL);
+    assert(watch != NULL);
+    assert(signals != NULL);
+
+    if (sigprocmask(SIG_BLOCK, signals, NULL) < 0) {
+        return false;
+    }
+    fd = signalfd(-1, signals, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    if (!loop_add(loop, watch, fd, EPOLLIN)) {
+        orig_errno = errno;
+        close(fd);
+        errno = orig_errno;
+        return false;
+    }
+    watch->owned = true;
+    return true;
+}
+
+int
+loop_signal_read(struct loop_watch *watch)
+{
+    struct signalfd_siginfo info;
+
+    assert(watch != NULL);
+    assert(watch->fd >= 0);
+
+    if (read(watch->fd, &info, sizeof(info)) != (ssize_t)sizeof(info)) {
+        return 0;
+    }
+    return (int)info.ssi_signo;
+}
+
+/**
+ * Handle readiness of a libusb file descriptor. Does nothing, as libusb
+ * events are handled once per loop iteration, after dispatching.
+ */
+static void
+loop_usb_ready(struct loop *loop, struct loop_watch *watch, uint32_t events)
+{
+    (void)loop;
+    (void)watch;
+    (void)events;
+}
+
+static void LIBUSB_CALL
+loop_usb_added_cb(int fd, short events, void *user_data)
+{
+    struct loop *loop = (struct loop *)user_data;
+    struct loop_watch *watch;
+
+    assert(loop != NULL);
+
+    watch = malloc(sizeof(*watch));
+    if (watch == NULL) {
+        GENERIC_FAILURE("allocate a libusb file descriptor watch");
+        return;
+    }
+    loop_watch_init(watch, loop_usb_ready, NULL);
+    /* poll(2) and epoll(7) input/output event bits match */
+    if (!loop_add(loop, watch, fd, (uint16_t)events)) {
+        LIBC_FAILURE(errno, "watch a libusb file descriptor");
+        free(watch);
+        return;
+    }
+    watch->next = loop->usb_watches;
+    loop->usb_watches = watch;
+}
+
+static void LIBUSB_CALL
+loop_usb_removed_cb(int fd, void *user_data)
+{
+    struct loop *loop = (struct loop *)user_data;
+    struct loop_watch *watch;
+
+    assert(loop != NULL);
+
+    /*
+     * Only remove from epoll here, as the watch can be among the events
+     * being dispatched. It's freed at the start of the next iteration.
+     */
+    for (watch = loop->usb_watches; watch != NULL; watch = watch->next) {
+        if (watch->fd == fd) {
+            loop_remove(loop, watch);
+            break;
+        }
+    }
+}
+
+/**
+ * Free the watches of removed libusb file descriptors.
+ *
+ * @param loop  The loop to free the removed watches of.
+ */
+static void
+loop_usb_purge(struct loop *loop)
+{
+    struct loop_watch **pwatch;
+    struct loop_watch *watch;
+
+    for (pwatch = &loop->usb_watches; *pwatch != NULL;) {
+        watch = *pwatch;
+        if (watch->fd < 0) {
+            *pwatch = watch->next;
+            free(watch);
+        } else {
+            pwatch = &watch->next;
+        }
+    }
+}
+
+bool
+loop_init(struct loop *loop, libusb_context *ctx)
+{
+    const struct libusb_pollfd **pollfds = NULL;
+    size_t i;
+
+    assert(loop != NULL);
+
+    loop->epoll_fd = -1;
+    loop->ctx = ctx;
+    loop->usb_timeouts_fd = false;
+    loop->usb_watches = NULL;
+    loop->stop = false;
+
+    loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (loop->epoll_fd < 0) {
+        return false;
+    }
+
+    if (ctx == NULL) {
+        return true;
+    }
+
+    /* Watch the current libusb file descriptors, and the future ones */
+    pollfds = libusb_get_pollfds(ctx);
+    if (pollfds == NULL) {
+        close(loop->epoll_fd);
+        loop->epoll_fd = -1;
+        errno = ENOMEM;
+        return false;
+    }
+    for (i = 0; pollfds[i] != NULL; i++) {
+        loop_usb_added_cb(pollfds[i]->fd, pollfds[i]->events, loop);
+    }
+#ifdef HAVE_LIBUSB_FREE_POLLFDS
+    libusb_free_pollfds(pollfds);
+#else
+    free(pollfds);
+#endif
+    libusb_set_pollfd_notifiers(ctx, loop_usb_added_cb, loop_usb_removed_cb,
+                                loop);
+    loop->usb_timeouts_fd = libusb_pollfds_handle_timeouts(ctx) != 0;
+    return true;
+}
+
+void
+loop_cleanup(struct loop *loop)
+{
+    struct loop_watch *watch;
+
+    assert(loop != NULL);
+
+    if (loop->ctx != NULL) {
+        libusb_set_pollfd_notifiers(loop->ctx, NULL, NULL, NULL);
+    }
+    while (loop->usb_watches != NULL) {
+        watch = loop->usb_watches;
+        loop->usb_watches = watch->next;
+        loop_remove(loop, watch);
+        free(watch);
+    }
+    if (loop->epoll_fd >= 0) {
+        close(loop->epoll_fd);
+        loop->epoll_fd = -1;
+    }
+}
+
+bool
+loop_run_once(struct loop *loop)
+{
+    struct timeval zero_tv = {0, 0};
+    struct epoll_event events[LOOP_MAX_EVENTS];
+    struct loop_watch *watch;
+    struct timeval tv;
+    int timeout = -1;
+    int num;
+    int i;
+    bool usb = false;
+    enum libusb_error err;
+
+    assert(loop != NULL);
+
+    loop_usb_purge(loop);
+
+    /* Wake up for the next libusb timeout, if it can't do it itself */
+    if (loop->ctx != NULL && !loop->usb_timeouts_fd &&
+        libusb_get_next_timeout(loop->ctx, &tv) == 1) {
+        timeout = (int)(tv.tv_sec * 1000 + (tv.tv_usec + 999) / 1000);
+        usb = timeout == 0;
+    }
+
+    num = epoll_wait(loop->epoll_fd, events, LOOP_MAX_EVENTS, timeout);
+    if (num < 0) {
+        return errno == EINTR;
+    }
+    if (num == 0 && timeout >= 0) {
+        usb = true;
+    }
+
+    for (i = 0; i < num; i++) {
+        watch = (struct loop_watch *)events[i].data.ptr;
+        if (watch->fn == loop_usb_ready) {
+            usb = true;
+        } else if (watch->fd >= 0) {
+            watch->fn(loop, watch, events[i].events);
+        }
+    }
+
+    /* Handle libusb events without blocking, once per iteration */
+    if (usb) {
+        err = libusb_handle_events_timeout_completed(loop->ctx,
+                                                     &zero_tv, NULL);
+        if (err != LIBUSB_SUCCESS && err != LIBUSB_ERROR_INTERRUPTED) {
+            LIBUSB_FAILURE(err, "handle libusb events");
+            errno = EIO;
+            return false;
+        }
+    }
+    return true;
+}
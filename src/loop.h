@@ -0,0 +1,217 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * This file is part of digimend-userspace-drivers.
+ */
+
+/*
+ * Event loop, multiplexing libusb file descriptors, timers, signals and
+ * any other file descriptors on a single epoll instance.
+ */
+
+#ifndef _LOOP_H
+#define _LOOP_H
+
+#include "usb.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <signal.h>
+
+struct loop;
+struct loop_watch;
+
+/**
+ * Watch callback prototype.
+ *
+ * @param loop      The loop the watch is added to.
+ * @param watch     The watch whose file descriptor is ready.
+ * @param events    The ready epoll events.
+ */
+typedef void (*loop_watch_fn)(struct loop *loop, struct loop_watch *watch,
+                              uint32_t events);
+
+/** A watch of a file descriptor in a loop */
+struct loop_watch {
+    /** The watched file descriptor, -1 if not added */
+    int fd;
+    /** True if the file descriptor is owned and closed by the watch */
+    bool owned;
+    /** The callback to call when the file descriptor is ready */
+    loop_watch_fn fn;
+    /** Callback data */
+    void *data;
+    /** Next libusb watch, for watches of libusb file descriptors */
+    struct loop_watch *next;
+};
+
+/** An event loop */
+struct loop {
+    /** The epoll instance file descriptor */
+    int epoll_fd;
+    /** The libusb context to handle events of, or NULL */
+    libusb_context *ctx;
+    /** True if libusb timeouts are handled through its file descriptors */
+    bool usb_timeouts_fd;
+    /** Watches of the libusb file descriptors */
+    struct loop_watch *usb_watches;
+    /** True if the loop was requested to stop running */
+    bool stop;
+};
+
+/**
+ * Initialize a watch, not adding it to any loop yet.
+ *
+ * @param watch The watch to initialize.
+ * @param fn    The callback to call when the file descriptor is ready.
+ * @param data  Callback data.
+ */
+extern void loop_watch_init(struct loop_watch *watch,
+                            loop_watch_fn fn, void *data);
+
+/**
+ * Initialize a loop, watching the file descriptors of a libusb context.
+ *
+ * @param loop  The loop to initialize.
+ * @param ctx   The libusb context to handle events of, or NULL.
+ *
+ * @return True if initialized, and to be cleaned up with loop_cleanup(),
+ *         false otherwise, with errno set, and nothing to clean up.
+ */
+extern bool loop_init(struct loop *loop, libusb_context *ctx);
+
+/**
+ * Cleanup a loop. Watches added by the caller must be removed before.
+ *
+ * @param loop  The loop to cleanup.
+ */
+extern void loop_cleanup(struct loop *loop);
+
+/**
+ * Add a watch of a file descriptor to a loop.
+ *
+ * @param loop      The loop to add the watch to.
+ * @param watch     The initialized watch to add.
+ * @param fd        The file descriptor to watch.
+ * @param events    The epoll events to watch for.
+ *
+ * @return True if added, false otherwise, with errno set.
+ */
+extern bool loop_add(struct loop *loop, struct loop_watch *watch,
+                     int fd, uint32_t events);
+
+/**
+ * Change the events a watch is watching for.
+ *
+ * @param loop      The loop the watch is added to.
+ * @param watch     The watch to modify.
+ * @param events    The epoll events to watch for.
+ *
+ * @return True if modified, false otherwise, with errno set.
+ */
+extern bool loop_modify(struct loop *loop, struct loop_watch *watch,
+                        uint32_t events);
+
+/**
+ * Remove a watch from a loop, closing its file descriptor, if owned.
+ * Does nothing if the watch is not added.
+ *
+ * @param loop  The loop to remove the watch from.
+ * @param watch The watch to remove.
+ */
+extern void loop_remove(struct loop *loop, struct loop_watch *watch);
+
+/**
+ * Add a timer watch to a loop, backed by a timerfd, disarmed.
+ * The callback should call loop_timer_read() to acknowledge expiration.
+ *
+ * @param loop  The loop to add the timer to.
+ * @param watch The initialized watch to add as a timer.
+ *
+ * @return True if added, false otherwise, with errno set.
+ */
+extern bool loop_add_timer(struct loop *loop, struct loop_watch *watch);
+
+/**
+ * Arm or disarm a timer watch.
+ *
+ * @param watch     The timer watch to arm.
+ * @param delay_ns  Delay before the first expiration, nanoseconds,
+ *                  zero to disarm.
+ * @param period_ns Period of expirations after the first, nanoseconds,
+ *                  zero for a single expiration.
+ *
+ * @return True if armed, false otherwise, with errno set.
+ */
+extern bool loop_timer_set(struct loop_watch *watch,
+                           uint64_t delay_ns, uint64_t period_ns);
+
+/**
+ * Acknowledge expirations of a timer watch.
+ *
+ * @param watch The timer watch to acknowledge the expirations of.
+ *
+ * @return Number of expirations since the last acknowledgement.
+ */
+extern uint64_t loop_timer_read(struct loop_watch *watch);
+
+/**
+ * Add a signal watch to a loop, backed by a signalfd, and block the
+ * signals from normal delivery. The callback should call
+ * loop_signal_read() to receive the signals.
+ *
+ * @param loop      The loop to add the signal watch to.
+ * @param watch     The initialized watch to add as a signal watch.
+ * @param signals   The set of signals to watch.
+ *
+ * @return True if added, false otherwise, with errno set.
+ */
+extern bool loop_add_signals(struct loop *loop, struct loop_watch *watch,
+                             const sigset_t *signals);
+
+/**
+ * Receive a signal from a signal watch.
+ *
+ * @param watch The signal watch to receive the signal from.
+ *
+ * @return The received signal number, or zero if none are pending.
+ */
+extern int loop_signal_read(struct loop_watch *watch);
+
+/**
+ * Run a single iteration of a loop: wait for any watched file descriptor
+ * to become ready, or for a libusb timeout, and dispatch the events.
+ * A watch removed during the iteration is not dispatched anymore, but
+ * must stay allocated until the iteration ends.
+ *
+ * @param loop  The loop to run an iteration of.
+ *
+ * @return True if the iteration succeeded, false otherwise, with errno
+ *         set.
+ */
+extern bool loop_run_once(struct loop *loop);
+
+/**
+ * Request a loop to stop running, making loop_stopped() return true.
+ *
+ * @param loop  The loop to stop.
+ */
+static inline void
+loop_stop(struct loop *loop)
+{
+    loop->stop = true;
+}
+
+/**
+ * Check if a loop was requested to stop running.
+ *
+ * @param loop  The loop to check.
+ *
+ * @return True if the loop was requested to stop, false otherwise.
+ */
+static inline bool
+loop_stopped(const struct loop *loop)
+{
+    return loop->stop;
+}
+
+#endif /* _LOOP_H */
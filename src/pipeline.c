@@ -0,0 +1,237 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * This file is part of digimend-userspace-drivers.
+ */
+
+#include "config.h"
+#include "pipeline.h"
+#include "misc.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+/**
+ * Wait for reports to be pushed into an empty pipeline ring, or the
+ * output thread to be requested to stop.
+ *
+ * @param pipeline  The pipeline to wait for.
+ * @param head      The index of the next slot to consume.
+ */
+static void
+pipeline_wait(struct pipeline *pipeline, size_t head)
+{
+    uint64_t value;
+
+    /*
+     * Announce sleeping, and check the ring again, so either this sees
+     * the producer's push, or the producer sees the announcement
+     */
+    atomic_store_explicit(&pipeline->waiting, true, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&pipeline->tail,
+                             memory_order_relaxed) == head &&
+        !pipeline_stopping(pipeline) &&
+        read(pipeline->wake_fd, &value, sizeof(value)) < 0 &&
+        errno != EINTR) {
+        LIBC_FAILURE(errno, "wait for reports");
+    }
+    atomic_store_explicit(&pipeline->waiting, false, memory_order_relaxed);
+}
+
+/**
+ * Run the output thread of a pipeline: consume the reports in the ring,
+ * waiting for more when it's empty, until requested to stop.
+ *
+ * @param arg   The pipeline.
+ *
+ * @return NULL.
+ */
+static void *
+pipeline_run(void *arg)
+{
+    struct pipeline *pipeline = (struct pipeline *)arg;
+    const struct pipeline_slot *slot;
+    size_t head;
+    size_t tail;
+
+    assert(pipeline != NULL);
+
+    head = atomic_load_explicit(&pipeline->head, memory_order_relaxed);
+    while (true) {
+        tail = atomic_load_explicit(&pipeline->tail, memory_order_acquire);
+        if (head == tail) {
+            if (pipeline_stopping(pipeline)) {
+                break;
+            }
+            pipeline_wait(pipeline, head);
+            continue;
+        }
+        /* Consume all available reports, releasing each slot after */
+        do {
+            slot = &pipeline->slots[head & pipeline->mask];
+            pipeline->fn(pipeline->data, slot->ts, slot->buf, slot->len);
+            head++;
+            atomic_store_explicit(&pipeline->head, head,
+                                  memory_order_release);
+        } while (head != tail);
+    }
+    return NULL;
+}
+
+bool
+pipeline_init(struct pipeline *pipeline, size_t num,
+              pipeline_fn fn, void *data, struct pipeline_stats *stats)
+{
+    void *mem;
+
+    assert(pipeline != NULL);
+    assert(num >= 2 && num <= PIPELINE_MAX_SLOTS);
+    assert((num & (num - 1)) == 0);
+    assert(fn != NULL);
+    assert(stats != NULL);
+
+    memset(pipeline, 0, sizeof(*pipeline));
+    pipeline->mask = num - 1;
+    pipeline->fn = fn;
+    pipeline->data = data;
+    pipeline->stats = stats;
+
+    pipeline->wake_fd = eventfd(0, EFD_CLOEXEC);
+    if (pipeline->wake_fd < 0) {
+        return false;
+    }
+
+    errno = posix_memalign(&mem, PIPELINE_CACHE_LINE,
+                           sizeof(*pipeline->slots) * num);
+    if (errno != 0) {
+        return false;
+    }
+    /* Pre-fault the slots, to not fault when reports arrive */
+    memset(mem, 0, sizeof(*pipeline->slots) * num);
+    pipeline->slots = mem;
+    return true;
+}
+
+bool
+pipeline_start(struct pipeline *pipeline)
+{
+    int err;
+
+    assert(pipeline != NULL);
+    assert(pipeline->slots != NULL);
+    assert(!pipeline->started);
+
+    atomic_store_explicit(&pipeline->stop, false, memory_order_relaxed);
+    err = pthread_create(&pipeline->thread, NULL, pipeline_run, pipeline);
+    if (err != 0) {
+        errno = err;
+        return false;
+    }
+    pipeline->started = true;
+    return true;
+}
+
+bool
+pipeline_push(struct pipeline *pipeline, uint64_t ts,
+              const uint8_t *buf, size_t len)
+{
+    struct pipeline_slot *slot;
+    size_t tail;
+    size_t used;
+    uint64_t value = 1;
+
+    assert(pipeline != NULL);
+    assert(buf != NULL || len == 0);
+    assert(len <= PIPELINE_REPORT_MAX);
+
+    tail = atomic_load_explicit(&pipeline->tail, memory_order_relaxed);
+    used = tail - atomic_load_explicit(&pipeline->head,
+                                       memory_order_acquire);
+    if (used > pipeline->mask) {
+        counter_inc(&pipeline->stats->overruns);
+        return false;
+    }
+
+    /* Fill the slot, and publish it */
+    slot = &pipeline->slots[tail & pipeline->mask];
+    slot->ts = ts;
+    slot->len = len;
+    memcpy(slot->buf, buf, len);
+    atomic_store_explicit(&pipeline->tail, tail + 1, memory_order_release);
+
+    counter_inc(&pipeline->stats->pushed);
+    used++;
+    if (used > counter_get(&pipeline->stats->high_water)) {
+        atomic_store_explicit(&pipeline->stats->high_water, used,
+                              memory_order_relaxed);
+    }
+
+    /*
+     * Wake up the output thread, if it's going to sleep, once per sleep,
+     * taking the announcement, and only locking if there's one
+     */
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&pipeline->waiting, memory_order_relaxed) &&
+        atomic_exchange_explicit(&pipeline->waiting, false,
+                                 memory_order_relaxed)) {
+        counter_inc(&pipeline->stats->wakeups);
+        if (write(pipeline->wake_fd, &value, sizeof(value)) < 0) {
+            LIBC_FAILURE(errno, "wake up the output thread");
+        }
+    }
+    return true;
+}
+
+void
+pipeline_stop(struct pipeline *pipeline)
+{
+    uint64_t value = 1;
+
+    assert(pipeline != NULL);
+
+    if (!pipeline->started) {
+        return;
+    }
+    atomic_store_explicit(&pipeline->stop, true, memory_order_release);
+    if (write(pipeline->wake_fd, &value, sizeof(value)) < 0) {
+        LIBC_FAILURE(errno, "wake up the output thread");
+    }
+    pthread_join(pipeline->thread, NULL);
+    pipeline->started = false;
+}
+
+void
+pipeline_cleanup(struct pipeline *pipeline)
+{
+    assert(pipeline != NULL);
+    assert(!pipeline->started);
+
+    free(pipeline->slots);
+    pipeline->slots = NULL;
+    if (pipeline->wake_fd >= 0) {
+        close(pipeline->wake_fd);
+        pipeline->wake_fd = -1;
+    }
+}
+
+void
+pipeline_stats_dump(FILE *stream, const char *prefix,
+                    const struct pipeline_stats *stats)
+{
+    assert(stream != NULL);
+    assert(prefix != NULL);
+    assert(stats != NULL);
+
+#define DUMP(_field) \
+    fprintf(stream, "%s" #_field " %llu\n", prefix, \
+            (unsigned long long)counter_get(&stats->_field))
+    DUMP(pushed);
+    DUMP(overruns);
+    DUMP(high_water);
+    DUMP(wakeups);
+#undef DUMP
+}
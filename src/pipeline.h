@@ -0,0 +1,203 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * This file is part of digimend-userspace-drivers.
+ */
+
+/*
+ * Report pipeline.
+ *
+ * A single-producer/single-consumer ring of fixed-size report slots,
+ * and an output thread consuming them. The producer, e.g. the thread
+ * reaping interrupt transfers, copies each report into the ring with its
+ * arrival time, and moves on at once, and the output thread translates
+ * it and writes the events, so a stall in the output path only fills the
+ * ring, instead of delaying the next transfer.
+ *
+ * Neither side locks: the ring indices are published with release stores
+ * and read with acquire loads, and the output thread only sleeps on an
+ * eventfd after announcing it, for the producer to signal it only then.
+ */
+
+#ifndef _PIPELINE_H
+#define _PIPELINE_H
+
+#include "counter.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/** Maximum length of a report in a pipeline slot */
+#define PIPELINE_REPORT_MAX 64
+
+/** Default number of slots in a pipeline ring */
+#define PIPELINE_DEF_SLOTS  256
+
+/** Maximum number of slots in a pipeline ring */
+#define PIPELINE_MAX_SLOTS  65536
+
+/**
+ * Size of a cache line, the distance between the fields written by each
+ * side, to not share cache lines
+ */
+#define PIPELINE_CACHE_LINE 64
+
+/**
+ * Pipeline report consumer function prototype, called on the output
+ * thread for each report, in the order they were pushed.
+ *
+ * @param data  The opaque data supplied with the function.
+ * @param ts    The report arrival time, nanoseconds.
+ * @param buf   The report buffer.
+ * @param len   The length of the report.
+ */
+typedef void (*pipeline_fn)(void *data, uint64_t ts,
+                            const uint8_t *buf, size_t len);
+
+/**
+ * Statistics of a pipeline, counters updated by the producer, kept by
+ * the pipeline's owner across re-initializations
+ */
+struct pipeline_stats {
+    /** Number of reports pushed into the ring */
+    _Atomic uint64_t pushed;
+    /** Number of reports dropped, as the ring was full */
+    _Atomic uint64_t overruns;
+    /** Highest number of reports in the ring, after a push */
+    _Atomic uint64_t high_water;
+    /** Number of times the sleeping output thread was woken up */
+    _Atomic uint64_t wakeups;
+};
+
+/** A pipeline ring slot */
+struct pipeline_slot {
+    /** The report arrival time, nanoseconds */
+    uint64_t ts;
+    /** The length of the report */
+    size_t len;
+    /** The report buffer */
+    uint8_t buf[PIPELINE_REPORT_MAX];
+};
+
+/** A report pipeline */
+struct pipeline {
+    /** Index of the next slot to push to, written by the producer */
+    _Atomic size_t tail;
+    uint8_t tail_pad[PIPELINE_CACHE_LINE - sizeof(size_t)];
+    /** Index of the next slot to consume, written by the output thread */
+    _Atomic size_t head;
+    uint8_t head_pad[PIPELINE_CACHE_LINE - sizeof(size_t)];
+    /** True if the output thread is about to sleep, or sleeping */
+    _Atomic bool waiting;
+    /** True if the output thread should exit once the ring is empty */
+    _Atomic bool stop;
+    uint8_t flags_pad[PIPELINE_CACHE_LINE - 2 * sizeof(bool)];
+    /** Number of slots minus one, the number is a power of two */
+    size_t mask;
+    /** The ring slots, or NULL if not allocated */
+    struct pipeline_slot *slots;
+    /** The eventfd waking up the output thread, or -1 */
+    int wake_fd;
+    /** The function consuming the reports */
+    pipeline_fn fn;
+    /** The opaque data to pass to the function */
+    void *data;
+    /** The statistics to update */
+    struct pipeline_stats *stats;
+    /** The output thread, if started */
+    pthread_t thread;
+    /** True if the output thread is started */
+    bool started;
+};
+
+/**
+ * Initialize a pipeline, allocating its ring, not starting the output
+ * thread yet.
+ *
+ * @param pipeline  The pipeline to initialize.
+ * @param num       Number of slots in the ring, a power of two,
+ *                  2 to PIPELINE_MAX_SLOTS.
+ * @param fn        The function consuming the reports on the output
+ *                  thread.
+ * @param data      The opaque data to pass to the function.
+ * @param stats     The statistics to update.
+ *
+ * @return True if initialized, false otherwise, with errno set
+ *         appropriately. The pipeline must be cleaned up with
+ *         pipeline_cleanup() either way.
+ */
+extern bool pipeline_init(struct pipeline *pipeline, size_t num,
+                          pipeline_fn fn, void *data,
+                          struct pipeline_stats *stats);
+
+/**
+ * Start the output thread of a pipeline. From then on, until it's
+ * stopped, the consumer function owns everything it writes to.
+ *
+ * @param pipeline  The pipeline to start the output thread of.
+ *
+ * @return True if started, false otherwise, with errno set
+ *         appropriately.
+ */
+extern bool pipeline_start(struct pipeline *pipeline);
+
+/**
+ * Check if the output thread of a pipeline is requested to stop, for
+ * the consumer function to stop waiting for anything but the ring.
+ *
+ * @param pipeline  The pipeline to check.
+ *
+ * @return True if stopping, false otherwise.
+ */
+static inline bool
+pipeline_stopping(struct pipeline *pipeline)
+{
+    return atomic_load_explicit(&pipeline->stop, memory_order_acquire);
+}
+
+/**
+ * Push a report into a pipeline ring, from the producer thread, waking
+ * up the output thread, if it's sleeping.
+ *
+ * @param pipeline  The pipeline to push the report into.
+ * @param ts        The report arrival time, nanoseconds.
+ * @param buf       The report buffer.
+ * @param len       The length of the report, up to PIPELINE_REPORT_MAX.
+ *
+ * @return True if pushed, false if the ring is full, and the report is
+ *         dropped.
+ */
+extern bool pipeline_push(struct pipeline *pipeline, uint64_t ts,
+                          const uint8_t *buf, size_t len);
+
+/**
+ * Stop the output thread of a pipeline, after it consumes all reports
+ * pushed so far, and wait for it to exit. Does nothing if not started.
+ *
+ * @param pipeline  The pipeline to stop the output thread of.
+ */
+extern void pipeline_stop(struct pipeline *pipeline);
+
+/**
+ * Cleanup a pipeline, freeing its ring. The output thread must be
+ * stopped.
+ *
+ * @param pipeline  The pipeline to cleanup.
+ */
+extern void pipeline_cleanup(struct pipeline *pipeline);
+
+/**
+ * Dump pipeline statistics counters to a stream, one "PREFIXCOUNTER
+ * VALUE" line each.
+ *
+ * @param stream    The stream to dump to.
+ * @param prefix    The prefix of each line.
+ * @param stats     The statistics to dump.
+ */
+extern void pipeline_stats_dump(FILE *stream, const char *prefix,
+                                const struct pipeline_stats *stats);
+
+#endif /* _PIPELINE_H */
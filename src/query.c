@@ -0,0 +1,278 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * This file is part of digimend-userspace-drivers.
+ */
+
+#include "config.h"
+#include "query.h"
+#include "misc.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+/**
+ * Disconnect a query client, freeing its slot.
+ *
+ * @param client    The client to disconnect.
+ */
+static void
+query_client_close(struct query_client *client)
+{
+    loop_remove(client->server->loop, &client->watch);
+    free(client->response);
+    client->response = NULL;
+    client->response_len = 0;
+    client->response_off = 0;
+    client->command_len = 0;
+}
+
+/**
+ * Send as much of the rest of a client's response as the socket accepts,
+ * and disconnect the client once it's sent, or sending fails.
+ *
+ * @param client    The client to send the response to.
+ */
+static void
+query_client_send(struct query_client *client)
+{
+    ssize_t rc;
+
+    while (client->response_off < client->response_len) {
+        rc = send(client->watch.fd, client->response + client->response_off,
+                  client->response_len - client->response_off,
+                  MSG_NOSIGNAL);
+        if (rc < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN) {
+                if (loop_modify(client->server->loop, &client->watch,
+                                EPOLLOUT)) {
+                    return;
+                }
+                LIBC_FAILURE(errno, "watch a query client");
+            }
+            break;
+        }
+        client->response_off += (size_t)rc;
+    }
+    query_client_close(client);
+}
+
+/**
+ * Format the response to the command received from a client.
+ *
+ * @param client    The client to respond to.
+ *
+ * @return True if the response was formatted, false otherwise, with
+ *         errno set appropriately.
+ */
+static bool
+query_client_respond(struct query_client *client)
+{
+    const struct query_server *server = client->server;
+    FILE *stream;
+
+    stream = open_memstream(&client->response, &client->response_len);
+    if (stream == NULL) {
+        return false;
+    }
+    if (!server->fn(server->data, stream, client->command)) {
+        fprintf(stream, "unknown command: %s\n", client->command);
+    }
+    if (fclose(stream) != 0) {
+        free(client->response);
+        client->response = NULL;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Receive a command from a query client, and respond once it's complete,
+ * or continue sending the response, once the client accepts more.
+ */
+static void
+query_client_ready(struct loop *loop, struct loop_watch *watch,
+                   uint32_t events)
+{
+    struct query_client *client = (struct query_client *)watch->data;
+    ssize_t rc;
+    char *end;
+
+    (void)loop;
+    (void)events;
+    assert(client != NULL);
+
+    if (client->response != NULL) {
+        query_client_send(client);
+        return;
+    }
+
+    rc = recv(watch->fd, client->command + client->command_len,
+              sizeof(client->command) - client->command_len, 0);
+    if (rc < 0 && (errno == EAGAIN || errno == EINTR)) {
+        return;
+    }
+    if (rc <= 0) {
+        query_client_close(client);
+        return;
+    }
+    client->command_len += (size_t)rc;
+
+    /* Wait for the complete command, unless it's too long */
+    end = memchr(client->command, '\n', client->command_len);
+    if (end == NULL) {
+        if (client->command_len >= sizeof(client->command)) {
+            query_client_close(client);
+        }
+        return;
+    }
+    if (end > client->command && end[-1] == '\r') {
+        end--;
+    }
+    *end = '\0';
+
+    if (!query_client_respond(client)) {
+        LIBC_FAILURE(errno, "format a query response");
+        query_client_close(client);
+        return;
+    }
+    query_client_send(client);
+}
+
+/**
+ * Accept connections to a query socket, refusing them beyond the
+ * maximum number of clients.
+ */
+static void
+query_server_ready(struct loop *loop, struct loop_watch *watch,
+                   uint32_t events)
+{
+    struct query_server *server = (struct query_server *)watch->data;
+    struct query_client *client;
+    int fd;
+    size_t i;
+
+    (void)events;
+    assert(server != NULL);
+
+    while (true) {
+        fd = accept4(watch->fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            if (errno != EAGAIN) {
+                LIBC_FAILURE(errno, "accept a query client");
+            }
+            return;
+        }
+        for (i = 0; i < QUERY_MAX_CLIENTS &&
+                    server->clients[i].watch.fd >= 0; i++);
+        if (i >= QUERY_MAX_CLIENTS) {
+            close(fd);
+            continue;
+        }
+        client = &server->clients[i];
+        if (!loop_add(loop, &client->watch, fd, EPOLLIN)) {
+            LIBC_FAILURE(errno, "watch a query client");
+            close(fd);
+            continue;
+        }
+        client->watch.owned = true;
+    }
+}
+
+bool
+query_server_init(struct query_server *server, struct loop *loop,
+                  const char *path, query_fn fn, void *data)
+{
+    bool result = false;
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    size_t len;
+    int fd = -1;
+    bool bound = false;
+    int orig_errno;
+    size_t i;
+
+    assert(server != NULL);
+    assert(loop != NULL);
+    assert(path != NULL);
+    assert(fn != NULL);
+
+    memset(server, 0, sizeof(*server));
+    server->loop = loop;
+    server->path = path;
+    server->fn = fn;
+    server->data = data;
+    loop_watch_init(&server->watch, query_server_ready, server);
+    for (i = 0; i < QUERY_MAX_CLIENTS; i++) {
+        server->clients[i].server = server;
+        loop_watch_init(&server->clients[i].watch, query_client_ready,
+                        &server->clients[i]);
+    }
+
+    len = strlen(path);
+    if (len >= sizeof(addr.sun_path)) {
+        errno = ENAMETOOLONG;
+        goto cleanup;
+    }
+    memcpy(addr.sun_path, path, len + 1);
+
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        goto cleanup;
+    }
+    /* Replace the socket left by a previous instance */
+    if (unlink(path) < 0 && errno != ENOENT) {
+        goto cleanup;
+    }
+    if (bind(fd, (const struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        goto cleanup;
+    }
+    bound = true;
+    if (listen(fd, QUERY_MAX_CLIENTS) < 0 ||
+        !loop_add(loop, &server->watch, fd, EPOLLIN)) {
+        goto cleanup;
+    }
+    server->watch.owned = true;
+    fd = -1;
+
+    result = true;
+cleanup:
+    if (!result) {
+        orig_errno = errno;
+        if (fd >= 0) {
+            close(fd);
+        }
+        if (bound) {
+            unlink(path);
+        }
+        errno = orig_errno;
+    }
+    return result;
+}
+
+void
+query_server_cleanup(struct query_server *server)
+{
+    size_t i;
+
+    assert(server != NULL);
+
+    for (i = 0; i < QUERY_MAX_CLIENTS; i++) {
+        if (server->clients[i].watch.fd >= 0) {
+            query_client_close(&server->clients[i]);
+        }
+    }
+    if (server->watch.fd >= 0) {
+        loop_remove(server->loop, &server->watch);
+        unlink(server->path);
+    }
+}
@@ -0,0 +1,109 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * This file is part of digimend-userspace-drivers.
+ */
+
+/*
+ * Query socket.
+ *
+ * A Unix stream socket served from an event loop, answering one-line
+ * text queries. A client connects, sends a command terminated with a
+ * newline, receives the text response, and the server closes the
+ * connection. All socket operations are non-blocking, and a response is
+ * formatted at once, when its command arrives, so a slow client only
+ * costs the memory of its response.
+ */
+
+#ifndef _QUERY_H
+#define _QUERY_H
+
+#include "loop.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/** Maximum number of clients served at once */
+#define QUERY_MAX_CLIENTS   8
+
+/**
+ * Maximum length of a command, including the newline. Clients sending
+ * longer ones are disconnected.
+ */
+#define QUERY_MAX_COMMAND   64
+
+/**
+ * Query handler function prototype.
+ *
+ * @param data      The opaque data supplied with the function.
+ * @param stream    The stream to write the response to.
+ * @param command   The command, without the newline.
+ *
+ * @return True if the command was handled, false if it's unknown.
+ */
+typedef bool (*query_fn)(void *data, FILE *stream, const char *command);
+
+struct query_server;
+
+/** A client of a query socket */
+struct query_client {
+    /** The server the client is connected to */
+    struct query_server *server;
+    /** The watch of the client connection, not added if unused */
+    struct loop_watch watch;
+    /** The command received so far */
+    char command[QUERY_MAX_COMMAND];
+    /** Length of the command received so far */
+    size_t command_len;
+    /** The response to send, NULL until the command is received */
+    char *response;
+    /** Length of the response */
+    size_t response_len;
+    /** Number of bytes of the response sent so far */
+    size_t response_off;
+};
+
+/** A query socket server */
+struct query_server {
+    /** The loop the socket is served from */
+    struct loop *loop;
+    /** The path the socket is bound to */
+    const char *path;
+    /** The watch of the listening socket */
+    struct loop_watch watch;
+    /** The function handling commands */
+    query_fn fn;
+    /** The opaque data to pass to the function */
+    void *data;
+    /** Client slots */
+    struct query_client clients[QUERY_MAX_CLIENTS];
+};
+
+/**
+ * Start serving a query socket: create it, replacing the file at the
+ * path, if any, bind, and listen.
+ *
+ * @param server    The server to initialize.
+ * @param loop      The loop to serve the socket from.
+ * @param path      The path to bind the socket to, must stay valid while
+ *                  the server is used.
+ * @param fn        The function handling commands.
+ * @param data      The opaque data to pass to the function.
+ *
+ * @return True if started, false otherwise, with errno set
+ *         appropriately. The server must be cleaned up with
+ *         query_server_cleanup() either way.
+ */
+extern bool query_server_init(struct query_server *server,
+                              struct loop *loop, const char *path,
+                              query_fn fn, void *data);
+
+/**
+ * Stop serving a query socket: disconnect all clients, and close and
+ * remove the socket.
+ *
+ * @param server    The server to clean up.
+ */
+extern void query_server_cleanup(struct query_server *server);
+
+#endif /* _QUERY_H */
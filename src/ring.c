@@ -0,0 +1,427 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * This file is part of digimend-userspace-drivers.
+ */
+
+#include "config.h"
+#include "ring.h"
+#include "capture.h"
+#include "misc.h"
+#include "probe.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+
+/** Alignment of transfer buffers, a cache line */
+#define RING_BUF_ALIGN  64
+
+/**
+ * Get the CPU time consumed by the process.
+ *
+ * @return The process CPU time, nanoseconds.
+ */
+static uint64_t
+process_cpu_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * Account a completed report in stress mode statistics, and print them
+ * once a second.
+ *
+ * @param stress    The stress statistics to update.
+ * @param now       The report arrival time, nanoseconds.
+ * @param queued    Number of transfers still queued on the endpoint.
+ * @param reordered Number of completions reaped out of order so far.
+ */
+static void
+stress_account(struct stress *stress, uint64_t now,
+               size_t queued, uint64_t reordered)
+{
+    uint64_t cpu_ns;
+
+    assert(stress != NULL);
+
+    if (stress->period_ns == 0) {
+        return;
+    }
+
+    if (stress->start_ns == 0) {
+        stress->start_ns = now;
+        stress->start_cpu_ns = process_cpu_ns();
+        stress->min_queued = queued;
+    } else if ((now - stress->last_ns) * 2 > stress->period_ns * 3) {
+        stress->gaps++;
+    }
+    stress->last_ns = now;
+    stress->reports++;
+    if (queued < stress->min_queued) {
+        stress->min_queued = queued;
+    }
+
+    if (now - stress->start_ns >= 1000000000) {
+        cpu_ns = process_cpu_ns();
+        fprintf(stderr,
+                "stress: %.0f reports/s (expected %.0f), "
+                "%llu gaps > %.2f ms, min %zu transfers queued, "
+                "%llu reordered in total, %.2f%% process CPU\n",
+                (double)stress->reports * 1e9 /
+                    (double)(now - stress->start_ns),
+                1e9 / (double)stress->period_ns,
+                (unsigned long long)stress->gaps,
+                (double)stress->period_ns * 1.5 / 1e6,
+                stress->min_queued,
+                (unsigned long long)reordered,
+                (double)(cpu_ns - stress->start_cpu_ns) * 100 /
+                    (double)(now - stress->start_ns));
+        stress->start_ns = now;
+        stress->start_cpu_ns = cpu_ns;
+        stress->reports = 0;
+        stress->gaps = 0;
+        stress->min_queued = queued;
+    }
+}
+
+
+/**
+ * Submit a ring slot's transfer.
+ *
+ * @param slot  The slot to submit the transfer of.
+ *
+ * @return Libusb error code.
+ */
+static enum libusb_error
+slot_submit(struct slot *slot)
+{
+    enum libusb_error err;
+    assert(slot != NULL);
+    assert(!slot->submitted);
+    err = transport_submit(slot->ring->transport, slot->transfer);
+    if (err == LIBUSB_SUCCESS) {
+        slot->submitted = true;
+        slot->ring->queued++;
+    }
+    return err;
+}
+
+
+void
+ring_translate(struct ring *ring, uint64_t ts,
+               const uint8_t *buf, size_t len)
+{
+    struct report report;
+    uint64_t now;
+
+    assert(ring != NULL);
+
+    if (ring->flight != NULL) {
+        flight_record(ring->flight, FLIGHT_KIND_REPORT,
+                      FLIGHT_DEVICE_TABLET, ts, buf, len);
+    }
+
+    /* Translate, and account the latency since completion */
+    if (decoder_decode(ring->decoder, &report, buf, len)) {
+        translate_report(ring->outputs, ts, &report);
+        now = clock_ns();
+        hist_record(&ring->latency[report.kind], now - ts);
+        counter_inc(&ring->stats->reports[report.kind]);
+        if (atomic_load_explicit(&ring->first_ns,
+                                 memory_order_relaxed) == 0) {
+            atomic_store_explicit(&ring->first_ns, now,
+                                  memory_order_relaxed);
+        }
+    } else {
+        counter_inc(&ring->stats->rejected);
+    }
+}
+
+
+static void LIBUSB_CALL
+interrupt_transfer_cb(struct libusb_transfer *transfer)
+{
+    enum libusb_error err;
+    struct slot *slot;
+    struct ring *ring;
+
+    assert(transfer != NULL);
+    assert(transfer->user_data != NULL);
+
+    slot = (struct slot *)transfer->user_data;
+    ring = slot->ring;
+    assert(slot->submitted);
+    slot->submitted = false;
+    ring->queued--;
+    PROBE2(transfer, transfer->status, transfer->actual_length);
+    if ((unsigned int)transfer->status < RING_STATUS_NUM) {
+        counter_inc(&ring->stats->status[transfer->status]);
+    }
+
+    switch (transfer->status)
+    {
+        case LIBUSB_TRANSFER_COMPLETED:
+            if (ring->stopping) {
+                break;
+            }
+            slot->completed = true;
+            slot->ts = clock_ns();
+            ring->completed++;
+            if (slot != &ring->slots[ring->head]) {
+                ring->reordered++;
+            }
+            stress_account(&ring->stress, slot->ts,
+                           ring->queued, ring->reordered);
+            break;
+
+#define MAP(_name, _desc) \
+    case LIBUSB_TRANSFER_##_name: \
+        GENERIC_ERROR(_desc);  \
+        break
+
+        MAP(ERROR,      "Interrupt transfer failed");
+        MAP(TIMED_OUT,  "Interrupt transfer timed out");
+        MAP(STALL,      "Interrupt transfer halted (endpoint stalled)");
+        MAP(NO_DEVICE,  "Device was disconnected");
+        MAP(OVERFLOW,   "Interrupt transfer overflowed "
+                        "(device sent more data than requested)");
+#undef MAP
+
+        case LIBUSB_TRANSFER_CANCELLED:
+            break;
+        default:
+            GENERIC_ERROR("Unknown status of interrupt transfer: %d",
+                          transfer->status);
+            break;
+    }
+
+    /*
+     * Translate completed reports in submission order, or hand them over
+     * to the output thread, and resubmit their transfers to the tail of
+     * the queue. Skip failed slots.
+     */
+    while (true) {
+        slot = &ring->slots[ring->head];
+        if (slot->completed) {
+            /* Capture */
+            if (ring->capture != NULL &&
+                !capture_write(ring->capture, slot->ts,
+                               slot->transfer->buffer,
+                               slot->transfer->actual_length)) {
+                LIBC_FAILURE(errno, "write a capture record");
+            }
+            /* Translate, or copy out, dropping it if the ring is full */
+            if (ring->pipeline != NULL) {
+                pipeline_push(ring->pipeline, slot->ts,
+                              slot->transfer->buffer,
+                              (size_t)slot->transfer->actual_length);
+            } else {
+                ring_translate(ring, slot->ts, slot->transfer->buffer,
+                               (size_t)slot->transfer->actual_length);
+            }
+            slot->completed = false;
+            ring->completed--;
+            /* Resubmit the transfer */
+            err = slot_submit(slot);
+            PROBE2(resubmit, err, ring->queued);
+            if (err != LIBUSB_SUCCESS) {
+                counter_inc(&ring->stats->resubmit_failures);
+                LIBUSB_FAILURE(err, "resubmit a transfer");
+            }
+        } else if (slot->submitted || ring->completed == 0) {
+            break;
+        }
+        ring->head = (ring->head + 1) % ring->num;
+    }
+
+    /* Report the ring stopped, if no transfers are left to complete */
+    if (ring->queued == 0 && !ring->stopping && !ring->failed) {
+        ring->failed = true;
+        if (ring->changed != NULL) {
+            *ring->changed = true;
+        }
+    }
+}
+
+
+void
+ring_cleanup(struct ring *ring)
+{
+    size_t i;
+    struct libusb_transfer *transfer;
+
+    assert(ring != NULL);
+
+    for (i = 0; i < ring->num; i++) {
+        transfer = ring->slots[i].transfer;
+        assert(!ring->slots[i].submitted);
+        if (transfer != NULL) {
+            transport_free(ring->transport, transfer);
+            ring->slots[i].transfer = NULL;
+        }
+    }
+    ring->num = 0;
+
+    /* Keep a repeated cleanup away from the transport, maybe gone */
+    if (ring->mem == NULL) {
+        return;
+    }
+    if (ring->zero_copy) {
+        ring->transport->mem_free(ring->transport, ring->mem, ring->mem_size);
+    } else {
+        free(ring->mem);
+    }
+    ring->mem = NULL;
+    ring->mem_size = 0;
+    ring->zero_copy = false;
+}
+
+
+bool
+ring_init(struct ring *ring, struct transport *transport,
+          uint8_t endpoint, size_t num, size_t len,
+          bool zero_copy, const struct decoder *decoder,
+          struct outputs *outputs, FILE *capture)
+{
+    size_t i;
+    struct slot *slot;
+    size_t stride;
+    void *mem;
+
+    assert(ring != NULL);
+    assert(transport != NULL);
+    assert(num > 0 && num <= RING_MAX_TRANSFERS);
+    assert(len > 0);
+    assert(decoder != NULL);
+    assert(outputs != NULL);
+
+    memset(ring, 0, sizeof(*ring));
+    ring->transport = transport;
+    ring->decoder = decoder;
+    ring->outputs = outputs;
+    ring->capture = capture;
+
+    /* Allocate the buffers from the transport, e.g. usbfs, if possible */
+    stride = (len + RING_BUF_ALIGN - 1) / RING_BUF_ALIGN * RING_BUF_ALIGN;
+    ring->mem_size = stride * num;
+    if (zero_copy && transport->mem_alloc != NULL) {
+        ring->mem = transport->mem_alloc(transport, ring->mem_size);
+        ring->zero_copy = ring->mem != NULL;
+    }
+    if (ring->mem == NULL) {
+        errno = posix_memalign(&mem, RING_BUF_ALIGN, ring->mem_size);
+        if (errno != 0) {
+            LIBC_FAILURE(errno, "allocate interrupt transfer buffers");
+            return false;
+        }
+        ring->mem = mem;
+    }
+    /* Pre-fault the buffers, to not fault when reports arrive */
+    memset(ring->mem, 0, ring->mem_size);
+
+    for (i = 0; i < num; i++) {
+        slot = &ring->slots[i];
+        slot->ring = ring;
+        /* Allocate interrupt transfer */
+        slot->transfer = transport_alloc(transport);
+        if (slot->transfer == NULL) {
+            GENERIC_FAILURE("allocate a transfer");
+            return false;
+        }
+        ring->num++;
+        /* Initialize interrupt transfer */
+        libusb_fill_interrupt_transfer(slot->transfer,
+                                       slot->transfer->dev_handle, endpoint,
+                                       ring->mem + stride * i, len,
+                                       interrupt_transfer_cb,
+                                       /* Callback data */
+                                       slot,
+                                       /* Timeout */
+                                       0);
+    }
+
+    return true;
+}
+
+
+void
+ring_stats_dump(FILE *stream, const char *prefix,
+                const struct ring_stats *stats)
+{
+    static const char *status_names[RING_STATUS_NUM] = {
+        [LIBUSB_TRANSFER_COMPLETED] = "completed",
+        [LIBUSB_TRANSFER_ERROR] = "error",
+        [LIBUSB_TRANSFER_TIMED_OUT] = "timed_out",
+        [LIBUSB_TRANSFER_CANCELLED] = "cancelled",
+        [LIBUSB_TRANSFER_STALL] = "stall",
+        [LIBUSB_TRANSFER_NO_DEVICE] = "no_device",
+        [LIBUSB_TRANSFER_OVERFLOW] = "overflow",
+    };
+    size_t i;
+    enum report_kind kind;
+
+    assert(stream != NULL);
+    assert(prefix != NULL);
+    assert(stats != NULL);
+
+    for (i = 0; i < RING_STATUS_NUM; i++) {
+        fprintf(stream, "%stransfers.%s %llu\n", prefix, status_names[i],
+                (unsigned long long)counter_get(&stats->status[i]));
+    }
+    for (kind = 0; kind < REPORT_KIND_NUM; kind++) {
+        fprintf(stream, "%sreports.%s %llu\n", prefix,
+                report_kind_name(kind),
+                (unsigned long long)counter_get(&stats->reports[kind]));
+    }
+    fprintf(stream, "%sreports.rejected %llu\n", prefix,
+            (unsigned long long)counter_get(&stats->rejected));
+    fprintf(stream, "%sresubmit_failures %llu\n", prefix,
+            (unsigned long long)counter_get(&stats->resubmit_failures));
+}
+
+
+enum libusb_error
+ring_submit(struct ring *ring)
+{
+    size_t i;
+    enum libusb_error err;
+
+    assert(ring != NULL);
+    assert(ring->stats != NULL);
+
+    for (i = 0; i < ring->num; i++) {
+        err = slot_submit(&ring->slots[i]);
+        if (err != LIBUSB_SUCCESS) {
+            return err;
+        }
+    }
+    return LIBUSB_SUCCESS;
+}
+
+
+void
+ring_cancel(struct ring *ring)
+{
+    size_t i;
+    enum libusb_error err;
+
+    assert(ring != NULL);
+
+    ring->stopping = true;
+    for (i = 0; i < ring->num; i++) {
+        if (ring->slots[i].submitted) {
+            transport_cancel(ring->transport, ring->slots[i].transfer);
+        }
+    }
+    while (ring->queued > 0) {
+        err = transport_handle_events(ring->transport);
+        if (err != LIBUSB_SUCCESS && err != LIBUSB_ERROR_INTERRUPTED) {
+            LIBUSB_FAILURE(err, "handle transfer cancellation events");
+            break;
+        }
+    }
+}
@@ -0,0 +1,236 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * This file is part of digimend-userspace-drivers.
+ */
+
+/* Rings of interrupt transfers */
+
+#ifndef _RING_H
+#define _RING_H
+
+#include "counter.h"
+#include "decoder.h"
+#include "flight.h"
+#include "hist.h"
+#include "pipeline.h"
+#include "report.h"
+#include "translate.h"
+#include "transport.h"
+#include "usb.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/** Maximum number of transfers in a ring */
+#define RING_MAX_TRANSFERS  64
+
+/** Default number of transfers in a ring */
+#define RING_DEF_TRANSFERS  4
+
+struct ring;
+
+/**
+ * Number of transfer statuses counted, LIBUSB_TRANSFER_COMPLETED through
+ * LIBUSB_TRANSFER_OVERFLOW
+ */
+#define RING_STATUS_NUM     (LIBUSB_TRANSFER_OVERFLOW + 1)
+
+/**
+ * Statistics of the transfers and reports of a ring, transfer counters
+ * updated by the thread handling its transfers, and report counters by
+ * the thread translating them
+ */
+struct ring_stats {
+    /** Number of transfers finished, per transfer status */
+    _Atomic uint64_t status[RING_STATUS_NUM];
+    /** Number of reports translated, per report kind */
+    _Atomic uint64_t reports[REPORT_KIND_NUM];
+    /** Number of reports rejected as unknown or short */
+    _Atomic uint64_t rejected;
+    /** Number of transfers which failed to be resubmitted */
+    _Atomic uint64_t resubmit_failures;
+};
+
+/** A transfer slot in a ring */
+struct slot {
+    /** The ring the slot belongs to */
+    struct ring *ring;
+    /** The transfer of the slot */
+    struct libusb_transfer *transfer;
+    /** True if the transfer is submitted and not completed yet */
+    bool submitted;
+    /** True if the transfer completed and awaits translation */
+    bool completed;
+    /** Completion time of the transfer, nanoseconds */
+    uint64_t ts;
+};
+
+/** Stress mode statistics, verifying no reports are lost */
+struct stress {
+    /** Expected interval between reports, ns, zero if stress mode is off */
+    uint64_t period_ns;
+    /** Time the current measurement second started, ns */
+    uint64_t start_ns;
+    /** Time the previous report arrived, ns */
+    uint64_t last_ns;
+    /** Reports received in the current second */
+    uint64_t reports;
+    /** Report intervals longer than 1.5 periods in the current second */
+    uint64_t gaps;
+    /** Minimum number of transfers left queued on a completion */
+    size_t min_queued;
+    /** Process CPU time the current measurement second started, ns */
+    uint64_t start_cpu_ns;
+};
+
+/**
+ * A ring of interrupt transfers kept continuously queued on an endpoint.
+ * Transfers are submitted in ring order, and their reports are translated
+ * in the same order, even if completions are reaped out of order.
+ */
+struct ring {
+    /** The transport to transfer from the device through */
+    struct transport *transport;
+    /** The memory of all transfer buffers, or NULL */
+    uint8_t *mem;
+    /** Size of the transfer buffer memory */
+    size_t mem_size;
+    /**
+     * True if the buffer memory is provided by the transport, e.g. mapped
+     * from usbfs, so the kernel transfers into it directly, instead of
+     * copying from its own buffers
+     */
+    bool zero_copy;
+    /** Decoder to decode the reports with */
+    const struct decoder *decoder;
+    /** Outputs to translate the reports to */
+    struct outputs *outputs;
+    /** The stream to capture the reports to, or NULL */
+    FILE *capture;
+    /**
+     * The flight recorder to record the reports into, as they're
+     * translated, or NULL
+     */
+    struct flight *flight;
+    /**
+     * The pipeline to push the reports into, for its output thread to
+     * translate them with ring_translate(), or NULL to translate them
+     * on completion
+     */
+    struct pipeline *pipeline;
+    /** Number of slots in the ring */
+    size_t num;
+    /** Index of the slot expected to complete next */
+    size_t head;
+    /** Number of submitted transfers */
+    size_t queued;
+    /** Number of completed transfers awaiting translation */
+    size_t completed;
+    /** True if the ring is being stopped and must not resubmit */
+    bool stopping;
+    /** True if all transfers failed, and the ring stopped by itself */
+    bool failed;
+    /** The flag to raise when the ring fails, or NULL */
+    bool *changed;
+    /**
+     * The statistics to update, kept by the ring's owner across
+     * re-initializations, must be set before submitting
+     */
+    struct ring_stats *stats;
+    /** Number of completions reaped out of order */
+    uint64_t reordered;
+    /** Stress mode statistics */
+    struct stress stress;
+    /**
+     * Histograms of latency from transfer completion to output flush,
+     * nanoseconds, per report kind.
+     */
+    struct hist latency[REPORT_KIND_NUM];
+    /** Time the first report was delivered, nanoseconds, zero if none */
+    _Atomic uint64_t first_ns;
+    /** Transfer slots */
+    struct slot slots[RING_MAX_TRANSFERS];
+};
+
+/**
+ * Initialize a ring of interrupt transfers, allocating the transfers
+ * and their buffers. The buffers are allocated in a single block, each
+ * on its own cache line, by the transport, e.g. mapped from usbfs, if
+ * requested and supported, or on the heap otherwise.
+ *
+ * @param ring      The ring to initialize.
+ * @param transport The transport to transfer from the device through,
+ *                  must stay valid while the ring is initialized.
+ * @param endpoint  The address of the endpoint to transfer from.
+ * @param num       Number of transfers to allocate,
+ *                  1 to RING_MAX_TRANSFERS.
+ * @param len       Length of each transfer buffer.
+ * @param zero_copy True if the buffers should be provided by the
+ *                  transport, if supported, for the kernel to transfer
+ *                  into them without copying.
+ * @param decoder   The decoder to decode the reports with.
+ * @param outputs   The outputs to translate the reports to.
+ * @param capture   The stream to capture the reports to, or NULL.
+ *
+ * @return True if the ring was initialized, false otherwise.
+ *         The ring must be cleaned up with ring_cleanup() either way.
+ */
+extern bool ring_init(struct ring *ring, struct transport *transport,
+                      uint8_t endpoint, size_t num, size_t len,
+                      bool zero_copy, const struct decoder *decoder,
+                      struct outputs *outputs, FILE *capture);
+
+/**
+ * Cleanup a transfer ring, freeing its transfers and buffers.
+ * The transfers must not be submitted. Cleaning up a ring again does
+ * nothing, and doesn't use its transport.
+ *
+ * @param ring  The ring to cleanup.
+ */
+extern void ring_cleanup(struct ring *ring);
+
+/**
+ * Dump ring statistics counters to a stream, one "PREFIXCOUNTER VALUE"
+ * line each.
+ *
+ * @param stream    The stream to dump to.
+ * @param prefix    The prefix of each line.
+ * @param stats     The statistics to dump.
+ */
+extern void ring_stats_dump(FILE *stream, const char *prefix,
+                            const struct ring_stats *stats);
+
+/**
+ * Record a report received by a ring into its flight recorder, if any,
+ * decode it, translate it to the ring's outputs, and account it in the
+ * ring's statistics and latency histograms.
+ * Called on completion, or on the output thread of the ring's pipeline.
+ *
+ * @param ring  The ring the report was received by.
+ * @param ts    The report arrival time, nanoseconds.
+ * @param buf   The report buffer.
+ * @param len   The length of the report.
+ */
+extern void ring_translate(struct ring *ring, uint64_t ts,
+                           const uint8_t *buf, size_t len);
+
+/**
+ * Submit all transfers of a ring.
+ *
+ * @param ring  The ring to submit transfers of.
+ *
+ * @return Libusb error code.
+ */
+extern enum libusb_error ring_submit(struct ring *ring);
+
+/**
+ * Cancel all submitted transfers of a ring and wait for them to finish,
+ * handling the events of its transport.
+ *
+ * @param ring  The ring to cancel transfers of.
+ */
+extern void ring_cancel(struct ring *ring);
+
+#endif /* _RING_H */
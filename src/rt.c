@@ -0,0 +1,78 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * This file is part of digimend-userspace-drivers.
+ */
+
+#include "config.h"
+#include "rt.h"
+#include "misc.h"
+#include <assert.h>
+#include <malloc.h>
+#include <sched.h>
+#include <string.h>
+#include <sys/mman.h>
+
+/** Size of the stack to pre-fault, bytes */
+#define RT_STACK_PREFAULT   (256 * 1024)
+
+/**
+ * Pre-fault the stack, so the locked pages are there before they're
+ * needed. Not inlined, to have its frame below the caller's.
+ */
+static void __attribute__((noinline))
+rt_prefault_stack(void)
+{
+    volatile unsigned char buf[RT_STACK_PREFAULT];
+    size_t i;
+
+    for (i = 0; i < sizeof(buf); i += 4096) {
+        buf[i] = 0;
+    }
+}
+
+bool
+rt_setup(const struct rt_options *options)
+{
+    bool result = false;
+    cpu_set_t cpus;
+    struct sched_param param = {.sched_priority = 0};
+
+    assert(options != NULL);
+
+    if (options->priority == 0 && options->cpu < 0) {
+        return true;
+    }
+
+    /* Pin to the CPU */
+    if (options->cpu >= 0) {
+        CPU_ZERO(&cpus);
+        CPU_SET(options->cpu, &cpus);
+        LIBC_GUARD(sched_setaffinity(0, sizeof(cpus), &cpus),
+                   "pin to CPU %d", options->cpu);
+    }
+
+    if (options->priority != 0) {
+        /*
+         * Keep freed heap memory and allocate from the heap only, so
+         * that locked pages are reused instead of mapping new ones.
+         */
+        if (mallopt(M_TRIM_THRESHOLD, -1) == 0 ||
+            mallopt(M_MMAP_MAX, 0) == 0) {
+            FAILURE_CLEANUP("configure memory allocation");
+        }
+        /* Lock all memory, current and future, to avoid page faults */
+        LIBC_GUARD(mlockall(MCL_CURRENT | MCL_FUTURE),
+                   "lock memory");
+        rt_prefault_stack();
+
+        /* Switch to real-time scheduling */
+        param.sched_priority = options->priority;
+        LIBC_GUARD(sched_setscheduler(0, SCHED_FIFO, &param),
+                   "switch to SCHED_FIFO priority %d", options->priority);
+    }
+
+    result = true;
+cleanup:
+    return result;
+}
@@ -0,0 +1,35 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * This file is part of digimend-userspace-drivers.
+ */
+
+/* Real-time, low-jitter execution setup */
+
+#ifndef _RT_H
+#define _RT_H
+
+#include <stdbool.h>
+
+/** Real-time execution options */
+struct rt_options {
+    /** SCHED_FIFO priority to run at, 1-99, or zero to keep the policy */
+    int priority;
+    /** The CPU to pin the thread to, or -1 to not pin */
+    int cpu;
+};
+
+/**
+ * Setup the calling thread for real-time, low-jitter execution: pin it
+ * to a CPU, switch it to SCHED_FIFO, lock all current and future memory,
+ * keep freed heap memory mapped, and pre-fault the stack. Does nothing
+ * if neither priority, nor CPU is specified.
+ *
+ * @param options   The real-time options.
+ *
+ * @return True if setup succeeded, false otherwise, with the failure
+ *         reported.
+ */
+extern bool rt_setup(const struct rt_options *options);
+
+#endif /* _RT_H */
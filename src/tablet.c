@@ -0,0 +1,920 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * This file is part of digimend-userspace-drivers.
+ */
+
+#include "config.h"
+#include "tablet.h"
+#include "misc.h"
+#include "uhid.h"
+#include "uinput.h"
+#include <assert.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <poll.h>
+#include <sys/epoll.h>
+
+/** Time to wait for a congested output device on the output thread, ms */
+#define TABLET_FLUSH_POLL_MS    100
+
+/**
+ * Get the epoll events to always watch the output devices of a tablet
+ * for: kernel requests of uhid devices, none for uinput devices.
+ *
+ * @param tablet    The tablet to get the events for.
+ *
+ * @return The epoll events.
+ */
+static uint32_t
+tablet_output_events(const struct tablet *tablet)
+{
+    return tablet->outputs.backend == OUTPUT_BACKEND_UHID ? EPOLLIN : 0;
+}
+
+/**
+ * Handle kernel requests to a uhid output device of a tablet, or write
+ * the frames queued on a congested output device, once it's writable,
+ * and stop watching it for that, once they're all written.
+ */
+static void
+tablet_output_ready(struct loop *loop, struct loop_watch *watch,
+                    uint32_t events)
+{
+    struct tablet *tablet = (struct tablet *)watch->data;
+    struct output *output;
+
+    assert(tablet != NULL);
+
+    if ((events & EPOLLIN) && uhid_handle(watch->fd) < 0) {
+        LIBC_FAILURE(errno, "handle a uhid request");
+    }
+    if (!(events & EPOLLOUT)) {
+        return;
+    }
+    output = watch == &tablet->pen_watch ? &tablet->outputs.pen
+                                         : &tablet->outputs.pad;
+    if (frame_queue_drain(&output->queue, output->sink,
+                          &output->stats) < 0 &&
+        errno == EAGAIN) {
+        return;
+    }
+    if (!loop_modify(loop, watch, tablet_output_events(tablet))) {
+        LIBC_FAILURE(errno, "stop watching %s output",
+                     watch == &tablet->pen_watch ? "pen" : "pad");
+    }
+}
+
+/**
+ * Format the identity of a tablet device, staying the same across
+ * replugs into the same port: the USB port path, "bus-port.port...", if
+ * supported by libusb, or "bus:address" otherwise.
+ *
+ * @param dev   The device to format the identity of.
+ * @param buf   The buffer to format the identity into.
+ * @param size  The size of the buffer.
+ */
+static void
+tablet_format_port(libusb_device *dev, char *buf, size_t size)
+{
+#ifdef HAVE_LIBUSB_GET_PORT_NUMBERS
+    uint8_t ports[7];
+    int num;
+    int i;
+    int len;
+
+    num = libusb_get_port_numbers(dev, ports, (int)sizeof(ports));
+    if (num > 0) {
+        len = snprintf(buf, size, "%u", libusb_get_bus_number(dev));
+        for (i = 0; i < num && len >= 0 && (size_t)len < size; i++) {
+            len += snprintf(buf + len, size - (size_t)len, "%c%u",
+                            i == 0 ? '-' : '.', ports[i]);
+        }
+        return;
+    }
+#endif
+    snprintf(buf, size, "%03u:%03u",
+             libusb_get_bus_number(dev), libusb_get_device_address(dev));
+}
+
+struct tablet *
+tablet_new(libusb_device *dev, const struct model *model)
+{
+    struct tablet *tablet;
+
+    assert(dev != NULL);
+    assert(model != NULL);
+
+    tablet = calloc(1, sizeof(*tablet));
+    if (tablet == NULL) {
+        return NULL;
+    }
+    tablet->dev = libusb_ref_device(dev);
+    tablet->model = model;
+    tablet->timing.arrived = clock_ns();
+    tablet->pen_fd = -1;
+    tablet->pad_fd = -1;
+    loop_watch_init(&tablet->pen_watch, tablet_output_ready, tablet);
+    loop_watch_init(&tablet->pad_watch, tablet_output_ready, tablet);
+    tablet_format_port(dev, tablet->name, sizeof(tablet->name));
+    return tablet;
+}
+
+bool
+tablet_matches(const struct tablet *tablet, libusb_device *dev,
+               const struct model *model)
+{
+    char name[sizeof(tablet->name)];
+
+    assert(tablet != NULL);
+    assert(dev != NULL);
+    assert(model != NULL);
+
+    tablet_format_port(dev, name, sizeof(name));
+    return model == tablet->model && strcmp(name, tablet->name) == 0;
+}
+
+void
+tablet_attach(struct tablet *tablet, libusb_device *dev)
+{
+    assert(tablet != NULL);
+    assert(tablet->dev == NULL);
+    assert(tablet->handle == NULL);
+    assert(dev != NULL);
+
+    tablet->dev = libusb_ref_device(dev);
+    tablet->gone = false;
+    tablet->failed = false;
+    memset(&tablet->timing, 0, sizeof(tablet->timing));
+    tablet->timing.arrived = clock_ns();
+}
+
+/**
+ * Free the initialization control transfers of a tablet, not submitted.
+ *
+ * @param tablet    The tablet to free the transfers of.
+ */
+static void
+tablet_init_free(struct tablet *tablet)
+{
+    size_t i;
+
+    for (i = 0; i < MODEL_INIT_MAX; i++) {
+        if (tablet->init_transfers[i] != NULL) {
+            free(tablet->init_transfers[i]->buffer);
+            libusb_free_transfer(tablet->init_transfers[i]);
+            tablet->init_transfers[i] = NULL;
+        }
+    }
+}
+
+/**
+ * Mark a tablet failed asynchronously, to have it closed outside libusb
+ * callbacks.
+ *
+ * @param tablet    The failed tablet.
+ */
+static void
+tablet_fail(struct tablet *tablet)
+{
+    tablet->failed = true;
+    *tablet->options->changed = true;
+}
+
+/**
+ * Write the frames queued on a congested output device of a tablet from
+ * its output thread, waiting for the device to get writable, until
+ * they're written, or the thread is stopping.
+ *
+ * @param tablet    The tablet to flush the output device of.
+ * @param output    The output to flush.
+ * @param fd        The output device file descriptor.
+ */
+static void
+tablet_flush_output(struct tablet *tablet, struct output *output, int fd)
+{
+    struct pollfd pfd = {.fd = fd, .events = POLLOUT};
+
+    while (output->queue.num > 0 &&
+           frame_queue_drain(&output->queue, output->sink,
+                             &output->stats) < 0 &&
+           errno == EAGAIN && !pipeline_stopping(&tablet->pipeline)) {
+        if (poll(&pfd, 1, TABLET_FLUSH_POLL_MS) < 0 && errno != EINTR) {
+            LIBC_FAILURE(errno, "wait for an output device");
+            return;
+        }
+    }
+}
+
+/**
+ * Translate a report of a tablet on its output thread, and write out the
+ * frames queued on its congested output devices, if any, as the main
+ * loop doesn't watch them meanwhile.
+ */
+static void
+tablet_output_report(void *data, uint64_t ts, const uint8_t *buf, size_t len)
+{
+    struct tablet *tablet = (struct tablet *)data;
+
+    assert(tablet != NULL);
+
+    ring_translate(&tablet->ring, ts, buf, len);
+    tablet_flush_output(tablet, &tablet->outputs.pen, tablet->pen_fd);
+    tablet_flush_output(tablet, &tablet->outputs.pad, tablet->pad_fd);
+}
+
+/**
+ * Hand the output devices of a tablet over to an output thread, fed with
+ * the reports of its interrupt transfer ring through a pipeline.
+ *
+ * @param tablet    The tablet to start the output thread of.
+ *
+ * @return True if started, false otherwise. The thread must be stopped
+ *         with tablet_output_thread_stop() either way.
+ */
+static bool
+tablet_output_thread_start(struct tablet *tablet)
+{
+    bool result = false;
+    const struct tablet_options *options = tablet->options;
+
+    if (tablet->model->report_size > PIPELINE_REPORT_MAX) {
+        ERROR_CLEANUP("%s: reports are too long for the output thread",
+                      tablet->name);
+    }
+    tablet->ring.pipeline = &tablet->pipeline;
+    if (!pipeline_init(&tablet->pipeline, PIPELINE_DEF_SLOTS,
+                       tablet_output_report, tablet,
+                       &tablet->pipeline_stats)) {
+        LIBC_FAILURE_CLEANUP(errno, "initialize the output pipeline");
+    }
+    /* Stop raising congestion, and draining the devices in the loop */
+    tablet->outputs.congested = NULL;
+    if (!loop_modify(options->loop, &tablet->pen_watch,
+                     tablet_output_events(tablet)) ||
+        !loop_modify(options->loop, &tablet->pad_watch,
+                     tablet_output_events(tablet))) {
+        LIBC_FAILURE_CLEANUP(errno, "stop watching output devices");
+    }
+    if (!pipeline_start(&tablet->pipeline)) {
+        LIBC_FAILURE_CLEANUP(errno, "start the output thread");
+    }
+
+    result = true;
+cleanup:
+    return result;
+}
+
+/**
+ * Stop the output thread of a tablet, once it translates all the reports
+ * pushed so far, and take the output devices back to the main loop,
+ * having them watched, if they're congested. Does nothing if the thread
+ * wasn't started.
+ *
+ * @param tablet    The tablet to stop the output thread of.
+ */
+static void
+tablet_output_thread_stop(struct tablet *tablet)
+{
+    if (tablet->ring.pipeline == NULL) {
+        return;
+    }
+    pipeline_stop(&tablet->pipeline);
+    pipeline_cleanup(&tablet->pipeline);
+    tablet->ring.pipeline = NULL;
+    tablet->outputs.congested = tablet->options->changed;
+    if (tablet->outputs.pen.queue.num > 0 ||
+        tablet->outputs.pad.queue.num > 0) {
+        *tablet->options->changed = true;
+    }
+}
+
+/**
+ * Start serving a tablet, once its initialization control transfers
+ * completed: compile its decoder, and start its interrupt transfers.
+ *
+ * @param tablet    The tablet to start.
+ *
+ * @return True if started, false otherwise.
+ */
+static bool
+tablet_start(struct tablet *tablet)
+{
+    bool result = false;
+    const struct model *model = tablet->model;
+    const struct libusb_transfer *rdesc;
+    const struct tablet_timing *timing = &tablet->timing;
+
+    /* Compile the report decoder, unless kept from the previous device */
+    if (!tablet->reopened) {
+        rdesc = tablet->init_transfers[model->init_rdesc];
+        if (rdesc->status != LIBUSB_TRANSFER_COMPLETED) {
+            rdesc = NULL;
+        }
+        if (!model->decoder_init(
+                &tablet->decoder,
+                rdesc == NULL ? NULL : libusb_control_transfer_get_data(
+                                            (struct libusb_transfer *)rdesc),
+                rdesc == NULL ? 0 : (size_t)rdesc->actual_length)) {
+            FAILURE_CLEANUP("compile report decoder");
+        }
+        fprintf(stderr, "%s: decoding reports with a %splan compiled "
+                "from %s report descriptor\n",
+                tablet->name,
+                tablet->decoder.specialized ? "specialized " : "",
+                tablet->decoder.builtin ? "the built-in" : "the interface's");
+    }
+
+    /* Allocate interrupt transfers */
+    if (!ring_init(&tablet->ring,
+                   transport_libusb_init(&tablet->transport,
+                                         tablet->options->loop->ctx,
+                                         tablet->handle),
+                   model->endpoint,
+                   tablet->options->transfers, model->report_size,
+                   tablet->options->zero_copy, &tablet->decoder,
+                   &tablet->outputs, tablet->options->capture)) {
+        FAILURE_CLEANUP("initialize interrupt transfer ring");
+    }
+    if (tablet->options->stress_rate != 0) {
+        tablet->ring.stress.period_ns =
+            1000000000 / tablet->options->stress_rate;
+    }
+    tablet->ring.changed = tablet->options->changed;
+    tablet->ring.stats = &tablet->ring_stats;
+    if (flight_is_open(&tablet->flight)) {
+        tablet->ring.flight = &tablet->flight;
+    }
+
+    /* Translate on an output thread, if requested */
+    if (tablet->options->output_thread &&
+        !tablet_output_thread_start(tablet)) {
+        FAILURE_CLEANUP("start the output thread");
+    }
+
+    /* Submit transfers */
+    LIBUSB_GUARD(ring_submit(&tablet->ring), "submit a transfer");
+    tablet->timing.started = clock_ns();
+
+    fprintf(stderr, "%s: %s %zu %s transfers%s in %.1f ms since arrival: "
+            "open %.1f ms, then control transfers %.1f ms, "
+            "concurrent with input device creation %.1f ms\n",
+            tablet->name, tablet->reopened ? "restarted" : "started",
+            tablet->ring.num,
+            tablet->ring.zero_copy ? "zero-copy" : "heap-buffered",
+            tablet->ring.pipeline != NULL ? ", feeding an output thread" : "",
+            (double)(timing->started - timing->arrived) / 1e6,
+            (double)(timing->opened - timing->arrived) / 1e6,
+            (double)(timing->configured - timing->opened) / 1e6,
+            (double)(timing->created - timing->opened) / 1e6);
+
+    result = true;
+cleanup:
+    return result;
+}
+
+/**
+ * Check if a tablet should be served with uhid output devices, according
+ * to its options.
+ *
+ * @param tablet    The tablet to check.
+ *
+ * @return True if the tablet should be served with uhid devices.
+ */
+static bool
+tablet_uses_uhid(const struct tablet *tablet)
+{
+    const char *port = tablet->options->uhid_ports;
+    size_t len;
+
+    if (port == NULL) {
+        return false;
+    }
+    while (*port != '\0') {
+        len = strcspn(port, ",");
+        if ((len == 3 && strncmp(port, "all", len) == 0) ||
+            (len == strlen(tablet->name) &&
+             strncmp(port, tablet->name, len) == 0)) {
+            return true;
+        }
+        port += len;
+        port += *port == ',';
+    }
+    return false;
+}
+
+/**
+ * Get the kind of the data a tablet writes to its output devices, for
+ * recording.
+ *
+ * @param tablet    The tablet to get the kind for.
+ *
+ * @return The flight record kind.
+ */
+static enum flight_kind
+tablet_flight_kind(const struct tablet *tablet)
+{
+    return tablet->outputs.backend == OUTPUT_BACKEND_UHID
+        ? FLIGHT_KIND_UHID : FLIGHT_KIND_EVENTS;
+}
+
+/**
+ * Stop watching and destroy the input devices of a tablet, if any.
+ *
+ * @param tablet    The tablet to destroy the input devices of.
+ */
+static void
+tablet_destroy_outputs(struct tablet *tablet)
+{
+    if (tablet->options != NULL) {
+        loop_remove(tablet->options->loop, &tablet->pad_watch);
+        loop_remove(tablet->options->loop, &tablet->pen_watch);
+    }
+    if (tablet->outputs.backend == OUTPUT_BACKEND_UHID) {
+        uhid_destroy(tablet->pad_fd);
+        uhid_destroy(tablet->pen_fd);
+    } else {
+        uinput_destroy(tablet->pad_fd);
+        uinput_destroy(tablet->pen_fd);
+    }
+    tablet->pad_fd = -1;
+    tablet->pen_fd = -1;
+}
+
+/**
+ * Create the input devices of a tablet, once its axis capabilities are
+ * known, and set up the outputs writing to them.
+ *
+ * @param tablet    The tablet to create the input devices for.
+ *
+ * @return True if created, false otherwise.
+ */
+static bool
+tablet_create_outputs(struct tablet *tablet)
+{
+    bool result = false;
+    const struct tablet_options *options = tablet->options;
+    const struct model *model = tablet->model;
+    const struct model_axes *axes = &tablet->axes;
+
+    /* Precompute the mapping for the axes */
+    if (options->map_config != NULL) {
+        if (!map_init(&tablet->map, options->map_config, axes)) {
+            ERROR_CLEANUP("%s: the mapping area doesn't fit the tablet's "
+                          "%dx%d", tablet->name, axes->x_max, axes->y_max);
+        }
+        tablet->outputs.map = &tablet->map;
+    }
+
+    if (tablet_uses_uhid(tablet)) {
+        tablet->outputs.backend = OUTPUT_BACKEND_UHID;
+        tablet->pen_fd = uhid_create_pen(model, axes);
+        if (tablet->pen_fd < 0) {
+            FAILURE_CLEANUP("create uhid pen device");
+        }
+        tablet->pad_fd = uhid_create_pad(model);
+        if (tablet->pad_fd < 0) {
+            FAILURE_CLEANUP("create uhid pad device");
+        }
+    } else {
+        tablet->outputs.backend = OUTPUT_BACKEND_UINPUT;
+        tablet->pen_fd = uinput_create_pen(model, axes);
+        if (tablet->pen_fd < 0) {
+            FAILURE_CLEANUP("create uinput pen device");
+        }
+        tablet->pad_fd = uinput_create_pad(model);
+        if (tablet->pad_fd < 0) {
+            FAILURE_CLEANUP("create uinput pad device");
+        }
+    }
+    tablet->outputs.pen.sink = sink_fd_init(&tablet->pen_sink,
+                                            tablet->pen_fd);
+    tablet->outputs.pad.sink = sink_fd_init(&tablet->pad_sink,
+                                            tablet->pad_fd);
+    /* Record what's written, if recording */
+    if (flight_is_open(&tablet->flight)) {
+        tablet->outputs.pen.sink = flight_sink_init(
+            &tablet->pen_flight_sink, tablet->outputs.pen.sink,
+            &tablet->flight, tablet_flight_kind(tablet), FLIGHT_DEVICE_PEN);
+        tablet->outputs.pad.sink = flight_sink_init(
+            &tablet->pad_flight_sink, tablet->outputs.pad.sink,
+            &tablet->flight, tablet_flight_kind(tablet), FLIGHT_DEVICE_PAD);
+    }
+    predictor_init(&tablet->outputs.predictor, axes,
+                   options->predict_ns, options->predict_pressure);
+    tablet->outputs.congested = options->changed;
+    /* Watch the devices for requests only, until they're congested */
+    if (!loop_add(options->loop, &tablet->pen_watch, tablet->pen_fd,
+                  tablet_output_events(tablet)) ||
+        !loop_add(options->loop, &tablet->pad_watch, tablet->pad_fd,
+                  tablet_output_events(tablet))) {
+        LIBC_FAILURE_CLEANUP(errno, "watch output devices");
+    }
+    tablet->timing.created = clock_ns();
+
+    result = true;
+cleanup:
+    /* Don't keep a partial set of devices across replugs */
+    if (!result) {
+        tablet_destroy_outputs(tablet);
+    }
+    return result;
+}
+
+/**
+ * Take the axis capabilities of a tablet from the parameters it
+ * reported, falling back to the model's, and create its input devices.
+ *
+ * @param tablet    The tablet to configure.
+ * @param transfer  The completed parameters retrieval transfer.
+ *
+ * @return True if configured, false otherwise.
+ */
+static bool
+tablet_configure(struct tablet *tablet, struct libusb_transfer *transfer)
+{
+    const struct model_axes *axes = &tablet->axes;
+    bool reported;
+
+    tablet->axes = tablet->model->axes;
+    reported = model_parse_params(&tablet->axes,
+                                  libusb_control_transfer_get_data(transfer),
+                                  (size_t)transfer->actual_length);
+    fprintf(stderr, "%s: %s, pen X 0-%d, Y 0-%d at %d units/mm, "
+            "pressure 0-%d, %s\n",
+            tablet->name, tablet->model->name,
+            axes->x_max, axes->y_max, axes->resolution, axes->pressure_max,
+            reported ? "as reported" : "as known for the model");
+    return tablet_create_outputs(tablet);
+}
+
+static void LIBUSB_CALL
+tablet_init_cb(struct libusb_transfer *transfer)
+{
+    struct tablet *tablet = (struct tablet *)transfer->user_data;
+    const struct model_init_step *step;
+    size_t i;
+
+    assert(tablet != NULL);
+    assert(tablet->init_pending > 0);
+
+    tablet->init_pending--;
+    for (i = 0; tablet->init_transfers[i] != transfer; i++);
+    step = &tablet->model->init[i];
+
+    if (transfer->status == LIBUSB_TRANSFER_COMPLETED) {
+        /* Create the input devices, while the rest of the transfers run */
+        if (i == tablet->model->init_params && !tablet->reopened &&
+            !tablet->init_stopping && !tablet_configure(tablet, transfer)) {
+            tablet->init_stopping = true;
+        }
+    } else if (transfer->status == LIBUSB_TRANSFER_CANCELLED) {
+        tablet->init_stopping = true;
+    } else if (!step->optional &&
+               !(step->stall_ok &&
+                 transfer->status == LIBUSB_TRANSFER_STALL)) {
+        GENERIC_ERROR("%s: failed to %s: transfer status %d",
+                      tablet->name, step->desc, transfer->status);
+        tablet->init_stopping = true;
+    }
+
+    if (tablet->init_pending > 0) {
+        return;
+    }
+    /* All completed */
+    tablet->timing.configured = clock_ns();
+    if (tablet->init_stopping) {
+        if (!tablet->gone) {
+            tablet_fail(tablet);
+        }
+        return;
+    }
+    if (!tablet_start(tablet)) {
+        tablet_fail(tablet);
+    }
+    tablet_init_free(tablet);
+}
+
+/**
+ * Allocate and submit all initialization control transfers of a tablet
+ * at once, to have them queued on the default control endpoint without
+ * a round trip between them.
+ *
+ * @param tablet    The tablet to submit the transfers for.
+ *
+ * @return True if submitted, false otherwise.
+ */
+static bool
+tablet_init_submit(struct tablet *tablet)
+{
+    size_t i;
+    const struct model *model = tablet->model;
+    const struct model_init_step *step;
+    struct libusb_transfer *transfer;
+    uint8_t *buf;
+    enum libusb_error err;
+    /* Keep the decoder compiled from the previous device's descriptor */
+    size_t num = tablet->reopened ? model->init_rdesc : model->init_num;
+
+    for (i = 0; i < num; i++) {
+        step = &model->init[i];
+        buf = malloc(LIBUSB_CONTROL_SETUP_SIZE + step->length);
+        transfer = libusb_alloc_transfer(0);
+        if (buf == NULL || transfer == NULL) {
+            free(buf);
+            libusb_free_transfer(transfer);
+            GENERIC_FAILURE("allocate a control transfer");
+            return false;
+        }
+        tablet->init_transfers[i] = transfer;
+        libusb_fill_control_setup(buf, step->request_type, step->request,
+                                  step->value, step->index, step->length);
+        libusb_fill_control_transfer(transfer, tablet->handle, buf,
+                                     tablet_init_cb, tablet,
+                                     /* timeout */
+                                     1000);
+    }
+    for (i = 0; i < num; i++) {
+        err = libusb_submit_transfer(tablet->init_transfers[i]);
+        if (err != LIBUSB_SUCCESS) {
+            LIBUSB_FAILURE(err, "submit a control transfer to %s",
+                           model->init[i].desc);
+            return false;
+        }
+        tablet->init_pending++;
+    }
+    return true;
+}
+
+bool
+tablet_open(struct tablet *tablet, const struct tablet_options *options)
+{
+    bool result = false;
+    const struct model *model = tablet->model;
+    enum libusb_error err;
+    int iface;
+    char path[PATH_MAX];
+
+    assert(tablet != NULL);
+    assert(tablet->handle == NULL);
+    assert(options != NULL);
+    assert(options->changed != NULL);
+
+    tablet->options = options;
+    tablet->init_stopping = false;
+    tablet->reopened = tablet->pen_fd >= 0;
+
+    /* Start recording on the first open, carrying on without, if failed */
+    if (options->flight_dir != NULL && !flight_is_open(&tablet->flight) &&
+        !tablet->reopened) {
+        snprintf(path, sizeof(path), "%s/%s.flight",
+                 options->flight_dir, tablet->name);
+        if (!flight_open(&tablet->flight, path, FLIGHT_DEF_SIZE,
+                         tablet->name)) {
+            LIBC_FAILURE(errno, "open flight recorder file %s", path);
+        }
+    }
+
+    /* Open the device */
+    LIBUSB_GUARD(libusb_open(tablet->dev, &tablet->handle),
+                 "open the device");
+
+    /* Take over the interfaces */
+    for (iface = 0; iface < model->iface_num; iface++) {
+        err = libusb_detach_kernel_driver(tablet->handle, iface);
+        if (err == LIBUSB_SUCCESS) {
+            tablet->ifaces_detached |= 1u << iface;
+        } else if (err != LIBUSB_ERROR_NOT_FOUND) {
+            LIBUSB_FAILURE_CLEANUP(err, "detach kernel driver "
+                                   "from interface #%d", iface);
+        }
+        LIBUSB_GUARD(libusb_claim_interface(tablet->handle, iface),
+                     "claim interface #%d", iface);
+        tablet->ifaces_claimed |= 1u << iface;
+    }
+
+    /* Recover the interrupt endpoint, if transfers failed on it */
+    if (tablet->halted) {
+        err = libusb_clear_halt(tablet->handle, model->endpoint);
+        if (err != LIBUSB_SUCCESS) {
+            LIBUSB_FAILURE(err, "clear halt of the interrupt endpoint");
+        }
+        tablet->halted = false;
+    }
+    tablet->timing.opened = clock_ns();
+
+    /* Queue the control transfers enabling proprietary reports */
+    if (!tablet_init_submit(tablet)) {
+        FAILURE_CLEANUP("start initialization");
+    }
+
+    /* Keep the input devices registered across replugs and resets */
+    if (tablet->reopened) {
+        tablet->timing.created = tablet->timing.opened;
+    }
+
+    result = true;
+cleanup:
+    return result;
+}
+
+/**
+ * Cancel the initialization control transfers of a tablet, if any are
+ * submitted, wait for them to finish, and free them.
+ *
+ * @param tablet    The tablet to cancel the initialization of.
+ * @param ctx       The libusb context to handle events of while waiting.
+ */
+static void
+tablet_init_cancel(struct tablet *tablet, libusb_context *ctx)
+{
+    size_t i;
+    enum libusb_error err;
+
+    tablet->init_stopping = true;
+    if (tablet->init_pending > 0) {
+        for (i = 0; i < MODEL_INIT_MAX; i++) {
+            if (tablet->init_transfers[i] != NULL) {
+                libusb_cancel_transfer(tablet->init_transfers[i]);
+            }
+        }
+    }
+    while (tablet->init_pending > 0) {
+        err = libusb_handle_events(ctx);
+        if (err != LIBUSB_SUCCESS && err != LIBUSB_ERROR_INTERRUPTED) {
+            LIBUSB_FAILURE(err, "handle control transfer cancellation");
+            return;
+        }
+    }
+    tablet_init_free(tablet);
+}
+
+/**
+ * Close the USB side of a tablet: stop its transfers, and return its
+ * interfaces to the kernel, keeping its input devices. Does nothing if
+ * not open.
+ *
+ * @param tablet    The tablet to close the USB side of.
+ * @param ctx       The libusb context to handle events of while stopping
+ *                  transfers.
+ */
+static void
+tablet_close_usb(struct tablet *tablet, libusb_context *ctx)
+{
+    int iface;
+
+    if (tablet->handle == NULL) {
+        return;
+    }
+
+    tablet_init_cancel(tablet, ctx);
+    ring_cancel(&tablet->ring);
+    tablet_output_thread_stop(tablet);
+    ring_cleanup(&tablet->ring);
+    tablet_print_latency(tablet, stderr);
+
+    for (iface = tablet->model->iface_num - 1; iface >= 0; iface--) {
+        if (tablet->ifaces_claimed & (1u << iface)) {
+            libusb_release_interface(tablet->handle, iface);
+        }
+    }
+    tablet->ifaces_claimed = 0;
+    for (iface = tablet->model->iface_num - 1; iface >= 0; iface--) {
+        if (tablet->ifaces_detached & (1u << iface)) {
+            libusb_attach_kernel_driver(tablet->handle, iface);
+        }
+    }
+    tablet->ifaces_detached = 0;
+
+    /* Close the device */
+    libusb_close(tablet->handle);
+    tablet->handle = NULL;
+}
+
+void
+tablet_close(struct tablet *tablet, libusb_context *ctx)
+{
+    char name[48];
+
+    assert(tablet != NULL);
+
+    tablet_close_usb(tablet, ctx);
+
+    if (tablet->pen_fd >= 0) {
+        snprintf(name, sizeof(name), "%s: pen", tablet->name);
+        frame_stats_print(name, &tablet->outputs.pen.stats);
+    }
+    if (tablet->pad_fd >= 0) {
+        snprintf(name, sizeof(name), "%s: pad", tablet->name);
+        frame_stats_print(name, &tablet->outputs.pad.stats);
+    }
+
+    tablet_destroy_outputs(tablet);
+}
+
+void
+tablet_detach(struct tablet *tablet, libusb_context *ctx)
+{
+    assert(tablet != NULL);
+    assert(tablet->pen_fd >= 0);
+
+    tablet_close_usb(tablet, ctx);
+    translate_neutral(&tablet->outputs);
+    libusb_unref_device(tablet->dev);
+    tablet->dev = NULL;
+    tablet->gone = false;
+}
+
+void
+tablet_reset(struct tablet *tablet, libusb_context *ctx)
+{
+    assert(tablet != NULL);
+    assert(tablet->pen_fd >= 0);
+
+    tablet_close_usb(tablet, ctx);
+    translate_neutral(&tablet->outputs);
+    tablet->halted = true;
+    memset(&tablet->timing, 0, sizeof(tablet->timing));
+    tablet->timing.arrived = clock_ns();
+}
+
+void
+tablet_watch_outputs(struct tablet *tablet)
+{
+    assert(tablet != NULL);
+
+    if (tablet->pipeline.started) {
+        return;
+    }
+    if (tablet->outputs.pen.queue.num > 0 &&
+        !loop_modify(tablet->options->loop, &tablet->pen_watch,
+                     EPOLLOUT | tablet_output_events(tablet))) {
+        LIBC_FAILURE(errno, "watch pen output");
+    }
+    if (tablet->outputs.pad.queue.num > 0 &&
+        !loop_modify(tablet->options->loop, &tablet->pad_watch,
+                     EPOLLOUT | tablet_output_events(tablet))) {
+        LIBC_FAILURE(errno, "watch pad output");
+    }
+}
+
+void
+tablet_print_latency(const struct tablet *tablet, FILE *stream)
+{
+    char name[64];
+    enum report_kind kind;
+    uint64_t first_ns;
+
+    assert(tablet != NULL);
+    assert(stream != NULL);
+
+    if (tablet->handle == NULL) {
+        return;
+    }
+    first_ns = atomic_load_explicit(&tablet->ring.first_ns,
+                                    memory_order_relaxed);
+    if (first_ns != 0) {
+        fprintf(stream, "%s: first report delivered %.1f ms since arrival\n",
+                tablet->name,
+                (double)(first_ns - tablet->timing.arrived) / 1e6);
+    }
+    for (kind = 0; kind < REPORT_KIND_NUM; kind++) {
+        snprintf(name, sizeof(name), "%s: %s latency",
+                 tablet->name, report_kind_name(kind));
+        hist_print(stream, name, &tablet->ring.latency[kind]);
+    }
+}
+
+void
+tablet_dump_stats(const struct tablet *tablet, FILE *stream)
+{
+    char prefix[64];
+
+    assert(tablet != NULL);
+    assert(stream != NULL);
+
+    snprintf(prefix, sizeof(prefix), "%s ", tablet->name);
+    ring_stats_dump(stream, prefix, &tablet->ring_stats);
+    snprintf(prefix, sizeof(prefix), "%s pen.", tablet->name);
+    frame_stats_dump(stream, prefix, &tablet->outputs.pen.stats);
+    snprintf(prefix, sizeof(prefix), "%s pad.", tablet->name);
+    frame_stats_dump(stream, prefix, &tablet->outputs.pad.stats);
+    snprintf(prefix, sizeof(prefix), "%s pipeline.", tablet->name);
+    pipeline_stats_dump(stream, prefix, &tablet->pipeline_stats);
+}
+
+void
+tablet_free(struct tablet *tablet)
+{
+    if (tablet == NULL) {
+        return;
+    }
+    assert(tablet->handle == NULL);
+    if (tablet->dev != NULL) {
+        libusb_unref_device(tablet->dev);
+    }
+    flight_close(&tablet->flight);
+    free(tablet);
+}
@@ -0,0 +1,302 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * This file is part of digimend-userspace-drivers.
+ */
+
+/* Tablet device contexts */
+
+#ifndef _TABLET_H
+#define _TABLET_H
+
+#include "decoder.h"
+#include "flight.h"
+#include "loop.h"
+#include "map.h"
+#include "model.h"
+#include "pipeline.h"
+#include "ring.h"
+#include "sink.h"
+#include "translate.h"
+#include "transport.h"
+#include "usb.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/** Options of serving a tablet */
+struct tablet_options {
+    /** Number of interrupt transfers to keep in flight */
+    size_t transfers;
+    /** Report rate to verify no reports are lost at, Hz, or zero */
+    unsigned long stress_rate;
+    /** The stream to capture the reports to, or NULL */
+    FILE *capture;
+    /** Time to predict pen motion ahead, nanoseconds, or zero */
+    uint64_t predict_ns;
+    /** True if pen pressure should be predicted as well */
+    bool predict_pressure;
+    /**
+     * Pen value mapping configuration, or NULL for none, precomputed for
+     * each tablet's axes
+     */
+    const struct map_config *map_config;
+    /**
+     * Comma-separated names (port paths) of the tablets to serve with
+     * uhid output devices instead of uinput ones, "all" for all tablets,
+     * or NULL for none
+     */
+    const char *uhid_ports;
+    /**
+     * True if transfer buffers should be mapped from usbfs, if supported,
+     * avoiding a copy of each report
+     */
+    bool zero_copy;
+    /**
+     * True if reports should be translated and written on an output
+     * thread, fed through a pipeline, instead of on transfer completion
+     */
+    bool output_thread;
+    /**
+     * The directory to keep a flight recorder file of each tablet in,
+     * named after the tablet, or NULL for none
+     */
+    const char *flight_dir;
+    /** The loop to watch the output devices with */
+    struct loop *loop;
+    /**
+     * The flag to raise when a tablet fails asynchronously, to have it
+     * closed outside libusb callbacks, or when its output devices get
+     * congested, to have them watched.
+     */
+    bool *changed;
+};
+
+/** Startup phase timestamps of a tablet, monotonic, nanoseconds */
+struct tablet_timing {
+    /** The device arrived */
+    uint64_t arrived;
+    /** The device was opened and its interfaces claimed */
+    uint64_t opened;
+    /** The input devices were created */
+    uint64_t created;
+    /** The initialization control transfers completed */
+    uint64_t configured;
+    /** The interrupt transfers were submitted */
+    uint64_t started;
+};
+
+/** A served tablet */
+struct tablet {
+    /** Next tablet in the daemon's list */
+    struct tablet *next;
+    /**
+     * Name of the tablet for messages, and its identity across replugs:
+     * the USB port path "bus-port.port...", or "bus:address", if libusb
+     * can't retrieve port numbers.
+     */
+    char name[32];
+    /** The USB device, referenced, or NULL if detached */
+    libusb_device *dev;
+    /** The model of the tablet */
+    const struct model *model;
+    /**
+     * The pen axis capabilities: the model's, overridden by the ones
+     * reported by the tablet, kept with the input devices
+     */
+    struct model_axes axes;
+    /** The device handle, or NULL if not open */
+    libusb_device_handle *handle;
+    /** True if the device was disconnected */
+    bool gone;
+    /** True if opening failed, and the tablet is ignored until replugged */
+    bool failed;
+    /**
+     * True if the tablet was last opened with the input devices, the
+     * axes, and the decoder kept from a previous device, or the same one
+     * before reset
+     */
+    bool reopened;
+    /** True if the interrupt endpoint should be cleared of halt on open */
+    bool halted;
+    /** The options the tablet is served with, while open */
+    const struct tablet_options *options;
+    /** Initialization control transfers, NULL if not allocated */
+    struct libusb_transfer *init_transfers[MODEL_INIT_MAX];
+    /** Number of submitted initialization control transfers */
+    size_t init_pending;
+    /** True if initialization failed or is being cancelled */
+    bool init_stopping;
+    /** Startup phase timestamps */
+    struct tablet_timing timing;
+    /** Bitmap of interfaces the kernel driver was detached from */
+    uint32_t ifaces_detached;
+    /** Bitmap of claimed interfaces */
+    uint32_t ifaces_claimed;
+    /** The report decoder */
+    struct decoder decoder;
+    /** The uinput or uhid pen device file descriptor, or -1 */
+    int pen_fd;
+    /** The uinput or uhid pad device file descriptor, or -1 */
+    int pad_fd;
+    /** The sink writing to the pen device */
+    struct sink_fd pen_sink;
+    /** The sink writing to the pad device */
+    struct sink_fd pad_sink;
+    /** The sink recording the pen device output, if recording */
+    struct flight_sink pen_flight_sink;
+    /** The sink recording the pad device output, if recording */
+    struct flight_sink pad_flight_sink;
+    /** The watch of the pen device, for writability when congested */
+    struct loop_watch pen_watch;
+    /** The watch of the pad device, for writability when congested */
+    struct loop_watch pad_watch;
+    /** The pen value mapping, precomputed for the axes, if configured */
+    struct map map;
+    /** The outputs to translate the reports to */
+    struct outputs outputs;
+    /** The libusb transport of the interrupt transfers, while open */
+    struct transport_libusb transport;
+    /** The ring of interrupt transfers */
+    struct ring ring;
+    /** Statistics of the ring, kept across replugs and resets */
+    struct ring_stats ring_stats;
+    /** The pipeline feeding the output thread, while the ring is used */
+    struct pipeline pipeline;
+    /** Statistics of the pipeline, kept across replugs and resets */
+    struct pipeline_stats pipeline_stats;
+    /**
+     * The flight recorder of the reports and the output, kept open
+     * across replugs and resets, if recording
+     */
+    struct flight flight;
+};
+
+/**
+ * Create a context for a tablet device, not opening it yet.
+ *
+ * @param dev   The USB device of the tablet. Will be referenced.
+ * @param model The model of the tablet.
+ *
+ * @return The created tablet, or NULL if failed to allocate.
+ */
+extern struct tablet *tablet_new(libusb_device *dev,
+                                 const struct model *model);
+
+/**
+ * Check if a device is the one a tablet was created for, or is of the
+ * same model, and was plugged into the same port.
+ *
+ * @param tablet    The tablet to check.
+ * @param dev       The device to check.
+ * @param model     The model of the device.
+ *
+ * @return True if the device matches the tablet, false otherwise.
+ */
+extern bool tablet_matches(const struct tablet *tablet, libusb_device *dev,
+                           const struct model *model);
+
+/**
+ * Attach a device to a detached tablet, to be opened with the tablet's
+ * input devices and decoder.
+ *
+ * @param tablet    The detached tablet to attach the device to.
+ * @param dev       The device to attach. Will be referenced.
+ */
+extern void tablet_attach(struct tablet *tablet, libusb_device *dev);
+
+/**
+ * Open a tablet: take over its interfaces, and start initializing it.
+ * The control transfers switching the tablet to proprietary reports are
+ * submitted all at once, and its input devices are created while they
+ * run, as soon as the first one retrieves the axis capabilities. Once
+ * they complete, the report decoder is compiled, and the interrupt
+ * transfers are started, all from the libusb event handling.
+ * If that fails, the tablet is marked failed, and the options' changed
+ * flag is raised.
+ *
+ * If the tablet's input devices are kept from a previous device, they
+ * are reused, and so are the axes and the decoder, skipping the report
+ * descriptor retrieval. The options' changed flag is raised if the interrupt
+ * transfers fail, as on disconnect or endpoint stall.
+ *
+ * @param tablet    The tablet to open.
+ * @param options   The options to serve the tablet with, must stay valid
+ *                  while the tablet is open.
+ *
+ * @return True if opened, false otherwise. The tablet must be closed
+ *         with tablet_close() either way.
+ */
+extern bool tablet_open(struct tablet *tablet,
+                        const struct tablet_options *options);
+
+/**
+ * Detach a tablet from its departed device: stop its transfers, return
+ * its interfaces to the kernel, release the device, and bring its input
+ * devices to the neutral state, keeping them registered for the device
+ * to return with tablet_attach(). The tablet must have input devices.
+ *
+ * @param tablet    The tablet to detach.
+ * @param ctx       The libusb context to handle events of while stopping
+ *                  transfers.
+ */
+extern void tablet_detach(struct tablet *tablet, libusb_context *ctx);
+
+/**
+ * Reset a tablet, which transfers failed: stop its transfers, return its
+ * interfaces to the kernel, and bring its input devices to the neutral
+ * state, to be opened again, clearing the endpoint halt. The tablet must
+ * have input devices.
+ *
+ * @param tablet    The tablet to reset.
+ * @param ctx       The libusb context to handle events of while stopping
+ *                  transfers.
+ */
+extern void tablet_reset(struct tablet *tablet, libusb_context *ctx);
+
+/**
+ * Close a tablet: stop its transfers, destroy its input devices, and
+ * return its interfaces to the kernel. Does nothing if not open, and has
+ * no input devices.
+ *
+ * @param tablet    The tablet to close.
+ * @param ctx       The libusb context to handle events of while stopping
+ *                  transfers.
+ */
+extern void tablet_close(struct tablet *tablet, libusb_context *ctx);
+
+/**
+ * Start watching the congested output devices of an open tablet, to
+ * write their queued frames once they're writable. Does nothing while
+ * the tablet's output thread runs, as it writes them itself.
+ *
+ * @param tablet    The tablet to watch the outputs of.
+ */
+extern void tablet_watch_outputs(struct tablet *tablet);
+
+/**
+ * Print the latency statistics of an open tablet, per report kind, and
+ * the time its first report took to be delivered since its arrival.
+ *
+ * @param tablet    The tablet to print the statistics of.
+ * @param stream    The stream to print to.
+ */
+extern void tablet_print_latency(const struct tablet *tablet, FILE *stream);
+
+/**
+ * Dump the statistics counters of a tablet, kept across replugs and
+ * resets, one "NAME COUNTER VALUE" line each.
+ *
+ * @param tablet    The tablet to dump the statistics of.
+ * @param stream    The stream to dump to.
+ */
+extern void tablet_dump_stats(const struct tablet *tablet, FILE *stream);
+
+/**
+ * Free a tablet context, closed before.
+ *
+ * @param tablet    The tablet to free, can be NULL.
+ */
+extern void tablet_free(struct tablet *tablet);
+
+#endif /* _TABLET_H */
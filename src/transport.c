@@ -0,0 +1,96 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * This file is part of digimend-userspace-drivers.
+ */
+
+#include "config.h"
+#include "transport.h"
+
+static struct libusb_transfer *
+transport_libusb_alloc(struct transport *transport)
+{
+    struct transport_libusb *transport_libusb =
+        (struct transport_libusb *)transport;
+    struct libusb_transfer *transfer;
+
+    transfer = libusb_alloc_transfer(0);
+    if (transfer != NULL) {
+        transfer->dev_handle = transport_libusb->handle;
+    }
+    return transfer;
+}
+
+static void
+transport_libusb_free(struct transport *transport,
+                      struct libusb_transfer *transfer)
+{
+    (void)transport;
+    libusb_free_transfer(transfer);
+}
+
+static int
+transport_libusb_submit(struct transport *transport,
+                        struct libusb_transfer *transfer)
+{
+    (void)transport;
+    return libusb_submit_transfer(transfer);
+}
+
+static int
+transport_libusb_cancel(struct transport *transport,
+                        struct libusb_transfer *transfer)
+{
+    (void)transport;
+    return libusb_cancel_transfer(transfer);
+}
+
+static int
+transport_libusb_handle_events(struct transport *transport)
+{
+    struct transport_libusb *transport_libusb =
+        (struct transport_libusb *)transport;
+    return libusb_handle_events(transport_libusb->ctx);
+}
+
+#ifdef HAVE_LIBUSB_DEV_MEM_ALLOC
+static void *
+transport_libusb_mem_alloc(struct transport *transport, size_t len)
+{
+    struct transport_libusb *transport_libusb =
+        (struct transport_libusb *)transport;
+    return libusb_dev_mem_alloc(transport_libusb->handle, len);
+}
+
+static void
+transport_libusb_mem_free(struct transport *transport, void *mem, size_t len)
+{
+    struct transport_libusb *transport_libusb =
+        (struct transport_libusb *)transport;
+    libusb_dev_mem_free(transport_libusb->handle, mem, len);
+}
+#endif
+
+struct transport *
+transport_libusb_init(struct transport_libusb *transport_libusb,
+                      libusb_context *ctx, libusb_device_handle *handle)
+{
+    assert(transport_libusb != NULL);
+    assert(handle != NULL);
+    transport_libusb->transport.alloc = transport_libusb_alloc;
+    transport_libusb->transport.free = transport_libusb_free;
+    transport_libusb->transport.submit = transport_libusb_submit;
+    transport_libusb->transport.cancel = transport_libusb_cancel;
+    transport_libusb->transport.handle_events =
+        transport_libusb_handle_events;
+#ifdef HAVE_LIBUSB_DEV_MEM_ALLOC
+    transport_libusb->transport.mem_alloc = transport_libusb_mem_alloc;
+    transport_libusb->transport.mem_free = transport_libusb_mem_free;
+#else
+    transport_libusb->transport.mem_alloc = NULL;
+    transport_libusb->transport.mem_free = NULL;
+#endif
+    transport_libusb->ctx = ctx;
+    transport_libusb->handle = handle;
+    return &transport_libusb->transport;
+}
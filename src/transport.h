@@ -0,0 +1,204 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * This file is part of digimend-userspace-drivers.
+ */
+
+/*
+ * Transports of interrupt transfers: the USB device access of a ring,
+ * through libusb, or a simulated device. Transfers are libusb transfers
+ * either way, completed by calling their callbacks from the transport's
+ * event handling.
+ */
+
+#ifndef _TRANSPORT_H
+#define _TRANSPORT_H
+
+#include "usb.h"
+#include <assert.h>
+#include <stddef.h>
+
+struct transport;
+
+/**
+ * Transfer allocation function prototype.
+ *
+ * @param transport The transport to allocate the transfer for.
+ *
+ * @return The allocated transfer, with no isochronous packets, and its
+ *         device handle set, or NULL if failed.
+ */
+typedef struct libusb_transfer *(*transport_alloc_fn)(
+                                        struct transport *transport);
+
+/**
+ * Transfer freeing function prototype.
+ *
+ * @param transport The transport the transfer was allocated for.
+ * @param transfer  The transfer to free, not submitted.
+ */
+typedef void (*transport_free_fn)(struct transport *transport,
+                                  struct libusb_transfer *transfer);
+
+/**
+ * Transfer submission, or cancellation function prototype.
+ *
+ * @param transport The transport to submit or cancel the transfer with.
+ * @param transfer  The transfer to submit or cancel.
+ *
+ * @return Libusb error code, same as libusb_submit_transfer() and
+ *         libusb_cancel_transfer().
+ */
+typedef int (*transport_transfer_fn)(struct transport *transport,
+                                     struct libusb_transfer *transfer);
+
+/**
+ * Event handling function prototype: wait for, and call the callbacks of
+ * finished transfers.
+ *
+ * @param transport The transport to handle events of.
+ *
+ * @return Libusb error code, same as libusb_handle_events().
+ */
+typedef int (*transport_handle_events_fn)(struct transport *transport);
+
+/**
+ * Transfer buffer memory allocation function prototype.
+ *
+ * @param transport The transport to allocate the memory for.
+ * @param len       The size of the memory to allocate.
+ *
+ * @return The allocated memory, or NULL, if failed, or not supported.
+ */
+typedef void *(*transport_mem_alloc_fn)(struct transport *transport,
+                                        size_t len);
+
+/**
+ * Transfer buffer memory freeing function prototype.
+ *
+ * @param transport The transport the memory was allocated for.
+ * @param mem       The memory to free.
+ * @param len       The size of the memory.
+ */
+typedef void (*transport_mem_free_fn)(struct transport *transport,
+                                      void *mem, size_t len);
+
+/** An abstract transport */
+struct transport {
+    /** The transfer allocation function */
+    transport_alloc_fn alloc;
+    /** The transfer freeing function */
+    transport_free_fn free;
+    /** The transfer submission function */
+    transport_transfer_fn submit;
+    /** The transfer cancellation function */
+    transport_transfer_fn cancel;
+    /** The event handling function */
+    transport_handle_events_fn handle_events;
+    /**
+     * The transfer buffer memory allocation function, or NULL, if the
+     * transport can't provide memory to transfer into without copying
+     */
+    transport_mem_alloc_fn mem_alloc;
+    /** The transfer buffer memory freeing function, or NULL */
+    transport_mem_free_fn mem_free;
+};
+
+/**
+ * Allocate a transfer for a transport.
+ *
+ * @param transport The transport to allocate the transfer for.
+ *
+ * @return The allocated transfer, or NULL if failed.
+ */
+static inline struct libusb_transfer *
+transport_alloc(struct transport *transport)
+{
+    assert(transport != NULL);
+    return transport->alloc(transport);
+}
+
+/**
+ * Free a transfer allocated for a transport.
+ *
+ * @param transport The transport the transfer was allocated for.
+ * @param transfer  The transfer to free, not submitted.
+ */
+static inline void
+transport_free(struct transport *transport, struct libusb_transfer *transfer)
+{
+    assert(transport != NULL);
+    transport->free(transport, transfer);
+}
+
+/**
+ * Submit a transfer with a transport.
+ *
+ * @param transport The transport to submit the transfer with.
+ * @param transfer  The transfer to submit.
+ *
+ * @return Libusb error code.
+ */
+static inline enum libusb_error
+transport_submit(struct transport *transport,
+                 struct libusb_transfer *transfer)
+{
+    assert(transport != NULL);
+    return transport->submit(transport, transfer);
+}
+
+/**
+ * Cancel a transfer submitted with a transport.
+ *
+ * @param transport The transport the transfer was submitted with.
+ * @param transfer  The transfer to cancel.
+ *
+ * @return Libusb error code.
+ */
+static inline enum libusb_error
+transport_cancel(struct transport *transport,
+                 struct libusb_transfer *transfer)
+{
+    assert(transport != NULL);
+    return transport->cancel(transport, transfer);
+}
+
+/**
+ * Wait for, and call the callbacks of finished transfers of a transport.
+ *
+ * @param transport The transport to handle events of.
+ *
+ * @return Libusb error code.
+ */
+static inline enum libusb_error
+transport_handle_events(struct transport *transport)
+{
+    assert(transport != NULL);
+    return transport->handle_events(transport);
+}
+
+/** A transport transferring from a device through libusb */
+struct transport_libusb {
+    /** The abstract transport */
+    struct transport transport;
+    /** The libusb context to handle events of */
+    libusb_context *ctx;
+    /** The handle of the device to transfer from */
+    libusb_device_handle *handle;
+};
+
+/**
+ * Initialize a libusb transport.
+ *
+ * @param transport_libusb  The transport to initialize.
+ * @param ctx               The libusb context to handle events of.
+ * @param handle            The handle of the device to transfer from.
+ *
+ * @return The abstract transport.
+ */
+extern struct transport *transport_libusb_init(
+                                struct transport_libusb *transport_libusb,
+                                libusb_context *ctx,
+                                libusb_device_handle *handle);
+
+#endif /* _TRANSPORT_H */
@@ -0,0 +1,634 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * This file is part of digimend-userspace-drivers.
+ */
+
+/*
+ * Report translation micro-benchmark.
+ *
+ * Translates a synthetic corpus of each report type into a counting sink,
+ * measuring ns/report and events/report, and compares them against a
+ * baseline. Fails if the number of events differs from the baseline at
+ * all, as that's deterministic, and, if a threshold is given, if the time
+ * exceeds the baseline by more than it. The time isn't checked by default,
+ * as it depends on the machine and the build, unlike the baseline.
+ *
+ * Also checks that the built-in descriptor's plan is decoded specialized,
+ * and that a pen whose release frame was dropped is released once it
+ * leaves proximity, or the tablet is detached.
+ */
+
+#include "config.h"
+#include "decoder.h"
+#include "map.h"
+#include "misc.h"
+#include "model.h"
+#include "sink.h"
+#include "translate.h"
+#include <assert.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <getopt.h>
+#include <linux/input.h>
+
+/** Number of reports in each corpus */
+#define BENCH_CORPUS_LEN    1024
+
+/** Maximum length of a corpus report */
+#define BENCH_REPORT_MAX    12
+
+/** Number of corpus passes in each timed run */
+#define BENCH_PASSES        200
+
+/** Number of timed runs, the fastest of which is taken */
+#define BENCH_RUNS          5
+
+/** Maximum number of baseline entries */
+#define BENCH_BASELINE_MAX  16
+
+/** A sink counting written events, and discarding them */
+struct bench_sink {
+    /** The abstract sink */
+    struct sink sink;
+    /** Number of events written */
+    uint64_t events;
+};
+
+static ssize_t
+bench_sink_write(struct sink *sink, const void *buf, size_t len)
+{
+    struct bench_sink *bench_sink = (struct bench_sink *)sink;
+
+    (void)buf;
+    bench_sink->events += len / sizeof(struct input_event);
+    return (ssize_t)len;
+}
+
+/**
+ * Initialize a counting sink.
+ *
+ * @param bench_sink    The sink to initialize.
+ *
+ * @return The abstract sink.
+ */
+static struct sink *
+bench_sink_init(struct bench_sink *bench_sink)
+{
+    bench_sink->sink.write = bench_sink_write;
+    bench_sink->events = 0;
+    return &bench_sink->sink;
+}
+
+/** A sink tracking the written pen state, failing writes on request */
+struct bench_pen_sink {
+    /** The abstract sink */
+    struct sink sink;
+    /** True if writes should fail */
+    bool fail;
+    /** The last written BTN_TOUCH value */
+    int32_t touch;
+    /** The last written ABS_PRESSURE value */
+    int32_t pressure;
+    /** The last written BTN_TOOL_PEN value */
+    int32_t tool;
+};
+
+static ssize_t
+bench_pen_sink_write(struct sink *sink, const void *buf, size_t len)
+{
+    struct bench_pen_sink *pen_sink = (struct bench_pen_sink *)sink;
+    const struct input_event *ev = buf;
+    size_t num = len / sizeof(*ev);
+
+    if (pen_sink->fail) {
+        errno = EIO;
+        return -1;
+    }
+    for (; num > 0; ev++, num--) {
+        if (ev->type == EV_KEY && ev->code == BTN_TOUCH) {
+            pen_sink->touch = ev->value;
+        } else if (ev->type == EV_KEY && ev->code == BTN_TOOL_PEN) {
+            pen_sink->tool = ev->value;
+        } else if (ev->type == EV_ABS && ev->code == ABS_PRESSURE) {
+            pen_sink->pressure = ev->value;
+        }
+    }
+    return (ssize_t)(len - len % sizeof(*ev));
+}
+
+/**
+ * Check that a touch is released after its release frame is dropped.
+ *
+ * @param detach    True if the frame leaving proximity should be dropped
+ *                  too, and the tablet detached, false if the pen should
+ *                  leave proximity.
+ *
+ * @return True if the pen was released and out of proximity in the end.
+ */
+static bool
+bench_check_resync(bool detach)
+{
+    struct bench_pen_sink pen_sink = {
+        .sink = {.write = bench_pen_sink_write}
+    };
+    struct bench_sink pad_sink;
+    struct outputs outputs;
+    struct report report = {.kind = REPORT_KIND_PEN};
+
+    memset(&outputs, 0, sizeof(outputs));
+    outputs.pen.sink = &pen_sink.sink;
+    outputs.pad.sink = bench_sink_init(&pad_sink);
+
+    /* Touch */
+    report.values[REPORT_FIELD_IN_RANGE] = 1;
+    report.values[REPORT_FIELD_X] = 1000;
+    report.values[REPORT_FIELD_Y] = 1000;
+    report.values[REPORT_FIELD_PRESSURE] = 500;
+    report.values[REPORT_FIELD_PEN_BUTTONS] = 1;
+    translate_report(&outputs, 0, &report);
+
+    /* Lift, dropping the release */
+    pen_sink.fail = true;
+    report.values[REPORT_FIELD_PRESSURE] = 0;
+    report.values[REPORT_FIELD_PEN_BUTTONS] = 0;
+    translate_report(&outputs, 0, &report);
+
+    /* Leave proximity, or drop that too, and detach */
+    pen_sink.fail = detach;
+    report.values[REPORT_FIELD_IN_RANGE] = 0;
+    translate_report(&outputs, 0, &report);
+    if (detach) {
+        pen_sink.fail = false;
+        translate_neutral(&outputs);
+    }
+
+    return pen_sink.touch == 0 && pen_sink.pressure == 0 &&
+           pen_sink.tool == 0;
+}
+
+/**
+ * Corpus report generator function prototype.
+ *
+ * @param idx   The index of the report in the corpus.
+ * @param buf   The buffer to generate the report in, BENCH_REPORT_MAX
+ *              bytes long, zeroed.
+ *
+ * @return The length of the generated report.
+ */
+typedef size_t (*bench_generate_fn)(size_t idx, uint8_t *buf);
+
+/** Generate a report of an in-range pen, moving, and pressing and lifting */
+static size_t
+bench_generate_pen_in_range(size_t idx, uint8_t *buf)
+{
+    uint32_t x = 1000 + (uint32_t)idx * 40;
+    uint32_t y = 1000 + (uint32_t)idx * 25;
+    uint32_t pressure = (idx / 64) % 2 ? (uint32_t)(idx % 64) * 100 : 0;
+
+    buf[0] = 0x08;
+    buf[1] = (uint8_t)(0x80 | (pressure != 0) | ((idx / 256) % 2) << 1);
+    buf[2] = (uint8_t)x;
+    buf[3] = (uint8_t)(x >> 8);
+    buf[4] = (uint8_t)y;
+    buf[5] = (uint8_t)(y >> 8);
+    buf[6] = (uint8_t)pressure;
+    buf[7] = (uint8_t)(pressure >> 8);
+    buf[8] = (uint8_t)(x >> 16);
+    buf[9] = (uint8_t)(y >> 16);
+    buf[10] = (uint8_t)(int8_t)((int)(idx % 61) - 30);
+    buf[11] = (uint8_t)(int8_t)(30 - (int)(idx % 41));
+    return 12;
+}
+
+/** Generate a report of an out-of-range pen */
+static size_t
+bench_generate_pen_out_of_range(size_t idx, uint8_t *buf)
+{
+    (void)idx;
+    buf[0] = 0x08;
+    return 12;
+}
+
+/** Generate a frame button report, pressing and releasing each button */
+static size_t
+bench_generate_buttons(size_t idx, uint8_t *buf)
+{
+    uint32_t buttons = idx % 2 ? 0 : 1u << (idx / 2 % 12);
+
+    buf[0] = 0x08;
+    buf[1] = 0xe0;
+    buf[2] = 0x01;
+    buf[3] = 0x01;
+    buf[4] = (uint8_t)buttons;
+    buf[5] = (uint8_t)(buttons >> 8);
+    return 12;
+}
+
+/** Generate a touch dial report, going around, and releasing */
+static size_t
+bench_generate_dial(size_t idx, uint8_t *buf)
+{
+    buf[0] = 0x08;
+    buf[1] = 0xf0;
+    buf[2] = 0x01;
+    buf[3] = 0x01;
+    buf[5] = (uint8_t)(idx % 13);
+    return 12;
+}
+
+/** Generate a short, or a foreign report, to be rejected */
+static size_t
+bench_generate_rejected(size_t idx, uint8_t *buf)
+{
+    switch (idx % 3) {
+    case 0:
+        /* Short pen report */
+        buf[0] = 0x08;
+        buf[1] = 0x80;
+        return 6;
+    case 1:
+        /* Report of another report ID */
+        buf[0] = 0x01;
+        buf[1] = 0x80;
+        return 12;
+    default:
+        /* Report of an unknown kind */
+        buf[0] = 0x08;
+        buf[1] = 0x30;
+        return 12;
+    }
+}
+
+/** A benchmark corpus */
+struct bench_corpus {
+    /** The name of the corpus */
+    const char *name;
+    /** The report generator */
+    bench_generate_fn generate;
+    /** The pen value mapping configuration, or NULL for none */
+    const struct map_config *map;
+};
+
+/** A pen value mapping configuration exercising all of the mapping */
+static const struct map_config bench_map = {
+    .curve = MAP_CURVE_BEZIER,
+    .params = {0.2, 0.4, 0.6, 0.9},
+    .area = {5000, 3000, 45000, 28000},
+    .aspect = {16, 9},
+    .rotation = MAP_ROTATION_90,
+};
+
+/** The corpora to benchmark */
+static const struct bench_corpus bench_corpora[] = {
+    {"pen-in-range",        bench_generate_pen_in_range,        NULL},
+    {"pen-in-range-mapped", bench_generate_pen_in_range,        &bench_map},
+    {"pen-out-of-range",    bench_generate_pen_out_of_range,    NULL},
+    {"buttons",             bench_generate_buttons,             NULL},
+    {"dial",                bench_generate_dial,                NULL},
+    {"rejected",            bench_generate_rejected,            NULL},
+};
+
+/** A benchmark result, or a baseline entry */
+struct bench_result {
+    /** The name of the corpus */
+    char name[32];
+    /** Nanoseconds per report */
+    double ns_per_report;
+    /** Events per report */
+    double events_per_report;
+};
+
+/**
+ * Benchmark the translation of a corpus.
+ *
+ * @param corpus    The corpus to benchmark.
+ * @param decoder   The decoder to decode the reports with.
+ * @param result    Location for the result.
+ */
+static void
+bench_run(const struct bench_corpus *corpus,
+          const struct decoder *decoder, struct bench_result *result)
+{
+    uint8_t data[BENCH_CORPUS_LEN][BENCH_REPORT_MAX];
+    size_t lens[BENCH_CORPUS_LEN];
+    struct bench_sink pen_sink;
+    struct bench_sink pad_sink;
+    struct outputs outputs;
+    struct map map;
+    uint64_t start;
+    uint64_t duration;
+    uint64_t best = UINT64_MAX;
+    uint64_t events = 0;
+    unsigned int run;
+    unsigned int pass;
+    size_t i;
+
+    /* Generate the corpus */
+    memset(data, 0, sizeof(data));
+    for (i = 0; i < BENCH_CORPUS_LEN; i++) {
+        lens[i] = corpus->generate(i, data[i]);
+        assert(lens[i] <= BENCH_REPORT_MAX);
+    }
+    if (corpus->map != NULL &&
+        !map_init(&map, corpus->map, &model_huion_v2_axes)) {
+        assert(!"Invalid mapping configuration");
+    }
+
+    /* Translate, including an untimed warm-up run */
+    for (run = 0; run <= BENCH_RUNS; run++) {
+        memset(&outputs, 0, sizeof(outputs));
+        outputs.pen.sink = bench_sink_init(&pen_sink);
+        outputs.pad.sink = bench_sink_init(&pad_sink);
+        outputs.map = corpus->map == NULL ? NULL : &map;
+        start = clock_ns();
+        for (pass = 0; pass < BENCH_PASSES; pass++) {
+            for (i = 0; i < BENCH_CORPUS_LEN; i++) {
+                translate(&outputs, decoder, i, data[i], lens[i]);
+            }
+        }
+        duration = clock_ns() - start;
+        if (run > 0 && duration < best) {
+            best = duration;
+        }
+        events = pen_sink.events + pad_sink.events;
+    }
+
+    snprintf(result->name, sizeof(result->name), "%s", corpus->name);
+    result->ns_per_report = (double)best /
+                            (BENCH_PASSES * BENCH_CORPUS_LEN);
+    result->events_per_report = (double)events /
+                                (BENCH_PASSES * BENCH_CORPUS_LEN);
+}
+
+/**
+ * Load a baseline file: lines of corpus name, ns/report, and
+ * events/report, separated by whitespace. Lines starting with '#' are
+ * comments.
+ *
+ * @param path      The path of the baseline file.
+ * @param baseline  The array to load the entries into,
+ *                  BENCH_BASELINE_MAX entries long.
+ * @param pnum      Location for the number of loaded entries.
+ *
+ * @return True if loaded successfully, false otherwise.
+ */
+static bool
+bench_baseline_load(const char *path, struct bench_result *baseline,
+                    size_t *pnum)
+{
+    bool result = false;
+    FILE *stream = NULL;
+    char line[128];
+    size_t num = 0;
+
+    stream = fopen(path, "r");
+    if (stream == NULL) {
+        LIBC_FAILURE_CLEANUP(errno, "open baseline file %s", path);
+    }
+    while (fgets(line, sizeof(line), stream) != NULL) {
+        if (line[0] == '#' || line[strspn(line, " \t\n")] == '\0') {
+            continue;
+        }
+        if (num >= BENCH_BASELINE_MAX) {
+            ERROR_CLEANUP("Too many baseline entries in %s", path);
+        }
+        if (sscanf(line, "%31s %lf %lf", baseline[num].name,
+                   &baseline[num].ns_per_report,
+                   &baseline[num].events_per_report) != 3) {
+            ERROR_CLEANUP("Invalid baseline entry in %s: %s", path, line);
+        }
+        num++;
+    }
+    if (ferror(stream)) {
+        LIBC_FAILURE_CLEANUP(errno, "read baseline file %s", path);
+    }
+
+    *pnum = num;
+    result = true;
+cleanup:
+    if (stream != NULL) {
+        fclose(stream);
+    }
+    return result;
+}
+
+/**
+ * Store results as a baseline file.
+ *
+ * @param path      The path of the baseline file.
+ * @param results   The results to store.
+ * @param num       The number of results.
+ *
+ * @return True if stored successfully, false otherwise.
+ */
+static bool
+bench_baseline_store(const char *path, const struct bench_result *results,
+                     size_t num)
+{
+    bool result = false;
+    FILE *stream = NULL;
+    size_t i;
+
+    stream = fopen(path, "w");
+    if (stream == NULL) {
+        LIBC_FAILURE_CLEANUP(errno, "create baseline file %s", path);
+    }
+    fprintf(stream, "# corpus ns/report events/report\n");
+    for (i = 0; i < num; i++) {
+        fprintf(stream, "%s %.1f %.4f\n", results[i].name,
+                results[i].ns_per_report, results[i].events_per_report);
+    }
+    if (fclose(stream) != 0) {
+        stream = NULL;
+        LIBC_FAILURE_CLEANUP(errno, "write baseline file %s", path);
+    }
+    stream = NULL;
+
+    result = true;
+cleanup:
+    if (stream != NULL) {
+        fclose(stream);
+    }
+    return result;
+}
+
+/**
+ * Print usage information.
+ *
+ * @param stream    The stream to print the usage information to.
+ * @param progname  The name of the program.
+ */
+static void
+usage(FILE *stream, const char *progname)
+{
+    fprintf(stream,
+            "Usage: %s [OPTION]...\n"
+            "Benchmark translation of each report type, and compare "
+            "against a baseline.\n"
+            "\n"
+            "Options:\n"
+            "  -h, --help               Output this help message and exit.\n"
+            "  -b, --baseline=FILE      Compare against the baseline "
+                                        "in FILE, default\n"
+            "                           $DUD_BENCH_BASELINE, if set.\n"
+            "  -t, --threshold=PERCENT  Fail if slower than the baseline "
+                                        "by more than\n"
+            "                           PERCENT, default "
+                                        "$DUD_BENCH_THRESHOLD, if set.\n"
+            "                           The time isn't checked "
+                                        "otherwise.\n"
+            "  -u, --update             Store the results as the "
+                                        "baseline, instead.\n"
+            "\n",
+            progname);
+}
+
+int
+main(int argc, char **argv)
+{
+    int result = 1;
+    const char *baseline_path = getenv("DUD_BENCH_BASELINE");
+    const char *threshold_str = getenv("DUD_BENCH_THRESHOLD");
+    double threshold = 0;
+    bool update = false;
+    struct decoder decoder;
+    struct bench_result results[ARRAY_SIZE(bench_corpora)];
+    struct bench_result baseline[BENCH_BASELINE_MAX];
+    const struct bench_result *base;
+    size_t baseline_num = 0;
+    size_t failures = 0;
+    size_t i;
+    size_t j;
+    double excess;
+    char *end;
+    int opt;
+    static const struct option longopts[] = {
+        {.name = "help",        .val = 'h'},
+        {.name = "baseline",    .val = 'b', .has_arg = required_argument},
+        {.name = "threshold",   .val = 't', .has_arg = required_argument},
+        {.name = "update",      .val = 'u'},
+        {.name = NULL}
+    };
+
+    /* Parse command-line options */
+    while ((opt = getopt_long(argc, argv, "+hb:t:u",
+                              longopts, NULL)) >= 0) {
+        switch (opt) {
+        case 'h':
+            usage(stdout, argv[0]);
+            return 0;
+        case 'b':
+            baseline_path = optarg;
+            break;
+        case 't':
+            threshold_str = optarg;
+            break;
+        case 'u':
+            update = true;
+            break;
+        default:
+            usage(stderr, argv[0]);
+            return 1;
+        }
+    }
+    if (optind < argc) {
+        GENERIC_ERROR("Positional arguments are not accepted");
+        usage(stderr, argv[0]);
+        return 1;
+    }
+    if (threshold_str != NULL) {
+        errno = 0;
+        threshold = strtod(threshold_str, &end);
+        if (errno != 0 || *end != '\0' || !(threshold >= 0)) {
+            GENERIC_ERROR("Invalid threshold: %s", threshold_str);
+            usage(stderr, argv[0]);
+            return 1;
+        }
+    }
+    if (update && baseline_path == NULL) {
+        GENERIC_ERROR("Updating requires a baseline file");
+        usage(stderr, argv[0]);
+        return 1;
+    }
+
+    /* Decode as the daemon does */
+    if (!decoder_init_huion_v2(&decoder, NULL, 0)) {
+        FAILURE_CLEANUP("initialize the decoder");
+    }
+    if (!decoder.specialized) {
+        GENERIC_ERROR("The built-in descriptor's plan isn't specialized");
+        failures++;
+    }
+    if (!update && baseline_path != NULL &&
+        !bench_baseline_load(baseline_path, baseline, &baseline_num)) {
+        FAILURE_CLEANUP("load the baseline");
+    }
+
+    /* Run the benchmarks, and compare against the baseline */
+    printf("%-20s %12s %14s %12s\n",
+           "corpus", "ns/report", "events/report", "baseline");
+    for (i = 0; i < ARRAY_SIZE(bench_corpora); i++) {
+        bench_run(&bench_corpora[i], &decoder, &results[i]);
+        printf("%-20s %12.1f %14.4f", results[i].name,
+               results[i].ns_per_report, results[i].events_per_report);
+
+        for (base = NULL, j = 0; j < baseline_num; j++) {
+            if (strcmp(baseline[j].name, results[i].name) == 0) {
+                base = &baseline[j];
+                break;
+            }
+        }
+        if (base == NULL) {
+            printf(" %12s\n", "-");
+            continue;
+        }
+        excess = (results[i].ns_per_report / base->ns_per_report - 1) * 100;
+        printf(" %12.1f %+6.0f%%\n", base->ns_per_report, excess);
+        if (threshold_str != NULL && excess > threshold) {
+            GENERIC_ERROR("%s: %.1f ns/report is %.0f%% over the baseline, "
+                          "more than the %.0f%% threshold",
+                          results[i].name, results[i].ns_per_report,
+                          excess, threshold);
+            failures++;
+        }
+        if (results[i].events_per_report - base->events_per_report >
+                0.00005 ||
+            base->events_per_report - results[i].events_per_report >
+                0.00005) {
+            GENERIC_ERROR("%s: %.4f events/report differs from "
+                          "the baseline %.4f",
+                          results[i].name, results[i].events_per_report,
+                          base->events_per_report);
+            failures++;
+        }
+    }
+
+    /* Check the pen is released after dropped frames */
+    if (!bench_check_resync(false)) {
+        GENERIC_ERROR("Pen left touching after a dropped release "
+                      "and leaving proximity");
+        failures++;
+    }
+    if (!bench_check_resync(true)) {
+        GENERIC_ERROR("Pen left touching after a dropped release "
+                      "and detaching");
+        failures++;
+    }
+
+    if (update) {
+        if (!bench_baseline_store(baseline_path, results,
+                                  ARRAY_SIZE(results))) {
+            FAILURE_CLEANUP("store the baseline");
+        }
+    } else if (failures > 0) {
+        ERROR_CLEANUP("%zu benchmark regressions", failures);
+    }
+
+    result = 0;
+cleanup:
+    return result;
+}
@@ -0,0 +1,249 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * This file is part of digimend-userspace-drivers.
+ */
+
+#include "config.h"
+#include "sim.h"
+#include "misc.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/** Number of reports in each cycle of generated input */
+#define SIM_CYCLE_LEN       1000
+
+/**
+ * Get the value of a triangle wave.
+ *
+ * @param pos   The position along the wave.
+ * @param amp   The amplitude of the wave.
+ *
+ * @return The value of the wave, 0 to amp.
+ */
+static uint32_t
+sim_triangle(uint64_t pos, uint32_t amp)
+{
+    uint32_t phase = (uint32_t)(pos % (2 * (uint64_t)amp));
+    return phase < amp ? phase : 2 * amp - phase;
+}
+
+void
+sim_generate(uint64_t idx, uint8_t *buf)
+{
+    uint32_t step = (uint32_t)(idx % SIM_CYCLE_LEN);
+    uint64_t cycle = idx / SIM_CYCLE_LEN;
+    uint32_t x;
+    uint32_t y;
+    uint32_t pressure;
+    uint32_t buttons;
+
+    assert(buf != NULL);
+
+    memset(buf, 0, SIM_REPORT_LEN);
+    buf[0] = 0x08;
+    if (step < 800) {
+        /* A stroke, touching in the middle, pressing the stylus button */
+        x = 5000 + sim_triangle(step * 50 + cycle * 997, 40000);
+        y = 3000 + sim_triangle(step * 31 + cycle * 503, 25000);
+        pressure = step < 100 || step >= 700 ? 0 :
+                   (step < 400 ? step - 100 : 700 - step) * 27;
+        buf[1] = (uint8_t)(0x80 | (pressure != 0) |
+                           (step >= 400 && step < 450) << 1);
+        buf[2] = (uint8_t)x;
+        buf[3] = (uint8_t)(x >> 8);
+        buf[4] = (uint8_t)y;
+        buf[5] = (uint8_t)(y >> 8);
+        buf[6] = (uint8_t)pressure;
+        buf[7] = (uint8_t)(pressure >> 8);
+        buf[8] = (uint8_t)(x >> 16);
+        buf[9] = (uint8_t)(y >> 16);
+        buf[10] = (uint8_t)(int8_t)((int)(step % 61) - 30);
+        buf[11] = (uint8_t)(int8_t)(30 - (int)(step % 41));
+    } else if (step < 820) {
+        /* The pen leaving, reported as an empty pen report */
+    } else if (step < 860) {
+        /* A frame button held, then released */
+        buttons = step < 840 ? 1u << (cycle % 12) : 0;
+        buf[1] = 0xe0;
+        buf[2] = 0x01;
+        buf[3] = 0x01;
+        buf[4] = (uint8_t)buttons;
+        buf[5] = (uint8_t)(buttons >> 8);
+    } else {
+        /* The dial touched and turned around, then released */
+        buf[1] = 0xf0;
+        buf[2] = 0x01;
+        buf[3] = 0x01;
+        buf[5] = step < 990 ? (uint8_t)((step - 860) / 4 % 12 + 1) : 0;
+    }
+}
+
+static struct libusb_transfer *
+sim_alloc(struct transport *transport)
+{
+    (void)transport;
+    return calloc(1, sizeof(struct libusb_transfer));
+}
+
+static void
+sim_free(struct transport *transport, struct libusb_transfer *transfer)
+{
+    (void)transport;
+    free(transfer);
+}
+
+static int
+sim_submit(struct transport *transport, struct libusb_transfer *transfer)
+{
+    struct sim_tablet *tablet = (struct sim_tablet *)transport;
+
+    assert(transfer != NULL);
+    assert(transfer->length >= SIM_REPORT_LEN);
+
+    if (tablet->queued >= RING_MAX_TRANSFERS) {
+        return LIBUSB_ERROR_BUSY;
+    }
+    tablet->queue[(tablet->head + tablet->queued) % RING_MAX_TRANSFERS] =
+        transfer;
+    tablet->queued++;
+    return LIBUSB_SUCCESS;
+}
+
+static int
+sim_cancel(struct transport *transport, struct libusb_transfer *transfer)
+{
+    struct sim_tablet *tablet = (struct sim_tablet *)transport;
+    size_t i;
+    size_t idx;
+
+    /* Find the transfer, and close the gap it leaves in the queue */
+    for (i = 0; i < tablet->queued; i++) {
+        idx = (tablet->head + i) % RING_MAX_TRANSFERS;
+        if (tablet->queue[idx] != transfer) {
+            continue;
+        }
+        for (; i + 1 < tablet->queued; i++) {
+            tablet->queue[(tablet->head + i) % RING_MAX_TRANSFERS] =
+                tablet->queue[(tablet->head + i + 1) % RING_MAX_TRANSFERS];
+        }
+        tablet->queued--;
+        tablet->cancelled[tablet->cancelled_num++] = transfer;
+        return LIBUSB_SUCCESS;
+    }
+    return LIBUSB_ERROR_NOT_FOUND;
+}
+
+static int
+sim_handle_events(struct transport *transport)
+{
+    struct sim *sim = ((struct sim_tablet *)transport)->sim;
+    struct sim_tablet *tablet;
+    struct sim_tablet *next = NULL;
+    struct libusb_transfer *transfer;
+    struct timespec ts;
+    uint64_t due;
+    uint64_t now;
+    size_t i;
+
+    /* Finish the cancelled transfers first */
+    for (i = 0; i < sim->num; i++) {
+        tablet = &sim->tablets[i];
+        if (tablet->cancelled_num > 0) {
+            transfer = tablet->cancelled[--tablet->cancelled_num];
+            transfer->status = LIBUSB_TRANSFER_CANCELLED;
+            transfer->actual_length = 0;
+            transfer->callback(transfer);
+            return LIBUSB_SUCCESS;
+        }
+    }
+
+    /* Find the earliest report due with a transfer to complete */
+    for (i = 0; i < sim->num; i++) {
+        tablet = &sim->tablets[i];
+        if (tablet->queued > 0 && tablet->reports < tablet->limit &&
+            (next == NULL || tablet->next_ns < next->next_ns)) {
+            next = tablet;
+        }
+    }
+    if (next == NULL) {
+        return LIBUSB_ERROR_NOT_FOUND;
+    }
+
+    /* Wait for it to be due, if paced */
+    if (sim->paced) {
+        due = sim->start_ns + next->next_ns;
+        now = clock_ns();
+        if (now < due) {
+            ts.tv_sec = (time_t)(due / 1000000000);
+            ts.tv_nsec = (long)(due % 1000000000);
+            while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+                                   &ts, NULL) != 0);
+            now = clock_ns();
+        }
+        hist_record(&sim->late, now > due ? now - due : 0);
+    }
+
+    /* Complete the oldest transfer with the report */
+    transfer = next->queue[next->head];
+    next->head = (next->head + 1) % RING_MAX_TRANSFERS;
+    next->queued--;
+    sim_generate(next->reports, transfer->buffer);
+    transfer->actual_length = SIM_REPORT_LEN;
+    transfer->status = LIBUSB_TRANSFER_COMPLETED;
+    next->reports++;
+    next->next_ns += next->period_ns;
+    transfer->callback(transfer);
+    return LIBUSB_SUCCESS;
+}
+
+void
+sim_init(struct sim *sim, struct sim_tablet *tablets, size_t num,
+         unsigned int rate, uint64_t limit, bool paced)
+{
+    struct sim_tablet *tablet;
+    size_t i;
+
+    assert(sim != NULL);
+    assert(tablets != NULL || num == 0);
+    assert(rate >= SIM_MIN_RATE && rate <= SIM_MAX_RATE);
+
+    sim->paced = paced;
+    sim->start_ns = clock_ns();
+    memset(&sim->late, 0, sizeof(sim->late));
+    sim->tablets = tablets;
+    sim->num = num;
+
+    for (i = 0; i < num; i++) {
+        tablet = &tablets[i];
+        memset(tablet, 0, sizeof(*tablet));
+        tablet->transport.alloc = sim_alloc;
+        tablet->transport.free = sim_free;
+        tablet->transport.submit = sim_submit;
+        tablet->transport.cancel = sim_cancel;
+        tablet->transport.handle_events = sim_handle_events;
+        tablet->sim = sim;
+        tablet->period_ns = 1000000000 / rate;
+        /* Spread the tablets' reports over the period */
+        tablet->next_ns = tablet->period_ns * i / num;
+        tablet->limit = limit;
+    }
+}
+
+bool
+sim_done(const struct sim *sim)
+{
+    size_t i;
+
+    assert(sim != NULL);
+
+    for (i = 0; i < sim->num; i++) {
+        if (sim->tablets[i].reports < sim->tablets[i].limit ||
+            sim->tablets[i].cancelled_num > 0) {
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,115 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * This file is part of digimend-userspace-drivers.
+ */
+
+/*
+ * Simulated tablets: transports completing interrupt transfers with
+ * generated reports of pen strokes, frame button presses, and dial
+ * motion, at a set rate, instead of a device's.
+ *
+ * All tablets of a simulation are served by the event handling of any of
+ * them, completing transfers in the order the reports are due, either as
+ * fast as possible, or paced by the monotonic clock.
+ */
+
+#ifndef _SIM_H
+#define _SIM_H
+
+#include "hist.h"
+#include "ring.h"
+#include "transport.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/** Length of a generated report */
+#define SIM_REPORT_LEN      12
+
+/** Minimum report rate, Hz */
+#define SIM_MIN_RATE        125
+
+/** Maximum report rate, Hz */
+#define SIM_MAX_RATE        8000
+
+struct sim;
+
+/** A simulated tablet */
+struct sim_tablet {
+    /** The abstract transport */
+    struct transport transport;
+    /** The simulation the tablet belongs to */
+    struct sim *sim;
+    /** Interval between reports, nanoseconds */
+    uint64_t period_ns;
+    /** Time the next report is due, since the simulation start, ns */
+    uint64_t next_ns;
+    /** Number of reports generated */
+    uint64_t reports;
+    /** Number of reports to generate */
+    uint64_t limit;
+    /** Submitted transfers, in submission order */
+    struct libusb_transfer *queue[RING_MAX_TRANSFERS];
+    /** Index of the oldest submitted transfer */
+    size_t head;
+    /** Number of submitted transfers */
+    size_t queued;
+    /** Cancelled transfers, awaiting their callbacks */
+    struct libusb_transfer *cancelled[RING_MAX_TRANSFERS];
+    /** Number of cancelled transfers */
+    size_t cancelled_num;
+};
+
+/** A simulation of a number of tablets */
+struct sim {
+    /** True if reports are completed when due, false if at once */
+    bool paced;
+    /** Start time of the simulation, monotonic, nanoseconds */
+    uint64_t start_ns;
+    /** Histogram of report completion delays past their due times, ns */
+    struct hist late;
+    /** The tablets */
+    struct sim_tablet *tablets;
+    /** Number of tablets */
+    size_t num;
+};
+
+/**
+ * Initialize a simulation, and its tablets.
+ *
+ * @param sim       The simulation to initialize.
+ * @param tablets   The tablets to initialize, with their transports.
+ * @param num       The number of tablets.
+ * @param rate      The report rate of each tablet, SIM_MIN_RATE to
+ *                  SIM_MAX_RATE, Hz.
+ * @param limit     The number of reports each tablet generates.
+ * @param paced     True to complete the reports when due, false to
+ *                  complete them as fast as possible.
+ */
+extern void sim_init(struct sim *sim, struct sim_tablet *tablets,
+                     size_t num, unsigned int rate, uint64_t limit,
+                     bool paced);
+
+/**
+ * Check if all tablets of a simulation generated all their reports, and
+ * have no cancelled transfers left to complete.
+ *
+ * @param sim   The simulation to check.
+ *
+ * @return True if done, false otherwise.
+ */
+extern bool sim_done(const struct sim *sim);
+
+/**
+ * Generate a report of a simulated tablet, the same for the same index:
+ * pen strokes, with pressure, tilt, and stylus button presses, then the
+ * pen leaving, a frame button press and release, and dial motion.
+ *
+ * @param idx   The index of the report.
+ * @param buf   The buffer to generate the report in, SIM_REPORT_LEN
+ *              bytes long.
+ */
+extern void sim_generate(uint64_t idx, uint8_t *buf);
+
+#endif /* _SIM_H */
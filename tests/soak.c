@@ -0,0 +1,495 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * This file is part of digimend-userspace-drivers.
+ */
+
+/*
+ * End-to-end soak test and scaling benchmark.
+ *
+ * Runs rings of transfers from simulated tablets through decoding and
+ * translation into memory sinks, the same as the daemon runs them from
+ * devices. Fails if any report is lost, rejected, or fails to be
+ * written, if the tablets, all sent the same reports, get different
+ * events, or if the time per report with the most tablets exceeds the
+ * one with a single tablet by more than the threshold.
+ */
+
+#include "config.h"
+#include "decoder.h"
+#include "misc.h"
+#include "ring.h"
+#include "rt.h"
+#include "sim.h"
+#include "sink.h"
+#include "translate.h"
+#include <assert.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <getopt.h>
+#include <sched.h>
+#include <linux/input.h>
+
+/** Size of each memory sink buffer, wrapped around when full */
+#define SOAK_SINK_SIZE      (64 * sizeof(struct input_event))
+
+/** Endpoint address the simulated tablets are read from */
+#define SOAK_ENDPOINT       0x81
+
+/** Default number of tablets in the paced soak */
+#define SOAK_DEF_TABLETS    4
+
+/** Default report rate of the paced soak, Hz */
+#define SOAK_DEF_RATE       SIM_MAX_RATE
+
+/** Default duration of the paced soak, seconds */
+#define SOAK_DEF_DURATION   1
+
+/** Default number of reports per tablet in the scaling benchmark */
+#define SOAK_DEF_REPORTS    100000
+
+/** Default maximum number of tablets in the scaling benchmark */
+#define SOAK_DEF_MAX_TABLETS    16
+
+/** Default scaling threshold, percent over the single tablet time */
+#define SOAK_DEF_THRESHOLD  100.0
+
+/** The translation chain of a simulated tablet */
+struct soak_tablet {
+    /** The pen sink */
+    struct sink_mem pen_sink;
+    /** The pad sink */
+    struct sink_mem pad_sink;
+    /** The pen sink buffer */
+    uint8_t pen_buf[SOAK_SINK_SIZE];
+    /** The pad sink buffer */
+    uint8_t pad_buf[SOAK_SINK_SIZE];
+    /** The outputs translated to */
+    struct outputs outputs;
+    /** The ring of transfers from the simulated tablet */
+    struct ring ring;
+    /** The statistics of the ring */
+    struct ring_stats stats;
+};
+
+/** A soak run result */
+struct soak_result {
+    /** Nanoseconds per report, over all tablets */
+    double ns_per_report;
+    /** Events per report, the same for all tablets */
+    double events_per_report;
+    /** 99th percentile of report completion delays past due time, ns */
+    uint64_t late_p99_ns;
+    /** Maximum delay of a report completion past its due time, ns */
+    uint64_t late_max_ns;
+};
+
+/**
+ * Verify a simulated tablet translated all its reports, without errors.
+ *
+ * @param tablet    The tablet to verify.
+ * @param idx       The index of the tablet, for messages.
+ * @param limit     The number of reports the tablet was sent.
+ *
+ * @return True if verified, false otherwise.
+ */
+static bool
+soak_verify(const struct soak_tablet *tablet, size_t idx, uint64_t limit)
+{
+    const struct output *outputs[] = {
+        &tablet->outputs.pen, &tablet->outputs.pad
+    };
+    const struct sink_mem *sinks[] = {&tablet->pen_sink, &tablet->pad_sink};
+    const struct frame_stats *stats;
+    uint64_t completed;
+    uint64_t translated = 0;
+    bool result = true;
+    size_t i;
+
+    completed = tablet->stats.status[LIBUSB_TRANSFER_COMPLETED];
+    for (i = 0; i < REPORT_KIND_NUM; i++) {
+        translated += tablet->stats.reports[i];
+    }
+    if (completed != limit || translated != limit) {
+        GENERIC_ERROR("Tablet %zu: %" PRIu64 " transfers completed, "
+                      "and %" PRIu64 " reports translated, "
+                      "out of %" PRIu64,
+                      idx, completed, translated, limit);
+        result = false;
+    }
+    if (tablet->stats.rejected != 0 ||
+        tablet->stats.resubmit_failures != 0) {
+        GENERIC_ERROR("Tablet %zu: %" PRIu64 " reports rejected, "
+                      "and %" PRIu64 " resubmissions failed",
+                      idx, (uint64_t)tablet->stats.rejected,
+                      (uint64_t)tablet->stats.resubmit_failures);
+        result = false;
+    }
+    for (i = 0; i < ARRAY_SIZE(outputs); i++) {
+        stats = &outputs[i]->stats;
+        if (stats->errors != 0 || stats->dropped != 0 ||
+            sinks[i]->total != stats->events * sizeof(struct input_event)) {
+            GENERIC_ERROR("Tablet %zu: %" PRIu64 " write errors, "
+                          "%" PRIu64 " events dropped, and "
+                          "%zu bytes written for %" PRIu64 " events",
+                          idx, (uint64_t)stats->errors,
+                          (uint64_t)stats->dropped, sinks[i]->total,
+                          (uint64_t)stats->events);
+            result = false;
+        }
+    }
+    return result;
+}
+
+/**
+ * Run simulated tablets through rings, decoding, and translation to
+ * memory, until they sent all their reports, and verify the results.
+ *
+ * @param num       The number of tablets.
+ * @param rate      The report rate of each tablet, Hz.
+ * @param limit     The number of reports each tablet sends.
+ * @param paced     True to send the reports at the rate, false to send
+ *                  them as fast as they're translated.
+ * @param decoder   The decoder to decode the reports with.
+ * @param result    Location for the result.
+ *
+ * @return True if the run succeeded and verified, false otherwise.
+ */
+static bool
+soak_run(size_t num, unsigned int rate, uint64_t limit, bool paced,
+         const struct decoder *decoder, struct soak_result *result)
+{
+    bool success = false;
+    enum libusb_error err;
+    struct soak_tablet *tablets = NULL;
+    struct sim_tablet *sim_tablets = NULL;
+    struct sim sim;
+    size_t initialized = 0;
+    size_t submitted = 0;
+    uint64_t start;
+    uint64_t duration;
+    uint64_t events;
+    size_t i;
+
+    assert(num > 0);
+    assert(decoder != NULL);
+    assert(result != NULL);
+
+    tablets = calloc(num, sizeof(*tablets));
+    sim_tablets = calloc(num, sizeof(*sim_tablets));
+    if (tablets == NULL || sim_tablets == NULL) {
+        LIBC_FAILURE_CLEANUP(errno, "allocate %zu tablets", num);
+    }
+    sim_init(&sim, sim_tablets, num, rate, limit, paced);
+
+    /* Setup the translation chain of each tablet */
+    for (i = 0; i < num; i++, initialized++) {
+        tablets[i].outputs.pen.sink =
+            sink_mem_init(&tablets[i].pen_sink, tablets[i].pen_buf,
+                          sizeof(tablets[i].pen_buf));
+        tablets[i].outputs.pad.sink =
+            sink_mem_init(&tablets[i].pad_sink, tablets[i].pad_buf,
+                          sizeof(tablets[i].pad_buf));
+        if (!ring_init(&tablets[i].ring, &sim_tablets[i].transport,
+                       SOAK_ENDPOINT, RING_DEF_TRANSFERS, SIM_REPORT_LEN,
+                       false, decoder, &tablets[i].outputs, NULL)) {
+            initialized++;
+            FAILURE_CLEANUP("initialize the ring of tablet %zu", i);
+        }
+        tablets[i].ring.stats = &tablets[i].stats;
+    }
+
+    /* Start the clock as the transfers are submitted */
+    start = clock_ns();
+    sim.start_ns = start;
+    for (i = 0; i < num; i++, submitted++) {
+        err = ring_submit(&tablets[i].ring);
+        if (err != LIBUSB_SUCCESS) {
+            submitted++;
+            LIBUSB_FAILURE_CLEANUP(err, "submit transfers of tablet %zu", i);
+        }
+    }
+
+    /* Run until all reports are sent */
+    while (!sim_done(&sim)) {
+        err = transport_handle_events(&sim_tablets[0].transport);
+        if (err != LIBUSB_SUCCESS) {
+            LIBUSB_FAILURE_CLEANUP(err, "handle events");
+        }
+    }
+    duration = clock_ns() - start;
+
+    /* Verify every tablet got the same events as the first */
+    for (i = 0; i < num; i++) {
+        events = tablets[i].outputs.pen.stats.events +
+                 tablets[i].outputs.pad.stats.events;
+        if (i == 0) {
+            result->events_per_report = (double)events / limit;
+        } else if ((double)events / limit != result->events_per_report) {
+            ERROR_CLEANUP("Tablet %zu got %" PRIu64 " events, "
+                          "while tablet 0 got %.0f",
+                          i, events, result->events_per_report * limit);
+        }
+        if (!soak_verify(&tablets[i], i, limit)) {
+            ERROR_CLEANUP("Tablet %zu failed verification", i);
+        }
+    }
+    result->ns_per_report = (double)duration / (num * limit);
+    result->late_p99_ns = hist_quantile(&sim.late, 0.99);
+    result->late_max_ns = sim.late.max;
+
+    success = true;
+cleanup:
+    for (i = 0; i < submitted; i++) {
+        ring_cancel(&tablets[i].ring);
+    }
+    for (i = 0; i < initialized; i++) {
+        ring_cleanup(&tablets[i].ring);
+    }
+    free(sim_tablets);
+    free(tablets);
+    return success;
+}
+
+/**
+ * Parse an unsigned integer option argument within a range.
+ *
+ * @param str   The argument to parse.
+ * @param min   The minimum accepted value.
+ * @param max   The maximum accepted value.
+ * @param pval  Location for the parsed value.
+ *
+ * @return True if parsed and within the range, false otherwise.
+ */
+static bool
+soak_parse_uint(const char *str, unsigned long min, unsigned long max,
+                unsigned long *pval)
+{
+    unsigned long val;
+    char *end;
+
+    errno = 0;
+    val = strtoul(str, &end, 0);
+    if (errno != 0 || *end != '\0' || *str == '-' ||
+        val < min || val > max) {
+        return false;
+    }
+    *pval = val;
+    return true;
+}
+
+/**
+ * Print usage information.
+ *
+ * @param stream    The stream to print the usage information to.
+ * @param progname  The name of the program.
+ */
+static void
+usage(FILE *stream, const char *progname)
+{
+    fprintf(stream,
+            "Usage: %s [OPTION]...\n"
+            "Soak-test translation of simulated tablets, and benchmark "
+            "its scaling.\n"
+            "\n"
+            "Options:\n"
+            "  -h, --help               Output this help message and exit.\n"
+            "  -t, --tablets=NUM        Soak NUM tablets, default %u.\n"
+            "  -r, --rate=HZ            Send HZ reports a second from "
+                                        "each soaked tablet,\n"
+            "                           %u to %u, default %u.\n"
+            "  -d, --duration=SEC       Soak for SEC seconds, default %u, "
+                                        "zero to skip.\n"
+            "  -n, --reports=NUM        Benchmark NUM reports per "
+                                        "tablet, default %u.\n"
+            "  -m, --max-tablets=NUM    Benchmark 1, 2, 4, and so on, "
+                                        "up to NUM tablets,\n"
+            "                           default %u.\n"
+            "  -x, --threshold=PERCENT  Fail if the time per report with "
+                                        "the most tablets\n"
+            "                           exceeds the one with a single "
+                                        "tablet by more than\n"
+            "                           PERCENT, default "
+                                        "$DUD_SOAK_THRESHOLD, or %.0f.\n"
+            "  -R, --rt-priority=PRIO   Run at SCHED_FIFO priority PRIO, "
+                                        "1-99, with memory\n"
+            "                           locked, as the daemon does.\n"
+            "  -C, --cpu=CPU            Pin to CPU, as the daemon does.\n"
+            "\n",
+            progname, SOAK_DEF_TABLETS, SIM_MIN_RATE, SIM_MAX_RATE,
+            SOAK_DEF_RATE, SOAK_DEF_DURATION, SOAK_DEF_REPORTS,
+            SOAK_DEF_MAX_TABLETS, SOAK_DEF_THRESHOLD);
+}
+
+int
+main(int argc, char **argv)
+{
+    int result = 1;
+    const char *threshold_str = getenv("DUD_SOAK_THRESHOLD");
+    double threshold = SOAK_DEF_THRESHOLD;
+    unsigned long tablets = SOAK_DEF_TABLETS;
+    unsigned long rate = SOAK_DEF_RATE;
+    unsigned long duration = SOAK_DEF_DURATION;
+    unsigned long reports = SOAK_DEF_REPORTS;
+    unsigned long max_tablets = SOAK_DEF_MAX_TABLETS;
+    struct rt_options rt_options = {.priority = 0, .cpu = -1};
+    unsigned long value;
+    struct decoder decoder;
+    struct soak_result base;
+    struct soak_result run;
+    unsigned long num;
+    double excess;
+    char *end;
+    int opt;
+    static const struct option longopts[] = {
+        {.name = "help",        .val = 'h'},
+        {.name = "tablets",     .val = 't', .has_arg = required_argument},
+        {.name = "rate",        .val = 'r', .has_arg = required_argument},
+        {.name = "duration",    .val = 'd', .has_arg = required_argument},
+        {.name = "reports",     .val = 'n', .has_arg = required_argument},
+        {.name = "max-tablets", .val = 'm', .has_arg = required_argument},
+        {.name = "threshold",   .val = 'x', .has_arg = required_argument},
+        {.name = "rt-priority", .val = 'R', .has_arg = required_argument},
+        {.name = "cpu",         .val = 'C', .has_arg = required_argument},
+        {.name = NULL}
+    };
+
+    /* Parse command-line options */
+    while ((opt = getopt_long(argc, argv, "+ht:r:d:n:m:x:R:C:",
+                              longopts, NULL)) >= 0) {
+        switch (opt) {
+        case 'h':
+            usage(stdout, argv[0]);
+            return 0;
+        case 't':
+            if (!soak_parse_uint(optarg, 1, 1024, &tablets)) {
+                GENERIC_ERROR("Invalid number of tablets: %s", optarg);
+                usage(stderr, argv[0]);
+                return 1;
+            }
+            break;
+        case 'r':
+            if (!soak_parse_uint(optarg, SIM_MIN_RATE, SIM_MAX_RATE,
+                                 &rate)) {
+                GENERIC_ERROR("Invalid report rate: %s", optarg);
+                usage(stderr, argv[0]);
+                return 1;
+            }
+            break;
+        case 'd':
+            if (!soak_parse_uint(optarg, 0, 86400, &duration)) {
+                GENERIC_ERROR("Invalid duration: %s", optarg);
+                usage(stderr, argv[0]);
+                return 1;
+            }
+            break;
+        case 'n':
+            if (!soak_parse_uint(optarg, 1, 100000000, &reports)) {
+                GENERIC_ERROR("Invalid number of reports: %s", optarg);
+                usage(stderr, argv[0]);
+                return 1;
+            }
+            break;
+        case 'm':
+            if (!soak_parse_uint(optarg, 1, 1024, &max_tablets)) {
+                GENERIC_ERROR("Invalid maximum number of tablets: %s",
+                              optarg);
+                usage(stderr, argv[0]);
+                return 1;
+            }
+            break;
+        case 'x':
+            threshold_str = optarg;
+            break;
+        case 'R':
+            if (!soak_parse_uint(optarg, 1, 99, &value)) {
+                GENERIC_ERROR("Invalid real-time priority: %s", optarg);
+                usage(stderr, argv[0]);
+                return 1;
+            }
+            rt_options.priority = (int)value;
+            break;
+        case 'C':
+            if (!soak_parse_uint(optarg, 0, CPU_SETSIZE - 1, &value)) {
+                GENERIC_ERROR("Invalid CPU number: %s", optarg);
+                usage(stderr, argv[0]);
+                return 1;
+            }
+            rt_options.cpu = (int)value;
+            break;
+        default:
+            usage(stderr, argv[0]);
+            return 1;
+        }
+    }
+    if (optind < argc) {
+        GENERIC_ERROR("Positional arguments are not accepted");
+        usage(stderr, argv[0]);
+        return 1;
+    }
+    if (threshold_str != NULL) {
+        errno = 0;
+        threshold = strtod(threshold_str, &end);
+        if (errno != 0 || *end != '\0' || !(threshold >= 0)) {
+            GENERIC_ERROR("Invalid threshold: %s", threshold_str);
+            usage(stderr, argv[0]);
+            return 1;
+        }
+    }
+
+    /* Run as the daemon's event loop does, if requested */
+    if (!rt_setup(&rt_options)) {
+        FAILURE_CLEANUP("setup real-time execution");
+    }
+
+    /* Decode as the daemon does */
+    if (!decoder_init_huion_v2(&decoder, NULL, 0)) {
+        FAILURE_CLEANUP("initialize the decoder");
+    }
+
+    /* Soak tablets sending at their rate */
+    if (duration > 0) {
+        if (!soak_run(tablets, rate, (uint64_t)rate * duration, true,
+                      &decoder, &run)) {
+            FAILURE_CLEANUP("soak %lu tablets", tablets);
+        }
+        printf("soaked %lu tablets at %lu Hz for %lu s: "
+               "%.4f events/report, lateness %.1f us p99, %.1f us max\n",
+               tablets, rate, duration, run.events_per_report,
+               run.late_p99_ns / 1000.0, run.late_max_ns / 1000.0);
+    }
+
+    /* Benchmark growing numbers of tablets sending at once */
+    printf("%-8s %12s %14s\n", "tablets", "ns/report", "events/report");
+    for (num = 1; num <= max_tablets; num *= 2) {
+        if (!soak_run(num, SIM_MAX_RATE, reports, false,
+                      &decoder, num == 1 ? &base : &run)) {
+            FAILURE_CLEANUP("benchmark %lu tablets", num);
+        }
+        if (num == 1) {
+            run = base;
+        }
+        printf("%-8lu %12.1f %14.4f\n",
+               num, run.ns_per_report, run.events_per_report);
+        if (run.events_per_report != base.events_per_report) {
+            ERROR_CLEANUP("%lu tablets: %.4f events/report differs from "
+                          "%.4f with a single tablet", num,
+                          run.events_per_report, base.events_per_report);
+        }
+    }
+    excess = (run.ns_per_report / base.ns_per_report - 1) * 100;
+    if (excess > threshold) {
+        ERROR_CLEANUP("%.1f ns/report with the most tablets is %.0f%% "
+                      "over %.1f with a single tablet, more than "
+                      "the %.0f%% threshold", run.ns_per_report, excess,
+                      base.ns_per_report, threshold);
+    }
+
+    result = 0;
+cleanup:
+    return result;
+}